@@ -19,7 +19,8 @@ struct arena {
 
 #define DEFAULT_STORAGE_SIZE 8
 
-static arena *current_arena;
+//each thread has its own current arena so systems running on different threads don't share one
+static __thread arena *current_arena;
 
 arena *get_current_arena()
 {
@@ -42,6 +42,7 @@ typedef struct deferred_addr {
 
 #include "memmap.h"
 #include "system.h"
+#include "jit_profile.h"
 
 typedef struct {
 	uint32_t flags;
@@ -58,6 +59,7 @@ typedef struct {
 	code_ptr           handle_align_error_write;
 	code_ptr           handle_align_error_read;
 	system_str_fun_r8  debug_cmd_handler;
+	jit_profile        *profile;
 	uint32_t           memmap_chunks;
 	uint32_t           address_mask;
 	uint32_t           max_address;
@@ -89,6 +91,9 @@ void check_cycles_int(cpu_options *opts, uint32_t address);
 void check_cycles(cpu_options * opts);
 void check_code_prologue(code_info *code);
 void log_address(cpu_options *opts, uint32_t address, char * format);
+//counts executions of the code emitted after this, nothing is emitted unless opts->profile is set
+void profile_inst(cpu_options *opts, uint32_t address);
+void profile_event(cpu_options *opts, uint8_t kind, uint32_t start, uint32_t end);
 
 void retranslate_calc(cpu_options *opts);
 void patch_for_retranslate(cpu_options *opts, code_ptr native_address, code_ptr handler);
@@ -50,6 +50,9 @@ void retranslate_calc(cpu_options *opts)
 
 void patch_for_retranslate(cpu_options *opts, code_ptr native_address, code_ptr handler)
 {
+	if (opts->profile) {
+		jit_profile_invalidated(opts->profile);
+	}
 	if (!is_mov_ir(native_address)) {
 		//instruction is not already patched for either retranslation or a breakpoint
 		//copy original mov_ir instruction containing PC to beginning of native code area
@@ -95,6 +98,31 @@ void log_address(cpu_options *opts, uint32_t address, char * format)
 	call(code, opts->load_context);
 }
 
+static void profile_count(code_info *code, uint64_t *count)
+{
+#ifdef X86_64
+	add_irabs(code, 1, count, SZ_Q);
+#else
+	//no 64-bit memory operands in 32-bit mode so carry into the upper half
+	add_irabs(code, 1, count, SZ_D);
+	adc_irabs(code, 0, (uint32_t *)count + 1, SZ_D);
+#endif
+}
+
+void profile_inst(cpu_options *opts, uint32_t address)
+{
+	if (opts->profile) {
+		profile_count(&opts->code, &jit_profile_inst(opts->profile, address)->count);
+	}
+}
+
+void profile_event(cpu_options *opts, uint8_t kind, uint32_t start, uint32_t end)
+{
+	if (opts->profile) {
+		profile_count(&opts->code, &jit_profile_counter(opts->profile, kind, start, end)->count);
+	}
+}
+
 void check_code_prologue(code_info *code)
 {
 	check_alloc_code(code, MAX_INST_LEN*4);
@@ -171,6 +199,7 @@ code_ptr gen_mem_fun(cpu_options * opts, memmap_chunk const * memmap, uint32_t n
 					cmp_irdisp(code, 0, opts->context_reg, opts->mem_ptr_off + sizeof(void*) * memmap[chunk].ptr_index, SZ_PTR);
 					code_ptr not_null = code->cur + 1;
 					jcc(code, CC_NZ, code->cur + 2);
+					profile_event(opts, JIT_PROF_READ_16 + fun_type, memmap[chunk].start, memmap[chunk].end);
 					call(code, opts->save_context);
 					if (is_write) {
 						call_args_abi(code, cfun, 3, opts->scratch2, opts->context_reg, opts->scratch1);
@@ -280,6 +309,7 @@ code_ptr gen_mem_fun(cpu_options * opts, memmap_chunk const * memmap, uint32_t n
 			}
 			retn(code);
 		} else if (cfun) {
+			profile_event(opts, JIT_PROF_READ_16 + fun_type, memmap[chunk].start, memmap[chunk].end);
 			call(code, opts->save_context);
 			if (is_write) {
 				call_args_abi(code, cfun, 3, opts->scratch2, opts->context_reg, opts->scratch1);
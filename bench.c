@@ -0,0 +1,129 @@
+#include <stdint.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "bench.h"
+#include "render_audio.h"
+#include "util.h"
+
+#define BENCH_SAMPLE_RATE 48000
+#define BENCH_BUFFER_SAMPLES 512
+#define MAX_NESTING 8
+
+uint8_t bench_active;
+
+static uint32_t frames;
+static uint64_t start_time, start_ticks;
+static uint64_t component_time[BENCH_NUM_COMPONENTS];
+static bench_component stack[MAX_NESTING];
+static uint64_t stack_start[MAX_NESTING];
+static uint32_t depth;
+
+static const char *component_names[BENCH_NUM_COMPONENTS] = {
+	"68K",
+	"Z80",
+	"VDP",
+	"YM2612",
+	"PSG",
+	"Audio resampling"
+};
+
+static uint64_t bench_now_ns(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	if (!freq.QuadPart) {
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1000000000.0 / (double)freq.QuadPart);
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+//component timing happens on every audio sample so it needs to be cheap, use the TSC where available
+//and calibrate it against the wall clock over the whole run
+static uint64_t bench_ticks(void)
+{
+#if defined(X86_64) || defined(X86_32)
+	return __builtin_ia32_rdtsc();
+#else
+	return bench_now_ns();
+#endif
+}
+
+void bench_init(uint32_t num_frames)
+{
+	frames = num_frames;
+	bench_active = 1;
+	//there's no audio device in headless mode, but we still want to measure the cost of resampling and mixing
+	render_audio_initialized(RENDER_AUDIO_UNKNOWN, BENCH_SAMPLE_RATE, 2, BENCH_BUFFER_SAMPLES, sizeof(int16_t));
+}
+
+void bench_start(void)
+{
+	for (int i = 0; i < BENCH_NUM_COMPONENTS; i++)
+	{
+		component_time[i] = 0;
+	}
+	depth = 0;
+	start_time = bench_now_ns();
+	start_ticks = bench_ticks();
+}
+
+void bench_enter(bench_component component)
+{
+	uint64_t now = bench_ticks();
+	if (depth) {
+		component_time[stack[depth-1]] += now - stack_start[depth-1];
+	}
+	if (depth == MAX_NESTING) {
+		fatal_error("Benchmark component nesting is too deep\n");
+	}
+	stack[depth] = component;
+	stack_start[depth++] = now;
+}
+
+void bench_exit(void)
+{
+	uint64_t now = bench_ticks();
+	if (!depth) {
+		return;
+	}
+	depth--;
+	component_time[stack[depth]] += now - stack_start[depth];
+	if (depth) {
+		stack_start[depth-1] = now;
+	}
+}
+
+void bench_report(void)
+{
+	uint64_t now = bench_ticks();
+	uint64_t total_ticks = now - start_ticks;
+	//the report is printed from inside the emulated components, so close out the innermost open one
+	if (depth) {
+		component_time[stack[depth-1]] += now - stack_start[depth-1];
+		stack_start[depth-1] = now;
+	}
+	double seconds = (double)(bench_now_ns() - start_time) / 1000000000.0;
+	double ms_per_tick = seconds * 1000.0 / total_ticks;
+	uint64_t other = total_ticks;
+	for (int i = 0; i < BENCH_NUM_COMPONENTS; i++)
+	{
+		other -= component_time[i];
+	}
+	info_message("Emulated %u frames in %.3f seconds, %.2f frames per second\n", frames, seconds, frames / seconds);
+	for (int i = 0; i < BENCH_NUM_COMPONENTS; i++)
+	{
+		info_message("  %-18s %8.3f ms/frame %6.2f%%\n", component_names[i], component_time[i] * ms_per_tick / frames, 100.0 * component_time[i] / total_ticks);
+	}
+	//whatever runs outside of all the timed components
+	info_message("  %-18s %8.3f ms/frame %6.2f%%\n", "Other", other * ms_per_tick / frames, 100.0 * other / total_ticks);
+}
@@ -0,0 +1,31 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdint.h>
+
+typedef enum {
+	BENCH_68K,
+	BENCH_Z80,
+	BENCH_VDP,
+	BENCH_YM,
+	BENCH_PSG,
+	BENCH_AUDIO,
+	BENCH_NUM_COMPONENTS
+} bench_component;
+
+extern uint8_t bench_active;
+
+//Enables benchmark mode for a headless run of the given number of frames
+void bench_init(uint32_t frames);
+//Resets the accumulated times, should be called right before emulation starts
+void bench_start(void);
+//Attributes time to component until the matching bench_exit, nested calls are excluded from the outer component
+void bench_enter(bench_component component);
+void bench_exit(void);
+//Prints emulated frames per second and the time spent in each component
+void bench_report(void);
+
+#define BENCH_ENTER(component) if (bench_active) { bench_enter(component); }
+#define BENCH_EXIT() if (bench_active) { bench_exit(); }
+
+#endif //BENCH_H_
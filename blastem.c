@@ -31,11 +31,12 @@
 #include "menu.h"
 #include "zip.h"
 #include "event_log.h"
+#include "bench.h"
 #ifndef DISABLE_NUKLEAR
 #include "nuklear_ui/blastem_nuklear.h"
 #endif
 
-#define BLASTEM_VERSION "0.6.3-pre"
+#include "version.h"
 
 #ifdef __ANDROID__
 #define FULLSCREEN_DEFAULT 1
@@ -305,10 +306,11 @@ void setup_saves(system_media *media, system_header *context)
 	context->save_dir = save_dir;
 	if (info->save_type != SAVE_NONE) {
 		context->load_save(context);
-		if (!persist_save_registered) {
-			atexit(persist_save);
-			persist_save_registered = 1;
-		}
+	}
+	//also needed without a save device so that other persistent state like the translation cache gets written
+	if (!persist_save_registered) {
+		atexit(persist_save);
+		persist_save_registered = 1;
 	}
 }
 
@@ -478,6 +480,18 @@ int main(int argc, char ** argv)
 				headless = 1;
 				exit_after = atoi(argv[i]);
 				break;
+			case 'B':
+				i++;
+				if (i >= argc) {
+					fatal_error("-B must be followed by a frame count\n");
+				}
+				headless = 1;
+				exit_after = atoi(argv[i]);
+				if (exit_after <= 0) {
+					fatal_error("-B frame count must be greater than zero\n");
+				}
+				bench_init(exit_after);
+				break;
 			case 'd':
 				start_in_debugger = 1;
 				//allow debugging the menu
@@ -583,6 +597,9 @@ int main(int argc, char ** argv)
 					"	-f          Toggles fullscreen mode\n"
 					"	-g          Disable OpenGL rendering\n"
 					"	-s FILE     Load a GST format savestate from FILE\n"
+					"	-b FRAMES   Run headless for FRAMES frames and then exit\n"
+					"	-B FRAMES   Benchmark FRAMES frames headless and report the time spent\n"
+					"	            in each emulated component\n"
 					"	-o FILE     Load FILE as a lock-on cartridge\n"
 					"	-d          Enter debugger on startup\n"
 					"	-n          Disable Z80\n"
@@ -732,6 +749,9 @@ int main(int argc, char ** argv)
 	
 	current_system->debugger_type = dtype;
 	current_system->enter_debugger = start_in_debugger && menu == debug_target;
+	if (bench_active) {
+		bench_start();
+	}
 	current_system->start_context(current_system,  menu ? NULL : statefile);
 	render_video_loop();
 	for(;;)
@@ -324,6 +324,23 @@ uint32_t get_lowpass_cutoff(tern_node *config)
 	return lowpass_cutoff_str ? atoi(lowpass_cutoff_str) : DEFAULT_LOWPASS_CUTOFF;
 }
 
+#define DEFAULT_CODE_CACHE_SIZE 32
+#define MAX_CODE_CACHE_SIZE 2048
+uint32_t get_code_cache_size(tern_node *config)
+{
+	char *cache_size_str = tern_find_path(config, "system\0code_cache_size\0", TVAL_PTR).ptrval;
+	long megabytes = DEFAULT_CODE_CACHE_SIZE;
+	if (cache_size_str) {
+		char *end;
+		megabytes = strtol(cache_size_str, &end, 10);
+		if (end == cache_size_str || *end || megabytes < 1 || megabytes > MAX_CODE_CACHE_SIZE) {
+			warning("Invalid value %s for system.code_cache_size, must be between 1 and %d, using %d\n", cache_size_str, MAX_CODE_CACHE_SIZE, DEFAULT_CODE_CACHE_SIZE);
+			megabytes = DEFAULT_CODE_CACHE_SIZE;
+		}
+	}
+	return (uint32_t)megabytes * 1024 * 1024;
+}
+
 tern_node *get_systems_config(void)
 {
 	static tern_node *systems;
@@ -18,6 +18,8 @@ void persist_config_at(tern_node *app_config, tern_node *to_save, char *fname);
 void persist_config(tern_node *config);
 char **get_extension_list(tern_node *config, uint32_t *num_exts_out);
 uint32_t get_lowpass_cutoff(tern_node *config);
+//size of each CPU's translated code cache in bytes, invalid or out of range settings give the default of 32MB
+uint32_t get_code_cache_size(tern_node *config);
 tern_node *get_systems_config(void);
 tern_node *get_model(tern_node *config, system_type stype);
 
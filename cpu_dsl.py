@@ -1,5 +1,11 @@
 #!/usr/bin/env python3
+import re
+import string
 
+#raised while generating x86 translator code for an instruction that uses something
+#that only has a C implementation, the instruction falls back to calling its C version
+class NotNative(Exception):
+	pass
 
 class Block:
 	def addOp(self, op):
@@ -175,6 +181,38 @@ class Instruction(Block):
 		if prog.dispatch == 'goto':
 			output += prog.nextInstruction(otype)
 		return begin + ''.join(output) + '\n}'
+	
+	def generateTranslator(self, value, prog):
+		output = []
+		prog.meta = {}
+		prog.temp = {}
+		prog.x86Locals = {}
+		prog.needFlagCoalesce = False
+		prog.needFlagDisperse = False
+		prog.lastOp = None
+		depth = len(prog.scopes)
+		prog.pushScope(self)
+		self.regValues = {}
+		try:
+			for var in self.locals:
+				prog.declareLocal('x86', var, self.locals[var])
+			fieldVals,_ = self.getFieldVals(value)
+			self.processOps(prog, fieldVals, output, 'x86', self.implementation)
+			if prog.needFlagCoalesce or prog.needFlagDisperse or prog.temp:
+				raise NotNative('flag register access')
+		except NotNative:
+			return None
+		finally:
+			del prog.scopes[depth:]
+			prog.currentScope = prog.scopes[-1] if prog.scopes else None
+			prog.conditional = False
+			prog.carryFlowDst = None
+		prog.jitLocalSlots = max(prog.jitLocalSlots, len(prog.x86Locals))
+		body = ''.join(output)
+		#no emitter call in the generated body produces more than 32 bytes
+		return '\nstatic void jit_{name}({pre}options *opts, code_info *code)\n{{\n\tcheck_alloc_code(code, {size});{body}\n}}'.format(
+			name = self.generateName(value), pre = prog.prefix, size = 32 * (body.count(';') + 1), body = body
+		)
 		
 	def __str__(self):
 		pieces = [self.name + ' ' + hex(self.value) + ' ' + str(self.fields)]
@@ -236,8 +274,7 @@ class SubRoutine(Block):
 			argValues[name] = params[i]
 			i += 1
 		for name in self.locals:
-			size = self.locals[name]
-			output.append('\n\tuint{size}_t {sub}_{local};'.format(size=size, sub=self.name, local=name))
+			output.append(prog.declareLocal(otype, '{sub}_{local}'.format(sub=self.name, local=name), self.locals[name]))
 		self.argValues = argValues
 		self.processOps(prog, argValues, output, otype, self.implementation)
 		prog.popScope()
@@ -340,6 +377,7 @@ class Op:
 				if destSize > size:
 					needsSizeAdjust = True
 					prog.sizeAdjust = size
+			needsCarry = needsOflow = needsHalf = False
 			if op == '-':
 				if flagUpdates:
 					for flag in flagUpdates:
@@ -393,6 +431,8 @@ class Op:
 			params = max(params, self.numArgs())
 		return params
 	def generate(self, otype, prog, params, rawParams, flagUpdates):
+		if not otype in self.impls:
+			raise NotNative('no {0} implementation'.format(otype))
 		if self.impls[otype].__code__.co_argcount == 2:
 			return self.impls[otype](prog, params)
 		elif self.impls[otype].__code__.co_argcount == 3:
@@ -411,6 +451,9 @@ def _dispatchCImpl(prog, params):
 		table = 'main'
 	else:
 		table = params[1]
+	if prog.jitFetch:
+		prog.jitFetchResult = params[0]
+		return '\n\treturn {op};'.format(op = params[0])
 	if prog.dispatch == 'call':
 		return '\n\timpl_{tbl}[{op}](context, target_cycle);'.format(tbl = table, op = params[0])
 	elif prog.dispatch == 'goto':
@@ -813,35 +856,285 @@ def _rrcCImpl(prog, params, rawParams, flagUpdates):
 	)
 	
 def _updateSyncCImpl(prog, params):
-	return '\n\t{sync}(context, target_cycle);'.format(sync=prog.sync_cycle)
+	return prog.syncCall()
+
+_x86Sizes = {8: 'SZ_B', 16: 'SZ_W', 32: 'SZ_D'}
+
+def _x86Imm(val):
+	val &= 0xFFFFFFFF
+	if val >= 0x80000000:
+		return '(int32_t)0x{0:X}'.format(val)
+	return str(val)
+
+def _x86UnaryOperator(op):
+	def _impl(prog, params, rawParams, flagUpdates):
+		if len(params) > 2 or flagUpdates:
+			raise NotNative('sized or flag-setting ' + op)
+		src = prog.x86Operand(params[0])
+		dst = prog.x86Operand(params[1])
+		output = [prog.x86Load(src, 'RAX')]
+		if op == 'not':
+			output.append('\n\tnot_r(code, RAX, SZ_D);')
+		elif op == 'neg':
+			output.append('\n\tneg_r(code, RAX, SZ_D);')
+		elif op == 'lnot':
+			output.append('\n\ttest_rr(code, RAX, RAX, SZ_D);')
+			output.append('\n\tsetcc_r(code, CC_Z, RAX);')
+			output.append('\n\tmovzx_rr(code, RAX, RAX, SZ_B, SZ_D);')
+		output.append(prog.x86Store(dst, 'RAX'))
+		return ''.join(output)
+	return _impl
+
+def _x86BinaryOperator(op):
+	def _impl(prog, params, rawParams, flagUpdates):
+		if len(params) > 3 or (flagUpdates and op in ('lsl', 'lsr')):
+			raise NotNative('sized or flag-setting ' + op)
+		if op == 'sub':
+			a = params[1]
+			b = params[0]
+		else:
+			a = params[0]
+			b = params[1]
+		a = prog.x86Operand(a)
+		b = prog.x86Operand(b)
+		dst = prog.x86Operand(params[2])
+		output = [prog.x86Load(a, 'RAX')]
+		if op in ('lsl', 'lsr'):
+			inst = 'shl' if op == 'lsl' else 'shr'
+			if b[0] == 'imm':
+				if b[1] < 0 or b[1] > 31:
+					raise NotNative('shift count out of range')
+				output.append('\n\t{inst}_ir(code, {val}, RAX, SZ_D);'.format(inst=inst, val=b[1]))
+			else:
+				output.append(prog.x86Load(b, 'RCX'))
+				output.append('\n\t{inst}_clr(code, RAX, SZ_D);'.format(inst=inst))
+		else:
+			if b[0] == 'imm':
+				output.append('\n\t{inst}_ir(code, {val}, RAX, SZ_D);'.format(inst=op, val=_x86Imm(b[1])))
+			else:
+				output.append(prog.x86Load(b, 'RCX'))
+				output.append('\n\t{inst}_rr(code, RCX, RAX, SZ_D);'.format(inst=op))
+		if flagUpdates:
+			output.append(prog.x86FlagResult(a, b, op != 'sub', dst))
+		else:
+			output.append(prog.x86Store(dst, 'RAX'))
+		return ''.join(output)
+	return _impl
+
+def _sextX86Impl(prog, params, rawParams, flagUpdates):
+	if flagUpdates:
+		raise NotNative('flag-setting sext')
+	output = [prog.x86Load(prog.x86Operand(params[1]), 'RAX')]
+	output.append('\n\tmovsx_rr(code, RAX, RAX, {src}, SZ_D);'.format(src='SZ_B' if params[0] == 16 else 'SZ_W'))
+	output.append(prog.x86Store(prog.x86Operand(params[2]), 'RAX'))
+	return ''.join(output)
+
+def _cmpX86Impl(prog, params, rawParams, flagUpdates):
+	prog.lastDst = rawParams[1]
+	prog.lastSize = None
+	if not flagUpdates:
+		#the comparison itself is emitted by the if that consumes it
+		return ''
+	if len(params) > 2:
+		raise NotNative('sized flag-setting cmp')
+	a = prog.x86Operand(params[1])
+	b = prog.x86Operand(params[0])
+	output = [prog.x86Load(a, 'RAX')]
+	if b[0] == 'imm':
+		output.append('\n\tsub_ir(code, {val}, RAX, SZ_D);'.format(val=_x86Imm(b[1])))
+	else:
+		output.append(prog.x86Load(b, 'RCX'))
+		output.append('\n\tsub_rr(code, RCX, RAX, SZ_D);')
+	output.append(prog.x86FlagResult(a, b, False, None))
+	return ''.join(output)
+
+#leaves the value a flag is calculated from in RAX, RCX is clobbered
+def _x86FlagSource(prog, calc):
+	result = prog.x86Operand(prog.carryFlowDst)
+	if calc == 'half':
+		return ''.join([
+			prog.x86Load(prog.x86LastA, 'RAX'),
+			prog.x86Load(prog.x86LastB, 'RCX'),
+			'\n\txor_rr(code, RCX, RAX, SZ_D);',
+			'\n\txor_rdispr(code, JIT_CONTEXT, {disp}, RAX, SZ_D);'.format(disp=result[1])
+		])
+	elif calc == 'overflow':
+		output = [prog.x86Load(prog.x86LastA, 'RAX'), prog.x86Load(prog.x86LastB, 'RCX')]
+		if prog.x86InvertB:
+			output.append('\n\tnot_r(code, RCX, SZ_D);')
+		output.append('\n\txor_rr(code, RAX, RCX, SZ_D);')
+		output.append('\n\txor_rdispr(code, JIT_CONTEXT, {disp}, RAX, SZ_D);'.format(disp=result[1]))
+		output.append('\n\tand_rr(code, RCX, RAX, SZ_D);')
+		return ''.join(output)
+	return prog.x86Load(result, 'RAX')
+
+#moves bit srcBit of RAX to dstBit and clears the others
+def _x86MoveBit(srcBit, dstBit):
+	output = []
+	if srcBit > dstBit:
+		output.append('\n\tshr_ir(code, {n}, RAX, SZ_D);'.format(n=srcBit - dstBit))
+	elif dstBit > srcBit:
+		output.append('\n\tshl_ir(code, {n}, RAX, SZ_D);'.format(n=dstBit - srcBit))
+	output.append('\n\tand_ir(code, {mask}, RAX, SZ_D);'.format(mask=_x86Imm(1 << dstBit)))
+	return ''.join(output)
+
+#stores the bits of RAX selected by mask in a flag storage register, RAX must have no other bits set
+def _x86MergeFlags(prog, reg, mask):
+	dst = prog.x86Operand(prog.resolveParam(reg, None, {}))
+	size = dst[2]
+	return ''.join([
+		'\n\tand_irdisp(code, {mask}, JIT_CONTEXT, {disp}, {sz});'.format(mask=_x86Imm(~mask), disp=dst[1], sz=_x86Sizes[size]),
+		'\n\tor_rrdisp(code, RAX, JIT_CONTEXT, {disp}, {sz});'.format(disp=dst[1], sz=_x86Sizes[size])
+	])
+
+#stores a condition code as 0 or 1 in a flag that has its own register, or in one bit of a shared one
+def _x86StoreCondition(prog, cc, storage):
+	output = ['\n\tsetcc_r(code, {cc}, RAX);'.format(cc=cc), '\n\tmovzx_rr(code, RAX, RAX, SZ_B, SZ_D);']
+	if type(storage) is tuple:
+		reg,bit = storage
+		if bit:
+			output.append('\n\tshl_ir(code, {n}, RAX, SZ_D);'.format(n=bit))
+		output.append(_x86MergeFlags(prog, reg, 1 << bit))
+	else:
+		output.append(prog.x86Store(prog.x86Operand(prog.resolveParam(storage, None, {})), 'RAX'))
+	return ''.join(output)
+
+#x86 version of _updateFlagsCImpl, only flags calculated from a native operation are supported
+def _updateFlagsX86Impl(prog, params, rawParams):
+	autoUpdate, explicit = prog.flags.parseFlagUpdate(params[0])
+	output = []
+	if autoUpdate and not prog.carryFlowDst:
+		raise NotNative('flags from an operation without a native flag implementation')
+	size = prog.getLastSize() if autoUpdate else None
+	#flags that are stored at the same bit they're calculated at share a single merge per source
+	direct = {}
+	for flag in prog.flags.flagOrder:
+		if not flag in autoUpdate:
+			continue
+		calc,_,resultBit = prog.flags.flagCalc[flag].partition('-')
+		storage = prog.flags.getStorage(flag)
+		if calc in ('bit', 'sign', 'carry', 'half', 'overflow'):
+			if calc == 'sign' or calc == 'overflow':
+				resultBit = size - 1
+			elif calc == 'carry':
+				resultBit = size
+			elif calc == 'half':
+				resultBit = size - 4
+			else:
+				resultBit = int(resultBit) + size - 8
+			source = calc if calc in ('half', 'overflow') else 'result'
+			if type(storage) is tuple:
+				reg,storageBit = storage
+				if storageBit == resultBit:
+					direct.setdefault((reg, source), []).append(resultBit)
+				else:
+					output.append(_x86FlagSource(prog, calc))
+					output.append(_x86MoveBit(resultBit, storageBit))
+					output.append(_x86MergeFlags(prog, reg, 1 << storageBit))
+			else:
+				maxBit = prog.paramSize(storage) - 1
+				output.append(_x86FlagSource(prog, calc))
+				output.append(_x86MoveBit(resultBit, min(resultBit, maxBit)))
+				output.append(prog.x86Store(prog.x86Operand(prog.resolveParam(storage, None, {})), 'RAX'))
+		elif calc == 'zero':
+			output.append(_x86FlagSource(prog, calc))
+			output.append('\n\ttest_rr(code, RAX, RAX, {sz});'.format(sz=_x86Sizes[size]))
+			output.append(_x86StoreCondition(prog, 'CC_Z', storage))
+		elif calc == 'parity':
+			output.append(_x86FlagSource(prog, calc))
+			for shift in (16, 8):
+				if size > shift:
+					output.append('\n\tmov_rr(code, RAX, RCX, SZ_D);')
+					output.append('\n\tshr_ir(code, {n}, RCX, SZ_D);'.format(n=shift))
+					output.append('\n\txor_rr(code, RCX, RAX, SZ_D);')
+			output.append('\n\ttest_rr(code, RAX, RAX, SZ_B);')
+			#the C version sets a flag bit in a shared register for odd parity and a separate flag for even
+			output.append(_x86StoreCondition(prog, 'CC_NP' if type(storage) is tuple else 'CC_P', storage))
+		else:
+			raise Exception('Unknown flag calc type: ' + calc)
+	for reg,source in direct:
+		bits = direct[(reg, source)]
+		output.append(_x86FlagSource(prog, source))
+		if len(bits) == len(prog.flags.storageToFlags[reg]):
+			output.append(prog.x86Store(prog.x86Operand(prog.resolveParam(reg, None, {})), 'RAX'))
+		else:
+			mask = 0
+			for bit in bits:
+				mask |= 1 << bit
+			output.append('\n\tand_ir(code, {mask}, RAX, SZ_D);'.format(mask=_x86Imm(mask)))
+			output.append(_x86MergeFlags(prog, reg, mask))
+	if prog.carryFlowDst:
+		if prog.x86FlagDst:
+			output.append(prog.x86Load(prog.x86Operand(prog.carryFlowDst), 'RAX'))
+			output.append(prog.x86Store(prog.x86FlagDst, 'RAX'))
+		prog.carryFlowDst = None
+	for flag in explicit:
+		location = prog.flags.getStorage(flag)
+		if type(location) is tuple:
+			reg,bit = location
+			dst = prog.x86Operand(prog.resolveReg(reg, None, {}))
+			if explicit[flag]:
+				output.append('\n\tor_irdisp(code, {val}, JIT_CONTEXT, {disp}, {sz});'.format(
+					val=_x86Imm(1 << bit), disp=dst[1], sz=_x86Sizes[dst[2]]
+				))
+			else:
+				output.append('\n\tand_irdisp(code, {val}, JIT_CONTEXT, {disp}, {sz});'.format(
+					val=_x86Imm(~(1 << bit)), disp=dst[1], sz=_x86Sizes[dst[2]]
+				))
+		else:
+			dst = prog.x86Operand(prog.resolveReg(location, None, {}))
+			output.append('\n\tmov_irdisp(code, {val}, JIT_CONTEXT, {disp}, {sz});'.format(
+				val=explicit[flag], disp=dst[1], sz=_x86Sizes[dst[2]]
+			))
+	return ''.join(output)
+
+def _cyclesX86Impl(prog, params):
+	if not type(params[0]) is int:
+		raise NotNative('variable cycle count')
+	return '\n\tadd_irdisp(code, opts->gen.clock_divider * {num}, JIT_CONTEXT, offsetof({ctx}, cycles), SZ_D);'.format(
+		num = params[0], ctx = prog.context_type
+	)
+
+def _ocallX86Impl(prog, params):
+	args = [prog.x86Operand(p) for p in params[1:]]
+	regs = ['RAX', 'RCX']
+	if len(args) > len(regs):
+		raise NotNative('too many ocall arguments')
+	output = []
+	for i in range(0, len(args)):
+		output.append(prog.x86Load(args[i], regs[i]))
+	output.append('\n\tcall_args(code, (code_ptr){pre}{fun}, {num}, {regs});'.format(
+		pre = prog.prefix, fun = params[0], num = len(args) + 1, regs = ', '.join(['JIT_CONTEXT'] + regs[:len(args)])
+	))
+	return ''.join(output)
 
 _opMap = {
-	'mov': Op(lambda val: val).cUnaryOperator(''),
-	'not': Op(lambda val: ~val).cUnaryOperator('~'),
-	'lnot': Op(lambda val: 0 if val else 1).cUnaryOperator('!'),
-	'neg': Op(lambda val: -val).cUnaryOperator('-'),
-	'add': Op(lambda a, b: a + b).cBinaryOperator('+'),
+	'mov': Op(lambda val: val).cUnaryOperator('').addImplementation('x86', None, _x86UnaryOperator('mov')),
+	'not': Op(lambda val: ~val).cUnaryOperator('~').addImplementation('x86', None, _x86UnaryOperator('not')),
+	'lnot': Op(lambda val: 0 if val else 1).cUnaryOperator('!').addImplementation('x86', None, _x86UnaryOperator('lnot')),
+	'neg': Op(lambda val: -val).cUnaryOperator('-').addImplementation('x86', None, _x86UnaryOperator('neg')),
+	'add': Op(lambda a, b: a + b).cBinaryOperator('+').addImplementation('x86', None, _x86BinaryOperator('add')),
 	'adc': Op().addImplementation('c', 2, _adcCImpl),
-	'sub': Op(lambda a, b: b - a).cBinaryOperator('-'),
+	'sub': Op(lambda a, b: b - a).cBinaryOperator('-').addImplementation('x86', None, _x86BinaryOperator('sub')),
 	'sbc': Op().addImplementation('c', 2, _sbcCImpl),
-	'lsl': Op(lambda a, b: a << b).cBinaryOperator('<<'),
-	'lsr': Op(lambda a, b: a >> b).cBinaryOperator('>>'),
+	'lsl': Op(lambda a, b: a << b).cBinaryOperator('<<').addImplementation('x86', None, _x86BinaryOperator('lsl')),
+	'lsr': Op(lambda a, b: a >> b).cBinaryOperator('>>').addImplementation('x86', None, _x86BinaryOperator('lsr')),
 	'asr': Op(lambda a, b: a >> b).addImplementation('c', 2, _asrCImpl),
 	'rol': Op().addImplementation('c', 2, _rolCImpl),
 	'rlc': Op().addImplementation('c', 2, _rlcCImpl),
 	'ror': Op().addImplementation('c', 2, _rorCImpl),
 	'rrc': Op().addImplementation('c', 2, _rrcCImpl),
-	'and': Op(lambda a, b: a & b).cBinaryOperator('&'),
-	'or':  Op(lambda a, b: a | b).cBinaryOperator('|'),
-	'xor': Op(lambda a, b: a ^ b).cBinaryOperator('^'),
+	'and': Op(lambda a, b: a & b).cBinaryOperator('&').addImplementation('x86', None, _x86BinaryOperator('and')),
+	'or':  Op(lambda a, b: a | b).cBinaryOperator('|').addImplementation('x86', None, _x86BinaryOperator('or')),
+	'xor': Op(lambda a, b: a ^ b).cBinaryOperator('^').addImplementation('x86', None, _x86BinaryOperator('xor')),
 	'abs': Op(lambda val: abs(val)).addImplementation(
 		'c', 1, lambda prog, params: '\n\t{dst} = abs({src});'.format(dst=params[1], src=params[0])
 	),
-	'cmp': Op().addImplementation('c', None, _cmpCImpl),
-	'sext': Op(_sext).addImplementation('c', 2, _sextCImpl),
+	'cmp': Op().addImplementation('c', None, _cmpCImpl).addImplementation('x86', None, _cmpX86Impl),
+	'sext': Op(_sext).addImplementation('c', 2, _sextCImpl).addImplementation('x86', None, _sextX86Impl),
 	'ocall': Op().addImplementation('c', None, lambda prog, params: '\n\t{pre}{fun}({args});'.format(
 		pre = prog.prefix, fun = params[0], args = ', '.join(['context'] + [str(p) for p in params[1:]])
-	)),
+	)).addImplementation('x86', None, _ocallX86Impl),
 	'pcall': Op().addImplementation('c', None, lambda prog, params: '\n\t(({typ}){fun})({args});'.format(
 		typ = params[1], fun = params[0], args = ', '.join([str(p) for p in params[2:]])
 	)),
@@ -849,7 +1142,7 @@ _opMap = {
 		lambda prog, params: '\n\tcontext->cycles += context->opts->gen.clock_divider * {0};'.format(
 			params[0]
 		)
-	),
+	).addImplementation('x86', None, _cyclesX86Impl),
 	'addsize': Op(
 		lambda a, b: b + (2 * a if a else 1)
 	).addImplementation('c', 2, lambda prog, params: '\n\t{dst} = {val} + ({sz} ? {sz} * 2 : 1);'.format(
@@ -862,10 +1155,210 @@ _opMap = {
 	)),
 	'xchg': Op().addImplementation('c', (0,1), _xchgCImpl),
 	'dispatch': Op().addImplementation('c', None, _dispatchCImpl),
-	'update_flags': Op().addImplementation('c', None, _updateFlagsCImpl),
+	'update_flags': Op().addImplementation('c', None, _updateFlagsCImpl).addImplementation('x86', None, _updateFlagsX86Impl),
 	'update_sync': Op().addImplementation('c', None, _updateSyncCImpl)
 }
 
+#support code shared by all generated x86 translators
+#translated code keeps the context pointer in JIT_CONTEXT and all CPU state in the context struct
+_x86Helpers = string.Template('''
+#define JIT_CONTEXT RBX
+#define ${PRE}JIT_MAX_BLOCK 32
+
+typedef void (*jit_fun)(${opts} *opts, code_info *code);
+
+//zero-extending load of a register or JIT local
+static void jit_load(code_info *code, uint8_t base, int32_t disp, uint8_t size, uint8_t dst)
+{
+	if (size == SZ_D) {
+		mov_rdispr(code, base, disp, dst, SZ_D);
+	} else {
+		movzx_rdispr(code, base, disp, dst, size, SZ_D);
+	}
+}
+''')
+
+#only emitted when a translator uses if/else, otherwise they would be unused functions
+_x86BranchHelpers = '''
+//emits a forward branch with a 32-bit displacement to be filled in by jit_patch_fwd
+static code_ptr jit_jcc_fwd(code_info *code, uint8_t cc)
+{
+	check_alloc_code(code, 6);
+	jcc(code, cc, code->cur + 0x100);
+	return code->cur - 4;
+}
+
+static code_ptr jit_jmp_fwd(code_info *code)
+{
+	check_alloc_code(code, 5);
+	jmp(code, code->cur + 0x100);
+	return code->cur - 4;
+}
+
+static void jit_patch_fwd(code_info *code, code_ptr patch)
+{
+	*(int32_t *)patch = code->cur - (patch + 4);
+}
+'''
+
+#only emitted when a translator indexes a register array, otherwise it would be an unused function
+_x86IndexHelper = '''
+//leaves the context pointer plus the scaled value of an index register in RDX
+static void jit_index(code_info *code, int32_t disp, uint8_t size, uint8_t shift)
+{
+	jit_load(code, JIT_CONTEXT, disp, size, RDX);
+	if (shift) {
+		shl_ir(code, shift, RDX, SZ_D);
+	}
+	add_rr(code, JIT_CONTEXT, RDX, SZ_PTR);
+}
+'''
+
+_x86Runtime = string.Template('''
+static void ${pre}jit_check_cycles(${opts} *opts, code_info *code)
+{
+	mov_rdispr(code, JIT_CONTEXT, offsetof(${ctx}, cycles), RAX, SZ_D);
+	cmp_rdispr(code, JIT_CONTEXT, offsetof(${ctx}, target_cycle), RAX, SZ_D);
+	jcc(code, CC_NC, opts->jit_exit);${synccheck}
+}
+
+//runs whatever instruction was actually fetched when it doesn't match the translation
+static void ${pre}jit_mismatch(${ctx} *context, uint32_t opcode)
+{
+	impl_main[opcode](context, context->target_cycle);
+}
+
+static void ${pre}jit_flush(${opts} *opts)
+{
+	for (uint32_t i = 0; i < ${PRE}JIT_BLOCKS; i++)
+	{
+		//an address that belongs in a different slot can never match
+		opts->jit_block_address[i] = i ^ 1;
+	}
+	flush_code_pool(&opts->gen.code);
+}
+
+static void ${pre}jit_init(${opts} *opts)
+{
+	code_info *code = &opts->gen.code;
+	init_code_info(code);
+	
+	opts->jit_enter = (${pre}jit_enter_fun)code->cur;
+	push_r(code, JIT_CONTEXT);
+#ifdef X86_64
+	mov_rr(code, FIRST_ARG_REG, JIT_CONTEXT, SZ_PTR);
+	jmp_r(code, SECOND_ARG_REG);
+#else
+	mov_rdispr(code, RSP, 8, JIT_CONTEXT, SZ_PTR);
+	mov_rdispr(code, RSP, 12, RAX, SZ_PTR);
+	jmp_r(code, RAX);
+#endif
+	
+	opts->jit_exit = code->cur;
+	pop_r(code, JIT_CONTEXT);
+	retn(code);
+	
+	//everything below runs with JIT_CONTEXT pushed on top of the return address
+	code->stack_off = sizeof(void *);
+	opts->jit_mismatch = code->cur;
+	call_args(code, (code_ptr)${pre}jit_mismatch, 2, JIT_CONTEXT, RAX);
+	jmp(code, opts->jit_exit);
+	
+	//taken when an opcode checked in place doesn't match, the real fetch decides what runs instead
+	opts->jit_refetch = code->cur;
+	call_args(code, (code_ptr)${pre}jit_fetch, 1, JIT_CONTEXT);
+	jmp(code, opts->jit_mismatch);
+	
+	//chains to the block for the current pc if there is one, otherwise returns to C to translate it
+	opts->jit_next = code->cur;
+	jit_load(code, JIT_CONTEXT, offsetof(${ctx}, ${pcfield}), ${pcsize}, RAX);
+	mov_rr(code, RAX, RCX, SZ_D);
+	and_ir(code, ${PRE}JIT_BLOCKS - 1, RCX, SZ_D);
+	shl_ir(code, 2, RCX, SZ_D);
+	mov_ir(code, (uintptr_t)opts->jit_block_address, RDX, SZ_PTR);
+	add_rr(code, RCX, RDX, SZ_PTR);
+	cmp_rdispr(code, RDX, 0, RAX, SZ_D);
+	jcc(code, CC_NZ, opts->jit_exit);
+	if (sizeof(code_ptr) == 8) {
+		shl_ir(code, 1, RCX, SZ_D);
+	}
+	mov_ir(code, (uintptr_t)opts->jit_block_chain, RDX, SZ_PTR);
+	add_rr(code, RCX, RDX, SZ_PTR);
+	mov_rdispr(code, RDX, 0, RCX, SZ_PTR);
+	jmp_r(code, RCX);
+	
+	init_code_pool(code, ${PRE}JIT_CODE_SIZE);
+	${pre}jit_flush(opts);
+}
+
+//translates a run of instructions starting at the current pc
+//each one fetches at runtime and checks the opcode against the one it was translated for
+//so a wrong guess about what comes next or modified code just falls back to the interpreter
+static code_ptr ${pre}jit_translate(${ctx} *context)
+{
+	${opts} *opts = context->opts;
+	code_info *code = &opts->gen.code;
+	uint32_t start = context->${pcfield}, address = start;
+	code->stack_off = sizeof(void *);
+	check_alloc_code(code, 64);
+	code_ptr chain = code->cur;
+	${pre}jit_check_cycles(opts, code);
+	//entry from C skips the first cycle check as the caller has already handled it
+	code_ptr entry = code->cur;
+	for (uint32_t i = 0; i < ${PRE}JIT_MAX_BLOCK; i++)
+	{
+		uint32_t opcode, offset;
+		uint8_t **page;
+		uint8_t predicted = ${peek}(context, address, &opcode, &page, &offset);
+		if (!predicted && i) {
+			break;
+		}
+		if (i) {
+			check_alloc_code(code, 64);
+			${pre}jit_check_cycles(opts, code);
+		}
+		check_alloc_code(code, 128);
+		if (!predicted) {
+			call_args(code, (code_ptr)${pre}jit_fetch, 1, JIT_CONTEXT);
+			jmp(code, opts->jit_mismatch);
+			break;
+		}${fetch}
+		if (jit_main[opcode]) {
+			jit_main[opcode](opts, code);
+		} else {
+			mov_rdispr(code, JIT_CONTEXT, offsetof(${ctx}, target_cycle), RCX, SZ_D);
+			call_args(code, (code_ptr)impl_main[opcode], 2, JIT_CONTEXT, RCX);
+		}
+		if (!jit_len_main[opcode]) {
+			break;
+		}
+		address = (address + jit_len_main[opcode]) & ${pcmask};
+	}
+	jmp(code, opts->jit_next);
+	uint32_t slot = start & (${PRE}JIT_BLOCKS - 1);
+	opts->jit_block_address[slot] = start;
+	opts->jit_block_chain[slot] = chain;
+	opts->jit_block_entry[slot] = entry;
+	return entry;
+}
+''')
+
+#checks the fetched opcode against the translated one after the fetch has run
+_x86CallFetch = string.Template('''
+		call_args(code, (code_ptr)${pre}jit_fetch, 1, JIT_CONTEXT);
+		cmp_ir(code, opcode, RAX, SZ_D);
+		jcc(code, CC_NZ, opts->jit_mismatch);''')
+
+#checks the opcode in the memory jit_peek read it from and only does the side effects of the fetch
+#the page pointer is reloaded every time as the memory map can change after translation
+_x86FastFetch = string.Template('''
+		mov_rdispr(code, JIT_CONTEXT, (uint8_t *)page - (uint8_t *)context, RAX, SZ_PTR);
+		test_rr(code, RAX, RAX, SZ_PTR);
+		jcc(code, CC_Z, opts->jit_refetch);
+		cmp_irdisp(code, opcode, RAX, offset, ${opsize});
+		jcc(code, CC_NZ, opts->jit_refetch);
+		${pre}jit_fast_fetch(opts, code, opcode);''')
+
 #represents a simple DSL instruction
 class NormalOp:
 	def __init__(self, parts):
@@ -888,6 +1381,14 @@ class NormalOp:
 			if (not type(param) is int) and len(procParams) != len(self.params) - 1:
 				allParamsConst = False
 			procParams.append(param)
+		
+		if prog.pcExpr:
+			if self.op == 'dispatch' and not prog.jitFetch:
+				prog.pcUnknown = True
+			elif not opDef is None:
+				for dstIdx in opDef.outOp:
+					if dstIdx < len(procParams):
+						prog.trackPcWrite(self.op, procParams, procParams[dstIdx])
 			
 		if self.op == 'meta':
 			param,_,index = self.params[1].partition('.')
@@ -949,6 +1450,8 @@ class NormalOp:
 				procParams.append(param)
 			prog.subroutines[self.op].inline(prog, procParams, output, otype, parent)
 		else:
+			if otype != 'c':
+				raise NotNative('call to ' + self.op)
 			output.append('\n\t' + self.op + '(' + ', '.join([str(p) for p in procParams]) + ');')
 		prog.lastOp = self
 	
@@ -1006,18 +1509,24 @@ class Switch(ChildBlock):
 			self.regValues = self.parent.regValues
 			if param in self.cases:
 				self.current_locals = self.case_locals[param]
-				output.append('\n\t{')
+				if otype == 'c':
+					output.append('\n\t{')
 				for local in self.case_locals[param]:
-					output.append('\n\tuint{0}_t {1};'.format(self.case_locals[param][local], local))
+					output.append(prog.declareLocal(otype, local, self.case_locals[param][local]))
 				self.processOps(prog, fieldVals, output, otype, self.cases[param])
-				output.append('\n\t}')
+				if otype == 'c':
+					output.append('\n\t}')
 			elif self.default:
 				self.current_locals = self.default_locals
-				output.append('\n\t{')
+				if otype == 'c':
+					output.append('\n\t{')
 				for local in self.default_locals:
-					output.append('\n\tuint{0}_t {1};'.format(self.default[local], local))
+					output.append(prog.declareLocal(otype, local, self.default_locals[local]))
 				self.processOps(prog, fieldVals, output, otype, self.default)
-				output.append('\n\t}')
+				if otype == 'c':
+					output.append('\n\t}')
+		elif otype != 'c':
+			raise NotNative('switch on a runtime value')
 		else:
 			oldCond = prog.conditional
 			prog.conditional = True
@@ -1077,11 +1586,50 @@ def _eqCImpl(prog, parent, fieldVals, output):
 def _neqCImpl(prog, parent, fieldVals, output):
 	return '\n\tif ({a}) {{'.format(a=prog.resolveParam(prog.lastDst, None, {}))
 	
+def _x86CmpParams(prog, parent, fieldVals, output):
+	output.pop()
+	params = [prog.x86Operand(prog.resolveParam(p, parent, fieldVals)) for p in prog.lastOp.params]
+	a = params[1]
+	b = params[0]
+	if a[0] == 'imm' or (b[0] == 'imm' and (b[1] < 0 or b[1] > 0xFFFFFFFF)):
+		raise NotNative('unsupported comparison')
+	ret = prog.x86Load(a, 'RAX')
+	if b[0] == 'imm':
+		ret += '\n\tcmp_ir(code, {val}, RAX, SZ_D);'.format(val=_x86Imm(b[1]))
+	else:
+		ret += prog.x86Load(b, 'RCX') + '\n\tcmp_rr(code, RCX, RAX, SZ_D);'
+	return ret
+
+def _x86TestLastDst(prog):
+	return prog.x86Load(prog.x86Operand(prog.resolveParam(prog.lastDst, None, {})), 'RAX') + '\n\ttest_rr(code, RAX, RAX, SZ_D);'
+
+#x86 condition implementations return the code to test the condition
+#along with the condition code that skips the true body
+def _geuX86Impl(prog, parent, fieldVals, output):
+	if prog.lastOp.op == 'cmp':
+		return (_x86CmpParams(prog, parent, fieldVals, output), 'CC_C')
+	else:
+		raise Exception(">=U not implemented in the general case yet")
+
+def _eqX86Impl(prog, parent, fieldVals, output):
+	if prog.lastOp.op == 'cmp':
+		return (_x86CmpParams(prog, parent, fieldVals, output), 'CC_NZ')
+	else:
+		return (_x86TestLastDst(prog), 'CC_NZ')
+
+def _neqX86Impl(prog, parent, fieldVals, output):
+	return (_x86TestLastDst(prog), 'CC_Z')
+
 _ifCmpImpl = {
 	'c': {
 		'>=U': _geuCImpl,
 		'=': _eqCImpl,
 		'!=': _neqCImpl
+	},
+	'x86': {
+		'>=U': _geuX86Impl,
+		'=': _eqX86Impl,
+		'!=': _neqX86Impl
 	}
 }
 #represents a DSL conditional construct
@@ -1121,19 +1669,15 @@ class If(ChildBlock):
 		
 	def _genTrueBody(self, prog, fieldVals, output, otype):
 		self.curLocals = self.locals
-		subOut = []
-		self.processOps(prog, fieldVals, subOut, otype, self.body)
 		for local in self.locals:
-			output.append('\n\tuint{sz}_t {nm};'.format(sz=self.locals[local], nm=local))
-		output += subOut
+			output.append(prog.declareLocal(otype, local, self.locals[local]))
+		self.processOps(prog, fieldVals, output, otype, self.body)
 			
 	def _genFalseBody(self, prog, fieldVals, output, otype):
 		self.curLocals = self.elseLocals
-		subOut = []
-		self.processOps(prog, fieldVals, subOut, otype, self.elseBody)
 		for local in self.elseLocals:
-			output.append('\n\tuint{sz}_t {nm};'.format(sz=self.elseLocals[local], nm=local))
-		output += subOut
+			output.append(prog.declareLocal(otype, local, self.elseLocals[local]))
+		self.processOps(prog, fieldVals, output, otype, self.elseBody)
 	
 	def _genConstParam(self, param, prog, fieldVals, output, otype):
 		if param:
@@ -1141,10 +1685,37 @@ class If(ChildBlock):
 		else:
 			self._genFalseBody(prog, fieldVals, output, otype)
 			
+	def _genX86(self, prog, parent, fieldVals, output):
+		if self.cond in _ifCmpImpl['x86']:
+			test,cc = _ifCmpImpl['x86'][self.cond](prog, parent, fieldVals, output)
+		else:
+			cond = prog.resolveParam(self.cond, parent, fieldVals)
+			if type(cond) is int:
+				self._genConstParam(cond, prog, fieldVals, output, 'x86')
+				return
+			test = prog.x86Load(prog.x86Operand(cond), 'RAX') + '\n\ttest_rr(code, RAX, RAX, SZ_D);'
+			cc = 'CC_Z'
+		label = prog.nextLabel()
+		output.append(test)
+		output.append('\n\tcode_ptr jit_else{n} = jit_jcc_fwd(code, {cc});'.format(n=label, cc=cc))
+		oldCond = prog.conditional
+		prog.conditional = True
+		self._genTrueBody(prog, fieldVals, output, 'x86')
+		if self.elseBody:
+			output.append('\n\tcode_ptr jit_end{n} = jit_jmp_fwd(code);'.format(n=label))
+			output.append('\n\tjit_patch_fwd(code, jit_else{n});'.format(n=label))
+			self._genFalseBody(prog, fieldVals, output, 'x86')
+			output.append('\n\tjit_patch_fwd(code, jit_end{n});'.format(n=label))
+		else:
+			output.append('\n\tjit_patch_fwd(code, jit_else{n});'.format(n=label))
+		prog.conditional = oldCond
+	
 	def generate(self, prog, parent, fieldVals, output, otype, flagUpdates):
 		self.regValues = parent.regValues
 		if self.cond in prog.booleans:
 			self._genConstParam(prog.checkBool(self.cond), prog, fieldVals, output, otype)
+		elif otype == 'x86':
+			self._genX86(prog, parent, fieldVals, output)
 		else:
 			if self.cond in _ifCmpImpl[otype]:
 				oldCond = prog.conditional
@@ -1475,6 +2046,22 @@ class Program:
 		self.conditional = False
 		self.declares = []
 		self.lastSize = None
+		self.jitPeek = info.get('jit_peek', [None])[0]
+		self.jitFastFetch = info.get('jit_fast_fetch', [None])[0]
+		self.jitFetch = False
+		self.jitFetchResult = None
+		self.jitLocalSlots = 0
+		self.x86Locals = {}
+		self.x86LastA = None
+		self.x86LastB = None
+		self.x86InvertB = False
+		self.x86FlagDst = None
+		self.labels = 0
+		self.jit = False
+		self.pcExpr = None
+		self.pcArray = None
+		self.pcAdvance = 0
+		self.pcUnknown = False
 		
 	def __str__(self):
 		pieces = []
@@ -1492,12 +2079,28 @@ class Program:
 		hFile.write('#ifndef {0}_'.format(macro))
 		hFile.write('\n#define {0}_'.format(macro))
 		hFile.write('\n#include "backend.h"')
+		if otype == 'x86':
+			hFile.write('\n\n#define {0}JIT_BLOCKS 4096'.format(self.prefix.upper()))
+			hFile.write('\n#define {0}JIT_CODE_SIZE (16 * 1024 * 1024)'.format(self.prefix.upper()))
+			hFile.write('\n\ntypedef void (*{0}jit_enter_fun)(void *context, code_ptr native);'.format(self.prefix))
 		hFile.write('\n\ntypedef struct {')
 		hFile.write('\n\tcpu_options gen;')
+		if otype == 'x86':
+			hFile.write('\n\t{0}jit_enter_fun jit_enter;'.format(self.prefix))
+			hFile.write('\n\tcode_ptr jit_exit;')
+			hFile.write('\n\tcode_ptr jit_next;')
+			hFile.write('\n\tcode_ptr jit_mismatch;')
+			hFile.write('\n\tcode_ptr jit_refetch;')
+			hFile.write('\n\tuint32_t jit_block_address[{0}JIT_BLOCKS];'.format(self.prefix.upper()))
+			hFile.write('\n\tcode_ptr jit_block_chain[{0}JIT_BLOCKS];'.format(self.prefix.upper()))
+			hFile.write('\n\tcode_ptr jit_block_entry[{0}JIT_BLOCKS];'.format(self.prefix.upper()))
 		hFile.write('\n}} {0}options;'.format(self.prefix))
 		hFile.write('\n\ntypedef struct {')
 		hFile.write('\n\t{0}options *opts;'.format(self.prefix))
-		self.regs.writeHeader(otype, hFile)
+		self.regs.writeHeader('c', hFile)
+		if otype == 'x86':
+			hFile.write('\n\tuint32_t target_cycle;')
+			hFile.write('\n\tuint32_t jit_locals[{0}];'.format(max(1, self.jitLocalSlots)))
 		hFile.write('\n}} {0}context;'.format(self.prefix))
 		hFile.write('\n')
 		hFile.write('\nvoid {pre}execute({type} *context, uint32_t target_cycle);'.format(pre = self.prefix, type = self.context_type))
@@ -1522,8 +2125,14 @@ class Program:
 						self.needFlagCoalesce = False
 						self.needFlagDisperse = False
 						self.lastOp = None
+						self.pcAdvance = 0
+						self.pcUnknown = False
 						opmap[val] = inst.generateName(val)
 						bodymap[val] = inst.generateBody(val, self, otype)
+						if self.jit and table == 'main':
+							self.jitLens[val] = None if self.pcUnknown else self.pcAdvance
+							self.jitTranslators[val] = inst.generateTranslator(val, self)
+							self.jitNames[val] = opmap[val]
 		
 		if self.dispatch == 'call':
 			pieces.append('\nstatic impl_fun impl_{name}[{sz}] = {{'.format(name = table, sz=len(opmap)))
@@ -1566,9 +2175,164 @@ class Program:
 			self.subroutines[self.body].inline(self, [], output, otype, None)
 		return output
 	
+	def syncCall(self):
+		if self.sync_cycle:
+			return '\n\t{sync}(context, target_cycle);'.format(sync=self.sync_cycle)
+		return ''
+	
+	#translates the side effects of a fetch that reads memory jit_peek can see, translated code
+	#has already checked the opcode so this only needs to leave the CPU state as the fetch would
+	def _buildFastFetch(self):
+		self.meta = {}
+		self.temp = {}
+		self.x86Locals = {}
+		self.lastOp = None
+		self.needFlagCoalesce = False
+		self.needFlagDisperse = False
+		output = []
+		self.subroutines[self.jitFastFetch].inline(self, [], output, 'x86', None)
+		if self.needFlagCoalesce or self.needFlagDisperse or self.temp:
+			raise Exception(self.jitFastFetch + ' must not access the flag register')
+		self.jitLocalSlots = max(self.jitLocalSlots, len(self.x86Locals))
+		result = self.x86Operand(self.jitFetchResult)
+		output.append('\n\tmov_irdisp(code, opcode, JIT_CONTEXT, {disp}, {sz});'.format(
+			disp = result[1], sz = _x86Sizes[result[2]]
+		))
+		body = ''.join(output)
+		return '\nstatic void {pre}jit_fast_fetch({pre}options *opts, code_info *code, uint32_t opcode)\n{{\n\tcheck_alloc_code(code, {size});{body}\n}}\n'.format(
+			pre = self.prefix, size = 32 * (body.count(';') + 1), body = body
+		)
+	
+	def _buildJit(self, body, pieces):
+		subs = {
+			'pre': self.prefix,
+			'PRE': self.prefix.upper(),
+			'ctx': self.context_type,
+			'opts': self.prefix + 'options',
+			'pcfield': self.pcExpr[len('context->'):],
+			'pcsize': _x86Sizes[self.paramSize('pc')],
+			'pcmask': hex((1 << self.paramSize('pc')) - 1),
+			'peek': self.jitPeek if self.jitPeek else self.prefix + 'jit_peek',
+			'synccheck': '',
+			'opsize': _x86Sizes[self.opsize]
+		}
+		if self.interrupt in self.subroutines:
+			subs['synccheck'] = '''
+	cmp_rdispr(code, JIT_CONTEXT, offsetof({ctx}, sync_cycle), RAX, SZ_D);
+	jcc(code, CC_NC, opts->jit_exit);'''.format(ctx=self.context_type)
+		body.append(_x86Helpers.substitute(subs))
+		translators = [translator for translator in self.jitTranslators.values() if translator]
+		if any('jit_patch_fwd(' in translator for translator in translators):
+			body.append(_x86BranchHelpers)
+		if any('jit_index(' in translator for translator in translators):
+			body.append(_x86IndexHelper)
+		
+		#the fetch half of the body subroutine is run from translated code, it returns the opcode instead of dispatching
+		self.meta = {}
+		self.temp = {}
+		self.lastOp = None
+		self.pcAdvance = 0
+		self.pcUnknown = False
+		self.jitFetch = True
+		fetch = []
+		self.subroutines[self.body].inline(self, [], fetch, 'c', None)
+		self.jitFetch = False
+		fetchLen = None if self.pcUnknown else self.pcAdvance
+		pieces.append('\nstatic uint32_t {pre}jit_fetch({type} *context)'.format(pre=self.prefix, type=self.context_type))
+		pieces.append('\n{')
+		for size in self.temp:
+			pieces.append('\n\tuint{sz}_t gen_tmp{sz}__;'.format(sz=size))
+		pieces += fetch
+		pieces.append('\n}\n')
+		if self.jitFastFetch:
+			if not self.jitPeek:
+				raise Exception('jit_fast_fetch requires jit_peek')
+			pieces.append(self._buildFastFetch())
+			subs['fetch'] = _x86FastFetch.substitute(subs)
+		else:
+			subs['fetch'] = _x86CallFetch.substitute(subs)
+		
+		size = 1 << self.opsize
+		for val in range(size):
+			if self.jitTranslators.get(val):
+				pieces.append(self.jitTranslators[val])
+		pieces.append('\n\nstatic jit_fun jit_main[{sz}] = {{'.format(sz=size))
+		for val in range(size):
+			if self.jitTranslators.get(val):
+				pieces.append('\n\tjit_{name},'.format(name=self.jitNames[val]))
+			else:
+				pieces.append('\n\tNULL,')
+		pieces.append('\n};')
+		#total number of bytes each instruction moves pc by, 0 when that isn't known at translation time
+		lens = []
+		for val in range(size):
+			length = self.jitLens.get(val)
+			if fetchLen is None or length is None or fetchLen + length > 255:
+				length = 0
+			else:
+				length += fetchLen
+			lens.append(str(length))
+		pieces.append('\nstatic uint8_t jit_len_main[{sz}] = {{'.format(sz=size))
+		for i in range(0, size, 32):
+			pieces.append('\n\t' + ', '.join(lens[i:i+32]) + ',')
+		pieces.append('\n};\n')
+		if not self.jitPeek:
+			pieces.append('\n//without a way to read memory side-effect free nothing can be predicted')
+			pieces.append('\nstatic uint8_t {pre}jit_peek({type} *context, uint32_t address, uint32_t *opcode, uint8_t ***page, uint32_t *offset)'.format(
+				pre=self.prefix, type=self.context_type
+			))
+			pieces.append('\n{\n\treturn 0;\n}\n')
+		pieces.append(_x86Runtime.substitute(subs))
+		
+		pieces.append('\nvoid {pre}execute({type} *context, uint32_t target_cycle)'.format(pre = self.prefix, type = self.context_type))
+		pieces.append('\n{')
+		pieces.append('\n\t{pre}options *opts = context->opts;'.format(pre = self.prefix))
+		pieces.append('\n\tif (!opts->jit_exit) {')
+		pieces.append('\n\t\t{pre}jit_init(opts);'.format(pre = self.prefix))
+		pieces.append('\n\t}')
+		pieces.append(self.syncCall())
+		pieces.append('\n\tcontext->target_cycle = target_cycle;')
+		pieces.append('\n\twhile (context->cycles < target_cycle)')
+		pieces.append('\n\t{')
+		if self.interrupt in self.subroutines:
+			pieces.append('\n\t\tif (context->cycles >= context->sync_cycle) {')
+			self.meta = {}
+			self.temp = {}
+			intpieces = []
+			self.subroutines[self.interrupt].inline(self, [], intpieces, 'c', None)
+			for size in self.temp:
+				pieces.append('\n\tuint{sz}_t gen_tmp{sz}__;'.format(sz=size))
+			pieces += intpieces
+			pieces.append('\n\t\t}')
+		pieces.append('\n\t\tif (opts->gen.code.pool && opts->gen.code.pool->flush_pending) {')
+		pieces.append('\n\t\t\t{pre}jit_flush(opts);'.format(pre = self.prefix))
+		pieces.append('\n\t\t}')
+		pieces.append('\n\t\tuint32_t slot = context->{pc} & ({PRE}JIT_BLOCKS - 1);'.format(pc = subs['pcfield'], PRE = subs['PRE']))
+		pieces.append('\n\t\tcode_ptr native;')
+		pieces.append('\n\t\tif (opts->jit_block_address[slot] == context->{pc}) {{'.format(pc = subs['pcfield']))
+		pieces.append('\n\t\t\tnative = opts->jit_block_entry[slot];')
+		pieces.append('\n\t\t} else {')
+		pieces.append('\n\t\t\tnative = {pre}jit_translate(context);'.format(pre = self.prefix))
+		pieces.append('\n\t\t}')
+		pieces.append('\n\t\topts->jit_enter(context, native);')
+		pieces.append('\n\t}')
+		pieces.append('\n}')
+	
 	def build(self, otype):
 		body = []
 		pieces = []
+		#the x86 target still generates the C implementations, they're used for anything that can't be translated
+		self.jit = otype == 'x86'
+		if self.jit:
+			otype = 'c'
+			self.dispatch = 'call'
+			if not self.regs.isReg('pc') and not self.regs.isRegArrayMember('pc'):
+				raise Exception('x86 target requires a pc register')
+			self.pcExpr = self.resolveReg('pc', None, {})
+			self.pcArray = self.pcExpr.partition('[')[0]
+			self.jitLens = {}
+			self.jitTranslators = {}
+			self.jitNames = {}
 		for include in self.includes:
 			body.append('#include "{0}"\n'.format(include))
 		if self.dispatch == 'call':
@@ -1587,10 +2351,12 @@ class Program:
 		for table in self.extra_tables:
 			self._buildTable(otype, table, body, pieces)
 		self._buildTable(otype, 'main', body, pieces)
-		if self.dispatch == 'call' and self.body in self.subroutines:
+		if self.jit:
+			self._buildJit(body, pieces)
+		elif self.dispatch == 'call' and self.body in self.subroutines:
 			pieces.append('\nvoid {pre}execute({type} *context, uint32_t target_cycle)'.format(pre = self.prefix, type = self.context_type))
 			pieces.append('\n{')
-			pieces.append('\n\t{sync}(context, target_cycle);'.format(sync=self.sync_cycle))
+			pieces.append(self.syncCall())
 			pieces.append('\n\twhile (context->cycles < target_cycle)')
 			pieces.append('\n\t{')
 			if self.interrupt in self.subroutines:
@@ -1609,7 +2375,7 @@ class Program:
 			pieces.append('\n\t}')
 			pieces.append('\n}')
 		elif self.dispatch == 'goto':
-			body.append('\n\t{sync}(context, target_cycle);'.format(sync=self.sync_cycle))
+			body.append(self.syncCall())
 			body += self.nextInstruction(otype)
 			pieces.append('\nunimplemented:')
 			pieces.append('\n\tfatal_error("Unimplemented instruction\\n");')
@@ -1621,6 +2387,105 @@ class Program:
 			raise Exception(name + ' is not a defined boolean flag')
 		return self.booleans[name]
 	
+	def trackPcWrite(self, op, params, dst):
+		#records how far an instruction moves pc so the x86 target can predict where the next one is
+		#helper functions called with ocall are assumed to leave pc alone
+		if type(dst) is int:
+			return
+		if dst == self.pcExpr:
+			if op == 'add' and not self.conditional and type(params[0]) is int and params[1] == self.pcExpr:
+				self.pcAdvance += params[0]
+			else:
+				self.pcUnknown = True
+		elif dst.startswith(self.pcArray + '[context->'):
+			self.pcUnknown = True
+	
+	def declareLocal(self, otype, name, size):
+		size = int(size)
+		if otype == 'c':
+			return '\n\tuint{sz}_t {nm};'.format(sz=size, nm=name)
+		if name in self.x86Locals:
+			if self.x86Locals[name][1] != size:
+				raise NotNative('local {0} redeclared with a different size'.format(name))
+		elif not size in _x86Sizes:
+			raise NotNative('unsupported local size {0}'.format(size))
+		else:
+			self.x86Locals[name] = (len(self.x86Locals), size)
+		return ''
+	
+	def nextLabel(self):
+		self.labels += 1
+		return self.labels
+	
+	def x86Operand(self, param):
+		if type(param) is int:
+			return ('imm', param)
+		match = re.fullmatch(r'context->(\w+)(?:\[(\d+)\])?', param)
+		if match:
+			name,index = match.groups()
+			if name in self.regs.regArrays:
+				size = self.regs.regArrays[name][0]
+			elif self.regs.isReg(name):
+				size = self.regs.regs[name]
+			else:
+				raise NotNative(param + ' is not a register')
+			if not index is None:
+				name += '[' + index + ']'
+			if not size in _x86Sizes:
+				raise NotNative('unsupported register size {0}'.format(size))
+			return ('mem', 'offsetof({ctx}, {field})'.format(ctx=self.context_type, field=name), size)
+		match = re.fullmatch(r'context->(\w+)\[(context->\w+(?:\[\d+\])?)\]', param)
+		if match and match.group(1) in self.regs.regArrays:
+			name,index = match.groups()
+			index = self.x86Operand(index)
+			size = self.regs.regArrays[name][0]
+			if not size in _x86Sizes:
+				raise NotNative('unsupported register size {0}'.format(size))
+			return ('idx', 'offsetof({ctx}, {field})'.format(ctx=self.context_type, field=name), size, index)
+		if param in self.x86Locals:
+			slot,size = self.x86Locals[param]
+			return ('mem', 'offsetof({ctx}, jit_locals[{slot}])'.format(ctx=self.context_type, slot=slot), size)
+		raise NotNative('unsupported operand ' + param)
+	
+	def _x86Index(self, operand):
+		_,disp,size,index = operand
+		shift = {8: 0, 16: 1, 32: 2}[size]
+		return '\n\tjit_index(code, {disp}, {sz}, {shift});'.format(disp=index[1], sz=_x86Sizes[index[2]], shift=shift)
+	
+	def x86Load(self, operand, reg):
+		if operand[0] == 'imm':
+			return '\n\tmov_ir(code, {val}, {reg}, SZ_D);'.format(val=_x86Imm(operand[1]), reg=reg)
+		elif operand[0] == 'mem':
+			return '\n\tjit_load(code, JIT_CONTEXT, {disp}, {sz}, {reg});'.format(disp=operand[1], sz=_x86Sizes[operand[2]], reg=reg)
+		else:
+			return self._x86Index(operand) + '\n\tjit_load(code, RDX, {disp}, {sz}, {reg});'.format(
+				disp=operand[1], sz=_x86Sizes[operand[2]], reg=reg
+			)
+	
+	#keeps the full result of a flag-setting operation in RAX for update_flags, like carryFlowDst does in C
+	#the destination is only written once the flags have been calculated as it can also be a source
+	def x86FlagResult(self, a, b, invertB, dst):
+		size = self.getLastSize()
+		if not size in (8, 16):
+			raise NotNative('flags for a {0}-bit result'.format(size))
+		self.declareLocal('x86', 'flag_result__', 32)
+		self.carryFlowDst = 'flag_result__'
+		self.x86LastA = a
+		self.x86LastB = b
+		self.x86InvertB = invertB
+		self.x86FlagDst = dst
+		return self.x86Store(self.x86Operand(self.carryFlowDst), 'RAX')
+	
+	def x86Store(self, operand, reg):
+		if operand[0] == 'imm':
+			raise NotNative('store to a constant')
+		elif operand[0] == 'mem':
+			return '\n\tmov_rrdisp(code, {reg}, JIT_CONTEXT, {disp}, {sz});'.format(disp=operand[1], sz=_x86Sizes[operand[2]], reg=reg)
+		else:
+			return self._x86Index(operand) + '\n\tmov_rrdisp(code, {reg}, RDX, {disp}, {sz});'.format(
+				disp=operand[1], sz=_x86Sizes[operand[2]], reg=reg
+			)
+	
 	def getTemp(self, size):
 		if size in self.temp:
 			return ('', self.temp[size])
@@ -1843,6 +2708,9 @@ def parse(args):
 	else:
 		p = Program(registers, instructions, subroutines, info, flags)
 		p.dispatch = args.dispatch
+		if args.target == 'x86':
+			#translated code calls into the C implementations so they need to be individual functions
+			p.dispatch = 'call'
 		p.declares = declares
 		p.booleans['dynarec'] = False
 		p.booleans['interp'] = True
@@ -1856,12 +2724,17 @@ def parse(args):
 				else:
 					p.booleans[name] = True
 		
+		#the header depends on how many JIT locals the translators needed so it has to be written after the build
+		output = p.build(args.target)
 		if 'header' in info:
 			print('#include "{0}"'.format(info['header'][0]))
-			p.writeHeader('c', info['header'][0])
+			p.writeHeader(args.target, info['header'][0])
 		print('#include "util.h"')
 		print('#include <stdlib.h>')
-		print(p.build('c'))
+		if args.target == 'x86':
+			print('#include <stddef.h>')
+			print('#include "gen_x86.h"')
+		print(output)
 
 def main(argv):
 	from argparse import ArgumentParser, FileType
@@ -1869,6 +2742,7 @@ def main(argv):
 	argParser.add_argument('source', type=FileType('r'))
 	argParser.add_argument('-D', '--define', action='append')
 	argParser.add_argument('-d', '--dispatch', choices=('call', 'switch', 'goto'), default='call')
+	argParser.add_argument('-t', '--target', choices=('c', 'x86'), default='c')
 	parse(argParser.parse_args(argv[1:]))
 
 if __name__ == '__main__':
@@ -360,7 +360,7 @@ void zdebugger_print(z80_context * context, char format_char, char * param)
 	case '0':
 		if (param[1] == 'x') {
 			uint16_t p_addr = strtol(param+2, NULL, 16);
-			value = read_byte(p_addr, (void **)context->mem_pointers, &context->options->gen, context);
+			value = read_byte(p_addr, (void **)context->mem_pointers, &context->Z80_OPTS->gen, context);
 		}
 		break;
 	}
@@ -585,6 +585,22 @@ z80_context * zdebugger(z80_context * context, uint16_t address)
 static uint32_t branch_t;
 static uint32_t branch_f;
 
+#ifndef NEW_CORE
+static void print_code_cache_stats(char *cpu, code_info *code)
+{
+	code_pool *pool = code->pool;
+	if (!pool) {
+		return;
+	}
+	size_t used = code_pool_used(code);
+	if (pool->max_chunks) {
+		printf("%s translation cache: %zu of %u KB used, %u flushes\n", cpu, used / 1024, pool->max_chunks * (CODE_ALLOC_SIZE / 1024), pool->flushes);
+	} else {
+		printf("%s translation cache: %zu KB used, unlimited, %u flushes\n", cpu, used / 1024, pool->flushes);
+	}
+}
+#endif
+
 int run_debugger_command(m68k_context *context, uint32_t address, char *input_buf, m68kinst inst, uint32_t after)
 {
 	char * param;
@@ -946,6 +962,17 @@ int run_debugger_command(m68k_context *context, uint32_t address, char *input_bu
 			}
 			break;
 		}
+#endif
+#ifndef NEW_CORE
+		case 't': {
+			genesis_context * gen = context->system;
+			//translation cache stats
+			print_code_cache_stats("68K", &context->options->gen.code);
+#ifndef NO_Z80
+			print_code_cache_stats("Z80", &gen->z80->Z80_OPTS->gen.code);
+#endif
+			break;
+		}
 #endif
 		case '?':
 			print_m68k_help();
@@ -986,6 +1013,7 @@ void print_m68k_help()
 	printf("    yt                   - Print YM-2612 timer info\n");
 	printf("    zb ADDRESS           - Set a Z80 breakpoint\n");
 	printf("    zp[/(x|X|d|c)] VALUE - Display a Z80 value\n");
+	printf("    t                    - Print translation cache stats\n");
 	printf("    ?                    - Display help\n");
 	printf("    q                    - Quit BlastEm\n");
 }
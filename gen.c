@@ -13,4 +13,104 @@ void init_code_info(code_info *code)
 	}
 	code->last = code->cur + size/sizeof(code_word) - RESERVE_WORDS;
 	code->stack_off = 0;
+	code->pool = NULL;
+}
+
+void set_code_pool_limit(code_info *code, uint32_t max_bytes)
+{
+	//the cache always has room for at least one chunk to make forward progress in, a flush
+	//leaves the first chunk in use so a limit of one chunk is raised to two
+	code->pool->max_chunks = max_bytes ? (max_bytes + CODE_ALLOC_SIZE - 1) / CODE_ALLOC_SIZE : 0;
+	if (code->pool->max_chunks == 1) {
+		code->pool->max_chunks = 2;
+	}
+	if (code->pool->max_chunks && code->pool->next_chunk >= code->pool->max_chunks) {
+		code->pool->flush_pending = 1;
+	}
+}
+
+void init_code_pool(code_info *code, uint32_t max_bytes)
+{
+	code_pool *pool = calloc(1, sizeof(code_pool));
+	code->pool = pool;
+	set_code_pool_limit(code, max_bytes);
+	size_t size = CODE_ALLOC_SIZE;
+	//no need to link the old chunk to the new one, nothing falls through from helper code
+	code->cur = next_code_chunk(code, &size);
+	code->last = code->cur + size/sizeof(code_word) - RESERVE_WORDS;
+}
+
+code_ptr next_code_chunk(code_info *code, size_t *size)
+{
+	code_pool *pool = code->pool;
+	if (!pool) {
+		return alloc_code(size);
+	}
+	if (pool->next_chunk == pool->num_chunks) {
+		code_ptr chunk = alloc_code(size);
+		if (!chunk) {
+			return NULL;
+		}
+		if (pool->num_chunks == pool->chunk_storage) {
+			pool->chunk_storage = pool->chunk_storage ? pool->chunk_storage * 2 : 8;
+			pool->chunks = realloc(pool->chunks, sizeof(code_ptr) * pool->chunk_storage);
+		}
+		pool->chunks[pool->num_chunks++] = chunk;
+	}
+	//code can't be thrown away in the middle of translation so this only requests a flush
+	//the cache can briefly exceed its limit until the CPU core reaches a safe point
+	if (pool->max_chunks && pool->next_chunk + 1 >= pool->max_chunks) {
+		pool->flush_pending = 1;
+	}
+	*size = CODE_ALLOC_SIZE;
+	return pool->chunks[pool->next_chunk++];
+}
+
+void flush_code_pool(code_info *code)
+{
+	code_pool *pool = code->pool;
+	code->cur = pool->chunks[0];
+	code->last = code->cur + CODE_ALLOC_SIZE/sizeof(code_word) - RESERVE_WORDS;
+	pool->next_chunk = 1;
+	pool->flush_pending = 0;
+	pool->flushes++;
+	pool->num_refs = 0;
+}
+
+size_t code_pool_used(code_info *code)
+{
+	code_pool *pool = code->pool;
+	if (!pool) {
+		return 0;
+	}
+	code_ptr chunk = pool->chunks[pool->next_chunk - 1];
+	size_t used = (pool->next_chunk - 1) * (size_t)CODE_ALLOC_SIZE;
+	if (code->cur >= chunk && code->cur <= chunk + CODE_ALLOC_SIZE/sizeof(code_word)) {
+		used += (code->cur - chunk) * sizeof(code_word);
+	}
+	return used;
+}
+
+void code_pool_log_ref(code_info *code, code_ptr loc, uint8_t type)
+{
+	code_pool *pool = code->pool;
+	if (!pool || !pool->log_refs) {
+		return;
+	}
+	if (pool->num_refs == pool->ref_storage) {
+		pool->ref_storage = pool->ref_storage ? pool->ref_storage * 2 : 1024;
+		pool->refs = realloc(pool->refs, sizeof(code_ref) * pool->ref_storage);
+	}
+	pool->refs[pool->num_refs].loc = loc;
+	pool->refs[pool->num_refs++].type = type;
+}
+
+void free_code_pool(code_info *code)
+{
+	if (code->pool) {
+		free(code->pool->refs);
+		free(code->pool->chunks);
+		free(code->pool);
+		code->pool = NULL;
+	}
 }
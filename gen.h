@@ -1,6 +1,7 @@
 #ifndef GEN_H_
 #define GEN_H_
 #include <stdint.h>
+#include <stddef.h>
 
 #if defined(X86_64) || defined(X86_32)
 typedef uint8_t code_word;
@@ -12,15 +13,64 @@ typedef uint32_t code_word;
 typedef code_word * code_ptr;
 #define CODE_ALLOC_SIZE (1024*1024)
 
+typedef struct code_pool code_pool;
+
+//kinds of references to other code embedded in generated code
+enum {
+	CODE_REF_REL8,  //8-bit branch displacement
+	CODE_REF_REL32, //32-bit branch or call displacement
+	CODE_REF_ABS    //absolute address loaded with a mov immediate for a far call
+};
+
 typedef struct {
-	code_ptr cur;
-	code_ptr last;
-	uint32_t stack_off;
+	code_ptr loc;
+	uint8_t  type;
+} code_ref;
+
+typedef struct {
+	code_ptr  cur;
+	code_ptr  last;
+	uint32_t  stack_off;
+	code_pool *pool;
 } code_info;
 
+//Chunks of translated code that are discarded together when the cache fills up
+//and then reused in the same order so the cache never grows past its limit
+struct code_pool {
+	code_ptr *chunks;
+	uint32_t num_chunks;
+	uint32_t chunk_storage;
+	uint32_t next_chunk;
+	uint32_t max_chunks;
+	uint32_t flushes;
+	//references to other code, only collected while log_refs is set so that the code
+	//can be moved to another address later
+	code_ref *refs;
+	uint32_t num_refs;
+	uint32_t ref_storage;
+	uint8_t  flush_pending;
+	uint8_t  log_refs;
+};
+
 void check_alloc_code(code_info *code, uint32_t inst_size);
 
 void init_code_info(code_info *code);
+//moves code to a fresh chunk that starts the flushable part of the cache
+//max_bytes of 0 means the cache is allowed to grow without bound
+void init_code_pool(code_info *code, uint32_t max_bytes);
+//max_bytes is rounded up to whole chunks with a minimum of two
+void set_code_pool_limit(code_info *code, uint32_t max_bytes);
+//returns the next chunk to continue code generation in, size is updated with the chunk size
+code_ptr next_code_chunk(code_info *code, size_t *size);
+//throws away everything generated since init_code_pool, the caller is responsible
+//for forgetting any pointers into the discarded code
+void flush_code_pool(code_info *code);
+size_t code_pool_used(code_info *code);
+//records the location of a reference emitted by the code generator if logging is enabled
+//for REL8 and REL32 loc points to the displacement, for ABS it points to the start of the mov
+void code_pool_log_ref(code_info *code, code_ptr loc, uint8_t type);
+//releases the bookkeeping for the pool, the chunks themselves are owned by the code arena
+void free_code_pool(code_info *code);
 void call(code_info *code, code_ptr fun);
 void jmp(code_info *code, code_ptr dest);
 void jmp_r(code_info *code, uint8_t dst);
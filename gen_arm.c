@@ -74,7 +74,7 @@ void check_alloc_code(code_info *code)
 {
 	if (code->cur == code->last) {
 		size_t size = CODE_ALLOC_SIZE;
-		uint32_t *next_code = alloc_code(&size);
+		uint32_t *next_code = next_code_chunk(code, &size);
 		if (!next_code) {
 			fatal_error("Failed to allocate memory for generated code\n");
 		}
@@ -182,11 +182,13 @@ void jmp_nocheck(code_info *code, code_ptr dest)
 	ptrdiff_t disp = dest-(out+2);
 	if (disp <= 0x7F && disp >= -0x80) {
 		*(out++) = OP_JMP_BYTE;
+		code_pool_log_ref(code, out, CODE_REF_REL8);
 		*(out++) = disp;
 	} else {
 		disp = dest-(out+5);
 		if (CHECK_DISP(disp)) {
 			*(out++) = OP_JMP;
+			code_pool_log_ref(code, out, CODE_REF_REL32);
 			*(out++) = disp;
 			disp >>= 8;
 			*(out++) = disp;
@@ -205,7 +207,7 @@ void check_alloc_code(code_info *code, uint32_t inst_size)
 {
 	if (code->cur + inst_size > code->last) {
 		size_t size = CODE_ALLOC_SIZE;
-		code_ptr next_code = alloc_code(&size);
+		code_ptr next_code = next_code_chunk(code, &size);
 		if (!next_code) {
 			fatal_error("Failed to allocate memory for generated code\n");
 		}
@@ -646,6 +648,53 @@ void x86_irdisp(code_info *code, uint8_t opcode, uint8_t op_ex, int32_t val, uin
 	code->cur = out;
 }
 
+//dst is encoded as a RIP-relative address on x86-64 so it has to be within 2GB of the generated code
+void x86_irabs(code_info *code, uint8_t opcode, uint8_t op_ex, int32_t val, void *dst, uint8_t size)
+{
+	check_alloc_code(code, 12);
+	code_ptr out = code->cur;
+	uint8_t imm_size = size == SZ_B ? 1 : size == SZ_W ? 2 : 4;
+	if (size != SZ_B && val <= 0x7F && val >= -0x80) {
+		imm_size = 1;
+		opcode |= BIT_DIR;
+	}
+	if (size == SZ_W) {
+		*(out++) = PRE_SIZE;
+	}
+	if (size == SZ_Q) {
+#ifdef X86_64
+		*(out++) = PRE_REX | REX_QUAD;
+#else
+		fatal_error("Instruction requires REX prefix but this is a 32-bit build | opcode: %X:%X, size: %s\n", opcode, op_ex, x86_sizes[size]);
+#endif
+	}
+	if (size != SZ_B) {
+		opcode |= BIT_SIZE;
+	}
+	*(out++) = opcode;
+	//an R/M field of RBP with no displacement selects RIP relative addressing in 64-bit mode and absolute in 32-bit mode
+	*(out++) = MODE_REG_INDIRECT | RBP | (op_ex << 3);
+#ifdef X86_64
+	ptrdiff_t disp = (code_ptr)dst - (out + sizeof(int32_t) + imm_size);
+	if (!CHECK_DISP(disp)) {
+		fatal_error("%p - %p = %lX which is out of range for a 32-bit displacement\n", dst, out + sizeof(int32_t) + imm_size, (long)disp);
+	}
+#else
+	intptr_t disp = (intptr_t)dst;
+#endif
+	for (int i = 0; i < sizeof(int32_t); i++)
+	{
+		*(out++) = disp;
+		disp >>= 8;
+	}
+	for (int i = 0; i < imm_size; i++)
+	{
+		*(out++) = val;
+		val >>= 8;
+	}
+	code->cur = out;
+}
+
 void x86_shiftrot_ir(code_info *code, uint8_t op_ex, uint8_t val, uint8_t dst, uint8_t size)
 {
 	check_alloc_code(code, 5);
@@ -933,6 +982,11 @@ void add_irdisp(code_info *code, int32_t val, uint8_t dst_base, int32_t disp, ui
 	x86_irdisp(code, OP_IMMED_ARITH, OP_EX_ADDI, val, dst_base, disp, size);
 }
 
+void add_irabs(code_info *code, int32_t val, void *dst, uint8_t size)
+{
+	x86_irabs(code, OP_IMMED_ARITH, OP_EX_ADDI, val, dst, size);
+}
+
 void add_rrdisp(code_info *code, uint8_t src, uint8_t dst_base, int32_t disp, uint8_t size)
 {
 	x86_rrdisp_sizedir(code, OP_ADD, src, dst_base, disp, size, 0);
@@ -958,6 +1012,11 @@ void adc_irdisp(code_info *code, int32_t val, uint8_t dst_base, int32_t disp, ui
 	x86_irdisp(code, OP_IMMED_ARITH, OP_EX_ADCI, val, dst_base, disp, size);
 }
 
+void adc_irabs(code_info *code, int32_t val, void *dst, uint8_t size)
+{
+	x86_irabs(code, OP_IMMED_ARITH, OP_EX_ADCI, val, dst, size);
+}
+
 void adc_rrdisp(code_info *code, uint8_t src, uint8_t dst_base, int32_t disp, uint8_t size)
 {
 	x86_rrdisp_sizedir(code, OP_ADC, src, dst_base, disp, size, 0);
@@ -1920,12 +1979,14 @@ void jcc(code_info *code, uint8_t cc, code_ptr dest)
 	ptrdiff_t disp = dest-(out+2);
 	if (disp <= 0x7F && disp >= -0x80) {
 		*(out++) = OP_JCC | cc;
+		code_pool_log_ref(code, out, CODE_REF_REL8);
 		*(out++) = disp;
 	} else {
 		disp = dest-(out+6);
 		if (CHECK_DISP(disp)) {
 			*(out++) = PRE_2BYTE;
 			*(out++) = OP2_JCC | cc;
+			code_pool_log_ref(code, out, CODE_REF_REL32);
 			*(out++) = disp;
 			disp >>= 8;
 			*(out++) = disp;
@@ -1947,11 +2008,13 @@ void jmp(code_info *code, code_ptr dest)
 	ptrdiff_t disp = dest-(out+2);
 	if (disp <= 0x7F && disp >= -0x80) {
 		*(out++) = OP_JMP_BYTE;
+		code_pool_log_ref(code, out, CODE_REF_REL8);
 		*(out++) = disp;
 	} else {
 		disp = dest-(out+5);
 		if (CHECK_DISP(disp)) {
 			*(out++) = OP_JMP;
+			code_pool_log_ref(code, out, CODE_REF_REL32);
 			*(out++) = disp;
 			disp >>= 8;
 			*(out++) = disp;
@@ -1999,6 +2062,7 @@ void call_noalign(code_info *code, code_ptr fun)
 	ptrdiff_t disp = fun-(out+5);
 	if (CHECK_DISP(disp)) {
 		*(out++) = OP_CALL;
+		code_pool_log_ref(code, out, CODE_REF_REL32);
 		*(out++) = disp;
 		disp >>= 8;
 		*(out++) = disp;
@@ -2037,6 +2101,7 @@ void call_raxfallback(code_info *code, code_ptr fun)
 	ptrdiff_t disp = fun-(out+5);
 	if (CHECK_DISP(disp)) {
 		*(out++) = OP_CALL;
+		code_pool_log_ref(code, out, CODE_REF_REL32);
 		*(out++) = disp;
 		disp >>= 8;
 		*(out++) = disp;
@@ -2046,6 +2111,9 @@ void call_raxfallback(code_info *code, code_ptr fun)
 		*(out++) = disp;
 		code->cur = out;
 	} else {
+		//make sure the mov doesn't move to a new chunk after its location has been logged
+		check_alloc_code(code, 10);
+		code_pool_log_ref(code, code->cur, CODE_REF_ABS);
 		mov_ir(code, (int64_t)fun, RAX, SZ_PTR);
 		call_r(code, RAX);
 	}
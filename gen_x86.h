@@ -132,7 +132,9 @@ void sub_ir(code_info *code, int32_t val, uint8_t dst, uint8_t size);
 void sbb_ir(code_info *code, int32_t val, uint8_t dst, uint8_t size);
 void cmp_ir(code_info *code, int32_t val, uint8_t dst, uint8_t size);
 void add_irdisp(code_info *code, int32_t val, uint8_t dst_base, int32_t disp, uint8_t size);
+void add_irabs(code_info *code, int32_t val, void *dst, uint8_t size);
 void adc_irdisp(code_info *code, int32_t val, uint8_t dst_base, int32_t disp, uint8_t size);
+void adc_irabs(code_info *code, int32_t val, void *dst, uint8_t size);
 void or_irdisp(code_info *code, int32_t val, uint8_t dst_base, int32_t disp, uint8_t size);
 void xor_irdisp(code_info *code, int32_t val, uint8_t dst_base, int32_t disp, uint8_t size);
 void and_irdisp(code_info *code, int32_t val, uint8_t dst_base, int32_t disp, uint8_t size);
@@ -20,6 +20,7 @@
 #include "jcart.h"
 #include "config.h"
 #include "event_log.h"
+#include "bench.h"
 #define MCLKS_NTSC 53693175
 #define MCLKS_PAL  53203395
 
@@ -30,6 +31,10 @@ uint32_t MCLKS_PER_68K;
 #define Z80_INT_PULSE_MCLKS 2573 //measured value is ~171.5 Z80 clocks
 #define DEFAULT_SYNC_INTERVAL MCLKS_LINE
 #define DEFAULT_LOWPASS_CUTOFF 3390
+#define DEFAULT_REWIND_SIZE 32 //megabytes
+#define MAX_REWIND_SIZE 1024
+#define MAX_REWIND_INTERVAL 600
+#define MAX_RUNAHEAD_FRAMES 4
 
 //TODO: Figure out the exact value for this
 #define LINES_NTSC 262
@@ -41,6 +46,13 @@ uint32_t MCLKS_PER_68K;
 #define MAX_SOUND_CYCLES 100000	
 #endif
 
+//My refresh emulation isn't currently good enough and causes more problems than it solves
+#define REFRESH_EMULATION
+#ifdef REFRESH_EMULATION
+#define REFRESH_INTERVAL 128
+#define REFRESH_DELAY 2
+#endif
+
 #ifdef NEW_CORE
 #define Z80_CYCLE cycles
 #define Z80_OPTS opts
@@ -107,14 +119,25 @@ void genesis_serialize(genesis_context *gen, serialize_buffer *buf, uint32_t m68
 	}
 }
 
+//the other components are run from inside the 68K's memory handlers and their time is subtracted
+//from this, so the 68K's time is the core itself plus the sync bookkeeping in those handlers
+static void run_68k(genesis_context *gen)
+{
+	BENCH_ENTER(BENCH_68K);
+	resume_68k(gen->m68k);
+	BENCH_EXIT();
+}
+
 static uint8_t *serialize(system_header *sys, size_t *size_out)
 {
 	genesis_context *gen = (genesis_context *)sys;
 	uint32_t address;
 	if (gen->m68k->resume_pc) {
+		gen->serialize_tmp = NULL;
+		gen->serialize_size = 0;
 		gen->m68k->target_cycle = gen->m68k->current_cycle;
 		gen->header.save_state = SERIALIZE_SLOT+1;
-		resume_68k(gen->m68k);
+		run_68k(gen);
 		if (size_out) {
 			*size_out = gen->serialize_size;
 		}
@@ -139,8 +162,34 @@ static void ram_deserialize(deserialize_buffer *buf, void *vgen)
 	if (ram_size > RAM_WORDS) {
 		fatal_error("State has a RAM size of %d bytes", ram_size * 2);
 	}
-	load_buffer16(buf, gen->work_ram, ram_size);
-	m68k_invalidate_code_range(gen->m68k, 0xE00000, 0x1000000);
+	if ((buf->size - buf->cur_pos) < ram_size * sizeof(uint16_t)) {
+		fatal_error("Failed to load required buffer of size %d\n", ram_size);
+	}
+	//only retranslate code in the parts of RAM that actually changed, states are often
+	//loaded over a running game with mostly the same RAM contents
+	uint8_t const *src = buf->data + buf->cur_pos;
+	uint32_t changed_start = 0;
+	uint8_t changed = 0;
+	for (uint32_t i = 0; i < ram_size; i++)
+	{
+		uint16_t value = src[i*2] << 8 | src[i*2 + 1];
+		if (value != gen->work_ram[i]) {
+			gen->work_ram[i] = value;
+			if (!changed) {
+				changed_start = i;
+				changed = 1;
+			}
+		} else if (changed) {
+			m68k_invalidate_code_range(gen->m68k, 0xE00000 + changed_start * 2, 0xE00000 + i * 2);
+			changed = 0;
+		}
+	}
+	if (changed) {
+		//end is exclusive and would alias back to the start of RAM, instructions are word aligned
+		//so stopping one byte short still covers the last word
+		m68k_invalidate_code_range(gen->m68k, 0xE00000 + changed_start * 2, 0xE00000 + ram_size * 2 - 1);
+	}
+	buf->cur_pos += ram_size * sizeof(uint16_t);
 }
 
 static void zram_deserialize(deserialize_buffer *buf, void *vgen)
@@ -150,18 +199,44 @@ static void zram_deserialize(deserialize_buffer *buf, void *vgen)
 	if (ram_size > Z80_RAM_BYTES) {
 		fatal_error("State has a Z80 RAM size of %d bytes", ram_size);
 	}
-	load_buffer8(buf, gen->zram, ram_size);
-	z80_invalidate_code_range(gen->z80, 0, 0x4000);
+	if ((buf->size - buf->cur_pos) < ram_size) {
+		fatal_error("Failed to load required buffer of size %d", ram_size);
+	}
+	uint8_t const *src = buf->data + buf->cur_pos;
+	uint32_t changed_start = 0;
+	uint8_t changed = 0;
+	for (uint32_t i = 0; i < ram_size; i++)
+	{
+		if (src[i] != gen->zram[i]) {
+			gen->zram[i] = src[i];
+			if (!changed) {
+				changed_start = i;
+				changed = 1;
+			}
+		} else if (changed) {
+			z80_invalidate_code_range(gen->z80, changed_start, i);
+			changed = 0;
+		}
+	}
+	if (changed) {
+		//end is exclusive and would alias back to the start of RAM so the last byte is handled separately
+		z80_invalidate_code_range(gen->z80, changed_start, ram_size - 1);
+		z80_handle_code_write(ram_size - 1, gen->z80);
+	}
+	buf->cur_pos += ram_size;
 }
 
 static void update_z80_bank_pointer(genesis_context *gen)
 {
+	uint8_t *old_pointer = gen->z80->mem_pointers[1];
 	if (gen->z80_bank_reg < 0x140) {
 		gen->z80->mem_pointers[1] = get_native_pointer(gen->z80_bank_reg << 15, (void **)gen->m68k->mem_pointers, &gen->m68k->options->gen);
 	} else {
 		gen->z80->mem_pointers[1] = NULL;
 	}
-	z80_invalidate_code_range(gen->z80, 0x8000, 0xFFFF);
+	if (gen->z80->mem_pointers[1] != old_pointer) {
+		z80_invalidate_code_range(gen->z80, 0x8000, 0xFFFF);
+	}
 }
 
 static void bus_arbiter_deserialize(deserialize_buffer *buf, void *vgen)
@@ -193,10 +268,42 @@ void genesis_deserialize(deserialize_buffer *buf, genesis_context *gen)
 	}
 	update_z80_bank_pointer(gen);
 	adjust_int_cycle(gen->m68k, gen->vdp);
+#ifdef REFRESH_EMULATION
+	//cycle counter may have moved backwards, don't count the difference as elapsed time
+	gen->last_sync_cycle = gen->m68k->current_cycle;
+#endif
 	free(buf->handlers);
 	buf->handlers = NULL;
 }
 
+//Same as serialize, but writes directly into a caller provided buffer
+//returns the size of the serialized state or 0 if it didn't fit
+static size_t serialize_into(system_header *sys, uint8_t *data, size_t size)
+{
+	genesis_context *gen = (genesis_context *)sys;
+	if (gen->m68k->resume_pc) {
+		gen->serialize_tmp = data;
+		gen->serialize_fixed_size = size;
+		//stays 0 if the 68K returns before the save happens
+		gen->serialize_size = 0;
+		gen->m68k->target_cycle = gen->m68k->current_cycle;
+		gen->header.save_state = SERIALIZE_SLOT+1;
+		run_68k(gen);
+		size_t saved = gen->serialize_size;
+		gen->serialize_tmp = NULL;
+		gen->serialize_size = 0;
+		gen->serialize_fixed_size = 0;
+		return saved;
+	} else {
+		serialize_buffer state;
+		init_serialize_fixed(&state, data, size);
+		uint32_t address = read_word(4, (void **)gen->m68k->mem_pointers, &gen->m68k->options->gen, gen->m68k) << 16;
+		address |= read_word(6, (void **)gen->m68k->mem_pointers, &gen->m68k->options->gen, gen->m68k);
+		genesis_serialize(gen, &state, address, 1);
+		return state.overflow ? 0 : state.size;
+	}
+}
+
 #include "m68k_internal.h" //needed for get_native_address_trans, should be eliminated once handling of PC is cleaned up
 static void deserialize(system_header *sys, uint8_t *data, size_t size)
 {
@@ -204,13 +311,15 @@ static void deserialize(system_header *sys, uint8_t *data, size_t size)
 	deserialize_buffer buffer;
 	init_deserialize(&buffer, data, size);
 	genesis_deserialize(&buffer, gen);
+	//frame counter comes from the state, don't treat the change as the end of a frame
+	gen->last_frame = gen->vdp->frame;
 	//HACK: Fix this once PC/IR is represented in a better way in 68K core
 	gen->m68k->resume_pc = get_native_address_trans(gen->m68k, gen->m68k->last_prefetch_address);
 }
 
-uint16_t read_dma_value(uint32_t address)
+uint16_t read_dma_value(system_header *system, uint32_t address)
 {
-	genesis_context *genesis = (genesis_context *)current_system;
+	genesis_context *genesis = (genesis_context *)system;
 	//TODO: Figure out what happens when you try to DMA from weird adresses like IO or banked Z80 area
 	if ((address >= 0xA00000 && address < 0xB00000) || (address >= 0xC00000 && address <= 0xE00000)) {
 		return 0;
@@ -223,7 +332,7 @@ uint16_t read_dma_value(uint32_t address)
 static uint16_t get_open_bus_value(system_header *system)
 {
 	genesis_context *genesis = (genesis_context *)system;
-	return read_dma_value(genesis->m68k->last_prefetch_address/2);
+	return read_dma_value(system, genesis->m68k->last_prefetch_address/2);
 }
 
 static void adjust_int_cycle(m68k_context * context, vdp_context * v_context)
@@ -324,7 +433,9 @@ static void sync_z80(z80_context * z_context, uint32_t mclks)
 			z80_next_int_pulse(z_context);
 		}
 #endif
+		BENCH_ENTER(BENCH_Z80);
 		z80_run(z_context, mclks);
+		BENCH_EXIT();
 	} else
 #endif
 	{
@@ -338,29 +449,74 @@ static void sync_sound(genesis_context * gen, uint32_t target)
 	while (target > gen->psg->cycles && target - gen->psg->cycles > MAX_SOUND_CYCLES) {
 		uint32_t cur_target = gen->psg->cycles + MAX_SOUND_CYCLES;
 		//printf("Running PSG to cycle %d\n", cur_target);
+		BENCH_ENTER(BENCH_PSG);
 		psg_run(gen->psg, cur_target);
+		BENCH_EXIT();
 		//printf("Running YM-2612 to cycle %d\n", cur_target);
+		BENCH_ENTER(BENCH_YM);
 		ym_run(gen->ym, cur_target);
+		BENCH_EXIT();
 	}
+	BENCH_ENTER(BENCH_PSG);
 	psg_run(gen->psg, target);
+	BENCH_EXIT();
+	BENCH_ENTER(BENCH_YM);
 	ym_run(gen->ym, target);
+	BENCH_EXIT();
 
 	//printf("Target: %d, YM bufferpos: %d, PSG bufferpos: %d\n", target, gen->ym->buffer_pos, gen->psg->buffer_pos * 2);
 }
 
-//My refresh emulation isn't currently good enough and causes more problems than it solves
-#define REFRESH_EMULATION
-#ifdef REFRESH_EMULATION
-#define REFRESH_INTERVAL 128
-#define REFRESH_DELAY 2
-uint32_t last_sync_cycle;
-uint32_t refresh_counter;
-#endif
-
 #include <limits.h>
 #define ADJUST_BUFFER (8*MCLKS_LINE*313)
 #define MAX_NO_ADJUST (UINT_MAX-ADJUST_BUFFER)
 
+//Z80 state can only be serialized at an instruction boundary or when it's not running
+static uint8_t z80_can_serialize(z80_context *z_context)
+{
+#ifdef NEW_CORE
+	return 1;
+#else
+	return z_context->pc || !z_context->native_pc || z_context->reset || !z_context->busreq;
+#endif
+}
+
+static void z80_advance_to_instruction(z80_context *z_context)
+{
+#ifndef NEW_CORE
+	if (z_context->native_pc && !z_context->reset) {
+		//advance Z80 core to the start of an instruction
+		while (!z_context->pc)
+		{
+			sync_z80(z_context, z_context->current_cycle + MCLKS_PER_Z80);
+		}
+	}
+#endif
+}
+
+//Only the last frame of a run-ahead sequence is displayed and in turbo mode
+//frames beyond what the display could show are dropped as well
+static void update_skip_output(genesis_context *gen)
+{
+	gen->vdp->skip_output = gen->runahead_phase != gen->runahead_frames || gen->skip_frame;
+}
+
+//Called at the end of each real frame to decide whether the next one will be displayed
+static void advance_frameskip(genesis_context *gen)
+{
+	if (!gen->frameskip || gen->speed_percent <= 100) {
+		gen->skip_frame = 0;
+		return;
+	}
+	gen->frameskip_credit += 100;
+	if (gen->frameskip_credit >= gen->speed_percent) {
+		gen->frameskip_credit -= gen->speed_percent;
+		gen->skip_frame = 0;
+	} else {
+		gen->skip_frame = 1;
+	}
+}
+
 m68k_context * sync_components(m68k_context * context, uint32_t address)
 {
 	genesis_context * gen = context->system;
@@ -368,17 +524,19 @@ m68k_context * sync_components(m68k_context * context, uint32_t address)
 	z80_context * z_context = gen->z80;
 #ifdef REFRESH_EMULATION
 	//lame estimation of refresh cycle delay
-	refresh_counter += context->current_cycle - last_sync_cycle;
+	gen->refresh_counter += context->current_cycle - gen->last_sync_cycle;
 	if (!gen->bus_busy) {
-		context->current_cycle += REFRESH_DELAY * MCLKS_PER_68K * (refresh_counter / (MCLKS_PER_68K * REFRESH_INTERVAL));
+		context->current_cycle += REFRESH_DELAY * MCLKS_PER_68K * (gen->refresh_counter / (MCLKS_PER_68K * REFRESH_INTERVAL));
 	}
-	refresh_counter = refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
+	gen->refresh_counter = gen->refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
 #endif
 
 	uint32_t mclks = context->current_cycle;
 	sync_z80(z_context, mclks);
 	sync_sound(gen, mclks);
+	BENCH_ENTER(BENCH_VDP);
 	vdp_run_context(v_context, mclks);
+	BENCH_EXIT();
 	if (mclks >= gen->reset_cycle) {
 		gen->reset_requested = 1;
 		context->should_return = 1;
@@ -393,9 +551,50 @@ m68k_context * sync_components(m68k_context * context, uint32_t address)
 		if(exit_after){
 			--exit_after;
 			if (!exit_after) {
+				if (bench_active) {
+					bench_report();
+				}
 				exit(0);
 			}
 		}
+		if (!gen->runahead_phase) {
+			advance_frameskip(gen);
+			update_skip_output(gen);
+		}
+		if (gen->runahead_frames) {
+			if (gen->runahead_phase == gen->runahead_frames) {
+				//the displayed frame is done, go back to the end of the last real frame
+				//if something else already requested a return, the restored state is resumed on the next resume_context
+				gen->runahead_resume = !context->should_return;
+				gen->runahead_restore = 1;
+				context->should_return = 1;
+			} else if (gen->runahead_phase) {
+				gen->runahead_phase++;
+				update_skip_output(gen);
+			} else {
+				gen->runahead_capture = 1;
+			}
+		}
+		if (gen->rewind && !gen->runahead_phase) {
+			if (gen->header.rewinding) {
+				if (!context->should_return) {
+					//don't clobber an exit request that came in during this frame
+					gen->rewind_restore = 1;
+					context->should_return = 1;
+				}
+			} else if (++gen->rewind_frames >= gen->rewind_interval) {
+				gen->rewind_frames = 0;
+				gen->rewind_capture = 1;
+			}
+		}
+#ifndef NEW_CORE
+		if (m68k_code_flush_pending(context)) {
+			//translated code can only be thrown away once the 68K has returned to C
+			gen->cache_flush_resume = !context->should_return;
+			gen->cache_flush = 1;
+			context->should_return = 1;
+		}
+#endif
 		if (context->current_cycle > MAX_NO_ADJUST) {
 			uint32_t deduction = mclks - ADJUST_BUFFER;
 			vdp_adjust_cycles(v_context, deduction);
@@ -430,7 +629,7 @@ m68k_context * sync_components(m68k_context * context, uint32_t address)
 		vdp_int_ack(v_context);
 		context->int_ack = 0;
 	}
-	if (!address && (gen->header.enter_debugger || gen->header.save_state)) {
+	if (!address && (gen->header.enter_debugger || gen->header.save_state || gen->rewind_capture || gen->runahead_capture)) {
 		context->sync_cycle = context->current_cycle + 1;
 	}
 	adjust_int_cycle(context, v_context);
@@ -442,30 +641,45 @@ m68k_context * sync_components(m68k_context * context, uint32_t address)
 			gen->header.enter_debugger = 0;
 			debugger(context, address);
 		}
-#ifdef NEW_CORE
-		if (gen->header.save_state) {
-#else
-		if (gen->header.save_state && (z_context->pc || !z_context->native_pc || z_context->reset || !z_context->busreq)) {
-#endif
+		if (gen->rewind_capture && z80_can_serialize(z_context)) {
+			gen->rewind_capture = 0;
+			z80_advance_to_instruction(z_context);
+			gen->rewind_state.size = 0;
+			gen->rewind_state.current_section_start = 0;
+			genesis_serialize(gen, &gen->rewind_state, address, 1);
+			rewind_push(gen->rewind, gen->rewind_state.data, gen->rewind_state.size);
+		} else if (gen->rewind_capture) {
+			context->sync_cycle = context->current_cycle + 1;
+		}
+		if (gen->runahead_capture && z80_can_serialize(z_context)) {
+			gen->runahead_capture = 0;
+			z80_advance_to_instruction(z_context);
+			gen->runahead_state.size = 0;
+			gen->runahead_state.current_section_start = 0;
+			genesis_serialize(gen, &gen->runahead_state, address, 1);
+			//everything up to the displayed frame is speculative, so its audio should never be heard
+			gen->runahead_phase = 1;
+			update_skip_output(gen);
+			render_audio_suppress(1);
+		} else if (gen->runahead_capture) {
+			context->sync_cycle = context->current_cycle + 1;
+		}
+		if (gen->header.save_state && z80_can_serialize(z_context)) {
 			uint8_t slot = gen->header.save_state - 1;
 			gen->header.save_state = 0;
-#ifndef NEW_CORE
-			if (z_context->native_pc && !z_context->reset) {
-				//advance Z80 core to the start of an instruction
-				while (!z_context->pc)
-				{
-					sync_z80(z_context, z_context->current_cycle + MCLKS_PER_Z80);
-				}
-			}
-#endif
+			z80_advance_to_instruction(z_context);
 			char *save_path = slot >= SERIALIZE_SLOT ? NULL : get_slot_name(&gen->header, slot, use_native_states ? "state" : "gst");
 			if (use_native_states || slot >= SERIALIZE_SLOT) {
 				serialize_buffer state;
-				init_serialize(&state);
+				if (slot == SERIALIZE_SLOT && gen->serialize_fixed_size) {
+					init_serialize_fixed(&state, gen->serialize_tmp, gen->serialize_fixed_size);
+				} else {
+					init_serialize(&state);
+				}
 				genesis_serialize(gen, &state, address, slot != EVENTLOG_SLOT);
 				if (slot == SERIALIZE_SLOT) {
 					gen->serialize_tmp = state.data;
-					gen->serialize_size = state.size;
+					gen->serialize_size = state.overflow ? 0 : state.size;
 					context->sync_cycle = context->current_cycle;
 					context->should_return = 1;
 				} else if (slot == EVENTLOG_SLOT) {
@@ -486,7 +700,7 @@ m68k_context * sync_components(m68k_context * context, uint32_t address)
 		}
 	}
 #ifdef REFRESH_EMULATION
-	last_sync_cycle = context->current_cycle;
+	gen->last_sync_cycle = context->current_cycle;
 #endif
 	return context;
 }
@@ -498,15 +712,15 @@ static m68k_context * vdp_port_write(uint32_t vdp_port, m68k_context * context,
 	}
 	vdp_port &= 0x1F;
 	//printf("vdp_port write: %X, value: %X, cycle: %d\n", vdp_port, value, context->current_cycle);
+	genesis_context * gen = context->system;
 #ifdef REFRESH_EMULATION
 	//do refresh check here so we can avoid adding a penalty for a refresh that happens during a VDP access
-	refresh_counter += context->current_cycle - 4*MCLKS_PER_68K - last_sync_cycle;
-	context->current_cycle += REFRESH_DELAY * MCLKS_PER_68K * (refresh_counter / (MCLKS_PER_68K * REFRESH_INTERVAL));
-	refresh_counter = refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
-	last_sync_cycle = context->current_cycle;
+	gen->refresh_counter += context->current_cycle - 4*MCLKS_PER_68K - gen->last_sync_cycle;
+	context->current_cycle += REFRESH_DELAY * MCLKS_PER_68K * (gen->refresh_counter / (MCLKS_PER_68K * REFRESH_INTERVAL));
+	gen->refresh_counter = gen->refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
+	gen->last_sync_cycle = context->current_cycle;
 #endif
 	sync_components(context, 0);
-	genesis_context * gen = context->system;
 	vdp_context *v_context = gen->vdp;
 	uint32_t before_cycle = v_context->cycles;
 	if (vdp_port < 0x10) {
@@ -514,7 +728,9 @@ static m68k_context * vdp_port_write(uint32_t vdp_port, m68k_context * context,
 		if (vdp_port < 4) {
 			while (vdp_data_port_write(v_context, value) < 0) {
 				while(v_context->flags & FLAG_DMA_RUN) {
+					BENCH_ENTER(BENCH_VDP);
 					vdp_run_dma_done(v_context, gen->frame_end);
+					BENCH_EXIT();
 					if (v_context->cycles >= gen->frame_end) {
 						uint32_t cycle_diff = v_context->cycles - context->current_cycle;
 						uint32_t m68k_cycle_diff = (cycle_diff / MCLKS_PER_68K) * MCLKS_PER_68K;
@@ -536,7 +752,9 @@ static m68k_context * vdp_port_write(uint32_t vdp_port, m68k_context * context,
 			if (blocked) {
 				while (blocked) {
 					while(v_context->flags & FLAG_DMA_RUN) {
+						BENCH_ENTER(BENCH_VDP);
 						vdp_run_dma_done(v_context, gen->frame_end);
+						BENCH_EXIT();
 						if (v_context->cycles >= gen->frame_end) {
 							uint32_t cycle_diff = v_context->cycles - context->current_cycle;
 							uint32_t m68k_cycle_diff = (cycle_diff / MCLKS_PER_68K) * MCLKS_PER_68K;
@@ -583,16 +801,16 @@ static m68k_context * vdp_port_write(uint32_t vdp_port, m68k_context * context,
 		vdp_test_port_write(gen->vdp, value);
 	}
 #ifdef REFRESH_EMULATION
-	last_sync_cycle -= 4;
+	gen->last_sync_cycle -= 4;
 	//refresh may have happened while we were waiting on the VDP,
 	//so advance refresh_counter but don't add any delays
 	if (vdp_port >= 4 && vdp_port < 8 && v_context->cycles != before_cycle) {
-		refresh_counter = 0;
+		gen->refresh_counter = 0;
 	} else {
-		refresh_counter += (context->current_cycle - last_sync_cycle);
-		refresh_counter = refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
+		gen->refresh_counter += (context->current_cycle - gen->last_sync_cycle);
+		gen->refresh_counter = gen->refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
 	}
-	last_sync_cycle = context->current_cycle;
+	gen->last_sync_cycle = context->current_cycle;
 #endif
 	return context;
 }
@@ -637,14 +855,14 @@ static uint16_t vdp_port_read(uint32_t vdp_port, m68k_context * context)
 	}
 	vdp_port &= 0x1F;
 	uint16_t value;
+	genesis_context *gen = context->system;
 #ifdef REFRESH_EMULATION
 	//do refresh check here so we can avoid adding a penalty for a refresh that happens during a VDP access
-	refresh_counter += context->current_cycle - 4*MCLKS_PER_68K - last_sync_cycle;
-	context->current_cycle += REFRESH_DELAY * MCLKS_PER_68K * (refresh_counter / (MCLKS_PER_68K * REFRESH_INTERVAL));
-	refresh_counter = refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
-	last_sync_cycle = context->current_cycle;
+	gen->refresh_counter += context->current_cycle - 4*MCLKS_PER_68K - gen->last_sync_cycle;
+	context->current_cycle += REFRESH_DELAY * MCLKS_PER_68K * (gen->refresh_counter / (MCLKS_PER_68K * REFRESH_INTERVAL));
+	gen->refresh_counter = gen->refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
+	gen->last_sync_cycle = context->current_cycle;
 #endif
-	genesis_context *gen = context->system;
 	vdp_context * v_context = gen->vdp;
 	if (vdp_port < 0x10) {
 		if (vdp_port < 4) {
@@ -674,12 +892,12 @@ static uint16_t vdp_port_read(uint32_t vdp_port, m68k_context * context)
 		value = get_open_bus_value(&gen->header);
 	}
 #ifdef REFRESH_EMULATION
-	last_sync_cycle -= 4;
+	gen->last_sync_cycle -= 4;
 	//refresh may have happened while we were waiting on the VDP,
 	//so advance refresh_counter but don't add any delays
-	refresh_counter += (context->current_cycle - last_sync_cycle);
-	refresh_counter = refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
-	last_sync_cycle = context->current_cycle;
+	gen->refresh_counter += (context->current_cycle - gen->last_sync_cycle);
+	gen->refresh_counter = gen->refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
+	gen->last_sync_cycle = context->current_cycle;
 #endif
 	return value;
 }
@@ -1164,6 +1382,8 @@ static void set_speed_percent(system_header * system, uint32_t percent)
 	genesis_context *context = (genesis_context *)system;
 	uint32_t old_clock = context->master_clock;
 	context->master_clock = ((uint64_t)context->normal_clock * (uint64_t)percent) / 100;
+	context->speed_percent = percent;
+	context->frameskip_credit = 0;
 	while (context->ym->current_cycle != context->psg->cycles) {
 		sync_sound(context, context->psg->cycles + MCLKS_PER_PSG);
 	}
@@ -1197,6 +1417,7 @@ void set_region(genesis_context *gen, rom_info *info, uint8_t region)
 		gen->soft_flush_cycles = MCLKS_LINE * 313 / 3 + 2;
 	}
 	gen->master_clock = gen->normal_clock;
+	gen->speed_percent = 100;
 }
 
 static uint8_t load_state(system_header *system, uint8_t slot)
@@ -1235,23 +1456,88 @@ done:
 	return ret;
 }
 
+//Drops any speculative frames in progress, the next frame will be a real one
+static void runahead_reset(genesis_context *gen)
+{
+	gen->runahead_phase = 0;
+	gen->runahead_capture = gen->runahead_restore = gen->runahead_resume = 0;
+	update_skip_output(gen);
+	render_audio_suppress(0);
+}
+
+static void runahead_restore(genesis_context *gen)
+{
+	deserialize(&gen->header, gen->runahead_state.data, gen->runahead_state.size);
+	runahead_reset(gen);
+}
+
+static void set_runahead(system_header *system, uint32_t frames)
+{
+	genesis_context *gen = (genesis_context *)system;
+	if (frames > MAX_RUNAHEAD_FRAMES) {
+		frames = MAX_RUNAHEAD_FRAMES;
+	}
+	if (gen->runahead_phase) {
+		runahead_restore(gen);
+	}
+	if (frames && !gen->runahead_state.data) {
+		init_serialize(&gen->runahead_state);
+	}
+	gen->runahead_frames = frames;
+	runahead_reset(gen);
+}
+
 static void handle_reset_requests(genesis_context *gen)
 {
-	while (gen->reset_requested || gen->header.delayed_load_slot)
+	while (gen->reset_requested || gen->header.delayed_load_slot || gen->rewind_restore || gen->runahead_restore || gen->cache_flush)
 	{
+		if (gen->cache_flush) {
+			gen->cache_flush = 0;
+			//resume_68k takes care of the actual flush
+			if (gen->cache_flush_resume) {
+				run_68k(gen);
+			}
+			continue;
+		}
+		if (gen->runahead_restore) {
+			uint8_t resume = gen->runahead_resume;
+			runahead_restore(gen);
+			if (resume) {
+				run_68k(gen);
+			}
+			continue;
+		}
 		if (gen->reset_requested) {
 			gen->reset_requested = 0;
+			runahead_reset(gen);
 			gen->m68k->should_return = 0;
 			z80_assert_reset(gen->z80, gen->m68k->current_cycle);
 			z80_clear_busreq(gen->z80, gen->m68k->current_cycle);
 			ym_reset(gen->ym);
 			//Is there any sort of VDP reset?
+			BENCH_ENTER(BENCH_68K);
 			m68k_reset(gen->m68k);
+			BENCH_EXIT();
 		}
 		if (gen->header.delayed_load_slot) {
+			runahead_reset(gen);
 			load_state(&gen->header, gen->header.delayed_load_slot - 1);
 			gen->header.delayed_load_slot = 0;
-			resume_68k(gen->m68k);
+			run_68k(gen);
+		}
+		if (gen->rewind_restore) {
+			gen->rewind_restore = 0;
+			size_t size;
+			uint8_t *state = rewind_pop(gen->rewind, &size);
+			if (state) {
+				if (!rewind_count(gen->rewind)) {
+					//keep the oldest snapshot around so holding rewind at the end of history stays put
+					rewind_push(gen->rewind, state, size);
+				}
+				deserialize(&gen->header, state, size);
+			}
+			runahead_reset(gen);
+			run_68k(gen);
 		}
 	}
 	if (gen->header.force_release || render_should_release_on_exit()) {
@@ -1286,14 +1572,18 @@ static void start_genesis(system_header *system, char *statefile)
 			insert_breakpoint(gen->m68k, pc, gen->header.debugger_type == DEBUGGER_NATIVE ? debugger : gdb_debug_enter);
 		}
 		adjust_int_cycle(gen->m68k, gen->vdp);
+		BENCH_ENTER(BENCH_68K);
 		start_68k_context(gen->m68k, pc);
+		BENCH_EXIT();
 	} else {
 		if (gen->header.enter_debugger) {
 			gen->header.enter_debugger = 0;
 			uint32_t address = gen->cart[2] << 16 | gen->cart[3];
 			insert_breakpoint(gen->m68k, address, gen->header.debugger_type == DEBUGGER_NATIVE ? debugger : gdb_debug_enter);
 		}
+		BENCH_ENTER(BENCH_68K);
 		m68k_reset(gen->m68k);
+		BENCH_EXIT();
 	}
 	handle_reset_requests(gen);
 	return;
@@ -1310,7 +1600,7 @@ static void resume_genesis(system_header *system)
 		render_resume_source(gen->ym->audio);
 		render_resume_source(gen->psg->audio);
 	}
-	resume_68k(gen->m68k);
+	run_68k(gen);
 	handle_reset_requests(gen);
 }
 
@@ -1327,9 +1617,47 @@ static void request_exit(system_header *system)
 	gen->m68k->should_return = 1;
 }
 
+#ifndef NEW_CORE
+//translated ROM code is shared by everything that uses the same ROM so it's keyed by hash rather than save dir
+static char *m68k_tcache_path(rom_info *info)
+{
+	char const *userdata = get_userdata_dir();
+	if (!userdata) {
+		return NULL;
+	}
+	uint8_t hex[41];
+	bin_to_hex(hex, info->sha1, sizeof(info->sha1));
+	char *dir = alloc_concat(userdata, PATH_SEP "blastem" PATH_SEP "tcache");
+	if (!ensure_dir_exists(dir)) {
+		warning("Failed to create translation cache directory %s\n", dir);
+		free(dir);
+		return NULL;
+	}
+	char const *parts[] = {dir, PATH_SEP, (char *)hex, ".m68k"};
+	char *path = alloc_concat_m(4, parts);
+	free(dir);
+	return path;
+}
+#endif
+
+static void save_m68k_tcache(genesis_context *gen)
+{
+#ifndef NEW_CORE
+	if (gen->m68k->options->tcache) {
+		char *path = m68k_tcache_path(&gen->header.info);
+		if (path) {
+			m68k_tcache_save(gen->m68k, path);
+			free(path);
+		}
+	}
+#endif
+}
+
 static void persist_save(system_header *system)
 {
 	genesis_context *gen = (genesis_context *)system;
+	//the standalone frontend exits without calling free_genesis
+	save_m68k_tcache(gen);
 	if (gen->save_type == SAVE_NONE) {
 		return;
 	}
@@ -1380,13 +1708,16 @@ static void soft_reset(system_header *system)
 static void free_genesis(system_header *system)
 {
 	genesis_context *gen = (genesis_context *)system;
+	save_m68k_tcache(gen);
 	vdp_free(gen->vdp);
 	memmap_chunk *map = (memmap_chunk *)gen->m68k->options->gen.memmap;
 	m68k_options_free(gen->m68k->options);
 	free(gen->cart);
 	free(gen->m68k);
 	free(gen->work_ram);
+	memmap_chunk *zmap = (memmap_chunk *)gen->z80->Z80_OPTS->gen.memmap;
 	z80_options_free(gen->z80->Z80_OPTS);
+	free(zmap);
 	free(gen->z80);
 	free(gen->zram);
 	ym_free(gen->ym);
@@ -1394,6 +1725,11 @@ static void free_genesis(system_header *system)
 	free(gen->header.save_dir);
 	free_rom_info(&gen->header.info);
 	free(gen->lock_on);
+	free(gen->runahead_state.data);
+	if (gen->rewind) {
+		rewind_free(gen->rewind);
+		free(gen->rewind_state.data);
+	}
 	free(gen);
 }
 
@@ -1461,6 +1797,70 @@ static void set_audio_config(genesis_context *gen)
 	
 	char *config_dac = tern_find_path_default(config, "audio\0fm_dac\0", (tern_val){.ptrval="zero_offset"}, TVAL_PTR).ptrval;
 	ym_enable_zero_offset(gen->ym, !strcmp(config_dac, "zero_offset"));
+	
+	char *config_block = tern_find_path_default(config, "audio\0fm_block_synthesis\0", (tern_val){.ptrval="on"}, TVAL_PTR).ptrval;
+	ym_enable_block_synthesis(gen->ym, !strcmp(config_block, "on"));
+}
+
+//Reads an integer config value, values outside of min-max are clamped to that range
+static uint32_t get_config_int_range(char *path, char *name, uint32_t def, uint32_t min, uint32_t max)
+{
+	char *value_str = tern_find_path(config, path, TVAL_PTR).ptrval;
+	if (!value_str) {
+		return def;
+	}
+	char *end;
+	long value = strtol(value_str, &end, 10);
+	if (end == value_str || *end) {
+		warning("Invalid value %s for %s, using %d\n", value_str, name, def);
+		return def;
+	}
+	if (value < (long)min || value > (long)max) {
+		uint32_t clamped = value < (long)min ? min : max;
+		warning("Value %s for %s is out of range, must be between %d and %d, using %d\n", value_str, name, min, max, clamped);
+		return clamped;
+	}
+	return value;
+}
+
+static void set_rewind_config(genesis_context *gen)
+{
+	uint32_t size = 0;
+	if (!strcmp(tern_find_path_default(config, "system\0rewind\0", (tern_val){.ptrval = "off"}, TVAL_PTR).ptrval, "on")) {
+		size = get_config_int_range("system\0rewind_size\0", "system.rewind_size", DEFAULT_REWIND_SIZE, 1, MAX_REWIND_SIZE);
+	}
+	gen->rewind_interval = get_config_int_range("system\0rewind_interval\0", "system.rewind_interval", 1, 1, MAX_REWIND_INTERVAL);
+	if (size == gen->rewind_size) {
+		return;
+	}
+	if (gen->rewind) {
+		rewind_free(gen->rewind);
+		free(gen->rewind_state.data);
+		gen->rewind = NULL;
+	}
+	gen->rewind_capture = gen->rewind_restore = 0;
+	gen->rewind_size = size;
+	if (size) {
+		gen->rewind = rewind_alloc(size * 1024 * 1024);
+		init_serialize(&gen->rewind_state);
+	}
+}
+
+static void set_runahead_config(genesis_context *gen)
+{
+	uint32_t frames = get_config_int_range("system\0runahead\0", "system.runahead", 0, 0, MAX_RUNAHEAD_FRAMES);
+	if (frames != gen->runahead_frames) {
+		set_runahead(&gen->header, frames);
+	}
+}
+
+static void set_frameskip_config(genesis_context *gen)
+{
+	gen->frameskip = !strcmp(tern_find_path_default(config, "system\0frameskip\0", (tern_val){.ptrval = "on"}, TVAL_PTR).ptrval, "on");
+	if (!gen->frameskip && gen->skip_frame) {
+		gen->skip_frame = 0;
+		update_skip_output(gen);
+	}
 }
 
 static void config_updated(system_header *system)
@@ -1468,6 +1868,9 @@ static void config_updated(system_header *system)
 	genesis_context *gen = (genesis_context *)system;
 	setup_io_devices(config, &system->info, &gen->io);
 	set_audio_config(gen);
+	set_rewind_config(gen);
+	set_runahead_config(gen);
+	set_frameskip_config(gen);
 }
 
 static void start_vgm_log(system_header *system, char *filename)
@@ -1505,6 +1908,7 @@ genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on
 	};
 	genesis_context *gen = calloc(1, sizeof(genesis_context));
 	gen->header.set_speed_percent = set_speed_percent;
+	gen->header.set_runahead = set_runahead;
 	gen->header.start_context = start_genesis;
 	gen->header.resume_context = resume_genesis;
 	gen->header.load_save = load_save;
@@ -1525,6 +1929,7 @@ genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on
 	gen->header.keyboard_up = keyboard_up;
 	gen->header.config_updated = config_updated;
 	gen->header.serialize = serialize;
+	gen->header.serialize_into = serialize_into;
 	gen->header.deserialize = deserialize;
 	gen->header.start_vgm_log = start_vgm_log;
 	gen->header.stop_vgm_log = stop_vgm_log;
@@ -1560,11 +1965,21 @@ genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on
 	psg_init(gen->psg, gen->master_clock, MCLKS_PER_PSG);
 	
 	set_audio_config(gen);
+	set_rewind_config(gen);
+	set_runahead_config(gen);
+	set_frameskip_config(gen);
 
-	z80_map[0].buffer = gen->zram = calloc(1, Z80_RAM_BYTES);
+	gen->zram = calloc(1, Z80_RAM_BYTES);
 #ifndef NO_Z80
+	//the Z80 options keep a pointer to the map so each system needs its own copy
+	memmap_chunk *zmap = malloc(sizeof(z80_map));
+	memcpy(zmap, z80_map, sizeof(z80_map));
+	zmap[0].buffer = gen->zram;
 	z80_options *z_opts = malloc(sizeof(z80_options));
-	init_z80_opts(z_opts, z80_map, 5, NULL, 0, MCLKS_PER_Z80, 0xFFFF);
+	init_z80_opts(z_opts, zmap, 5, NULL, 0, MCLKS_PER_Z80, 0xFFFF);
+#ifndef NEW_CORE
+	set_code_pool_limit(&z_opts->gen.code, get_code_cache_size(config));
+#endif
 	gen->z80 = init_z80_context(z_opts);
 #ifndef NEW_CORE
 	gen->z80->next_int_pulse = z80_next_int_pulse;
@@ -1609,6 +2024,9 @@ genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on
 			gen->vdp->vsram[i] = rand();
 		}
 	}
+	if (!strcmp(tern_find_path_default(config, "video\0vdp_thread\0", (tern_val){.ptrval = "off"}, TVAL_PTR).ptrval, "on")) {
+		vdp_start_worker(gen->vdp);
+	}
 	setup_io_devices(config, rom, &gen->io);
 	gen->header.has_keyboard = io_has_keyboard(&gen->io);
 
@@ -1641,6 +2059,9 @@ genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on
 
 	m68k_options *opts = malloc(sizeof(m68k_options));
 	init_m68k_opts(opts, rom->map, rom->map_chunks, MCLKS_PER_68K);
+#ifndef NEW_CORE
+	set_code_pool_limit(&opts->gen.code, get_code_cache_size(config));
+#endif
 	if (!strcmp(tern_find_ptr_default(model, "tas", "broken"), "broken")) {
 		opts->gen.flags |= M68K_OPT_BROKEN_READ_MODIFY;
 	}
@@ -1664,6 +2085,20 @@ genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on
 		}
 	}
 	gen->reset_cycle = CYCLE_NEVER;
+#ifndef NEW_CORE
+	char *tcache = tern_find_path_default(config, "system\0translation_cache\0", (tern_val){.ptrval = "off"}, TVAL_PTR).ptrval;
+	if (!strcmp(tcache, "on")) {
+		//must happen after the memory map is complete and before anything is translated
+		m68k_tcache_init(gen->m68k, rom->sha1);
+		char *path = m68k_tcache_path(rom);
+		if (path) {
+			if (m68k_tcache_load(gen->m68k, path)) {
+				debug_message("Loaded translated code from %s\n", path);
+			}
+			free(path);
+		}
+	}
+#endif
 
 	return gen;
 }
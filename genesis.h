@@ -21,6 +21,7 @@
 #include "romdb.h"
 #include "arena.h"
 #include "i2c.h"
+#include "rewind.h"
 
 typedef struct genesis_context genesis_context;
 
@@ -41,6 +42,17 @@ struct genesis_context {
 	eeprom_map      *eeprom_map;
 	uint8_t         *serialize_tmp;
 	size_t          serialize_size;
+	size_t          serialize_fixed_size;
+	rewind_buffer   *rewind;
+	serialize_buffer rewind_state;
+	uint32_t        rewind_size;
+	uint32_t        rewind_interval;
+	uint32_t        rewind_frames;
+	serialize_buffer runahead_state;
+	uint32_t        runahead_frames;
+	uint32_t        runahead_phase; //0 while running a real frame, otherwise the number of the speculative frame
+	uint32_t        speed_percent;
+	uint32_t        frameskip_credit;
 	uint32_t        num_eeprom;
 	uint32_t        save_size;
 	uint32_t        save_ram_mask;
@@ -54,6 +66,8 @@ struct genesis_context {
 	uint32_t        last_frame;
 	uint32_t        last_flush_cycle;
 	uint32_t        soft_flush_cycles;
+	uint32_t        last_sync_cycle; //68K cycle of the last refresh check
+	uint32_t        refresh_counter;
 	uint8_t         bank_regs[8];
 	uint16_t        z80_bank_reg;
 	uint16_t        tmss_lock[2];
@@ -65,6 +79,15 @@ struct genesis_context {
 	uint8_t         bus_busy;
 	uint8_t         reset_requested;
 	uint8_t         tmss;
+	uint8_t         rewind_capture;
+	uint8_t         rewind_restore;
+	uint8_t         runahead_capture;
+	uint8_t         runahead_restore;
+	uint8_t         runahead_resume;
+	uint8_t         cache_flush;
+	uint8_t         cache_flush_resume;
+	uint8_t         frameskip;
+	uint8_t         skip_frame;
 	eeprom_state    eeprom;
 	nor_state       nor;
 };
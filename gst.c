@@ -260,6 +260,7 @@ uint8_t vdp_load_gst(vdp_context * context, FILE * state_file)
 		context->vdpmem[i] = tmp_buf[i];
 		vdp_check_update_sat_byte(context, i, tmp_buf[i]);
 	}
+	vdp_worker_resync(context);
 	return 1;
 }
 
@@ -427,7 +427,6 @@ void mouse_check_ready(io_port *port, uint32_t current_cycle)
 	}
 }
 
-uint32_t last_poll_cycle;
 void io_adjust_cycles(io_port * port, uint32_t current_cycle, uint32_t deduction)
 {
 	/*uint8_t control = pad->control | 0x80;
@@ -459,10 +458,10 @@ void io_adjust_cycles(io_port * port, uint32_t current_cycle, uint32_t deduction
 			}
 		}
 	}
-	if (last_poll_cycle >= deduction) {
-		last_poll_cycle -= deduction;
+	if (port->last_poll_cycle >= deduction) {
+		port->last_poll_cycle -= deduction;
 	} else {
-		last_poll_cycle = 0;
+		port->last_poll_cycle = 0;
 	}
 }
 
@@ -766,9 +765,9 @@ uint8_t io_data_read(io_port * port, uint32_t current_cycle)
 	uint8_t th = output & 0x40;
 	uint8_t input;
 	uint8_t device_driven;
-	if (current_cycle - last_poll_cycle > MIN_POLL_INTERVAL) {
+	if (current_cycle - port->last_poll_cycle > MIN_POLL_INTERVAL) {
 		process_events();
-		last_poll_cycle = current_cycle;
+		port->last_poll_cycle = current_cycle;
 	}
 	switch (port->device_type)
 	{
@@ -62,6 +62,7 @@ typedef struct {
 	uint8_t  control;
 	uint8_t  input[3];
 	uint32_t slow_rise_start[8];
+	uint32_t last_poll_cycle;
 	uint8_t  serial_out;
 	uint8_t  serial_in;
 	uint8_t  serial_ctrl;
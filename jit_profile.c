@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jit_profile.h"
+#include "mem.h"
+#include "util.h"
+#include "tern.h"
+
+#define COUNTERS_PER_BLOCK (CODE_ALLOC_SIZE / sizeof(jit_counter))
+#define PAGE_BITS 16
+#define NUM_PAGES (1 << (24 - PAGE_BITS))
+//number of instructions listed in the report and how many of those get dis/zdis labels
+#define MAX_HOT_INSTS 1000
+#define MAX_HOT_LABELS 100
+
+struct jit_profile {
+	jit_profile *next;
+	char        *cpu_name;
+	code_info   *code;
+	//counters live in memory from alloc_code so that translated code can reach them with a 32-bit displacement
+	jit_counter **blocks;
+	uint32_t    num_blocks;
+	uint32_t    block_storage;
+	uint32_t    num_counters;
+	//1-based counter indices of instructions by guest address, split into pages that are allocated on demand
+	uint32_t    *inst_pages[NUM_PAGES];
+	uint64_t    invalidations;
+	uint64_t    retranslations;
+};
+
+static jit_profile *live_profiles;
+
+static void write_live_profiles(void)
+{
+	for (jit_profile *prof = live_profiles; prof; prof = prof->next)
+	{
+		jit_profile_write(prof);
+	}
+}
+
+jit_profile *jit_profile_new(char const *cpu_name, code_info *code)
+{
+	static uint8_t registered;
+	if (!registered) {
+		atexit(write_live_profiles);
+		registered = 1;
+	}
+	jit_profile *prof = calloc(1, sizeof(jit_profile));
+	prof->code = code;
+	//systems with more than one instance of a CPU, or a menu and a game, get numbered files
+	//numbers are never reused so a new profile can't overwrite the report of an earlier one
+	static tern_node *name_counts;
+	intptr_t same_name = tern_find_int(name_counts, cpu_name, 0);
+	name_counts = tern_insert_int(name_counts, cpu_name, same_name + 1);
+	if (same_name) {
+		char buf[16];
+		sprintf(buf, "_%u", (uint32_t)same_name);
+		prof->cpu_name = alloc_concat(cpu_name, buf);
+	} else {
+		prof->cpu_name = strdup(cpu_name);
+	}
+	prof->next = live_profiles;
+	live_profiles = prof;
+	return prof;
+}
+
+static jit_counter *alloc_counter(jit_profile *prof)
+{
+	if (prof->num_counters == prof->num_blocks * COUNTERS_PER_BLOCK) {
+		if (prof->num_blocks == prof->block_storage) {
+			prof->block_storage = prof->block_storage ? prof->block_storage * 2 : 4;
+			prof->blocks = realloc(prof->blocks, sizeof(jit_counter *) * prof->block_storage);
+		}
+		size_t size = CODE_ALLOC_SIZE;
+		jit_counter *block = alloc_code(&size);
+		if (!block) {
+			fatal_error("Failed to allocate memory for JIT profile counters\n");
+		}
+		memset(block, 0, CODE_ALLOC_SIZE);
+		prof->blocks[prof->num_blocks++] = block;
+	}
+	jit_counter *counter = prof->blocks[prof->num_counters / COUNTERS_PER_BLOCK] + prof->num_counters % COUNTERS_PER_BLOCK;
+	prof->num_counters++;
+	return counter;
+}
+
+static jit_counter *counter_at(jit_profile *prof, uint32_t index)
+{
+	return prof->blocks[index / COUNTERS_PER_BLOCK] + index % COUNTERS_PER_BLOCK;
+}
+
+static jit_counter *find_inst(jit_profile *prof, uint32_t address, uint8_t create)
+{
+	address &= 0xFFFFFF;
+	uint32_t **page = prof->inst_pages + (address >> PAGE_BITS);
+	if (!*page) {
+		if (!create) {
+			return NULL;
+		}
+		*page = calloc(1 << PAGE_BITS, sizeof(uint32_t));
+	}
+	uint32_t *index = *page + (address & ((1 << PAGE_BITS) - 1));
+	if (!*index) {
+		if (!create) {
+			return NULL;
+		}
+		jit_counter *counter = alloc_counter(prof);
+		counter->kind = JIT_PROF_INST;
+		counter->address = address;
+		*index = prof->num_counters;
+	}
+	return counter_at(prof, *index - 1);
+}
+
+jit_counter *jit_profile_inst(jit_profile *prof, uint32_t address)
+{
+	jit_counter *counter = find_inst(prof, address, 1);
+	counter->translations++;
+	return counter;
+}
+
+jit_counter *jit_profile_counter(jit_profile *prof, uint8_t kind, uint32_t start, uint32_t end)
+{
+	//there are only a handful of these so a linear search is fine
+	for (uint32_t i = 0; i < prof->num_counters; i++)
+	{
+		jit_counter *counter = counter_at(prof, i);
+		if (counter->kind == kind && counter->address == start && counter->end == end) {
+			return counter;
+		}
+	}
+	jit_counter *counter = alloc_counter(prof);
+	counter->kind = kind;
+	counter->address = start;
+	counter->end = end;
+	return counter;
+}
+
+void jit_profile_retranslated(jit_profile *prof, uint32_t address)
+{
+	prof->retranslations++;
+	jit_counter *counter = find_inst(prof, address, 0);
+	if (counter) {
+		counter->retranslations++;
+	}
+}
+
+void jit_profile_invalidated(jit_profile *prof)
+{
+	prof->invalidations++;
+}
+
+static int hot_compare(const void *a, const void *b)
+{
+	jit_counter const *left = *(jit_counter * const *)a, *right = *(jit_counter * const *)b;
+	if (left->count != right->count) {
+		return left->count > right->count ? -1 : 1;
+	}
+	return left->address < right->address ? -1 : left->address > right->address;
+}
+
+static char const *kind_names[] = {
+	"instruction", "read_16", "read_8", "write_16", "write_8", "cycle limit", "cycle limit/interrupt"
+};
+
+void jit_profile_write(jit_profile *prof)
+{
+	char const *parts[] = {"jit_profile_", prof->cpu_name, ".txt"};
+	char *path = alloc_concat_m(3, parts);
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		warning("Failed to open JIT profile %s for writing\n", path);
+		free(path);
+		return;
+	}
+	jit_counter **insts = malloc(sizeof(jit_counter *) * (prof->num_counters ? prof->num_counters : 1));
+	uint32_t num_insts = 0;
+	uint64_t translations = 0, executions = 0;
+	//every line that isn't an address is a comment so the whole file can be passed to dis/zdis with -f
+	fprintf(f, "#JIT profile for %s\n", prof->cpu_name);
+	fprintf(f, "#\n#Exits and slow paths\n");
+	for (uint32_t i = 0; i < prof->num_counters; i++)
+	{
+		jit_counter *counter = counter_at(prof, i);
+		if (counter->kind == JIT_PROF_INST) {
+			insts[num_insts++] = counter;
+			translations += counter->translations;
+			executions += counter->count;
+		} else if (counter->kind == JIT_PROF_CYCLE_LIMIT || counter->kind == JIT_PROF_CYCLE_LIMIT_INT) {
+			fprintf(f, "#  %-24s %20"PRIu64"\n", kind_names[counter->kind], counter->count);
+		} else {
+			fprintf(f, "#  %-8s %06X-%06X %20"PRIu64"\n", kind_names[counter->kind], counter->address, counter->end - 1, counter->count);
+		}
+	}
+	fprintf(f, "#\n#Translation\n");
+	fprintf(f, "#  instructions executed    %20"PRIu64"\n", executions);
+	fprintf(f, "#  distinct addresses       %20u\n", num_insts);
+	fprintf(f, "#  translations             %20"PRIu64"\n", translations);
+	fprintf(f, "#  retranslations           %20"PRIu64"\n", prof->retranslations);
+	fprintf(f, "#  invalidated by writes    %20"PRIu64"\n", prof->invalidations);
+	if (prof->code->pool) {
+		fprintf(f, "#  code cache flushes       %20u\n", prof->code->pool->flushes);
+	}
+	qsort(insts, num_insts, sizeof(jit_counter *), hot_compare);
+	uint32_t num_hot = num_insts < MAX_HOT_INSTS ? num_insts : MAX_HOT_INSTS;
+	fprintf(f, "#\n#Hot instructions\n#  address           executions  translations  retranslations\n");
+	for (uint32_t i = 0; i < num_hot && insts[i]->count; i++)
+	{
+		fprintf(f, "#  %06X  %20"PRIu64"  %12u  %14u\n", insts[i]->address, insts[i]->count, insts[i]->translations, insts[i]->retranslations);
+	}
+	fprintf(f, "#\n#Labels for the hottest instructions\n");
+	for (uint32_t i = 0; i < num_hot && i < MAX_HOT_LABELS && insts[i]->count; i++)
+	{
+		//address 0 is ignored by dis -f
+		if (insts[i]->address) {
+			fprintf(f, "%X=hot_%u\n", insts[i]->address, i + 1);
+		}
+	}
+	free(insts);
+	fclose(f);
+	free(path);
+}
+
+void jit_profile_free(jit_profile *prof)
+{
+	jit_profile_write(prof);
+	for (jit_profile **cur = &live_profiles; *cur; cur = &(*cur)->next)
+	{
+		if (*cur == prof) {
+			*cur = prof->next;
+			break;
+		}
+	}
+	//counter blocks are left alone like other memory from alloc_code, translated code may still point at them
+	for (uint32_t i = 0; i < NUM_PAGES; i++)
+	{
+		free(prof->inst_pages[i]);
+	}
+	free(prof->blocks);
+	free(prof->cpu_name);
+	free(prof);
+}
@@ -0,0 +1,40 @@
+#ifndef JIT_PROFILE_H_
+#define JIT_PROFILE_H_
+
+#include <stdint.h>
+#include "gen.h"
+
+//kinds of events counted by translated code
+enum {
+	JIT_PROF_INST,
+	JIT_PROF_READ_16,
+	JIT_PROF_READ_8,
+	JIT_PROF_WRITE_16,
+	JIT_PROF_WRITE_8,
+	JIT_PROF_CYCLE_LIMIT,
+	JIT_PROF_CYCLE_LIMIT_INT
+};
+
+//the count field is incremented directly by translated code so counters never move once allocated
+typedef struct {
+	uint64_t count;
+	uint32_t address;        //guest address of an instruction or start of a memory map chunk
+	uint32_t end;            //end of a memory map chunk
+	uint32_t translations;
+	uint32_t retranslations;
+	uint8_t  kind;
+} jit_counter;
+
+typedef struct jit_profile jit_profile;
+
+//creates a profile that is written to jit_profile_<cpu_name>.txt when freed or when the process exits
+jit_profile *jit_profile_new(char const *cpu_name, code_info *code);
+//returns the execution counter for the instruction at address and records that it was translated again
+jit_counter *jit_profile_inst(jit_profile *prof, uint32_t address);
+jit_counter *jit_profile_counter(jit_profile *prof, uint8_t kind, uint32_t start, uint32_t end);
+void jit_profile_retranslated(jit_profile *prof, uint32_t address);
+void jit_profile_invalidated(jit_profile *prof);
+void jit_profile_write(jit_profile *prof);
+void jit_profile_free(jit_profile *prof);
+
+#endif //JIT_PROFILE_H_
@@ -8,6 +8,15 @@
 #include "io.h"
 #include "genesis.h"
 #include "sms.h"
+#include "arena.h"
+#include "render_audio.h"
+#include "libblastem.h"
+
+#ifdef NEW_CORE
+#define Z80_OPTS opts
+#else
+#define Z80_OPTS options
+#endif
 
 static retro_environment_t retro_environment;
 RETRO_API void retro_set_environment(retro_environment_t re)
@@ -40,8 +49,15 @@ RETRO_API void retro_set_environment(retro_environment_t re)
 	};
 
 	re(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, (void *)desc);
+	
+	static const struct retro_variable vars[] = {
+		{ "blastem_runahead", "Run-ahead frames; 0|1|2|3" },
+		{ NULL, NULL }
+	};
+	re(RETRO_ENVIRONMENT_SET_VARIABLES, (void *)vars);
 }
 
+
 static retro_video_refresh_t retro_video_refresh;
 RETRO_API void retro_set_video_refresh(retro_video_refresh_t rvf)
 {
@@ -76,8 +92,88 @@ int z80_enabled = 1;
 char *save_filename;
 tern_node *config;
 uint8_t use_native_states = 1;
+//only ever points at the system driven by the libretro entry points
 system_header *current_system;
-system_media media;
+
+//everything the render backend functions below need to know about one emulated system
+struct blastem_instance {
+	system_header *system;
+	system_media  media;
+	arena         *arena;
+	arena         *prev_arena;
+	audio_mixer   *mixer;
+	audio_mixer   *prev_mixer;
+	int16_t       *audio;
+	uint32_t      audio_frames;
+	uint32_t      audio_storage;
+	size_t        serialize_size_cache;
+	system_type   stype;
+	vid_std       video_standard;
+	uint32_t      last_width, last_height;
+	uint32_t      overscan_top, overscan_bot, overscan_left, overscan_right;
+	int16_t       prev_state[2][RETRO_DEVICE_ID_JOYPAD_L2];
+	uint8_t       started;
+	uint8_t       last_fb;
+	uint8_t       direct; //created through the interface in libblastem.h rather than libretro
+	//the fields below are only used by direct instances
+	uint8_t       *rom; //unmodified copy of the ROM so the instance can be cloned
+	size_t        rom_size;
+	char          *path;
+	uint8_t       *clone_state;
+	uint16_t      pad_state[2];
+	uint32_t      fb[LINEBUF_SIZE * 294 * 2];
+};
+
+static blastem_instance retro;
+//instance whose system is running on this thread, the libretro one when none is
+static __thread blastem_instance *thread_instance;
+
+static blastem_instance *cur_instance(void)
+{
+	return thread_instance ? thread_instance : &retro;
+}
+
+static void enter_instance(blastem_instance *inst)
+{
+	thread_instance = inst;
+	inst->prev_arena = set_current_arena(inst->arena);
+	inst->prev_mixer = render_audio_select_mixer(inst->mixer);
+}
+
+static void leave_instance(blastem_instance *inst)
+{
+	//the arena is created on first use so it needs to be saved on the way out
+	inst->arena = set_current_arena(inst->prev_arena);
+	render_audio_select_mixer(inst->prev_mixer);
+	thread_instance = NULL;
+}
+
+//system creation fills in lookup tables shared by all instances on first use
+static uint8_t create_lock;
+static void lock_create(void)
+{
+	while (__atomic_test_and_set(&create_lock, __ATOMIC_ACQUIRE))
+	{
+	}
+}
+
+static void unlock_create(void)
+{
+	__atomic_clear(&create_lock, __ATOMIC_RELEASE);
+}
+
+//arenas from freed instances are handed to new ones so their translated code memory gets reused
+#define MAX_SPARE_ARENAS 64
+static arena *spare_arenas[MAX_SPARE_ARENAS];
+static uint32_t num_spare_arenas;
+
+static void update_core_options(void)
+{
+	struct retro_variable var = { .key = "blastem_runahead" };
+	if (retro_environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && retro.system->set_runahead) {
+		retro.system->set_runahead(retro.system, atoi(var.value));
+	}
+}
 
 RETRO_API void retro_init(void)
 {
@@ -86,7 +182,7 @@ RETRO_API void retro_init(void)
 
 RETRO_API void retro_deinit(void)
 {
-	if (current_system) {
+	if (retro.system) {
 		retro_unload_game();
 	}
 }
@@ -105,48 +201,63 @@ RETRO_API void retro_get_system_info(struct retro_system_info *info)
 	info->block_extract = 0;
 }
 
-static vid_std video_standard;
-static uint32_t last_width, last_height;
-static uint32_t overscan_top, overscan_bot, overscan_left, overscan_right;
 static void update_overscan(void)
 {
 	uint8_t overscan;
 	retro_environment(RETRO_ENVIRONMENT_GET_OVERSCAN, &overscan);
 	if (overscan) {
-		overscan_top = overscan_bot = overscan_left = overscan_right = 0;
+		retro.overscan_top = retro.overscan_bot = retro.overscan_left = retro.overscan_right = 0;
 	} else {
-		if (video_standard == VID_NTSC) {
-			overscan_top = 11;
-			overscan_bot = 8;
-			overscan_left = 13;
-			overscan_right = 14;
+		if (retro.video_standard == VID_NTSC) {
+			retro.overscan_top = 11;
+			retro.overscan_bot = 8;
+			retro.overscan_left = 13;
+			retro.overscan_right = 14;
 		} else {
-			overscan_top = 30;
-			overscan_bot = 24;
-			overscan_left = 13;
-			overscan_right = 14;
+			retro.overscan_top = 30;
+			retro.overscan_bot = 24;
+			retro.overscan_left = 13;
+			retro.overscan_right = 14;
 		}
 	}
 }
 
-static int32_t sample_rate;
+static uint32_t frame_height(blastem_instance *inst)
+{
+	return (inst->video_standard == VID_NTSC ? 243 : 294) - (inst->overscan_top + inst->overscan_bot);
+}
+
+static double master_clock(blastem_instance *inst)
+{
+	return inst->video_standard == VID_NTSC ? 53693175 : 53203395;
+}
+
+static void init_audio_format(blastem_instance *inst)
+{
+	//sample rate of YM2612
+	render_audio_initialized(RENDER_AUDIO_S16, master_clock(inst) / (7 * 6 * 24), 2, 4, sizeof(int16_t));
+}
+
+static void init_audio(blastem_instance *inst)
+{
+	init_audio_format(inst);
+	//force adjustment of resampling parameters since target sample rate may have changed slightly
+	inst->system->set_speed_percent(inst->system, 100);
+}
+
 RETRO_API void retro_get_system_av_info(struct retro_system_av_info *info)
 {
 	update_overscan();
-	last_width = LINEBUF_SIZE;
-	info->geometry.base_width = info->geometry.max_width = LINEBUF_SIZE - (overscan_left + overscan_right);
-	info->geometry.base_height = (video_standard == VID_NTSC ? 243 : 294) - (overscan_top + overscan_bot);
-	last_height = info->geometry.base_height;
+	retro.last_width = LINEBUF_SIZE;
+	info->geometry.base_width = info->geometry.max_width = LINEBUF_SIZE - (retro.overscan_left + retro.overscan_right);
+	info->geometry.base_height = frame_height(&retro);
+	retro.last_height = info->geometry.base_height;
 	info->geometry.max_height = info->geometry.base_height * 2;
 	info->geometry.aspect_ratio = 0;
-	double master_clock = video_standard == VID_NTSC ? 53693175 : 53203395;
-	double lines = video_standard == VID_NTSC ? 262 : 313;
-	info->timing.fps = master_clock / (3420.0 * lines);
-	info->timing.sample_rate = master_clock / (7 * 6 * 24); //sample rate of YM2612
-	sample_rate = info->timing.sample_rate;
-	render_audio_initialized(RENDER_AUDIO_S16, info->timing.sample_rate, 2, 4, sizeof(int16_t));
-	//force adjustment of resampling parameters since target sample rate may have changed slightly
-	current_system->set_speed_percent(current_system, 100);
+	double lines = retro.video_standard == VID_NTSC ? 262 : 313;
+	info->timing.fps = master_clock(&retro) / (3420.0 * lines);
+	info->timing.sample_rate = master_clock(&retro) / (7 * 6 * 24);
+	init_audio(&retro);
 }
 
 RETRO_API void retro_set_controller_port_device(unsigned port, unsigned device)
@@ -156,7 +267,7 @@ RETRO_API void retro_set_controller_port_device(unsigned port, unsigned device)
 /* Resets the current game. */
 RETRO_API void retro_reset(void)
 {
-	current_system->soft_reset(current_system);
+	retro.system->soft_reset(retro.system);
 }
 
 /* Runs the game for one video frame.
@@ -167,51 +278,59 @@ RETRO_API void retro_reset(void)
  * a frame if GET_CAN_DUPE returns true.
  * In this case, the video callback can take a NULL argument for data.
  */
-static uint8_t started;
-RETRO_API void retro_run(void)
+static void run_frame(blastem_instance *inst)
 {
-	if (started) {
-		current_system->resume_context(current_system);
+	if (inst->started) {
+		inst->system->resume_context(inst->system);
 	} else {
-		current_system->start_context(current_system, NULL);
-		started = 1;
+		inst->system->start_context(inst->system, NULL);
+		inst->started = 1;
 	}
 }
 
+RETRO_API void retro_run(void)
+{
+	bool options_updated;
+	if (retro_environment(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &options_updated) && options_updated) {
+		update_core_options();
+	}
+	run_frame(&retro);
+}
+
+//the VDP FIFO is only saved up to its current fill level so leave room for it to be full
+#define FIFO_ENTRY_STATE_SIZE (2 * sizeof(uint32_t) + sizeof(uint16_t) + 2)
+static size_t state_size(blastem_instance *inst)
+{
+	if (!inst->serialize_size_cache) {
+		uint8_t *tmp = inst->system->serialize(inst->system, &inst->serialize_size_cache);
+		free(tmp);
+		inst->serialize_size_cache += FIFO_SIZE * FIFO_ENTRY_STATE_SIZE;
+	}
+	return inst->serialize_size_cache;
+}
+
 /* Returns the amount of data the implementation requires to serialize
  * internal state (save states).
  * Between calls to retro_load_game() and retro_unload_game(), the
  * returned size is never allowed to be larger than a previous returned
  * value, to ensure that the frontend can allocate a save state buffer once.
  */
-static size_t serialize_size_cache;
 RETRO_API size_t retro_serialize_size(void)
 {
-	if (!serialize_size_cache) {
-		uint8_t *tmp = current_system->serialize(current_system, &serialize_size_cache);
-		free(tmp);
-	}
-	return serialize_size_cache;
+	return state_size(&retro);
 }
 
 /* Serializes internal state. If failed, or size is lower than
  * retro_serialize_size(), it should return false, true otherwise. */
 RETRO_API bool retro_serialize(void *data, size_t size)
 {
-	size_t actual_size;
-	uint8_t *tmp = current_system->serialize(current_system, &actual_size);
-	if (actual_size > size) {
-		free(tmp);
-		return 0;
-	}
-	memcpy(data, tmp, actual_size);
-	free(tmp);
-	return 1;
+	//serialize directly into the frontend's buffer so nothing is allocated or copied per call
+	return retro.system->serialize_into(retro.system, data, size) != 0;
 }
 
 RETRO_API bool retro_unserialize(const void *data, size_t size)
 {
-	current_system->deserialize(current_system, (uint8_t *)data, size);
+	retro.system->deserialize(retro.system, (uint8_t *)data, size);
 	return 0;
 }
 
@@ -223,26 +342,64 @@ RETRO_API void retro_cheat_set(unsigned index, bool enabled, const char *code)
 {
 }
 
+static uint8_t load_media(blastem_instance *inst, void const *data, size_t size, char const *path)
+{
+	inst->serialize_size_cache = 0;
+	if (path) {
+		inst->media.dir = path_dirname(path);
+		inst->media.name = basename_no_extension(path);
+		inst->media.extension = path_extension(path);
+	}
+	inst->media.buffer = malloc(nearest_pow2(size));
+	memcpy(inst->media.buffer, data, size);
+	inst->media.size = size;
+	inst->stype = detect_system_type(&inst->media);
+	lock_create();
+	if (!inst->arena && num_spare_arenas) {
+		inst->arena = spare_arenas[--num_spare_arenas];
+	}
+	enter_instance(inst);
+	inst->system = alloc_config_system(inst->stype, &inst->media, 0, 0);
+	leave_instance(inst);
+	unlock_create();
+	return inst->system != NULL;
+}
+
+static void unload_media(blastem_instance *inst)
+{
+	free(inst->media.dir);
+	free(inst->media.name);
+	free(inst->media.extension);
+	inst->media.dir = inst->media.name = inst->media.extension = NULL;
+	//buffer is freed by the context
+	inst->media.buffer = NULL;
+	lock_create();
+	enter_instance(inst);
+	inst->system->free_context(inst->system);
+	mark_all_free();
+	leave_instance(inst);
+	if (num_spare_arenas < MAX_SPARE_ARENAS) {
+		spare_arenas[num_spare_arenas++] = inst->arena;
+		inst->arena = NULL;
+	}
+	unlock_create();
+	inst->system = NULL;
+	inst->started = 0;
+}
+
 /* Loads a game. */
-static system_type stype;
 RETRO_API bool retro_load_game(const struct retro_game_info *game)
 {
-	serialize_size_cache = 0;
-	if (game->path) {
-		media.dir = path_dirname(game->path);
-		media.name = basename_no_extension(game->path);
-		media.extension = path_extension(game->path);
-	}
-	media.buffer = malloc(nearest_pow2(game->size));
-	memcpy(media.buffer, game->data, game->size);
-	media.size = game->size;
-	stype = detect_system_type(&media);
-	current_system = alloc_config_system(stype, &media, 0, 0);
+	load_media(&retro, game->data, game->size, game->path);
+	current_system = retro.system;
 	
 	unsigned format = RETRO_PIXEL_FORMAT_XRGB8888;
 	retro_environment(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &format);
+	if (retro.system) {
+		update_core_options();
+	}
 	
-	return current_system != NULL;
+	return retro.system != NULL;
 }
 
 /* Loads a "special" kind of game. Should not be used,
@@ -255,20 +412,14 @@ RETRO_API bool retro_load_game_special(unsigned game_type, const struct retro_ga
 /* Unloads a currently loaded game. */
 RETRO_API void retro_unload_game(void)
 {
-	free(media.dir);
-	free(media.name);
-	free(media.extension);
-	media.dir = media.name = media.extension = NULL;
-	//buffer is freed by the context
-	media.buffer = NULL;
-	current_system->free_context(current_system);
+	unload_media(&retro);
 	current_system = NULL;
 }
 
 /* Gets region of game. */
 RETRO_API unsigned retro_get_region(void)
 {
-	return video_standard == VID_NTSC ? RETRO_REGION_NTSC : RETRO_REGION_PAL;
+	return retro.video_standard == VID_NTSC ? RETRO_REGION_NTSC : RETRO_REGION_PAL;
 }
 
 /* Gets region of memory. */
@@ -276,22 +427,22 @@ RETRO_API void *retro_get_memory_data(unsigned id)
 {
 	switch (id) {
 	case RETRO_MEMORY_SYSTEM_RAM:
-		switch (stype) {
+		switch (retro.stype) {
 		case SYSTEM_GENESIS: {
-			genesis_context *gen = (genesis_context *)current_system;
+			genesis_context *gen = (genesis_context *)retro.system;
 			return (uint8_t *)gen->work_ram;
 		}
 #ifndef NO_Z80
 		case SYSTEM_SMS: {
-			sms_context *sms = (sms_context *)current_system;
+			sms_context *sms = (sms_context *)retro.system;
 			return sms->ram;
 		}
 #endif
 		}
 		break;
 	case RETRO_MEMORY_SAVE_RAM:
-		if (stype == SYSTEM_GENESIS) {
-			genesis_context *gen = (genesis_context *)current_system;
+		if (retro.stype == SYSTEM_GENESIS) {
+			genesis_context *gen = (genesis_context *)retro.system;
 			if (gen->save_type != SAVE_NONE)
 				return gen->save_storage;
 		}
@@ -306,7 +457,7 @@ RETRO_API size_t retro_get_memory_size(unsigned id)
 {
 	switch (id) {
 	case RETRO_MEMORY_SYSTEM_RAM:
-		switch (stype) {
+		switch (retro.stype) {
 		case SYSTEM_GENESIS:
 			return RAM_WORDS * sizeof(uint16_t);
 #ifndef NO_Z80
@@ -316,8 +467,8 @@ RETRO_API size_t retro_get_memory_size(unsigned id)
 		}
 		break;
 	case RETRO_MEMORY_SAVE_RAM:
-		if (stype == SYSTEM_GENESIS) {
-			genesis_context *gen = (genesis_context *)current_system;
+		if (retro.stype == SYSTEM_GENESIS) {
+			genesis_context *gen = (genesis_context *)retro.system;
 			if (gen->save_type != SAVE_NONE)
 				return gen->save_size;
 		}
@@ -345,43 +496,45 @@ void render_destroy_window(uint8_t which)
 	//not supported in lib build
 }
 
-static uint32_t fb[LINEBUF_SIZE * 294 * 2];
-static uint8_t last_fb;
 uint32_t *render_get_framebuffer(uint8_t which, int *pitch)
 {
+	blastem_instance *inst = cur_instance();
 	*pitch = LINEBUF_SIZE * sizeof(uint32_t);
-	if (which != last_fb) {
+	if (which != inst->last_fb) {
 		*pitch = *pitch * 2;
 	}
 
 	if (which) {
-		return fb + LINEBUF_SIZE;
+		return inst->fb + LINEBUF_SIZE;
 	} else {
-		return fb;
+		return inst->fb;
 	}
 }
 
 void render_framebuffer_updated(uint8_t which, int width)
 {
-	unsigned height = (video_standard == VID_NTSC ? 243 : 294) - (overscan_top + overscan_bot);
-	width -= (overscan_left + overscan_right);
+	blastem_instance *inst = cur_instance();
+	unsigned height = frame_height(inst);
+	width -= (inst->overscan_left + inst->overscan_right);
 	unsigned base_height = height;
-	if (which != last_fb) {
+	if (which != inst->last_fb) {
 		height *= 2;
-		last_fb = which;
+		inst->last_fb = which;
 	}
-	if (width != last_width || height != last_height) {
+	if (!inst->direct && (width != inst->last_width || height != inst->last_height)) {
 		struct retro_game_geometry geometry = {
 			.base_width = width,
 			.base_height = height,
 			.aspect_ratio = (float)LINEBUF_SIZE / base_height
 		};
 		retro_environment(RETRO_ENVIRONMENT_SET_GEOMETRY, &geometry);
-		last_width = width;
-		last_height = height;
 	}
-	retro_video_refresh(fb + overscan_left + LINEBUF_SIZE * overscan_top, width, height, LINEBUF_SIZE * sizeof(uint32_t));
-	system_request_exit(current_system, 0);
+	inst->last_width = width;
+	inst->last_height = height;
+	if (!inst->direct) {
+		retro_video_refresh(inst->fb + inst->overscan_left + LINEBUF_SIZE * inst->overscan_top, width, height, LINEBUF_SIZE * sizeof(uint32_t));
+	}
+	system_request_exit(inst->system, 0);
 }
 
 uint8_t render_get_active_framebuffer(void)
@@ -391,7 +544,7 @@ uint8_t render_get_active_framebuffer(void)
 
 void render_set_video_standard(vid_std std)
 {
-	video_standard = std;
+	cur_instance()->video_standard = std;
 }
 
 int render_fullscreen(void)
@@ -401,21 +554,24 @@ int render_fullscreen(void)
 
 uint32_t render_overscan_top()
 {
-	return overscan_top;
+	return cur_instance()->overscan_top;
 }
 
 uint32_t render_overscan_bot()
 {
-	return overscan_bot;
+	return cur_instance()->overscan_bot;
 }
 
 void process_events()
 {
-	static int16_t prev_state[2][RETRO_DEVICE_ID_JOYPAD_L2];
 	static const uint8_t map[] = {
 		BUTTON_A, BUTTON_X, BUTTON_MODE, BUTTON_START, DPAD_UP, DPAD_DOWN,
 		DPAD_LEFT, DPAD_RIGHT, BUTTON_B, BUTTON_Y, BUTTON_Z, BUTTON_C
 	};
+	blastem_instance *inst = cur_instance();
+	if (inst->direct) {
+		return;
+	}
 	//TODO: handle other input device types
 	//TODO: handle more than 2 ports when appropriate
 	retro_input_poll();
@@ -424,13 +580,13 @@ void process_events()
 		for (int id = RETRO_DEVICE_ID_JOYPAD_B; id < RETRO_DEVICE_ID_JOYPAD_L2; id++)
 		{
 			int16_t new_state = retro_input_state(port, RETRO_DEVICE_JOYPAD, 0, id);
-			if (new_state != prev_state[port][id]) {
+			if (new_state != inst->prev_state[port][id]) {
 				if (new_state) {
-					current_system->gamepad_down(current_system, port + 1, map[id]);
+					inst->system->gamepad_down(inst->system, port + 1, map[id]);
 				} else {
-					current_system->gamepad_up(current_system, port + 1, map[id]);
+					inst->system->gamepad_up(inst->system, port + 1, map[id]);
 				}
-				prev_state[port][id] = new_state;
+				inst->prev_state[port][id] = new_state;
 			}
 		}
 	}
@@ -505,7 +661,18 @@ void render_do_audio_ready(audio_source *src)
 		int16_t buffer[8];
 		int min_remaining_out;
 		mix_and_convert((uint8_t *)buffer, sizeof(buffer), &min_remaining_out);
-		retro_audio_sample_batch(buffer, sizeof(buffer)/(2*sizeof(*buffer)));
+		blastem_instance *inst = cur_instance();
+		if (!inst->direct) {
+			retro_audio_sample_batch(buffer, sizeof(buffer)/(2*sizeof(*buffer)));
+		} else {
+			uint32_t frames = sizeof(buffer)/(2*sizeof(*buffer));
+			if (inst->audio_frames + frames > inst->audio_storage) {
+				inst->audio_storage = inst->audio_storage ? inst->audio_storage * 2 : 1024;
+				inst->audio = realloc(inst->audio, inst->audio_storage * 2 * sizeof(int16_t));
+			}
+			memcpy(inst->audio + inst->audio_frames * 2, buffer, sizeof(buffer));
+			inst->audio_frames += frames;
+		}
 	}
 }
 
@@ -532,3 +699,214 @@ char *read_bundled_file(char *name, uint32_t *sizeret)
 	}
 	return NULL;
 }
+
+blastem_instance *blastem_create(void const *rom, size_t rom_size, char const *path)
+{
+	blastem_instance *inst = calloc(1, sizeof(blastem_instance));
+	inst->direct = 1;
+	inst->mixer = render_audio_new_mixer();
+	//sources are created along with the system so the mixer needs an output format first
+	enter_instance(inst);
+	init_audio_format(inst);
+	leave_instance(inst);
+	if (!load_media(inst, rom, rom_size, path)) {
+		free(inst->media.dir);
+		free(inst->media.name);
+		free(inst->media.extension);
+		render_audio_free_mixer(inst->mixer);
+		free(inst);
+		return NULL;
+	}
+	enter_instance(inst);
+	//the video standard isn't known until the system has been created
+	init_audio(inst);
+	leave_instance(inst);
+	//the system is free to modify its copy of the ROM (byte swapping, patches) so keep the original for cloning
+	inst->rom = malloc(rom_size);
+	memcpy(inst->rom, rom, rom_size);
+	inst->rom_size = rom_size;
+	inst->path = path ? strdup(path) : NULL;
+	return inst;
+}
+
+void blastem_free(blastem_instance *inst)
+{
+	unload_media(inst);
+	render_audio_free_mixer(inst->mixer);
+	free(inst->audio);
+	free(inst->rom);
+	free(inst->path);
+	free(inst->clone_state);
+	free(inst);
+}
+
+void blastem_run_frame(blastem_instance *inst)
+{
+	inst->audio_frames = 0;
+	enter_instance(inst);
+	run_frame(inst);
+	leave_instance(inst);
+}
+
+uint32_t const *blastem_frame(blastem_instance *inst, uint32_t *width, uint32_t *height, uint32_t *pitch)
+{
+	*width = inst->last_width;
+	*height = inst->last_height;
+	//interlaced frames are stored with the fields on alternating lines
+	*pitch = LINEBUF_SIZE * sizeof(uint32_t);
+	return inst->fb;
+}
+
+int16_t const *blastem_audio(blastem_instance *inst, uint32_t *num_frames)
+{
+	*num_frames = inst->audio_frames;
+	return inst->audio;
+}
+
+//button state isn't part of a save state so only changes are passed on to the system
+static void set_pad_state(blastem_instance *inst, int port, uint16_t state)
+{
+	//only the low 12 bits correspond to buttons, anything else would index past the button definitions
+	state &= BLASTEM_UP | BLASTEM_DOWN | BLASTEM_LEFT | BLASTEM_RIGHT | BLASTEM_A | BLASTEM_B | BLASTEM_C
+		| BLASTEM_START | BLASTEM_X | BLASTEM_Y | BLASTEM_Z | BLASTEM_MODE;
+	uint16_t changed = state ^ inst->pad_state[port];
+	for (uint8_t button = DPAD_UP; changed; button++, changed >>= 1)
+	{
+		if (!(changed & 1)) {
+			continue;
+		}
+		if (state & 1 << (button - DPAD_UP)) {
+			inst->system->gamepad_down(inst->system, port + 1, button);
+		} else {
+			inst->system->gamepad_up(inst->system, port + 1, button);
+		}
+	}
+	inst->pad_state[port] = state;
+}
+
+void blastem_step(blastem_instance *inst, uint16_t const *inputs, uint32_t num_frames, blastem_output *out)
+{
+	inst->audio_frames = 0;
+	enter_instance(inst);
+	if (inputs) {
+		set_pad_state(inst, 0, inputs[0]);
+		set_pad_state(inst, 1, inputs[1]);
+	}
+	for (uint32_t i = 0; i < num_frames; i++)
+	{
+		run_frame(inst);
+	}
+	leave_instance(inst);
+	if (out) {
+		out->frame = blastem_frame(inst, &out->width, &out->height, &out->pitch);
+		out->audio = inst->audio;
+		out->audio_frames = inst->audio_frames;
+	}
+}
+
+size_t blastem_state_size(blastem_instance *inst)
+{
+	enter_instance(inst);
+	size_t size = state_size(inst);
+	leave_instance(inst);
+	return size;
+}
+
+size_t blastem_save(blastem_instance *inst, void *buf, size_t size)
+{
+	enter_instance(inst);
+	//saving can run the CPU up to the end of the current instruction
+	size_t ret = inst->system->serialize_into(inst->system, buf, size);
+	leave_instance(inst);
+	return ret;
+}
+
+void blastem_restore(blastem_instance *inst, void const *buf, size_t size)
+{
+	enter_instance(inst);
+	inst->system->deserialize(inst->system, (uint8_t *)buf, size);
+	leave_instance(inst);
+	//starting the system would reset it, continue from the restored state instead
+	inst->started = 1;
+}
+
+//only reads memory that is directly backed by a buffer so I/O registers are never touched
+static uint32_t peek_memmap(cpu_options *opts, void **mem_pointers, uint32_t address, uint8_t *dst, uint32_t len)
+{
+	uint32_t read = 0;
+	memmap_chunk const *chunk = NULL;
+	for (uint32_t i = 0; i < len; i++, address++)
+	{
+		uint32_t masked = address & opts->address_mask;
+		if (!chunk || masked < chunk->start || masked >= chunk->end) {
+			chunk = find_map_chunk(address, opts, 0, NULL);
+		}
+		dst[i] = 0xFF;
+		if (!chunk || !(chunk->flags & MMAP_READ)) {
+			continue;
+		}
+		uint8_t *base = chunk->flags & MMAP_PTR_IDX ? mem_pointers[chunk->ptr_index] : chunk->buffer;
+		if (!base) {
+			continue;
+		}
+		uint32_t offset = address & chunk->mask;
+		if ((chunk->flags & MMAP_ONLY_ODD) || (chunk->flags & MMAP_ONLY_EVEN)) {
+			if ((address & 1) ? (chunk->flags & MMAP_ONLY_EVEN) : (chunk->flags & MMAP_ONLY_ODD)) {
+				continue;
+			}
+			offset /= 2;
+		} else if (opts->byte_swap) {
+			offset ^= 1;
+		}
+		dst[i] = base[offset];
+		read++;
+	}
+	return read;
+}
+
+uint32_t blastem_peek(blastem_instance *inst, uint32_t address, void *dst, uint32_t len)
+{
+	switch (inst->stype) {
+	case SYSTEM_GENESIS: {
+		m68k_context *m68k = ((genesis_context *)inst->system)->m68k;
+		return peek_memmap(&m68k->options->gen, (void **)m68k->mem_pointers, address, dst, len);
+	}
+#ifndef NO_Z80
+	case SYSTEM_SMS: {
+		z80_context *z80 = ((sms_context *)inst->system)->z80;
+		return peek_memmap(&z80->Z80_OPTS->gen, (void **)z80->mem_pointers, address, dst, len);
+	}
+#endif
+	default:
+		memset(dst, 0xFF, len);
+		return 0;
+	}
+}
+
+blastem_instance *blastem_clone(blastem_instance *src)
+{
+	blastem_instance *inst = blastem_create(src->rom, src->rom_size, src->path);
+	if (!inst) {
+		return NULL;
+	}
+	size_t size = blastem_state_size(src);
+	if (!src->clone_state) {
+		src->clone_state = malloc(size);
+	}
+	size = blastem_save(src, src->clone_state, size);
+	if (!size) {
+		//a freshly reset system is not a clone, let the caller know instead
+		blastem_free(inst);
+		return NULL;
+	}
+	blastem_restore(inst, src->clone_state, size);
+	inst->started = src->started;
+	enter_instance(inst);
+	set_pad_state(inst, 0, src->pad_state[0]);
+	set_pad_state(inst, 1, src->pad_state[1]);
+	leave_instance(inst);
+	inst->last_width = src->last_width;
+	inst->last_height = src->last_height;
+	memcpy(inst->fb, src->fb, sizeof(inst->fb));
+	return inst;
+}
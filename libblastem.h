@@ -0,0 +1,68 @@
+#ifndef LIBBLASTEM_H_
+#define LIBBLASTEM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+//Direct interface to libblastem for hosting several emulated systems in one process without the libretro callbacks
+//Instances are independent of each other and of the libretro entry points so they can be run in parallel on
+//different threads, but a single instance must only be used by one thread at a time
+typedef struct blastem_instance blastem_instance;
+
+//path is optional and only used to find save files and the ROM name, returns NULL if the ROM could not be loaded
+blastem_instance *blastem_create(void const *rom, size_t rom_size, char const *path);
+void blastem_free(blastem_instance *inst);
+//runs until the next frame is complete
+void blastem_run_frame(blastem_instance *inst);
+//most recently completed frame in 32-bit xRGB format, pitch is in bytes
+uint32_t const *blastem_frame(blastem_instance *inst, uint32_t *width, uint32_t *height, uint32_t *pitch);
+//interleaved stereo samples produced by the last call to blastem_run_frame
+int16_t const *blastem_audio(blastem_instance *inst, uint32_t *num_frames);
+
+//Stepping interface for hosts that run an instance many times with varying inputs and save states
+//None of these functions copy the frame or audio data or allocate memory per call, except for the first
+//call to blastem_state_size and blastem_clone
+
+//bits in the per-port input masks passed to blastem_step, a set bit means the button is held
+enum {
+	BLASTEM_UP    = 0x001,
+	BLASTEM_DOWN  = 0x002,
+	BLASTEM_LEFT  = 0x004,
+	BLASTEM_RIGHT = 0x008,
+	BLASTEM_A     = 0x010,
+	BLASTEM_B     = 0x020,
+	BLASTEM_C     = 0x040,
+	BLASTEM_START = 0x080,
+	BLASTEM_X     = 0x100,
+	BLASTEM_Y     = 0x200,
+	BLASTEM_Z     = 0x400,
+	BLASTEM_MODE  = 0x800
+};
+
+//pointers into the instance's own buffers, valid until the next call that runs the instance
+typedef struct {
+	uint32_t const *frame;
+	int16_t const  *audio; //interleaved stereo
+	uint32_t       width;
+	uint32_t       height;
+	uint32_t       pitch; //in bytes
+	uint32_t       audio_frames;
+} blastem_output;
+
+//inputs points to a mask for each of the 2 controller ports or is NULL to leave them unchanged,
+//out receives the last frame and all audio produced by the num_frames frames that were run
+void blastem_step(blastem_instance *inst, uint16_t const *inputs, uint32_t num_frames, blastem_output *out);
+//upper bound on the size of a save state, buffers of this size can be reused for any number of saves
+size_t blastem_state_size(blastem_instance *inst);
+//returns the number of bytes written or 0 if the state didn't fit
+size_t blastem_save(blastem_instance *inst, void *buf, size_t size);
+void blastem_restore(blastem_instance *inst, void const *buf, size_t size);
+//copies len bytes of memory starting at a CPU address, going through the CPU's memory map so banking
+//is taken into account. I/O and other areas that aren't backed by memory read as 0xFF without side effects.
+//Returns the number of bytes that were backed by memory
+uint32_t blastem_peek(blastem_instance *inst, uint32_t address, void *dst, uint32_t len);
+//new instance with the same ROM and current state as src, the two can be run independently afterwards
+//returns NULL if the instance could not be created or the state of src could not be saved
+blastem_instance *blastem_clone(blastem_instance *src);
+
+#endif //LIBBLASTEM_H_
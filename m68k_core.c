@@ -196,6 +196,7 @@ void jump_m68k_abs(m68k_options * opts, uint32_t address)
 		dest_addr = code->cur + 256;
 	}
 	jmp(code, dest_addr);
+	m68k_tcache_branch(opts, code->cur, address);
 	//this used to call opts->native_addr for destinations in RAM, but that shouldn't be needed
 	//since instruction retranslation patches the original native instruction location
 }
@@ -452,7 +453,7 @@ static void translate_movem_memtoreg_reglist(m68k_options * opts, m68kinst *inst
 	}
 }
 
-static code_ptr get_movem_impl(m68k_options *opts, m68kinst *inst)
+code_ptr get_movem_impl(m68k_options *opts, m68kinst *inst)
 {
 	uint8_t reg_to_mem = inst->src.addr_mode == MODE_REG;
 	uint8_t size = inst->extra.size;
@@ -491,9 +492,33 @@ static code_ptr get_movem_impl(m68k_options *opts, m68kinst *inst)
 	opts->gen.code = tmp;
 	
 	rts(&opts->extra_code);
+	opts->big_movem[opts->num_movem++] = (movem_fun){
+		.impl = impl,
+		.reglist = reglist,
+		.reg_to_mem = reg_to_mem,
+		.size = size,
+		.dir = dir
+	};
 	return impl;
 }
 
+code_ptr m68k_lazy_jump_stub(m68k_options *opts, uint32_t address)
+{
+	if (!opts->extra_code.cur) {
+		init_code_info(&opts->extra_code);
+	}
+	check_alloc_code(&opts->extra_code, 32);
+	code_ptr stub = opts->extra_code.cur;
+	code_info tmp = opts->gen.code;
+	opts->gen.code = opts->extra_code;
+	ldi_native(opts, address, opts->gen.scratch1);
+	call(&opts->gen.code, opts->native_addr);
+	jmp_r(&opts->gen.code, opts->gen.scratch1);
+	opts->extra_code = opts->gen.code;
+	opts->gen.code = tmp;
+	return stub;
+}
+
 static void translate_m68k_movem(m68k_options * opts, m68kinst * inst)
 {
 	code_info *code = &opts->gen.code;
@@ -698,7 +723,7 @@ uint32_t get_instruction_start(m68k_options *opts, uint32_t address)
 	return address;
 }
 
-static void map_native_address(m68k_context * context, uint32_t address, code_ptr native_addr, uint8_t size, uint8_t native_size)
+void map_native_address(m68k_context * context, uint32_t address, code_ptr native_addr, uint8_t size, uint8_t native_size)
 {
 	m68k_options * opts = context->options;
 	native_map_slot * native_code_map = opts->gen.native_code_map;
@@ -816,6 +841,8 @@ void insert_breakpoint(m68k_context * context, uint32_t address, m68k_debug_hand
 			.handler = bp_handler,
 			.address = address
 		};
+		//translations made from now on may contain breakpoint checks
+		m68k_tcache_taint(context->options);
 		m68k_breakpoint_patch(context, address, bp_handler, NULL);
 	}
 }
@@ -949,7 +976,7 @@ static impl_info m68k_impls[] = {
 	RAW_IMPL(M68K_TAS, translate_m68k_tas),
 };
 
-static void translate_m68k(m68k_context *context, m68kinst * inst)
+void translate_m68k(m68k_context *context, m68kinst * inst)
 {
 	m68k_options * opts = context->options;
 	if (inst->address & 1) {
@@ -963,6 +990,7 @@ static void translate_m68k(m68k_context *context, m68kinst * inst)
 	if ((bp = find_breakpoint(context, inst->address))) {
 		m68k_breakpoint_patch(context, inst->address, bp, start);
 	}
+	profile_inst(&opts->gen, inst->address);
 	
 	//log_address(&opts->gen, inst->address, "M68K: %X @ %d\n");
 	if (
@@ -1006,6 +1034,128 @@ static void translate_m68k(m68k_context *context, m68kinst * inst)
 	}
 }
 
+//longest loop body, in bytes, that is checked for idle loop behavior
+#define M68K_IDLE_MAX_BYTES 32
+//registers share a mask with the flag bits, which all fit in the low 16 bits
+#define IDLE_DREG(reg) (1U << (16 + (reg)))
+#define IDLE_AREG(reg) (1U << (24 + (reg)))
+
+//Checks whether an operand can be read by an idle loop body and adds the registers it reads to reads
+static uint8_t m68k_idle_operand(m68k_options *opts, m68k_op_info *op, uint8_t size, uint32_t *reads)
+{
+	switch (op->addr_mode)
+	{
+	case MODE_REG:
+		*reads |= IDLE_DREG(op->params.regs.pri);
+		return 1;
+	case MODE_AREG:
+		*reads |= IDLE_AREG(op->params.regs.pri);
+		return 1;
+	case MODE_IMMEDIATE:
+	case MODE_IMMEDIATE_WORD:
+	case MODE_UNUSED:
+		return 1;
+	case MODE_ABSOLUTE:
+	case MODE_ABSOLUTE_SHORT: {
+		uint32_t address = op->params.immed & opts->gen.address_mask;
+		if (size != OPSIZE_BYTE && (address & 1)) {
+			return 0;
+		}
+		//reads from plain memory have no side effects and nothing else can write to it while the 68K runs
+		//device registers like the VDP status port are excluded as their value depends on when they are read
+		memmap_chunk const *chunk = find_map_chunk(address, &opts->gen, 0, NULL);
+		return chunk && (chunk->flags & MMAP_READ)
+			&& !(chunk->flags & (MMAP_PTR_IDX|MMAP_ONLY_ODD|MMAP_ONLY_EVEN|MMAP_FUNC_NULL))
+			&& address + (1 << size) <= chunk->end;
+	}
+	default:
+		return 0;
+	}
+}
+
+//Checks whether inst is a branch that closes an idle loop. The body may only read registers and
+//plain memory and anything it writes has to be written before it is read, so once the branch has been
+//taken after a full iteration every later iteration will do exactly the same thing until an interrupt
+//or sync lets something else run. Only code in ROM is considered as a write to the body in RAM would
+//only retranslate the instruction it hits and not the branch
+static uint8_t m68k_is_idle_loop(m68k_context *context, m68kinst *inst)
+{
+	m68k_options *opts = context->options;
+	if (inst->op != M68K_BCC || (inst->address & 1)) {
+		return 0;
+	}
+	uint32_t target = inst->address + 2 + inst->src.params.immed;
+	if (target > inst->address || inst->address - target > M68K_IDLE_MAX_BYTES) {
+		return 0;
+	}
+	memmap_chunk const *chunk = find_map_chunk(inst->address, &opts->gen, 0, NULL);
+	if (!chunk || (chunk->flags & MMAP_CODE)) {
+		return 0;
+	}
+	//stay within the same 512KB bank as mappers invalidate code at that granularity
+	if ((target & 1) || (target >> 19) != (inst->address >> 19) || find_map_chunk(target, &opts->gen, 0, NULL) != chunk) {
+		return 0;
+	}
+	uint32_t written = 0, read_first = 0;
+	uint32_t address = target;
+	m68kinst body;
+	while (address < inst->address)
+	{
+		if (find_breakpoint(context, address)) {
+			return 0;
+		}
+		uint16_t *encoded = get_native_pointer(address, (void **)context->mem_pointers, &opts->gen);
+		if (!encoded) {
+			return 0;
+		}
+		m68k_decode(encoded, &body, address);
+		//none of the instructions allowed here read flags, the ones they always set count as writes
+		uint32_t reads = 0, writes = 0;
+		switch (body.op)
+		{
+		case M68K_NOP:
+			break;
+		case M68K_TST:
+		case M68K_CMP:
+			if (!m68k_idle_operand(opts, &body.dst, body.extra.size, &reads)) {
+				return 0;
+			}
+			writes = N|Z|V|C;
+			break;
+		case M68K_BTST:
+			if (!m68k_idle_operand(opts, &body.dst, body.extra.size, &reads)) {
+				return 0;
+			}
+			writes = Z;
+			break;
+		case M68K_MOVE:
+			if (body.dst.addr_mode != MODE_REG) {
+				return 0;
+			}
+			writes = IDLE_DREG(body.dst.params.regs.pri) | N|Z|V|C;
+			break;
+		case M68K_AND:
+		case M68K_OR:
+		case M68K_EOR:
+			if (body.dst.addr_mode != MODE_REG) {
+				return 0;
+			}
+			reads = IDLE_DREG(body.dst.params.regs.pri);
+			writes = reads | N|Z|V|C;
+			break;
+		default:
+			return 0;
+		}
+		if (!m68k_idle_operand(opts, &body.src, body.extra.size, &reads)) {
+			return 0;
+		}
+		read_first |= reads & ~written;
+		written |= writes;
+		address += body.bytes;
+	}
+	return address == inst->address && !(read_first & written);
+}
+
 void translate_m68k_stream(uint32_t address, m68k_context * context)
 {
 	m68kinst instbuf;
@@ -1016,6 +1166,7 @@ void translate_m68k_stream(uint32_t address, m68k_context * context)
 	}
 	uint16_t *encoded, *next;
 	do {
+		m68k_tcache_stop(opts);
 		if (opts->address_log) {
 			fprintf(opts->address_log, "%X\n", address);
 			fflush(opts->address_log);
@@ -1023,6 +1174,8 @@ void translate_m68k_stream(uint32_t address, m68k_context * context)
 		do {
 			encoded = get_native_pointer(address, (void **)context->mem_pointers, &opts->gen);
 			if (!encoded) {
+				//out of bounds code is never saved, this just ends the current run
+				m68k_tcache_start_inst(opts, address);
 				code_ptr start = code->cur;
 				translate_out_of_bounds(opts, address);
 				code_ptr after = code->cur;
@@ -1032,6 +1185,7 @@ void translate_m68k_stream(uint32_t address, m68k_context * context)
 			code_ptr existing = get_native_address(opts, address);
 			if (existing) {
 				jmp(code, existing);
+				m68k_tcache_branch(opts, code->cur, address);
 				break;
 			}
 			next = m68k_decode(encoded, &instbuf, address);
@@ -1044,18 +1198,26 @@ void translate_m68k_stream(uint32_t address, m68k_context * context)
 			//m68k_disasm(&instbuf, disbuf);
 			//printf("%X: %s\n", instbuf.address, disbuf);
 
+			//this can emit a jump that belongs to the previous instruction so it goes first
+			uint8_t cacheable = m68k_tcache_start_inst(opts, instbuf.address);
 			//make sure the beginning of the code for an instruction is contiguous
 			check_code_prologue(code);
 			code_ptr start = code->cur;
+			opts->idle_loop = m68k_is_idle_loop(context, &instbuf);
 			translate_m68k(context, &instbuf);
+			opts->idle_loop = 0;
 			code_ptr after = code->cur;
 			map_native_address(context, instbuf.address, start, m68k_size, after-start);
+			if (cacheable) {
+				m68k_tcache_end_inst(opts, instbuf.address, m68k_size, start, after);
+			}
 		} while(!m68k_is_terminal(&instbuf) && !(address & 1));
 		process_deferred(&opts->gen.deferred, context, (native_addr_func)get_native_from_context);
 		if (opts->gen.deferred) {
 			address = opts->gen.deferred->address;
 		}
 	} while(opts->gen.deferred);
+	m68k_tcache_stop(opts);
 }
 
 void * m68k_retranslate_inst(uint32_t address, m68k_context * context)
@@ -1069,6 +1231,9 @@ void * m68k_retranslate_inst(uint32_t address, m68k_context * context)
 	uint16_t *after, *inst = get_native_pointer(address, (void **)context->mem_pointers, &opts->gen);
 	m68kinst instbuf;
 	after = m68k_decode(inst, &instbuf, orig);
+	if (opts->gen.profile) {
+		jit_profile_retranslated(opts->gen.profile, address);
+	}
 	if (orig_size != MAX_NATIVE_SIZE) {
 		deferred_addr * orig_deferred = opts->gen.deferred;
 
@@ -1145,6 +1310,27 @@ code_ptr get_native_address_trans(m68k_context * context, uint32_t address)
 	return ret;
 }
 
+void m68k_clear_branch_cache(m68k_context *context)
+{
+	for (uint32_t i = 0; i < M68K_BRANCH_CACHE_SIZE; i++)
+	{
+		//the generated lookup indexes with (address >> 1) & (M68K_BRANCH_CACHE_SIZE - 1)
+		//so tagging an empty slot with an address that belongs in the neighboring slot
+		//guarantees it can never hit
+		context->branch_cache[i].address = (i ^ 1) << 1;
+		context->branch_cache[i].native = NULL;
+	}
+}
+
+code_ptr m68k_branch_cache_miss(m68k_context *context, uint32_t address)
+{
+	code_ptr native = get_native_address_trans(context, address);
+	m68k_branch_cache_entry *entry = context->branch_cache + ((address >> 1) & (M68K_BRANCH_CACHE_SIZE - 1));
+	entry->address = address;
+	entry->native = native;
+	return native;
+}
+
 void remove_breakpoint(m68k_context * context, uint32_t address)
 {
 	for (uint32_t i = 0; i < context->num_breakpoints; i++)
@@ -1168,8 +1354,76 @@ void remove_breakpoint(m68k_context * context, uint32_t address)
 	context->options->gen.code = tmp;
 }
 
+//finds the 68K instruction whose translation contains native
+static uint32_t get_instruction_from_native(m68k_options *opts, code_ptr native)
+{
+	native_map_slot *native_code_map = opts->gen.native_code_map;
+	uint32_t best = 0;
+	code_ptr best_native = NULL;
+	for (uint32_t chunk = 0; chunk < NATIVE_MAP_CHUNKS; chunk++)
+	{
+		if (!native_code_map[chunk].base) {
+			continue;
+		}
+		for (uint32_t offset = 0; offset < NATIVE_CHUNK_SIZE; offset++)
+		{
+			int32_t native_off = native_code_map[chunk].offsets[offset];
+			if (native_off == INVALID_OFFSET || native_off == EXTENSION_WORD) {
+				continue;
+			}
+			code_ptr start = native_code_map[chunk].base + native_off;
+			if (start <= native && start > best_native) {
+				best_native = start;
+				best = chunk * NATIVE_CHUNK_SIZE + offset;
+			}
+		}
+	}
+	return best;
+}
+
+uint8_t m68k_code_flush_pending(m68k_context *context)
+{
+	code_pool *pool = context->options->gen.code.pool;
+	return pool && pool->flush_pending;
+}
+
+void m68k_flush_code_cache(m68k_context *context)
+{
+	m68k_options *opts = context->options;
+	uint32_t resume_address = 0;
+	if (context->resume_pc) {
+		resume_address = get_instruction_from_native(opts, context->resume_pc);
+	}
+	for (uint32_t chunk = 0; chunk < NATIVE_MAP_CHUNKS; chunk++)
+	{
+		if (opts->gen.native_code_map[chunk].base) {
+			free(opts->gen.native_code_map[chunk].offsets);
+			opts->gen.native_code_map[chunk].base = NULL;
+			opts->gen.native_code_map[chunk].offsets = NULL;
+		}
+	}
+	uint32_t ram_inst_slots = ram_size(&opts->gen) / 1024;
+	for (uint32_t i = 0; i < ram_inst_slots; i++)
+	{
+		free(opts->gen.ram_inst_sizes[i]);
+		opts->gen.ram_inst_sizes[i] = NULL;
+	}
+	memset(context->ram_code_flags, 0, ram_size(&opts->gen) / (1 << opts->gen.ram_flags_shift) / 8);
+	remove_deferred_until(&opts->gen.deferred, NULL);
+	flush_code_pool(&opts->gen.code);
+	m68k_tcache_flushed(opts);
+	m68k_clear_branch_cache(context);
+	//breakpoints get patched back in by translate_m68k as code is retranslated
+	if (context->resume_pc) {
+		context->resume_pc = get_native_address_trans(context, resume_address);
+	}
+}
+
 void start_68k_context(m68k_context * context, uint32_t address)
 {
+	if (m68k_code_flush_pending(context)) {
+		m68k_flush_code_cache(context);
+	}
 	code_ptr addr = get_native_address_trans(context, address);
 	m68k_options * options = context->options;
 	options->start_context(addr, context);
@@ -1177,6 +1431,9 @@ void start_68k_context(m68k_context * context, uint32_t address)
 
 void resume_68k(m68k_context *context)
 {
+	if (m68k_code_flush_pending(context)) {
+		m68k_flush_code_cache(context);
+	}
 	code_ptr addr = context->resume_pc;
 	context->resume_pc = NULL;
 	m68k_options * options = context->options;
@@ -1216,7 +1473,12 @@ void m68k_options_free(m68k_options *opts)
 		free(opts->gen.ram_inst_sizes[i]);
 	}
 	free(opts->gen.ram_inst_sizes);
+	if (opts->gen.profile) {
+		jit_profile_free(opts->gen.profile);
+	}
+	free_code_pool(&opts->gen.code);
 	free(opts->big_movem);
+	m68k_tcache_free(opts);
 	free(opts);
 }
 
@@ -1228,6 +1490,7 @@ m68k_context * init_68k_context(m68k_options * opts, m68k_reset_handler reset_ha
 	context->int_cycle = CYCLE_NEVER;
 	context->status = 0x27;
 	context->reset_handler = (code_ptr)reset_handler;
+	m68k_clear_branch_cache(context);
 	return context;
 }
 
@@ -34,6 +34,8 @@ typedef struct {
 	int8_t   dir;
 } movem_fun;
 
+typedef struct m68k_tcache m68k_tcache;
+
 typedef struct {
 	cpu_options     gen;
 
@@ -59,11 +61,19 @@ typedef struct {
 	code_ptr		set_sr;
 	code_ptr		set_ccr;
 	code_ptr        bp_stub;
+	code_ptr        idle_loop_skip;
 	code_info       extra_code;
 	movem_fun       *big_movem;
 	uint32_t        num_movem;
 	uint32_t        movem_storage;
 	code_word       prologue_start;
+	//start and end of the helper routines generated by init_m68k_opts
+	code_ptr        routines_start;
+	code_ptr        routines_end;
+	//state of the on-disk translation cache, NULL when it's disabled
+	m68k_tcache     *tcache;
+	//set while translating a branch that closes an idle loop, see m68k_is_idle_loop
+	uint8_t         idle_loop;
 } m68k_options;
 
 typedef struct m68k_context m68k_context;
@@ -74,6 +84,13 @@ typedef struct {
 	uint32_t           address;
 } m68k_breakpoint;
 
+//small direct-mapped cache of 68K address -> native address for indirect jumps (jmp (a0), jsr (a0), rts, rtr)
+#define M68K_BRANCH_CACHE_SIZE 256
+typedef struct {
+	uint32_t address;
+	code_ptr native;
+} m68k_branch_cache_entry;
+
 struct m68k_context {
 	uint8_t         flags[5];
 	uint8_t         status;
@@ -97,6 +114,10 @@ struct m68k_context {
 	uint8_t         int_pending;
 	uint8_t         trace_pending;
 	uint8_t         should_return;
+	//set by the branch closing an idle loop, cleared whenever the translated code yields
+	uint8_t         idle_loop;
+	uint32_t        idle_loop_start;
+	m68k_branch_cache_entry branch_cache[M68K_BRANCH_CACHE_SIZE];
 	uint8_t         ram_code_flags[];
 };
 
@@ -106,6 +127,18 @@ typedef m68k_context *(*m68k_reset_handler)(m68k_context *context);
 void translate_m68k_stream(uint32_t address, m68k_context * context);
 void start_68k_context(m68k_context * context, uint32_t address);
 void resume_68k(m68k_context *context);
+uint8_t m68k_code_flush_pending(m68k_context *context);
+//discards all translated code, only safe to call while the 68K is not running
+void m68k_flush_code_cache(m68k_context *context);
+//empties the indirect branch cache, must be called whenever existing translated code is invalidated
+void m68k_clear_branch_cache(m68k_context *context);
+code_ptr m68k_branch_cache_miss(m68k_context *context, uint32_t address);
+//enables the on-disk cache of translated ROM code, must be called before anything is translated
+void m68k_tcache_init(m68k_context *context, uint8_t *rom_sha1);
+//loads previously saved translations from path, returns 0 if the file is missing or doesn't match
+uint8_t m68k_tcache_load(m68k_context *context, char const *path);
+//saves the translations of ROM code to path, only safe to call while the 68K is not running
+void m68k_tcache_save(m68k_context *context, char const *path);
 void init_m68k_opts(m68k_options * opts, memmap_chunk * memmap, uint32_t num_chunks, uint32_t clock_divider);
 m68k_context * init_68k_context(m68k_options * opts, m68k_reset_handler reset_handler);
 void m68k_reset(m68k_context * context);
@@ -818,6 +818,9 @@ void translate_m68k_bcc(m68k_options * opts, m68kinst * inst)
 	uint32_t after = inst->address + 2;
 	if (inst->extra.cond == COND_TRUE) {
 		cycles(&opts->gen, 10);
+		if (opts->idle_loop) {
+			call(code, opts->idle_loop_skip);
+		}
 		jump_m68k_abs(opts, after + disp);
 	} else {
 		uint8_t cond = m68k_eval_cond(opts, inst->extra.cond);
@@ -825,11 +828,18 @@ void translate_m68k_bcc(m68k_options * opts, m68kinst * inst)
 		jcc(code, cond, do_branch);
 		
 		cycles(&opts->gen, inst->variant == VAR_BYTE ? 8 : 12);
+		if (opts->idle_loop) {
+			//falling out of the loop disarms the skip
+			mov_irdisp(code, 0, opts->gen.context_reg, offsetof(m68k_context, idle_loop), SZ_B);
+		}
 		code_ptr done = code->cur + 1;
 		jmp(code, done);
 		
 		*do_branch = code->cur - (do_branch + 1);
 		cycles(&opts->gen, 10);
+		if (opts->idle_loop) {
+			call(code, opts->idle_loop_skip);
+		}
 		code_ptr dest_addr = get_native_address(opts, after + disp);
 		if (!dest_addr) {
 			opts->gen.deferred = defer_address(opts->gen.deferred, after + disp, code->cur + 1);
@@ -837,6 +847,7 @@ void translate_m68k_bcc(m68k_options * opts, m68kinst * inst)
 			dest_addr = code->cur + 256;
 		}
 		jmp(code, dest_addr);
+		m68k_tcache_branch(opts, code->cur, after + disp);
 		
 		*done = code->cur - (done + 1);
 	}
@@ -2464,6 +2475,16 @@ void translate_out_of_bounds(m68k_options *opts, uint32_t address)
 	call_args(code, (code_ptr)m68k_out_of_bounds_execution, 1, opts->gen.scratch1);
 }
 
+code_ptr const m68k_translation_helpers[] = {
+	(code_ptr)divu,
+	(code_ptr)divs,
+	(code_ptr)muls_cycles,
+	(code_ptr)mulu_cycles,
+	(code_ptr)m68k_get_ir,
+	(code_ptr)m68k_out_of_bounds_execution
+};
+uint32_t const m68k_num_translation_helpers = sizeof(m68k_translation_helpers)/sizeof(*m68k_translation_helpers);
+
 void m68k_set_last_prefetch(m68k_options *opts, uint32_t address)
 {
 	mov_irdisp(&opts->gen.code, address, opts->gen.context_reg, offsetof(m68k_context, last_prefetch_address), SZ_D);
@@ -2486,11 +2507,17 @@ m68k_context * m68k_handle_code_write(uint32_t address, m68k_context * context)
 {
 	m68k_options * options = context->options;
 	uint32_t inst_start = get_instruction_start(options, address);
+	uint8_t patched = 0;
 	while (inst_start && (address - inst_start) < M68K_MAX_INST_SIZE) {
 		code_ptr dst = get_native_address(context->options, inst_start);
 		patch_for_retranslate(&options->gen, dst, options->retrans_stub);
+		patched = 1;
 		inst_start = get_instruction_start(options, inst_start - 2);
 	}
+	if (patched) {
+		//cached branch targets may point at code that was just patched
+		m68k_clear_branch_cache(context);
+	}
 	return context;
 }
 
@@ -2508,6 +2535,8 @@ void m68k_invalidate_code_range(m68k_context *context, uint32_t start, uint32_t
 		//calculate the lowest alias for this address
 		end = mem_chunk->start + ((end - mem_chunk->start) & mem_chunk->mask);
 	}
+	m68k_tcache_invalidate(opts, start, end);
+	uint8_t patched = 0;
 	uint32_t start_chunk = start / NATIVE_CHUNK_SIZE, end_chunk = end / NATIVE_CHUNK_SIZE;
 	for (uint32_t chunk = start_chunk; chunk <= end_chunk; chunk++)
 	{
@@ -2518,6 +2547,7 @@ void m68k_invalidate_code_range(m68k_context *context, uint32_t start, uint32_t
 			{
 				if (native_code_map[chunk].offsets[offset] != INVALID_OFFSET && native_code_map[chunk].offsets[offset] != EXTENSION_WORD) {
 					patch_for_retranslate(&opts->gen, native_code_map[chunk].base + native_code_map[chunk].offsets[offset], opts->retrans_stub);
+					patched = 1;
 					/*code_info code;
 					code.cur = native_code_map[chunk].base + native_code_map[chunk].offsets[offset];
 					code.last = code.cur + 32;
@@ -2528,6 +2558,9 @@ void m68k_invalidate_code_range(m68k_context *context, uint32_t start, uint32_t
 			}
 		}
 	}
+	if (patched) {
+		m68k_clear_branch_cache(context);
+	}
 }
 
 void m68k_breakpoint_patch(m68k_context *context, uint32_t address, m68k_debug_handler bp_handler, code_ptr native_addr)
@@ -2546,6 +2579,7 @@ void m68k_breakpoint_patch(m68k_context *context, uint32_t address, m68k_debug_h
 	}
 	native.last = native.cur + 128;
 	native.stack_off = 0;
+	native.pool = NULL;
 	code_ptr start_native = native.cur;
 	mov_ir(&native, address, opts->gen.scratch1, SZ_D);
 	
@@ -2556,6 +2590,9 @@ void m68k_breakpoint_patch(m68k_context *context, uint32_t address, m68k_debug_h
 void init_m68k_opts(m68k_options * opts, memmap_chunk * memmap, uint32_t num_chunks, uint32_t clock_divider)
 {
 	memset(opts, 0, sizeof(*opts));
+#ifdef JIT_PROFILE
+	opts->gen.profile = jit_profile_new("m68k", &opts->gen.code);
+#endif
 	opts->gen.memmap = memmap;
 	opts->gen.memmap_chunks = num_chunks;
 	opts->gen.address_size = SZ_D;
@@ -2615,6 +2652,7 @@ void init_m68k_opts(m68k_options * opts, memmap_chunk * memmap, uint32_t num_chu
 
 	code_info *code = &opts->gen.code;
 	init_code_info(code);
+	opts->routines_start = code->cur;
 
 	opts->gen.save_context = code->cur;
 	for (int i = 0; i < 5; i++)
@@ -2651,6 +2689,8 @@ void init_m68k_opts(m68k_options * opts, memmap_chunk * memmap, uint32_t num_chu
 	}
 	mov_rdispr(code, opts->gen.context_reg, offsetof(m68k_context, current_cycle), opts->gen.cycles, SZ_D);
 	mov_rdispr(code, opts->gen.context_reg, offsetof(m68k_context, target_cycle), opts->gen.limit, SZ_D);
+	//anything could have changed while we were out in C so an idle loop needs to run a full iteration again
+	mov_irdisp(code, 0, opts->gen.context_reg, offsetof(m68k_context, idle_loop), SZ_B);
 	retn(code);
 
 	opts->start_context = (start_fun)code->cur;
@@ -2673,9 +2713,21 @@ void init_m68k_opts(m68k_options * opts, memmap_chunk * memmap, uint32_t num_chu
 	retn(code);
 
 	opts->native_addr = code->cur;
+	//check the indirect branch cache before paying for a context save and a native map lookup
+	//the slot is (address >> 1) & (M68K_BRANCH_CACHE_SIZE - 1) scaled by the entry size
+	mov_rr(code, opts->gen.scratch1, opts->gen.scratch2, SZ_D);
+	and_ir(code, (M68K_BRANCH_CACHE_SIZE - 1) << 1, opts->gen.scratch2, SZ_D);
+	shl_ir(code, sizeof(m68k_branch_cache_entry) == 16 ? 3 : 2, opts->gen.scratch2, SZ_D);
+	add_rr(code, opts->gen.context_reg, opts->gen.scratch2, SZ_PTR);
+	cmp_rdispr(code, opts->gen.scratch2, offsetof(m68k_context, branch_cache) + offsetof(m68k_branch_cache_entry, address), opts->gen.scratch1, SZ_D);
+	code_ptr cache_miss = code->cur + 1;
+	jcc(code, CC_NZ, code->cur + 2);
+	mov_rdispr(code, opts->gen.scratch2, offsetof(m68k_context, branch_cache) + offsetof(m68k_branch_cache_entry, native), opts->gen.scratch1, SZ_PTR);
+	retn(code);
+	*cache_miss = code->cur - (cache_miss + 1);
 	call(code, opts->gen.save_context);
 	push_r(code, opts->gen.context_reg);
-	call_args(code, (code_ptr)get_native_address_trans, 2, opts->gen.context_reg, opts->gen.scratch1);
+	call_args(code, (code_ptr)m68k_branch_cache_miss, 2, opts->gen.context_reg, opts->gen.scratch1);
 	mov_rr(code, RAX, opts->gen.scratch1, SZ_PTR); //move result to scratch reg
 	pop_r(code, opts->gen.context_reg);
 	call(code, opts->gen.load_context);
@@ -2700,6 +2752,7 @@ void init_m68k_opts(m68k_options * opts, memmap_chunk * memmap, uint32_t num_chu
 	code_ptr skip_sync = code->cur + 1;
 	jcc(code, CC_C, code->cur + 2);
 	opts->do_sync = code->cur;
+	profile_event(&opts->gen, JIT_PROF_CYCLE_LIMIT, 0, 0);
 	push_r(code, opts->gen.scratch1);
 	push_r(code, opts->gen.scratch2);
 	call(code, opts->gen.save_context);
@@ -2954,6 +3007,9 @@ void init_m68k_opts(m68k_options * opts, memmap_chunk * memmap, uint32_t num_chu
 	add_ir(code, 16-sizeof(void*), RSP, SZ_PTR);
 	uint32_t adjust_size = code->cur - opts->gen.handle_cycle_limit_int;
 	code->cur = opts->gen.handle_cycle_limit_int;
+	profile_event(&opts->gen, JIT_PROF_CYCLE_LIMIT_INT, 0, 0);
+	//an interrupt handler could change the inputs of an idle loop
+	mov_irdisp(code, 0, opts->gen.context_reg, offsetof(m68k_context, idle_loop), SZ_B);
 	//handle trace mode
 	cmp_irdisp(code, 0, opts->gen.context_reg, offsetof(m68k_context, trace_pending), SZ_B);
 	code_ptr do_trace = code->cur + 1;
@@ -3143,6 +3199,62 @@ void init_m68k_opts(m68k_options * opts, memmap_chunk * memmap, uint32_t num_chu
 	pop_r(code, opts->gen.scratch1);
 	retn(code);
 
+	//Called on the taken path of a branch that closes an idle loop, see m68k_is_idle_loop. The first call
+	//only arms the skip. When the branch is taken again a full iteration has run from the top without
+	//anything else getting a chance to run, so the cycles since the last call are the period of the loop
+	//and all the iterations that fit before the next interrupt or sync can be skipped at once
+	opts->idle_loop_skip = code->cur;
+	cmp_irdisp(code, 0, opts->gen.context_reg, offsetof(m68k_context, idle_loop), SZ_B);
+	code_ptr armed = code->cur + 1;
+	jcc(code, CC_NZ, armed);
+	mov_irdisp(code, 1, opts->gen.context_reg, offsetof(m68k_context, idle_loop), SZ_B);
+	mov_rrdisp(code, opts->gen.cycles, opts->gen.context_reg, offsetof(m68k_context, idle_loop_start), SZ_D);
+	retn(code);
+	*armed = code->cur - (armed + 1);
+	//period in scratch1, cycles left before the limit in scratch2
+	mov_rr(code, opts->gen.cycles, opts->gen.scratch1, SZ_D);
+	sub_rdispr(code, opts->gen.context_reg, offsetof(m68k_context, idle_loop_start), opts->gen.scratch1, SZ_D);
+	mov_rr(code, opts->gen.limit, opts->gen.scratch2, SZ_D);
+	sub_rr(code, opts->gen.cycles, opts->gen.scratch2, SZ_D);
+	code_ptr past_limit = code->cur + 1;
+	jcc(code, CC_BE, past_limit);
+	cmp_rr(code, opts->gen.scratch1, opts->gen.scratch2, SZ_D);
+	code_ptr too_close = code->cur + 1;
+	jcc(code, CC_BE, too_close);
+	//the remainder of (cycles left - 1) / period is how far short of limit - 1 the loop will be
+	//after the last whole iteration that fits, so the instruction crossing the limit is still the same
+	if (
+		opts->gen.scratch1 == RAX || opts->gen.scratch1 == RDX || opts->gen.scratch2 == RAX
+		|| opts->gen.scratch2 == RDX || opts->gen.limit == RAX || opts->gen.limit == RDX
+	) {
+		fatal_error("idle loop skip needs RAX and RDX free for div\n");
+	}
+	//div overwrites both RAX and RDX, the cycle count is recomputed afterwards so it doesn't need saving
+	if (opts->gen.cycles != RAX) {
+		push_r(code, RAX);
+	}
+	if (opts->gen.cycles != RDX) {
+		push_r(code, RDX);
+	}
+	mov_rr(code, opts->gen.scratch2, RAX, SZ_D);
+	sub_ir(code, 1, RAX, SZ_D);
+	xor_rr(code, RDX, RDX, SZ_D);
+	div_r(code, opts->gen.scratch1, SZ_D);
+	mov_rr(code, RDX, opts->gen.scratch2, SZ_D);
+	if (opts->gen.cycles != RDX) {
+		pop_r(code, RDX);
+	}
+	if (opts->gen.cycles != RAX) {
+		pop_r(code, RAX);
+	}
+	mov_rr(code, opts->gen.limit, opts->gen.cycles, SZ_D);
+	sub_ir(code, 1, opts->gen.cycles, SZ_D);
+	sub_rr(code, opts->gen.scratch2, opts->gen.cycles, SZ_D);
+	*past_limit = code->cur - (past_limit + 1);
+	*too_close = code->cur - (too_close + 1);
+	mov_rrdisp(code, opts->gen.cycles, opts->gen.context_reg, offsetof(m68k_context, idle_loop_start), SZ_D);
+	retn(code);
+
 	opts->trap = code->cur;
 	push_r(code, opts->gen.scratch2);
 	//swap USP and SSP if not already in supervisor mode
@@ -3217,4 +3329,7 @@ void init_m68k_opts(m68k_options * opts, memmap_chunk * memmap, uint32_t num_chu
 	code->stack_off = tmp_stack_off;
 	
 	retranslate_calc(&opts->gen);
+	opts->routines_end = code->cur;
+	//everything after this point is translated 68K code that can be thrown away when the cache fills up
+	init_code_pool(code, 0);
 }
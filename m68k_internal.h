@@ -107,6 +107,34 @@ void translate_m68k_reset(m68k_options *opts, m68kinst *inst);
 extern char disasm_buf[1024];
 
 m68k_context * sync_components(m68k_context * context, uint32_t address);
+void map_native_address(m68k_context * context, uint32_t address, code_ptr native_addr, uint8_t size, uint8_t native_size);
+code_ptr get_movem_impl(m68k_options *opts, m68kinst *inst);
+//generates a stub outside of the code pool that jumps to the translation of address,
+//translating it first if necessary
+code_ptr m68k_lazy_jump_stub(m68k_options *opts, uint32_t address);
+void translate_m68k(m68k_context *context, m68kinst * inst);
+
+//C functions that translated instructions call directly
+extern code_ptr const m68k_translation_helpers[];
+extern uint32_t const m68k_num_translation_helpers;
+
+//version of the code generated by the translator, saved caches of translated code from any other version are ignored
+//bump this whenever a change to m68k_core.c, m68k_core_x86.c or the x86 code generator changes the generated code
+#define M68K_TRANSLATOR_VERSION 1
+
+//translation cache hooks, see m68k_tcache.c
+//returns 1 if the instruction at address can be saved, references are logged until the next call
+//must be called before any code for the instruction is emitted
+uint8_t m68k_tcache_start_inst(m68k_options *opts, uint32_t address);
+void m68k_tcache_end_inst(m68k_options *opts, uint32_t address, uint32_t size, code_ptr start, code_ptr end);
+void m68k_tcache_stop(m68k_options *opts);
+//records the 68K address targeted by the direct branch that ends at branch_end
+void m68k_tcache_branch(m68k_options *opts, code_ptr branch_end, uint32_t address);
+void m68k_tcache_invalidate(m68k_options *opts, uint32_t start, uint32_t end);
+//prevents the cache from being saved, used when translated code depends on debugger state
+void m68k_tcache_taint(m68k_options *opts);
+void m68k_tcache_flushed(m68k_options *opts);
+void m68k_tcache_free(m68k_options *opts);
 
 void m68k_invalid();
 void bcd_add();
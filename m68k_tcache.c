@@ -0,0 +1,798 @@
+//On-disk cache of translated 68K code. Only code translated from plain ROM is saved. The pool chunks are
+//written out as is along with the location of every reference to code outside of them, which gets
+//rewritten for the new addresses on load. The file is keyed by the ROM SHA-1, the emulator and translator versions
+//and a fingerprint of the translator: the layout of the helper routines, the memory map and the normalized
+//translation of a fixed set of instructions. Anything that doesn't match is simply ignored and overwritten on exit
+//The contents are checksummed so a damaged file is never run as code
+#include "m68k_core.h"
+#include "m68k_internal.h"
+#include "68kinst.h"
+#include "backend.h"
+#include "gen.h"
+#include "util.h"
+#include "hash.h"
+#include "version.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define TCACHE_MAGIC "BLSTTC68"
+#define TCACHE_VERSION 3
+#define TCACHE_PROBE_ADDRESS 0x200
+
+typedef struct {
+	uint32_t address;
+	uint32_t size;
+	code_ptr start;
+	code_ptr end;
+} tcache_inst;
+
+typedef struct {
+	code_ptr branch_end;
+	uint32_t address;
+} tcache_branch;
+
+struct m68k_tcache {
+	tcache_inst   *insts;
+	tcache_branch *branches;
+	uint8_t       *fingerprint;
+	code_ptr      image_end;
+	uint32_t      num_insts;
+	uint32_t      inst_storage;
+	uint32_t      num_branches;
+	uint32_t      branch_storage;
+	uint32_t      fingerprint_size;
+	uint8_t       rom_sha1[20];
+	uint8_t       tainted;
+};
+
+typedef struct {
+	char     magic[8];
+	uint32_t version;
+	//the probe and routine offsets don't cover how every instruction is translated, so code from
+	//another release or translator version is never trusted even if the fingerprint matches
+	char     emu_version[16];
+	uint32_t translator_version;
+	uint32_t fingerprint_size;
+	uint8_t  rom_sha1[20];
+	uint8_t  checksum[20]; //SHA-1 of everything after the header
+	uint32_t num_chunks;
+	uint32_t last_chunk_size;
+	uint32_t num_insts;
+	uint32_t num_refs;
+} tcache_header;
+
+//code positions in the file are chunk index * CODE_ALLOC_SIZE + offset in chunk
+typedef struct {
+	uint32_t address;
+	uint32_t size;
+	uint32_t start;
+	uint32_t end;
+} tcache_file_inst;
+
+enum {
+	TARGET_POOL,    //position in the saved chunks
+	TARGET_ROUTINE, //offset from opts->routines_start
+	TARGET_HELPER,  //index in m68k_translation_helpers
+	TARGET_MOVEM,   //movem_fun parameters packed by pack_movem
+	TARGET_ADDRESS  //68K address of code that isn't saved
+};
+
+typedef struct {
+	uint32_t loc;
+	uint32_t target;
+	uint8_t  type;
+	uint8_t  target_type;
+	uint16_t reserved;
+} tcache_file_ref;
+
+void m68k_tcache_taint(m68k_options *opts)
+{
+	if (opts->tcache) {
+		opts->tcache->tainted = 1;
+	}
+}
+
+static uint8_t tcache_cacheable(m68k_options *opts, uint32_t address)
+{
+	memmap_chunk const *chunk = find_map_chunk(address, &opts->gen, 0, NULL);
+	return chunk && chunk->buffer && (chunk->flags & MMAP_READ)
+		&& !(chunk->flags & (MMAP_CODE|MMAP_PTR_IDX|MMAP_FUNC_NULL|MMAP_ONLY_ODD|MMAP_ONLY_EVEN));
+}
+
+//the saved image ends after the last code emitted for a cacheable instruction, which includes any jump that follows it
+static void tcache_end_run(m68k_options *opts)
+{
+	code_pool *pool = opts->gen.code.pool;
+	if (pool->log_refs) {
+		opts->tcache->image_end = opts->gen.code.cur;
+		pool->log_refs = 0;
+	}
+}
+
+uint8_t m68k_tcache_start_inst(m68k_options *opts, uint32_t address)
+{
+	if (!opts->tcache) {
+		return 0;
+	}
+	code_info *code = &opts->gen.code;
+	uint8_t cacheable = tcache_cacheable(opts, address);
+	if (!cacheable && code->pool->log_refs) {
+		//saved code falling through into code that isn't saved with it would run into whatever
+		//gets translated after it on load, so it jumps to the next instruction explicitly
+		jmp(code, m68k_lazy_jump_stub(opts, address));
+		m68k_tcache_branch(opts, code->cur, address);
+		tcache_end_run(opts);
+	}
+	code->pool->log_refs = cacheable;
+	return cacheable;
+}
+
+void m68k_tcache_end_inst(m68k_options *opts, uint32_t address, uint32_t size, code_ptr start, code_ptr end)
+{
+	m68k_tcache *tcache = opts->tcache;
+	if (tcache->num_insts == tcache->inst_storage) {
+		tcache->inst_storage = tcache->inst_storage ? tcache->inst_storage * 2 : 1024;
+		tcache->insts = realloc(tcache->insts, sizeof(tcache_inst) * tcache->inst_storage);
+	}
+	tcache->insts[tcache->num_insts++] = (tcache_inst){
+		.address = address,
+		.size = size,
+		.start = start,
+		.end = end
+	};
+}
+
+void m68k_tcache_stop(m68k_options *opts)
+{
+	if (opts->tcache) {
+		tcache_end_run(opts);
+	}
+}
+
+void m68k_tcache_branch(m68k_options *opts, code_ptr branch_end, uint32_t address)
+{
+	m68k_tcache *tcache = opts->tcache;
+	//branches to code that will be saved are found by position instead
+	if (!tcache || !opts->gen.code.pool->log_refs || tcache_cacheable(opts, address)) {
+		return;
+	}
+	if (tcache->num_branches == tcache->branch_storage) {
+		tcache->branch_storage = tcache->branch_storage ? tcache->branch_storage * 2 : 16;
+		tcache->branches = realloc(tcache->branches, sizeof(tcache_branch) * tcache->branch_storage);
+	}
+	tcache->branches[tcache->num_branches++] = (tcache_branch){
+		.branch_end = branch_end,
+		.address = address
+	};
+}
+
+void m68k_tcache_invalidate(m68k_options *opts, uint32_t start, uint32_t end)
+{
+	m68k_tcache *tcache = opts->tcache;
+	if (!tcache) {
+		return;
+	}
+	for (uint32_t i = 0; i < tcache->num_insts; i++)
+	{
+		if (tcache->insts[i].address < end && tcache->insts[i].address + tcache->insts[i].size > start) {
+			tcache->tainted = 1;
+			return;
+		}
+	}
+}
+
+void m68k_tcache_flushed(m68k_options *opts)
+{
+	if (opts->tcache) {
+		//the pool has already forgotten its references
+		opts->tcache->num_insts = 0;
+		opts->tcache->num_branches = 0;
+		opts->tcache->image_end = NULL;
+	}
+}
+
+void m68k_tcache_free(m68k_options *opts)
+{
+	if (opts->tcache) {
+		free(opts->tcache->insts);
+		free(opts->tcache->branches);
+		free(opts->tcache->fingerprint);
+		free(opts->tcache);
+		opts->tcache = NULL;
+	}
+}
+
+static uint32_t pack_movem(movem_fun *fun)
+{
+	return fun->reglist | fun->reg_to_mem << 16 | fun->size << 17 | (fun->dir < 0) << 19;
+}
+
+static code_ptr unpack_movem(m68k_options *opts, uint32_t packed)
+{
+	m68kinst inst;
+	memset(&inst, 0, sizeof(inst));
+	inst.op = M68K_MOVEM;
+	inst.extra.size = packed >> 17 & 3;
+	if (packed & 1 << 16) {
+		inst.src.addr_mode = MODE_REG;
+		inst.src.params.immed = packed;
+		inst.dst.addr_mode = (packed & 1 << 19) ? MODE_AREG_PREDEC : MODE_AREG_INDIRECT;
+	} else {
+		inst.src.addr_mode = MODE_AREG_INDIRECT;
+		inst.dst.addr_mode = MODE_REG;
+		inst.dst.params.immed = packed;
+	}
+	return get_movem_impl(opts, &inst);
+}
+
+static code_ptr ref_target(code_ref *ref)
+{
+	int32_t disp;
+	switch (ref->type)
+	{
+	case CODE_REF_REL8:
+		return ref->loc + 1 + (int8_t)*ref->loc;
+	case CODE_REF_REL32:
+		memcpy(&disp, ref->loc, sizeof(disp));
+		return ref->loc + sizeof(disp) + disp;
+#ifdef X86_64
+	case CODE_REF_ABS: {
+		//only the full 64-bit mov rax, imm form has room for any address
+		if (ref->loc[0] != 0x48 || ref->loc[1] != 0xB8) {
+			return NULL;
+		}
+		uint64_t abs;
+		memcpy(&abs, ref->loc + 2, sizeof(abs));
+		return (code_ptr)abs;
+	}
+#endif
+	default:
+		return NULL;
+	}
+}
+
+//works out what target points to if it's not part of the translated code itself
+static uint8_t classify_fixed_target(m68k_options *opts, code_ptr target, tcache_file_ref *out)
+{
+	if (target >= opts->routines_start && target < opts->routines_end) {
+		out->target_type = TARGET_ROUTINE;
+		out->target = target - opts->routines_start;
+		return 1;
+	}
+	for (uint32_t i = 0; i < m68k_num_translation_helpers; i++)
+	{
+		if (target == m68k_translation_helpers[i]) {
+			out->target_type = TARGET_HELPER;
+			out->target = i;
+			return 1;
+		}
+	}
+	for (uint32_t i = 0; i < opts->num_movem; i++)
+	{
+		if (target == opts->big_movem[i].impl) {
+			out->target_type = TARGET_MOVEM;
+			out->target = pack_movem(opts->big_movem + i);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//code that won't be saved, like RAM code called from ROM, is referenced by its 68K address
+static uint8_t find_branch_address(m68k_tcache *tcache, code_ref *ref, tcache_file_ref *out)
+{
+	code_ptr branch_end = ref->loc + (ref->type == CODE_REF_REL8 ? 1 : sizeof(int32_t));
+	for (uint32_t i = 0; i < tcache->num_branches; i++)
+	{
+		if (tcache->branches[i].branch_end == branch_end) {
+			out->target_type = TARGET_ADDRESS;
+			out->target = tcache->branches[i].address;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static uint8_t pool_position(code_pool *pool, code_ptr ptr, uint32_t *pos)
+{
+	for (uint32_t i = 0; i < pool->next_chunk; i++)
+	{
+		if (ptr >= pool->chunks[i] && ptr < pool->chunks[i] + CODE_ALLOC_SIZE) {
+			*pos = i * CODE_ALLOC_SIZE + (ptr - pool->chunks[i]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void fingerprint_append(m68k_tcache *tcache, void const *data, uint32_t size)
+{
+	tcache->fingerprint = realloc(tcache->fingerprint, tcache->fingerprint_size + size);
+	memcpy(tcache->fingerprint + tcache->fingerprint_size, data, size);
+	tcache->fingerprint_size += size;
+}
+
+static uint32_t routine_offset(m68k_options *opts, code_ptr routine)
+{
+	return routine ? routine - opts->routines_start : 0xFFFFFFFF;
+}
+
+//A small sample of instructions that covers the common addressing modes and the instructions that call
+//helpers. There are deliberately no branches as their translation depends on what has been translated already
+static uint16_t const probe_code[] = {
+	0x4E71,                 //nop
+	0x7001,                 //moveq #1, d0
+	0x2200,                 //move.l d0, d1
+	0x3410,                 //move.w (a0), d2
+	0x1618,                 //move.b (a0)+, d3
+	0x2A20,                 //move.l -(a0), d5
+	0x3228, 0x0010,         //move.w 16(a0), d1
+	0x3039, 0x00FF, 0x0000, //move.w $FF0000, d0
+	0x33C0, 0x00FF, 0x0002, //move.w d0, $FF0002
+	0xD081,                 //add.l d1, d0
+	0x9481,                 //sub.l d1, d2
+	0xC041,                 //and.w d1, d0
+	0x8041,                 //or.w d1, d0
+	0xB141,                 //eor.w d0, d1
+	0xB041,                 //cmp.w d1, d0
+	0x4A40,                 //tst.w d0
+	0xE348,                 //lsl.w #1, d0
+	0xE248,                 //lsr.w #1, d0
+	0xE2A1,                 //asr.l d1, d1
+	0xE358,                 //rol.w #1, d0
+	0xC0C1,                 //mulu.w d1, d0
+	0xC1C1,                 //muls.w d1, d0
+	0x80C1,                 //divu.w d1, d0
+	0x81C1,                 //divs.w d1, d0
+	0x0800, 0x0003,         //btst #3, d0
+	0x4240,                 //clr.w d0
+	0x4480,                 //neg.l d0
+	0x4840,                 //swap d0
+	0x48C0,                 //ext.l d0
+	0xC141,                 //exg d0, d1
+	0x41E8, 0x0004,         //lea 4(a0), a0
+	0x5280,                 //addq.l #1, d0
+	0x5380,                 //subq.l #1, d0
+	0x0640, 0x1234,         //addi.w #$1234, d0
+	0xC300,                 //abcd d0, d1
+	0x57C0,                 //seq d0
+	0x48E7, 0xC0C0,         //movem.l d0-d1/a0-a1, -(a7)
+	0x46FC, 0x2700,         //move #$2700, sr
+	0x40C0,                 //move sr, d0
+	0x4E75                  //rts
+};
+
+//Translates probe_code at the current position in the pool, adds the result with all references
+//replaced by what they point to to the fingerprint and then throws the code away again
+static uint8_t fingerprint_probe(m68k_context *context)
+{
+	m68k_options *opts = context->options;
+	m68k_tcache *tcache = opts->tcache;
+	code_info *code = &opts->gen.code;
+	code_pool *pool = code->pool;
+	code_info orig_code = *code;
+	uint32_t orig_refs = pool->num_refs;
+	deferred_addr *orig_deferred = opts->gen.deferred;
+	//make sure the probe doesn't need to continue in another chunk
+	check_alloc_code(code, 4096);
+	code_ptr start = code->cur;
+	uint16_t words[sizeof(probe_code)/sizeof(*probe_code) + 4];
+	memcpy(words, probe_code, sizeof(probe_code));
+	memset(words + sizeof(probe_code)/sizeof(*probe_code), 0, 4 * sizeof(*words));
+	uint16_t *encoded = words, *end = words + sizeof(probe_code)/sizeof(*probe_code);
+	uint32_t address = TCACHE_PROBE_ADDRESS;
+	pool->log_refs = 1;
+	while (encoded < end)
+	{
+		m68kinst inst;
+		uint16_t *next = m68k_decode(encoded, &inst, address);
+		address += (next - encoded) * 2;
+		encoded = next;
+		translate_m68k(context, &inst);
+	}
+	pool->log_refs = 0;
+	code_ptr probe_end = code->cur;
+	uint8_t success = probe_end - start < 4096;
+	uint32_t size = probe_end - start;
+	uint8_t *normalized = malloc(size);
+	memcpy(normalized, start, size);
+	for (uint32_t i = orig_refs; success && i < pool->num_refs; i++)
+	{
+		code_ref *ref = pool->refs + i;
+		code_ptr target = ref_target(ref);
+		tcache_file_ref out = {
+			.loc = ref->loc - start,
+			.type = ref->type
+		};
+		if (target >= start && target < probe_end) {
+			out.target_type = TARGET_POOL;
+			out.target = target - start;
+		} else if (!target || !classify_fixed_target(opts, target, &out)) {
+			success = 0;
+			break;
+		}
+		uint32_t ref_size = ref->type == CODE_REF_REL8 ? 1 : ref->type == CODE_REF_REL32 ? 4 : 10;
+		memset(normalized + out.loc, 0, ref_size);
+		fingerprint_append(tcache, &out, sizeof(out));
+	}
+	fingerprint_append(tcache, &size, sizeof(size));
+	fingerprint_append(tcache, normalized, size);
+	free(normalized);
+	remove_deferred_until(&opts->gen.deferred, orig_deferred);
+	pool->num_refs = orig_refs;
+	*code = orig_code;
+	return success;
+}
+
+void m68k_tcache_init(m68k_context *context, uint8_t *rom_sha1)
+{
+	m68k_options *opts = context->options;
+	if (opts->gen.profile) {
+		//profile counters are referenced directly by translated code and can't be relocated
+		return;
+	}
+	m68k_tcache *tcache = calloc(1, sizeof(m68k_tcache));
+	opts->tcache = tcache;
+	memcpy(tcache->rom_sha1, rom_sha1, sizeof(tcache->rom_sha1));
+	uint32_t sizes[] = {
+		sizeof(void *), sizeof(m68k_context), sizeof(m68k_options), opts->gen.clock_divider, opts->gen.flags,
+		opts->routines_end - opts->routines_start, m68k_num_translation_helpers, opts->gen.memmap_chunks
+	};
+	fingerprint_append(tcache, sizes, sizeof(sizes));
+	code_ptr routines[] = {
+		opts->read_16, opts->write_16, opts->read_8, opts->write_8, opts->read_32, opts->write_32_lowfirst,
+		opts->write_32_highfirst, opts->do_sync, opts->handle_int_latch, opts->trap, opts->retrans_stub,
+		opts->native_addr, opts->native_addr_and_sync, opts->get_sr, opts->set_sr, opts->set_ccr, opts->bp_stub,
+		opts->idle_loop_skip, opts->gen.save_context, opts->gen.load_context, opts->gen.handle_cycle_limit,
+		opts->gen.handle_cycle_limit_int, opts->gen.handle_align_error_write, opts->gen.handle_align_error_read
+	};
+	for (uint32_t i = 0; i < sizeof(routines)/sizeof(*routines); i++)
+	{
+		uint32_t offset = routine_offset(opts, routines[i]);
+		fingerprint_append(tcache, &offset, sizeof(offset));
+	}
+	for (uint32_t i = 0; i < opts->gen.memmap_chunks; i++)
+	{
+		memmap_chunk const *chunk = opts->gen.memmap + i;
+		uint32_t desc[] = {
+			chunk->start, chunk->end, chunk->mask, chunk->aux_mask, chunk->ptr_index, chunk->flags,
+			chunk->buffer != NULL, chunk->read_16 != NULL, chunk->write_16 != NULL, chunk->read_8 != NULL, chunk->write_8 != NULL
+		};
+		fingerprint_append(tcache, desc, sizeof(desc));
+	}
+	//the routines must be in a single allocation for offsets into them to make sense
+	if (opts->routines_end - opts->routines_start >= CODE_ALLOC_SIZE || !fingerprint_probe(context)) {
+		warning("Translation cache disabled as translated code can't be relocated\n");
+		m68k_tcache_free(opts);
+	}
+}
+
+static uint8_t *append(uint8_t *dst, void const *data, size_t size)
+{
+	memcpy(dst, data, size);
+	return dst + size;
+}
+
+void m68k_tcache_save(m68k_context *context, char const *path)
+{
+	m68k_options *opts = context->options;
+	m68k_tcache *tcache = opts->tcache;
+	if (!tcache || tcache->tainted || !tcache->num_insts || opts->gen.deferred) {
+		return;
+	}
+	code_pool *pool = opts->gen.code.pool;
+	tcache_file_inst *insts = malloc(sizeof(tcache_file_inst) * tcache->num_insts);
+	tcache_file_ref *refs = malloc(sizeof(tcache_file_ref) * (pool->num_refs ? pool->num_refs : 1));
+	uint32_t num_refs = 0;
+	uint8_t success = 1;
+	for (uint32_t i = 0; success && i < tcache->num_insts; i++)
+	{
+		insts[i].address = tcache->insts[i].address;
+		insts[i].size = tcache->insts[i].size;
+		success = pool_position(pool, tcache->insts[i].start, &insts[i].start)
+			&& pool_position(pool, tcache->insts[i].end, &insts[i].end)
+			//instructions are translated in pool order which lets targets be looked up with a binary search
+			&& (!i || insts[i].start >= insts[i-1].end);
+	}
+	for (uint32_t i = 0; success && i < pool->num_refs; i++)
+	{
+		code_ref *ref = pool->refs + i;
+		code_ptr target = ref_target(ref);
+		tcache_file_ref *out = refs + num_refs;
+		*out = (tcache_file_ref){
+			.type = ref->type
+		};
+		uint32_t target_pos;
+		if (!target || !pool_position(pool, ref->loc, &out->loc)) {
+			success = 0;
+		} else if (pool_position(pool, target, &target_pos)) {
+			//find the last instruction that starts at or before the target
+			uint32_t low = 0, high = tcache->num_insts;
+			while (high - low > 1)
+			{
+				uint32_t mid = (low + high) / 2;
+				if (insts[mid].start <= target_pos) {
+					low = mid;
+				} else {
+					high = mid;
+				}
+			}
+			if (insts[low].start <= target_pos && target_pos < insts[low].end) {
+				out->target_type = TARGET_POOL;
+				out->target = target_pos;
+			} else {
+				success = find_branch_address(tcache, ref, out);
+			}
+		} else {
+			//lazy jump stubs live outside the pool, so branches are checked here as well
+			success = classify_fixed_target(opts, target, out) || find_branch_address(tcache, ref, out);
+		}
+		if (ref->type == CODE_REF_REL8) {
+			//short branches are only ever emitted within a chunk and don't need to be updated
+			success = success && out->target_type == TARGET_POOL && out->target / CODE_ALLOC_SIZE == out->loc / CODE_ALLOC_SIZE;
+		} else {
+			num_refs++;
+		}
+	}
+	//anything translated after the last cacheable instruction, like RAM code, is left out
+	//but the jump that ends its block is not
+	uint32_t image_size;
+	success = success && pool_position(pool, tcache->image_end, &image_size)
+		&& image_size >= insts[tcache->num_insts - 1].end;
+	if (!success) {
+		warning("Translated code could not be saved to the translation cache\n");
+		free(insts);
+		free(refs);
+		return;
+	}
+	tcache_header header = {
+		.magic = TCACHE_MAGIC,
+		.version = TCACHE_VERSION,
+		.fingerprint_size = tcache->fingerprint_size,
+		.num_chunks = (image_size - 1) / CODE_ALLOC_SIZE + 1,
+		.last_chunk_size = (image_size - 1) % CODE_ALLOC_SIZE + 1,
+		.num_insts = tcache->num_insts,
+		.num_refs = num_refs
+	};
+	memcpy(header.rom_sha1, tcache->rom_sha1, sizeof(header.rom_sha1));
+	strncpy(header.emu_version, BLASTEM_VERSION, sizeof(header.emu_version));
+	header.translator_version = M68K_TRANSLATOR_VERSION;
+	size_t payload_size = tcache->fingerprint_size + sizeof(tcache_file_inst) * tcache->num_insts
+		+ sizeof(tcache_file_ref) * num_refs + image_size;
+	uint8_t *payload = malloc(payload_size);
+	uint8_t *cur = append(payload, tcache->fingerprint, tcache->fingerprint_size);
+	cur = append(cur, insts, sizeof(tcache_file_inst) * tcache->num_insts);
+	cur = append(cur, refs, sizeof(tcache_file_ref) * num_refs);
+	for (uint32_t i = 0; i < header.num_chunks; i++)
+	{
+		cur = append(cur, pool->chunks[i], i == header.num_chunks - 1 ? header.last_chunk_size : CODE_ALLOC_SIZE);
+	}
+	free(insts);
+	free(refs);
+	sha1(payload, payload_size, header.checksum);
+	//write to a temporary file first so an interrupted save never leaves a truncated cache behind
+	char *tmp_path = alloc_concat(path, ".tmp");
+	FILE *f = fopen(tmp_path, "wb");
+	if (!f) {
+		warning("Failed to open translation cache file %s for writing\n", tmp_path);
+		free(tmp_path);
+		free(payload);
+		return;
+	}
+	success = fwrite(&header, 1, sizeof(header), f) == sizeof(header)
+		&& fwrite(payload, 1, payload_size, f) == payload_size;
+	success = !fclose(f) && success;
+	free(payload);
+#ifdef _WIN32
+	//rename won't replace an existing file on Windows
+	if (success) {
+		remove(path);
+	}
+#endif
+	if (!success || rename(tmp_path, path)) {
+		warning("Failed to write translation cache file %s\n", path);
+		remove(tmp_path);
+	}
+	free(tmp_path);
+}
+
+static uint8_t relocate_ref(m68k_context *context, tcache_file_ref *ref, uint32_t num_chunks)
+{
+	m68k_options *opts = context->options;
+	code_info *code = &opts->gen.code;
+	code_pool *pool = code->pool;
+	uint32_t chunk = ref->loc / CODE_ALLOC_SIZE, offset = ref->loc % CODE_ALLOC_SIZE;
+	if (chunk >= num_chunks || offset + (ref->type == CODE_REF_ABS ? 10 : 4) > CODE_ALLOC_SIZE) {
+		return 0;
+	}
+	code_ptr loc = pool->chunks[chunk] + offset;
+	code_ptr target;
+	switch (ref->target_type)
+	{
+	case TARGET_POOL:
+		if (ref->target / CODE_ALLOC_SIZE >= num_chunks) {
+			return 0;
+		}
+		target = pool->chunks[ref->target / CODE_ALLOC_SIZE] + ref->target % CODE_ALLOC_SIZE;
+		break;
+	case TARGET_ROUTINE:
+		if (ref->target >= opts->routines_end - opts->routines_start) {
+			return 0;
+		}
+		target = opts->routines_start + ref->target;
+		break;
+	case TARGET_HELPER:
+		if (ref->target >= m68k_num_translation_helpers) {
+			return 0;
+		}
+		target = m68k_translation_helpers[ref->target];
+		break;
+	case TARGET_MOVEM:
+		target = unpack_movem(opts, ref->target);
+		break;
+	case TARGET_ADDRESS:
+		//the code may not even be there yet so it's only translated once the branch is taken
+		if (ref->type != CODE_REF_REL32) {
+			return 0;
+		}
+		m68k_tcache_branch(opts, loc + sizeof(int32_t), ref->target);
+		target = m68k_lazy_jump_stub(opts, ref->target);
+		break;
+	default:
+		return 0;
+	}
+	if (ref->type == CODE_REF_REL32) {
+		ptrdiff_t disp = target - (loc + sizeof(int32_t));
+		if (disp != (int32_t)disp) {
+			return 0;
+		}
+		int32_t disp32 = disp;
+		memcpy(loc, &disp32, sizeof(disp32));
+#ifdef X86_64
+	} else if (ref->type == CODE_REF_ABS && loc[0] == 0x48 && loc[1] == 0xB8) {
+		uint64_t abs = (uint64_t)target;
+		memcpy(loc + 2, &abs, sizeof(abs));
+#endif
+	} else {
+		return 0;
+	}
+	code_pool_log_ref(code, loc, ref->type);
+	return 1;
+}
+
+uint8_t m68k_tcache_load(m68k_context *context, char const *path)
+{
+	m68k_options *opts = context->options;
+	m68k_tcache *tcache = opts->tcache;
+	code_info *code = &opts->gen.code;
+	code_pool *pool = code->pool;
+	//saved code can only be restored into an empty cache
+	if (!tcache || pool->next_chunk != 1 || code->cur != pool->chunks[0] || tcache->num_insts) {
+		return 0;
+	}
+	uint8_t *data;
+	size_t size;
+#ifdef _WIN32
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		return 0;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = malloc(size ? size : 1);
+	if (fread(data, 1, size, f) != size) {
+		size = 0;
+	}
+	fclose(f);
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+	struct stat st;
+	if (fstat(fd, &st) || !st.st_size) {
+		close(fd);
+		return 0;
+	}
+	size = st.st_size;
+	data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return 0;
+	}
+#endif
+	tcache_header header;
+	uint8_t success = size >= sizeof(header);
+	if (success) {
+		memcpy(&header, data, sizeof(header));
+		success = !memcmp(header.magic, TCACHE_MAGIC, sizeof(header.magic))
+			&& header.version == TCACHE_VERSION
+			&& !strncmp(header.emu_version, BLASTEM_VERSION, sizeof(header.emu_version))
+			&& header.translator_version == M68K_TRANSLATOR_VERSION
+			&& !memcmp(header.rom_sha1, tcache->rom_sha1, sizeof(header.rom_sha1))
+			&& header.fingerprint_size == tcache->fingerprint_size
+			&& header.num_chunks && header.last_chunk_size <= CODE_ALLOC_SIZE
+			//leave room for new translations without immediately triggering a flush
+			&& (!pool->max_chunks || header.num_chunks + 1 < pool->max_chunks);
+	}
+	uint64_t expected = sizeof(header);
+	if (success) {
+		expected += (uint64_t)header.fingerprint_size + (uint64_t)header.num_insts * sizeof(tcache_file_inst)
+			+ (uint64_t)header.num_refs * sizeof(tcache_file_ref)
+			+ (uint64_t)(header.num_chunks - 1) * CODE_ALLOC_SIZE + header.last_chunk_size;
+		success = expected == size && !memcmp(data + sizeof(header), tcache->fingerprint, tcache->fingerprint_size);
+	}
+	if (!success) {
+		debug_message("Translation cache %s does not match, ignoring\n", path);
+	} else {
+		uint8_t checksum[20];
+		sha1(data + sizeof(header), size - sizeof(header), checksum);
+		if (memcmp(checksum, header.checksum, sizeof(checksum))) {
+			warning("Translation cache %s is corrupt, ignoring\n", path);
+			success = 0;
+		}
+	}
+	if (success) {
+		uint8_t *cur = data + sizeof(header) + header.fingerprint_size;
+		tcache_file_inst *insts = (tcache_file_inst *)cur;
+		cur += header.num_insts * sizeof(tcache_file_inst);
+		tcache_file_ref *refs = (tcache_file_ref *)cur;
+		cur += header.num_refs * sizeof(tcache_file_ref);
+		for (uint32_t i = 1; success && i < header.num_chunks; i++)
+		{
+			size_t chunk_size;
+			success = next_code_chunk(code, &chunk_size) != NULL;
+		}
+		for (uint32_t i = 0; success && i < header.num_chunks; i++)
+		{
+			uint32_t chunk_size = i == header.num_chunks - 1 ? header.last_chunk_size : CODE_ALLOC_SIZE;
+			memcpy(pool->chunks[i], cur, chunk_size);
+			cur += chunk_size;
+		}
+		if (success) {
+			code->cur = pool->chunks[header.num_chunks - 1] + header.last_chunk_size;
+			code->last = pool->chunks[header.num_chunks - 1] + CODE_ALLOC_SIZE - RESERVE_WORDS;
+			tcache->image_end = code->cur;
+		}
+		pool->log_refs = 1;
+		for (uint32_t i = 0; success && i < header.num_refs; i++)
+		{
+			success = relocate_ref(context, refs + i, header.num_chunks);
+		}
+		pool->log_refs = 0;
+		for (uint32_t i = 0; success && i < header.num_insts; i++)
+		{
+			tcache_file_inst *inst = insts + i;
+			uint32_t chunk = inst->start / CODE_ALLOC_SIZE;
+			success = chunk < header.num_chunks && inst->end / CODE_ALLOC_SIZE < header.num_chunks
+				&& inst->end > inst->start && inst->size && inst->size <= 10 && tcache_cacheable(opts, inst->address);
+			if (success) {
+				code_ptr start = pool->chunks[chunk] + inst->start % CODE_ALLOC_SIZE;
+				code_ptr end = pool->chunks[inst->end / CODE_ALLOC_SIZE] + inst->end % CODE_ALLOC_SIZE;
+				map_native_address(context, inst->address, start, inst->size, inst->end - inst->start);
+				m68k_tcache_end_inst(opts, inst->address, inst->size, start, end);
+			}
+		}
+		if (!success) {
+			warning("Translation cache %s is corrupt, ignoring\n", path);
+		}
+	}
+#ifdef _WIN32
+	free(data);
+#else
+	munmap(data, size);
+#endif
+	if (!success) {
+		m68k_flush_code_cache(context);
+	}
+	return success;
+}
@@ -12,16 +12,92 @@ void m68k_read_16(m68k_context *context)
 	context->scratch1 = read_word(context->scratch1, context->mem_pointers, &context->opts->gen, context);
 }
 
+#define M68K_FETCH_CACHE_SIZE 4096
+//an address with bits above the 24-bit bus set never matches a lookup
+#define M68K_FETCH_CACHE_EMPTY 0xFFFFFFFFU
+
+//calculates the lowest alias of an address in a mirrored chunk
+static uint32_t m68k_fetch_alias(memmap_chunk const *chunk, uint32_t address)
+{
+	return chunk->start + ((address - chunk->start) & chunk->mask);
+}
+
+//opcodes and extension words are cached by address so fetching from the instruction stream
+//doesn't have to search the memory map each time, only plain memory is cached
+//the lowest alias of each entry is kept so writes and invalidations through a mirror find it,
+//chunks that mirror more often than the cache wraps aren't cached so all aliases share a slot
+void m68k_fetch_16(m68k_context *context)
+{
+	context->cycles += 4 * context->opts->gen.clock_divider;
+	uint32_t address = context->scratch1 & context->opts->gen.address_mask;
+	uint32_t slot = address >> 1 & (M68K_FETCH_CACHE_SIZE - 1);
+	if (context->fetch_address[slot] == address) {
+		context->scratch1 = context->fetch_word[slot];
+		return;
+	}
+	memmap_chunk const *chunk = find_map_chunk(address, &context->opts->gen, 0, NULL);
+	if (chunk && (chunk->flags & MMAP_READ) && !(chunk->flags & (MMAP_ONLY_ODD|MMAP_ONLY_EVEN))) {
+		uint8_t *base = chunk->flags & MMAP_PTR_IDX ? context->mem_pointers[chunk->ptr_index] : chunk->buffer;
+		if (base) {
+			context->scratch1 = *(uint16_t *)(base + (address & chunk->mask));
+			if (!((chunk->mask + 1) & (M68K_FETCH_CACHE_SIZE * 2 - 1))) {
+				context->fetch_address[slot] = address;
+				context->fetch_alias[slot] = m68k_fetch_alias(chunk, address);
+				context->fetch_word[slot] = context->scratch1;
+			}
+			return;
+		}
+	}
+	context->scratch1 = read_word(address, context->mem_pointers, &context->opts->gen, context);
+}
+
+static void m68k_fetch_cache_write(m68k_context *context, uint32_t address)
+{
+	address &= context->opts->gen.address_mask & ~1;
+	uint32_t slot = address >> 1 & (M68K_FETCH_CACHE_SIZE - 1);
+	if (context->fetch_address[slot] == M68K_FETCH_CACHE_EMPTY) {
+		return;
+	}
+	if (context->fetch_address[slot] != address) {
+		//the cached word can still be the same memory seen through a different mirror
+		memmap_chunk const *chunk = find_map_chunk(address, &context->opts->gen, 0, NULL);
+		if (!chunk || context->fetch_alias[slot] != m68k_fetch_alias(chunk, address)) {
+			return;
+		}
+	}
+	context->fetch_address[slot] = M68K_FETCH_CACHE_EMPTY;
+}
+
+void m68k_invalidate_code_range(m68k_context *context, uint32_t start, uint32_t end)
+{
+	memmap_chunk const *chunk = find_map_chunk(start, &context->opts->gen, 0, NULL);
+	if (chunk) {
+		start = m68k_fetch_alias(chunk, start);
+	}
+	chunk = find_map_chunk(end, &context->opts->gen, 0, NULL);
+	if (chunk) {
+		end = m68k_fetch_alias(chunk, end);
+	}
+	for (uint32_t i = 0; i < M68K_FETCH_CACHE_SIZE; i++)
+	{
+		if (context->fetch_address[i] != M68K_FETCH_CACHE_EMPTY && context->fetch_alias[i] >= start && context->fetch_alias[i] < end) {
+			context->fetch_address[i] = M68K_FETCH_CACHE_EMPTY;
+		}
+	}
+}
+
 void m68k_write_8(m68k_context *context)
 {
 	context->cycles += 4 * context->opts->gen.clock_divider;
 	write_byte(context->scratch2, context->scratch1, context->mem_pointers, &context->opts->gen, context);
+	m68k_fetch_cache_write(context, context->scratch2);
 }
 
 void m68k_write_16(m68k_context *context)
 {
 	context->cycles += 4 * context->opts->gen.clock_divider;
 	write_word(context->scratch2, context->scratch1, context->mem_pointers, &context->opts->gen, context);
+	m68k_fetch_cache_write(context, context->scratch2);
 }
 
 void m68k_sync_cycle(m68k_context *context, uint32_t target_cycle)
@@ -44,10 +120,15 @@ void init_m68k_opts(m68k_options *opts, memmap_chunk * memmap, uint32_t num_chun
 
 m68k_context *init_68k_context(m68k_options * opts, m68k_reset_handler reset_handler)
 {
-	m68k_context *context = calloc(1, sizeof(m68k_context));
+	//the fetch cache is allocated along with the context so freeing the context frees it too
+	m68k_context *context = calloc(1, sizeof(m68k_context) + M68K_FETCH_CACHE_SIZE * (2 * sizeof(uint32_t) + sizeof(uint16_t)));
 	context->opts = opts;
 	context->reset_handler = reset_handler;
 	context->int_cycle = 0xFFFFFFFFU;
+	context->fetch_address = (uint32_t *)(context + 1);
+	context->fetch_alias = context->fetch_address + M68K_FETCH_CACHE_SIZE;
+	context->fetch_word = (uint16_t *)(context->fetch_alias + M68K_FETCH_CACHE_SIZE);
+	memset(context->fetch_address, 0xFF, M68K_FETCH_CACHE_SIZE * sizeof(uint32_t));
 	return context;
 }
 
@@ -70,7 +151,7 @@ void m68k_reset(m68k_context *context)
 	context->pc |= context->scratch1;
 	
 	context->scratch1 = context->pc;
-	m68k_read_16(context);
+	m68k_fetch_16(context);
 	context->prefetch = context->scratch1;
 	context->pc += 2;
 	
@@ -33,13 +33,14 @@ void * alloc_code(size_t *size)
 	if (*size & (PAGE_SIZE -1)) {
 		*size += PAGE_SIZE - (*size & (PAGE_SIZE - 1));
 	}
-	ret = mmap(next, *size, PROT_EXEC | PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+	//systems running on other threads may be allocating at the same time, so the address hint is claimed atomically
+	uint8_t *hint = __atomic_fetch_add(&next, *size, __ATOMIC_RELAXED);
+	ret = mmap(hint, *size, PROT_EXEC | PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
 	if (ret == MAP_FAILED) {
 		perror("alloc_code");
 		return NULL;
 	}
 	track_block(ret);
-	next = ret + *size;
 	return ret;
 }
 
@@ -87,9 +87,41 @@ static int16_t volume_table[16] = {
 	2067/PSG_VOL_DIV, 1642/PSG_VOL_DIV, 1304/PSG_VOL_DIV, 0
 };
 
+static int16_t psg_output(psg_context *context)
+{
+	int16_t accum = 0;
+	
+	for (int i = 0; i < 3; i++) {
+		if (context->output_state[i]) {
+			accum += volume_table[context->volume[i]];
+		}
+	}
+	if (context->noise_out) {
+		accum += volume_table[context->volume[3]];
+	}
+	return accum;
+}
+
 void psg_run(psg_context * context, uint32_t cycles)
 {
 	while (context->cycles < cycles) {
+		//the output level can only change when one of the counters expires
+		//so all the clocks before the next expiration can be output as a single run
+		uint32_t run = (cycles - context->cycles + context->clock_inc - 1) / context->clock_inc;
+		for (int i = 0; i < 4; i++) {
+			uint32_t until_toggle = context->counters[i] ? context->counters[i] - 1 : 0;
+			if (until_toggle < run) {
+				run = until_toggle;
+			}
+		}
+		if (run) {
+			for (int i = 0; i < 4; i++) {
+				context->counters[i] -= run;
+			}
+			render_put_mono_samples(context->audio, psg_output(context), run);
+			context->cycles += run * context->clock_inc;
+			continue;
+		}
 		for (int i = 0; i < 4; i++) {
 			if (context->counters[i]) {
 				context->counters[i] -= 1;
@@ -109,19 +141,8 @@ void psg_run(psg_context * context, uint32_t cycles)
 				}
 			}
 		}
-
-		int16_t accum = 0;
-		
-		for (int i = 0; i < 3; i++) {
-			if (context->output_state[i]) {
-				accum += volume_table[context->volume[i]];
-			}
-		}
-		if (context->noise_out) {
-			accum += volume_table[context->volume[3]];
-		}
 		
-		render_put_mono_sample(context->audio, accum);
+		render_put_mono_sample(context->audio, psg_output(context));
 
 		context->cycles += context->clock_inc;
 	}
@@ -6,23 +6,81 @@
 #include "util.h"
 #include "config.h"
 #include "blastem.h"
+#include "bench.h"
 
-static uint8_t output_channels;
-static uint32_t buffer_samples, sample_rate;
+//The resampler dot product covers 2 stereo frames per 128-bit vector, left in the even lanes and right in the odd ones
+#ifndef DISABLE_SIMD
+#if defined(__SSE2__) || defined(X86_64)
+#include <emmintrin.h>
+#define AUDIO_SIMD
+typedef __m128 f32x4;
+#define f32x4_zero() _mm_setzero_ps()
+#define f32x4_load(ptr) _mm_loadu_ps(ptr)
+#define f32x4_store(ptr, v) _mm_storeu_ps(ptr, v)
+#define f32x4_madd(acc, a, b) _mm_add_ps(acc, _mm_mul_ps(a, b))
+#define f32x4_add(a, b) _mm_add_ps(a, b)
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define AUDIO_SIMD
+typedef float32x4_t f32x4;
+#define f32x4_zero() vdupq_n_f32(0.0f)
+#define f32x4_load(ptr) vld1q_f32(ptr)
+#define f32x4_store(ptr, v) vst1q_f32(ptr, v)
+#define f32x4_madd(acc, a, b) vmlaq_f32(acc, a, b)
+#define f32x4_add(a, b) vaddq_f32(a, b)
+#endif
+#endif //DISABLE_SIMD
 
-static audio_source *audio_sources[8];
-static audio_source *inactive_audio_sources[8];
-static uint8_t num_audio_sources;
-static uint8_t num_inactive_audio_sources;
+typedef void (*conv_func)(float *samples, void *vstream, int sample_count);
 
-static float overall_gain_mult, *mix_buf;
-static int sample_size;
+//output format and the set of sources that get mixed together
+struct audio_mixer {
+	audio_source *audio_sources[8];
+	audio_source *inactive_audio_sources[8];
+	float        *mix_buf;
+	conv_func    convert;
+	float        overall_gain_mult;
+	uint32_t     buffer_samples;
+	uint32_t     sample_rate;
+	uint32_t     sync_samples;
+	int          sample_size;
+	uint8_t      output_channels;
+	uint8_t      num_audio_sources;
+	uint8_t      num_inactive_audio_sources;
+	uint8_t      use_fir;
+	uint8_t      output_suppressed;
+	uint8_t      old_audio_sync;
+};
 
-typedef void (*conv_func)(float *samples, void *vstream, int sample_count);
+static audio_mixer default_mixer;
+static __thread audio_mixer *thread_mixer;
+
+static audio_mixer *current_mixer(void)
+{
+	return thread_mixer ? thread_mixer : &default_mixer;
+}
+
+audio_mixer *render_audio_new_mixer(void)
+{
+	return calloc(1, sizeof(audio_mixer));
+}
+
+void render_audio_free_mixer(audio_mixer *mixer)
+{
+	free(mixer->mix_buf);
+	free(mixer);
+}
+
+audio_mixer *render_audio_select_mixer(audio_mixer *mixer)
+{
+	audio_mixer *old = thread_mixer;
+	thread_mixer = mixer;
+	return old;
+}
 
 static void convert_null(float *samples, void *vstream, int sample_count)
 {
-	memset(vstream, 0, sample_count * sample_size);
+	memset(vstream, 0, sample_count * current_mixer()->sample_size);
 }
 
 static void convert_s16(float *samples, void *vstream, int sample_count)
@@ -62,10 +120,11 @@ static int32_t mix_f32(audio_source *audio, float *stream, int samples)
 	float *end = stream + samples;
 	int16_t *src = audio->front;
 	uint32_t i = audio->read_start;
-	uint32_t i_end = audio->read_end;
+	uint32_t i_end = AUDIO_LOAD(audio->read_end);
 	float *cur = stream;
-	float gain_mult = audio->gain_mult * overall_gain_mult;
-	size_t first_add = output_channels > 1 ? 1 : 0, second_add = output_channels > 1 ? output_channels - 1 : 1;
+	audio_mixer *mixer = audio->mixer;
+	float gain_mult = audio->gain_mult * mixer->overall_gain_mult;
+	size_t first_add = mixer->output_channels > 1 ? 1 : 0, second_add = mixer->output_channels > 1 ? mixer->output_channels - 1 : 1;
 	if (audio->num_channels == 1) {
 		while (cur < end && i != i_end)
 		{
@@ -86,7 +145,7 @@ static int32_t mix_f32(audio_source *audio, float *stream, int samples)
 		}
 	}
 	if (!render_is_audio_sync()) {
-		audio->read_start = i;
+		AUDIO_STORE(audio->read_start, i);
 	}
 	if (cur != end) {
 		debug_message("Underflow of %d samples, read_start: %d, read_end: %d, mask: %X\n", (int)(end-cur)/2, audio->read_start, audio->read_end, audio->mask);
@@ -96,26 +155,25 @@ static int32_t mix_f32(audio_source *audio, float *stream, int samples)
 	}
 }
 
-static conv_func convert;
-
-
 int mix_and_convert(unsigned char *byte_stream, int len, int *min_remaining_out)
 {
-	int samples = len / sample_size;
-	float *mix_dest = mix_buf ? mix_buf : (float *)byte_stream;
+	audio_mixer *mixer = current_mixer();
+	int samples = len / mixer->sample_size;
+	float *mix_dest = mixer->mix_buf ? mixer->mix_buf : (float *)byte_stream;
 	memset(mix_dest, 0, samples * sizeof(float));
 	int min_buffered = INT_MAX;
 	int min_remaining_buffer = INT_MAX;
-	for (uint8_t i = 0; i < num_audio_sources; i++)
+	for (uint8_t i = 0; i < mixer->num_audio_sources; i++)
 	{
-		int buffered = mix_f32(audio_sources[i], mix_dest, samples);
-		int remaining = (audio_sources[i]->mask + 1) / audio_sources[i]->num_channels - buffered;
+		audio_source *src = mixer->audio_sources[i];
+		int buffered = mix_f32(src, mix_dest, samples);
+		int remaining = (src->mask + 1) / src->num_channels - buffered;
 		min_buffered = buffered < min_buffered ? buffered : min_buffered;
 		min_remaining_buffer = remaining < min_remaining_buffer ? remaining : min_remaining_buffer;
-		audio_sources[i]->front_populated = 0;
-		render_buffer_consumed(audio_sources[i]);
+		AUDIO_STORE(src->front_populated, 0);
+		render_buffer_consumed(src);
 	}
-	convert(mix_dest, byte_stream, samples);
+	mixer->convert(mix_dest, byte_stream, samples);
 	if (min_remaining_out) {
 		*min_remaining_out = min_remaining_buffer;
 	}
@@ -124,45 +182,215 @@ int mix_and_convert(unsigned char *byte_stream, int len, int *min_remaining_out)
 
 uint8_t all_sources_ready(void)
 {
+	audio_mixer *mixer = current_mixer();
 	uint8_t num_populated = 0;
-	num_populated = 0;
-	for (uint8_t i = 0; i < num_audio_sources; i++)
+	for (uint8_t i = 0; i < mixer->num_audio_sources; i++)
 	{
-		if (audio_sources[i]->front_populated) {
+		if (AUDIO_LOAD(mixer->audio_sources[i]->front_populated)) {
 			num_populated++;
 		}
 	}
-	return num_populated == num_audio_sources;
+	return num_populated == mixer->num_audio_sources;
 }
 
 #define BUFFER_INC_RES 0x40000000UL
 
+//Polyphase windowed-sinc resampler
+//The filter kernel is precomputed for FIR_PHASES+1 evenly spaced positions between two input samples
+//so producing an output sample is just a dot product of the nearest phase with the recent input history
+#define FIR_PHASES 256
+#define FIR_ZERO_CROSSINGS 8
+#define FIR_MAX_TAPS 128
+
+struct fir_resampler {
+	float    *taps;
+	float    *history;
+	uint64_t phase_mult;
+	uint32_t num_taps;
+	uint32_t pos;
+};
+
+static void fir_update_phase_mult(audio_source *src)
+{
+	if (src->fir) {
+		//converts buffer_fraction to a phase index with a multiply instead of a divide
+		src->fir->phase_mult = ((uint64_t)FIR_PHASES << 32) / src->buffer_inc;
+	}
+}
+
+static void fir_free(audio_source *src)
+{
+	if (src->fir) {
+		free(src->fir->taps);
+		free(src->fir->history);
+		free(src->fir);
+		src->fir = NULL;
+	}
+}
+
+static double blackman(double x)
+{
+	return 0.42 + 0.5 * cos(M_PI * x) + 0.08 * cos(2.0 * M_PI * x);
+}
+
+static void fir_init(audio_source *src)
+{
+	fir_free(src);
+	fir_resampler *fir = calloc(1, sizeof(fir_resampler));
+	//cutoff is in cycles per input sample, leave some room for the transition band below the output Nyquist frequency
+	double ratio = (double)src->buffer_inc / (double)BUFFER_INC_RES;
+	double cutoff = 0.45 * (ratio < 1.0 ? ratio : 1.0);
+	uint32_t half = ceil(FIR_ZERO_CROSSINGS / (2.0 * cutoff));
+	//keep the tap count a multiple of 8 so the dot product can be unrolled
+	half = (half + 3) & ~3;
+	if (half > FIR_MAX_TAPS / 2) {
+		half = FIR_MAX_TAPS / 2;
+	}
+	fir->num_taps = half * 2;
+	uint32_t channels = src->num_channels;
+	uint32_t row = fir->num_taps * channels;
+	fir->taps = malloc((FIR_PHASES + 1) * row * sizeof(float));
+	fir->history = calloc(2 * row, sizeof(float));
+	double *kernel = malloc(fir->num_taps * sizeof(double));
+	for (uint32_t phase = 0; phase <= FIR_PHASES; phase++)
+	{
+		//distance of the output sample behind the newest input sample
+		double delay = (double)phase / FIR_PHASES;
+		double sum = 0.0;
+		for (uint32_t tap = 0; tap < fir->num_taps; tap++)
+		{
+			//tap 0 applies to the oldest sample in the history
+			double t = (double)tap + 1.0 - fir->num_taps + half + delay;
+			double x = 2.0 * cutoff * t;
+			double sinc = x == 0.0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+			kernel[tap] = sinc * blackman(t / (half + 1));
+			sum += kernel[tap];
+		}
+		float *dst = fir->taps + phase * row;
+		for (uint32_t tap = 0; tap < fir->num_taps; tap++)
+		{
+			//taps are repeated for each channel to match the interleaved history
+			for (uint32_t channel = 0; channel < channels; channel++)
+			{
+				*(dst++) = kernel[tap] / sum;
+			}
+		}
+	}
+	free(kernel);
+	src->fir = fir;
+	fir_update_phase_mult(src);
+}
+
+static void fir_push(audio_source *src, int16_t left, int16_t right)
+{
+	fir_resampler *fir = src->fir;
+	//history is stored twice so that the most recent num_taps samples are always contiguous
+	uint32_t offset = fir->pos * src->num_channels;
+	uint32_t dup = fir->num_taps * src->num_channels;
+	fir->history[offset] = fir->history[offset + dup] = left;
+	if (src->num_channels > 1) {
+		fir->history[offset + 1] = fir->history[offset + dup + 1] = right;
+	}
+	if (++fir->pos == fir->num_taps) {
+		fir->pos = 0;
+	}
+}
+
+static void fir_fill(audio_source *src, int16_t value, uint64_t count)
+{
+	if (count > src->fir->num_taps) {
+		count = src->fir->num_taps;
+	}
+	for (; count; count--)
+	{
+		fir_push(src, value, value);
+	}
+}
+
+static int16_t fir_clamp(float sample)
+{
+	if (sample >= 32767.0f) {
+		return 32767;
+	} else if (sample <= -32768.0f) {
+		return -32768;
+	}
+	return lrintf(sample);
+}
+
+static void fir_sample(audio_source *src)
+{
+	fir_resampler *fir = src->fir;
+	uint32_t phase = (src->buffer_fraction * fir->phase_mult + 0x80000000) >> 32;
+	if (phase > FIR_PHASES) {
+		phase = FIR_PHASES;
+	}
+	uint32_t len = fir->num_taps * src->num_channels;
+	float *taps = fir->taps + phase * len;
+	float *history = fir->history + fir->pos * src->num_channels;
+	//for stereo sources, even lanes hold the left channel and odd lanes the right
+#ifdef AUDIO_SIMD
+	f32x4 vacc0 = f32x4_zero(), vacc1 = f32x4_zero();
+	for (uint32_t i = 0; i < len; i += 8)
+	{
+		vacc0 = f32x4_madd(vacc0, f32x4_load(taps + i), f32x4_load(history + i));
+		vacc1 = f32x4_madd(vacc1, f32x4_load(taps + i + 4), f32x4_load(history + i + 4));
+	}
+	float lanes[4];
+	f32x4_store(lanes, f32x4_add(vacc0, vacc1));
+	float acc0 = lanes[0], acc1 = lanes[1], acc2 = lanes[2], acc3 = lanes[3];
+#else
+	float acc0 = 0.0f, acc1 = 0.0f, acc2 = 0.0f, acc3 = 0.0f;
+	for (uint32_t i = 0; i < len; i += 4)
+	{
+		acc0 += taps[i] * history[i];
+		acc1 += taps[i+1] * history[i+1];
+		acc2 += taps[i+2] * history[i+2];
+		acc3 += taps[i+3] * history[i+3];
+	}
+#endif
+	if (src->num_channels > 1) {
+		src->back[src->buffer_pos++] = fir_clamp(acc0 + acc2);
+		src->back[src->buffer_pos++] = fir_clamp(acc1 + acc3);
+	} else {
+		src->back[src->buffer_pos++] = fir_clamp(acc0 + acc1 + acc2 + acc3);
+	}
+}
+
 void render_audio_adjust_clock(audio_source *src, uint64_t master_clock, uint64_t sample_divider)
 {
-	src->buffer_inc = ((BUFFER_INC_RES * (uint64_t)sample_rate) / master_clock) * sample_divider;
+	src->buffer_inc = ((BUFFER_INC_RES * (uint64_t)src->mixer->sample_rate) / master_clock) * sample_divider;
+	if (src->fir) {
+		fir_init(src);
+	}
 }
 
 void render_audio_adjust_speed(float adjust_ratio)
 {
-	for (uint8_t i = 0; i < num_audio_sources; i++)
+	audio_mixer *mixer = current_mixer();
+	for (uint8_t i = 0; i < mixer->num_audio_sources; i++)
 	{
-		audio_sources[i]->buffer_inc = ((double)audio_sources[i]->buffer_inc) + ((double)audio_sources[i]->buffer_inc) * adjust_ratio + 0.5;
+		audio_source *src = mixer->audio_sources[i];
+		src->buffer_inc = ((double)src->buffer_inc) + ((double)src->buffer_inc) * adjust_ratio + 0.5;
+		//speed adjustments are tiny so the filter kernel doesn't need to be recomputed
+		fir_update_phase_mult(src);
 	}
 }
 
 audio_source *render_audio_source(uint64_t master_clock, uint64_t sample_divider, uint8_t channels)
 {
 	audio_source *ret = NULL;
-	uint32_t alloc_size = render_is_audio_sync() ? channels * buffer_samples : nearest_pow2(render_min_buffered() * 4 * channels);
+	audio_mixer *mixer = current_mixer();
+	uint32_t alloc_size = render_is_audio_sync() ? channels * mixer->buffer_samples : nearest_pow2(render_min_buffered() * 4 * channels);
 	render_lock_audio();
-		if (num_audio_sources < 8) {
+		if (mixer->num_audio_sources < 8) {
 			ret = calloc(1, sizeof(audio_source));
 			ret->back = malloc(alloc_size * sizeof(int16_t));
 			ret->front = render_is_audio_sync() ? malloc(alloc_size * sizeof(int16_t)) : ret->back;
 			ret->front_populated = 0;
 			ret->opaque = render_new_audio_opaque();
 			ret->num_channels = channels;
-			audio_sources[num_audio_sources++] = ret;
+			ret->mixer = mixer;
+			mixer->audio_sources[mixer->num_audio_sources++] = ret;
 		}
 	render_unlock_audio();
 	if (!ret) {
@@ -178,9 +406,12 @@ audio_source *render_audio_source(uint64_t master_clock, uint64_t sample_divider
 		ret->buffer_fraction = 0;
 		ret->last_left = ret->last_right = 0;
 		ret->read_start = 0;
-		ret->read_end = render_is_audio_sync() ? buffer_samples * channels : 0;
+		ret->read_end = render_is_audio_sync() ? mixer->buffer_samples * channels : 0;
 		ret->mask = render_is_audio_sync() ? 0xFFFFFFFF : alloc_size-1;
 		ret->gain_mult = 1.0f;
+		if (mixer->use_fir) {
+			fir_init(ret);
+		}
 	}
 	render_audio_created(ret);
 	
@@ -200,14 +431,15 @@ void render_audio_source_gaindb(audio_source *src, float gain)
 
 void render_pause_source(audio_source *src)
 {
+	audio_mixer *mixer = src->mixer;
 	uint8_t found = 0, remaining_sources;
 	render_lock_audio();
-		for (uint8_t i = 0; i < num_audio_sources; i++)
+		for (uint8_t i = 0; i < mixer->num_audio_sources; i++)
 		{
-			if (audio_sources[i] == src) {
-				audio_sources[i] = audio_sources[--num_audio_sources];
+			if (mixer->audio_sources[i] == src) {
+				mixer->audio_sources[i] = mixer->audio_sources[--mixer->num_audio_sources];
 				found = 1;
-				remaining_sources = num_audio_sources;
+				remaining_sources = mixer->num_audio_sources;
 				break;
 			}
 		}
@@ -216,20 +448,21 @@ void render_pause_source(audio_source *src)
 	if (found) {
 		render_source_paused(src, remaining_sources);
 	}
-	inactive_audio_sources[num_inactive_audio_sources++] = src;
+	mixer->inactive_audio_sources[mixer->num_inactive_audio_sources++] = src;
 }
 
 void render_resume_source(audio_source *src)
 {
+	audio_mixer *mixer = src->mixer;
 	render_lock_audio();
-		if (num_audio_sources < 8) {
-			audio_sources[num_audio_sources++] = src;
+		if (mixer->num_audio_sources < 8) {
+			mixer->audio_sources[mixer->num_audio_sources++] = src;
 		}
 	render_unlock_audio();
-	for (uint8_t i = 0; i < num_inactive_audio_sources; i++)
+	for (uint8_t i = 0; i < mixer->num_inactive_audio_sources; i++)
 	{
-		if (inactive_audio_sources[i] == src) {
-			inactive_audio_sources[i] = inactive_audio_sources[--num_inactive_audio_sources];
+		if (mixer->inactive_audio_sources[i] == src) {
+			mixer->inactive_audio_sources[i] = mixer->inactive_audio_sources[--mixer->num_inactive_audio_sources];
 		}
 	}
 	render_source_resumed(src);
@@ -237,20 +470,22 @@ void render_resume_source(audio_source *src)
 
 void render_free_source(audio_source *src)
 {
+	audio_mixer *mixer = src->mixer;
 	uint8_t found = 0;
-	for (uint8_t i = 0; i < num_inactive_audio_sources; i++)
+	for (uint8_t i = 0; i < mixer->num_inactive_audio_sources; i++)
 	{
-		if (inactive_audio_sources[i] == src) {
-			inactive_audio_sources[i] = inactive_audio_sources[--num_inactive_audio_sources];
+		if (mixer->inactive_audio_sources[i] == src) {
+			mixer->inactive_audio_sources[i] = mixer->inactive_audio_sources[--mixer->num_inactive_audio_sources];
 			found = 1;
 			break;
 		}
 	}
 	if (!found) {
 		render_pause_source(src);
-		num_inactive_audio_sources--;
+		mixer->num_inactive_audio_sources--;
 	}
 	
+	fir_free(src);
 	free(src->front);
 	if (render_is_audio_sync()) {
 		free(src->back);
@@ -273,18 +508,31 @@ static void interp_sample(audio_source *src, int16_t last, int16_t current)
 	src->back[src->buffer_pos++] = tmp >> 16;
 }
 
-static uint32_t sync_samples;
-void render_put_mono_sample(audio_source *src, int16_t value)
+//While suppressed, samples from all sources are dropped before resampling
+//used for frames whose audio will never be heard (e.g. run-ahead)
+void render_audio_suppress(uint8_t suppress)
+{
+	current_mixer()->output_suppressed = suppress;
+}
+
+static void put_mono_sample(audio_source *src, int16_t value)
 {
 	value = lowpass_sample(src, src->last_left, value);
+	if (src->fir) {
+		fir_push(src, value, value);
+	}
 	src->buffer_fraction += src->buffer_inc;
 	uint32_t base = render_is_audio_sync() ? 0 : src->read_end;
 	while (src->buffer_fraction > BUFFER_INC_RES)
 	{
 		src->buffer_fraction -= BUFFER_INC_RES;
-		interp_sample(src, src->last_left, value);
+		if (src->fir) {
+			fir_sample(src);
+		} else {
+			interp_sample(src, src->last_left, value);
+		}
 		
-		if (((src->buffer_pos - base) & src->mask) >= sync_samples) {
+		if (((src->buffer_pos - base) & src->mask) >= src->mixer->sync_samples) {
 			render_do_audio_ready(src);
 		}
 		src->buffer_pos &= src->mask;
@@ -292,35 +540,112 @@ void render_put_mono_sample(audio_source *src, int16_t value)
 	src->last_left = value;
 }
 
+void render_put_mono_sample(audio_source *src, int16_t value)
+{
+	if (src->mixer->output_suppressed) {
+		return;
+	}
+	BENCH_ENTER(BENCH_AUDIO);
+	put_mono_sample(src, value);
+	BENCH_EXIT();
+}
+
+void render_put_mono_samples(audio_source *src, int16_t value, uint32_t count)
+{
+	if (src->mixer->output_suppressed) {
+		return;
+	}
+	BENCH_ENTER(BENCH_AUDIO);
+	while (count)
+	{
+		if (lowpass_sample(src, src->last_left, value) == src->last_left && src->buffer_fraction <= BUFFER_INC_RES) {
+			//once the lowpass filter has settled, input samples that don't produce an output sample
+			//have no effect other than advancing the fractional position so they can be skipped in bulk
+			uint64_t skip = (BUFFER_INC_RES - src->buffer_fraction) / src->buffer_inc;
+			if (skip >= count) {
+				skip = count;
+			}
+			if (src->fir) {
+				fir_fill(src, src->last_left, skip);
+			}
+			src->buffer_fraction += skip * src->buffer_inc;
+			count -= skip;
+			if (!count) {
+				break;
+			}
+		}
+		put_mono_sample(src, value);
+		count--;
+	}
+	BENCH_EXIT();
+}
+
 void render_put_stereo_sample(audio_source *src, int16_t left, int16_t right)
 {
+	if (src->mixer->output_suppressed) {
+		return;
+	}
+	BENCH_ENTER(BENCH_AUDIO);
 	left = lowpass_sample(src, src->last_left, left);
 	right = lowpass_sample(src, src->last_right, right);
+	if (src->fir) {
+		fir_push(src, left, right);
+	}
 	src->buffer_fraction += src->buffer_inc;
 	uint32_t base = render_is_audio_sync() ? 0 : src->read_end;
 	while (src->buffer_fraction > BUFFER_INC_RES)
 	{
 		src->buffer_fraction -= BUFFER_INC_RES;
 		
-		interp_sample(src, src->last_left, left);
-		interp_sample(src, src->last_right, right);
+		if (src->fir) {
+			fir_sample(src);
+		} else {
+			interp_sample(src, src->last_left, left);
+			interp_sample(src, src->last_right, right);
+		}
 		
-		if (((src->buffer_pos - base) & src->mask)/2 >= sync_samples) {
+		if (((src->buffer_pos - base) & src->mask)/2 >= src->mixer->sync_samples) {
 			render_do_audio_ready(src);
 		}
 		src->buffer_pos &= src->mask;
 	}
 	src->last_left = left;
 	src->last_right = right;
+	BENCH_EXIT();
+}
+
+void render_audio_discard(audio_source *src)
+{
+	int16_t *tmp = src->front;
+	src->front = src->back;
+	src->back = tmp;
+	src->front_populated = 1;
+	src->buffer_pos = 0;
+	if (all_sources_ready()) {
+		int16_t discard_buf[2 * 1024];
+		audio_mixer *mixer = current_mixer();
+		int len = mixer->output_channels * mixer->buffer_samples * mixer->sample_size;
+		if (len > sizeof(discard_buf)) {
+			len = sizeof(discard_buf);
+		}
+		mix_and_convert((unsigned char *)discard_buf, len, NULL);
+	}
 }
 
 static void update_source(audio_source *src, double rc, uint8_t sync_changed)
 {
+	audio_mixer *mixer = src->mixer;
 	double alpha = src->dt / (src->dt + rc);
 	int32_t lowpass_alpha = (int32_t)(((double)0x10000) * alpha);
 	src->lowpass_alpha = lowpass_alpha;
+	if (mixer->use_fir) {
+		//sample rate may have changed so the kernel always needs to be recomputed
+		fir_init(src);
+	} else {
+		fir_free(src);
+	}
 	if (sync_changed) {
-		uint32_t alloc_size = render_is_audio_sync() ? src->num_channels * buffer_samples : nearest_pow2(render_min_buffered() * 4 * src->num_channels);
+		uint32_t alloc_size = render_is_audio_sync() ? src->num_channels * mixer->buffer_samples : nearest_pow2(render_min_buffered() * 4 * src->num_channels);
 		src->back = realloc(src->back, alloc_size * sizeof(int16_t));
 		if (render_is_audio_sync()) {
 			src->front = malloc(alloc_size * sizeof(int16_t));
@@ -330,56 +655,58 @@ static void update_source(audio_source *src, double rc, uint8_t sync_changed)
 		}
 		src->mask = render_is_audio_sync() ? 0xFFFFFFFF : alloc_size-1;
 		src->read_start = 0;
-		src->read_end = render_is_audio_sync() ? buffer_samples * src->num_channels : 0;
+		src->read_end = render_is_audio_sync() ? mixer->buffer_samples * src->num_channels : 0;
 		src->buffer_pos = 0;
 	}
 }
 
-uint8_t old_audio_sync;
 void render_audio_initialized(render_audio_format format, uint32_t rate, uint8_t channels, uint32_t buffer_size, int sample_size_in)
 {
-	sample_rate = rate;
-	output_channels = channels;
-	buffer_samples = buffer_size;
-	sample_size = sample_size_in;
-	if (mix_buf) {
-		free(mix_buf);
-		mix_buf = NULL;
+	audio_mixer *mixer = current_mixer();
+	mixer->sample_rate = rate;
+	mixer->output_channels = channels;
+	mixer->buffer_samples = buffer_size;
+	mixer->sample_size = sample_size_in;
+	if (mixer->mix_buf) {
+		free(mixer->mix_buf);
+		mixer->mix_buf = NULL;
 	}
 	switch(format)
 	{
 	case RENDER_AUDIO_S16:
-		convert = convert_s16;
-		mix_buf = calloc(output_channels * buffer_samples, sizeof(float));
+		mixer->convert = convert_s16;
+		mixer->mix_buf = calloc(mixer->output_channels * mixer->buffer_samples, sizeof(float));
 		break;
 	case RENDER_AUDIO_FLOAT:
-		convert = clamp_f32;
+		mixer->convert = clamp_f32;
 		break;
 	case RENDER_AUDIO_UNKNOWN:
-		convert = convert_null;
-		mix_buf = calloc(output_channels * buffer_samples, sizeof(float));
+		mixer->convert = convert_null;
+		mixer->mix_buf = calloc(mixer->output_channels * mixer->buffer_samples, sizeof(float));
 		break;
 	}
 	uint32_t syncs = render_audio_syncs_per_sec();
 	if (syncs) {
-		sync_samples = rate / syncs;
+		mixer->sync_samples = rate / syncs;
 	} else {
-		sync_samples = buffer_samples;
+		mixer->sync_samples = mixer->buffer_samples;
 	}
 	char * gain_str = tern_find_path(config, "audio\0gain\0", TVAL_PTR).ptrval;
-	overall_gain_mult = db_to_mult(gain_str ? atof(gain_str) : 0.0f);
-	uint8_t sync_changed = old_audio_sync != render_is_audio_sync();
-	old_audio_sync = render_is_audio_sync();
+	mixer->overall_gain_mult = db_to_mult(gain_str ? atof(gain_str) : 0.0f);
+	char *resampler = tern_find_path_default(config, "audio\0resampler\0", (tern_val){.ptrval = "linear"}, TVAL_PTR).ptrval;
+	mixer->use_fir = !strcmp(resampler, "sinc");
+	uint8_t sync_changed = mixer->old_audio_sync != render_is_audio_sync();
+	mixer->old_audio_sync = render_is_audio_sync();
 	double lowpass_cutoff = get_lowpass_cutoff(config);
 	double rc = (1.0 / lowpass_cutoff) / (2.0 * M_PI);
 	render_lock_audio();
-		for (uint8_t i = 0; i < num_audio_sources; i++)
+		for (uint8_t i = 0; i < mixer->num_audio_sources; i++)
 		{
-			update_source(audio_sources[i], rc, sync_changed);
+			update_source(mixer->audio_sources[i], rc, sync_changed);
 		}
 	render_unlock_audio();
-	for (uint8_t i = 0; i < num_inactive_audio_sources; i++)
+	for (uint8_t i = 0; i < mixer->num_inactive_audio_sources; i++)
 	{
-		update_source(inactive_audio_sources[i], rc, sync_changed);
+		update_source(mixer->inactive_audio_sources[i], rc, sync_changed);
 	}
-}
\ No newline at end of file
+}
@@ -8,8 +8,18 @@ typedef enum {
 	RENDER_AUDIO_UNKNOWN
 } render_audio_format;
 
+typedef struct fir_resampler fir_resampler;
+typedef struct audio_mixer audio_mixer;
+
+//read_start, read_end and front_populated are handed between the emulation thread and the audio thread
+//without a lock. Each one only has a single writer so acquire/release ordering is all that's needed
+#define AUDIO_LOAD(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define AUDIO_STORE(var, val) __atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+
 typedef struct {
 	void     *opaque;
+	audio_mixer   *mixer;
+	fir_resampler *fir;
 	int16_t  *front;
 	int16_t  *back;
 	double   dt;
@@ -32,15 +42,26 @@ audio_source *render_audio_source(uint64_t master_clock, uint64_t sample_divider
 void render_audio_source_gaindb(audio_source *src, float gain);
 void render_audio_adjust_clock(audio_source *src, uint64_t master_clock, uint64_t sample_divider);
 void render_put_mono_sample(audio_source *src, int16_t value);
+//equivalent to calling render_put_mono_sample count times with the same value, but cheaper
+void render_put_mono_samples(audio_source *src, int16_t value, uint32_t count);
 void render_put_stereo_sample(audio_source *src, int16_t left, int16_t right);
+void render_audio_suppress(uint8_t suppress);
 void render_pause_source(audio_source *src);
 void render_resume_source(audio_source *src);
 void render_free_source(audio_source *src);
+//Each mixer has its own output format and set of sources so several systems in one process can have separate audio
+//New sources are added to the mixer selected on the calling thread, as are the functions below that don't take a source
+//NULL selects the default mixer, returns the previously selected mixer
+audio_mixer *render_audio_select_mixer(audio_mixer *mixer);
+audio_mixer *render_audio_new_mixer(void);
+void render_audio_free_mixer(audio_mixer *mixer);
 //interface for render backends
 void render_audio_initialized(render_audio_format format, uint32_t rate, uint8_t channels, uint32_t buffer_size, int sample_size);
 int mix_and_convert(unsigned char *byte_stream, int len, int *min_remaining_out);
 uint8_t all_sources_ready(void);
 void render_audio_adjust_speed(float adjust_ratio);
+//mixes and throws away the output of all sources, for use when there is no audio device
+void render_audio_discard(audio_source *src);
 //to be implemented by render backend
 uint8_t render_is_audio_sync(void);
 void render_buffer_consumed(audio_source *src);
@@ -66,6 +66,10 @@ static snd_pcm_t *audio_handle;
 static void *output_buffer;
 void render_do_audio_ready(audio_source *src)
 {
+	if (headless) {
+		render_audio_discard(src);
+		return;
+	}
 	if (src->front_populated) {
 		fatal_error("Audio source filled up a buffer a second time before other sources finished their first\n");
 	}
@@ -824,184 +828,338 @@ static uint32_t *copy_buffer;
 static uint32_t last_width, last_width_scale, last_height, last_height_scale;
 static uint32_t max_multiple;
 
-static uint32_t mix_pixel(uint32_t last, uint32_t cur, float ratio)
+//Scaling works on precomputed taps: each output column and row maps to a source pixel or line plus the 8-bit
+//weight of the one before it. The vector paths blend 4 pixels at a time through the helpers below so SSE2 and
+//NEON share the same logic
+#ifndef DISABLE_SIMD
+#if defined(__SSE2__) || defined(X86_64)
+#include <emmintrin.h>
+#define FBDEV_SIMD
+typedef __m128i px4;
+#define px4_load(ptr) _mm_loadu_si128((__m128i *)(ptr))
+#define px4_store(ptr, v) _mm_storeu_si128((__m128i *)(ptr), v)
+#define px4_ziplo(v) _mm_unpacklo_epi32(v, v)
+#define px4_ziphi(v) _mm_unpackhi_epi32(v, v)
+#define px4_set(a, b, c, d) _mm_set_epi32(d, c, b, a)
+//weights holds 16 lanes, one per byte of the 4 pixels, each the weight of a out of 256
+static inline px4 px4_blend(px4 a, px4 b, uint16_t const *weights)
 {
-	float a,b,c,d;
-	a = (last & 255) * ratio;
-	b = (last >> 8 & 255) * ratio;
-	c = (last >> 16 & 255) * ratio;
-	d = (last >> 24 & 255) * ratio;
-	ratio = 1.0f - ratio;
-	a += (cur & 255) * ratio;
-	b += (cur >> 8 & 255) * ratio;
-	c += (cur >> 16 & 255) * ratio;
-	d += (cur >> 24 & 255) * ratio;
-	return ((int)d) << 24 | ((int)c) << 16 | ((int)b) << 8 | ((int)a);
+	__m128i zero = _mm_setzero_si128();
+	__m128i full = _mm_set1_epi16(256);
+	__m128i wlo = _mm_loadu_si128((__m128i *)weights);
+	__m128i whi = _mm_loadu_si128((__m128i *)(weights + 8));
+	__m128i lo = _mm_add_epi16(
+		_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), wlo),
+		_mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), _mm_sub_epi16(full, wlo))
+	);
+	__m128i hi = _mm_add_epi16(
+		_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), whi),
+		_mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), _mm_sub_epi16(full, whi))
+	);
+	return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
 }
-static void do_buffer_copy(void)
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FBDEV_SIMD
+typedef uint32x4_t px4;
+#define px4_load(ptr) vld1q_u32(ptr)
+#define px4_store(ptr, v) vst1q_u32(ptr, v)
+#define px4_ziplo(v) vzipq_u32(v, v).val[0]
+#define px4_ziphi(v) vzipq_u32(v, v).val[1]
+#define px4_set(a, b, c, d) ((uint32x4_t){a, b, c, d})
+static inline px4 px4_blend(px4 a, px4 b, uint16_t const *weights)
+{
+	uint8x16_t a8 = vreinterpretq_u8_u32(a), b8 = vreinterpretq_u8_u32(b);
+	uint16x8_t full = vdupq_n_u16(256);
+	uint16x8_t wlo = vld1q_u16(weights);
+	uint16x8_t whi = vld1q_u16(weights + 8);
+	uint16x8_t lo = vmlaq_u16(vmulq_u16(vmovl_u8(vget_low_u8(a8)), wlo), vmovl_u8(vget_low_u8(b8)), vsubq_u16(full, wlo));
+	uint16x8_t hi = vmlaq_u16(vmulq_u16(vmovl_u8(vget_high_u8(a8)), whi), vmovl_u8(vget_high_u8(b8)), vsubq_u16(full, whi));
+	return vreinterpretq_u32_u8(vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+}
+#endif
+#endif //DISABLE_SIMD
+
+enum {
+	FILTER_LINEAR,
+	FILTER_NEAREST
+};
+
+typedef struct {
+	uint16_t src;
+	uint16_t prev;   //src - 1 when the two are blended, src otherwise
+	uint16_t weight; //weight of prev out of 256
+} scale_tap;
+
+//each copy thread fills a band of output rows, lines caches the horizontally scaled source lines it used last
+typedef struct {
+	uint32_t *lines[2];
+	int32_t  line_src[2];
+	uint32_t first_row, end_row;
+	uint32_t generation; //last value of band_generation this band was scaled for
+	uint8_t  next_line;
+} copy_band;
+
+#define MAX_COPY_THREADS 8
+static copy_band copy_bands[MAX_COPY_THREADS];
+static uint32_t num_copy_threads = 1;
+static uint8_t scale_filter;
+static pthread_mutex_t band_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t band_start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t band_done_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t band_generation, bands_pending;
+
+static scale_tap *col_taps, *row_taps;
+static uint16_t *col_weights;
+static uint32_t *scale_origin;
+static uint32_t scale_width, scale_height, scale_multiple;
+static uint8_t scale_replicate; //every source pixel maps to exactly scale_multiple output pixels
+
+//output pixel i covers [i, i+1) which is [i * src / dst, (i+1) * src / dst) in source pixels
+static void calc_taps(scale_tap *taps, uint32_t src_count, uint32_t dst_count)
 {
+	for (uint32_t i = 0; i < dst_count; i++)
+	{
+		uint32_t first = i * src_count / dst_count;
+		uint32_t last = ((i + 1) * src_count - 1) / dst_count;
+		uint32_t weight = 0;
+		if (first != last) {
+			//portion of this output pixel covered by the source pixels before last
+			weight = ((last * dst_count - i * src_count) * 256 + src_count / 2) / src_count;
+		}
+		if (scale_filter == FILTER_NEAREST) {
+			if (weight >= 128) {
+				last--;
+			}
+			weight = 0;
+		} else if (weight >= 256) {
+			last--;
+			weight = 0;
+		}
+		taps[i].src = last;
+		taps[i].prev = weight ? last - 1 : last;
+		taps[i].weight = weight;
+	}
+}
+
+static void update_scale(void)
+{
+	static uint32_t cur_width, cur_width_scale, cur_height, cur_height_scale, cur_bands;
 	uint32_t width_multiple = main_width / last_width_scale;
 	uint32_t height_multiple = main_height / last_height_scale;
 	uint32_t multiple = width_multiple < height_multiple ? width_multiple : height_multiple;
 	if (max_multiple && multiple > max_multiple) {
 		multiple = max_multiple;
 	}
-	height_multiple = last_height_scale * multiple / last_height;
-	uint32_t *cur_line = framebuffer + (main_width - last_width_scale * multiple)/2;
-	cur_line += fb_stride * (main_height - last_height_scale * multiple) / (2 * sizeof(uint32_t));
-	uint32_t *src_line = copy_buffer;
-	if (height_multiple * last_height == multiple * last_height_scale) {
-		if (last_width == last_width_scale) {
-			for (uint32_t y = 0; y < last_height; y++)
+	if (
+		col_taps && multiple == scale_multiple && last_width == cur_width && last_width_scale == cur_width_scale
+		&& last_height == cur_height && last_height_scale == cur_height_scale && num_copy_threads == cur_bands
+	) {
+		return;
+	}
+	cur_bands = num_copy_threads;
+	cur_width = last_width;
+	cur_width_scale = last_width_scale;
+	cur_height = last_height;
+	cur_height_scale = last_height_scale;
+	scale_multiple = multiple;
+	scale_width = last_width_scale * multiple;
+	scale_height = last_height_scale * multiple;
+	scale_origin = framebuffer + (main_width - scale_width)/2;
+	scale_origin += fb_stride * (main_height - scale_height) / (2 * sizeof(uint32_t));
+	
+	free(col_taps);
+	free(row_taps);
+	free(col_weights);
+	col_taps = malloc(sizeof(scale_tap) * (scale_width ? scale_width : 1));
+	row_taps = malloc(sizeof(scale_tap) * (scale_height ? scale_height : 1));
+	//the vector blend reads the weights of 4 pixels at a time so round up
+	col_weights = malloc(sizeof(uint16_t) * 4 * ((scale_width + 3) & ~3));
+	calc_taps(col_taps, last_width, scale_width);
+	calc_taps(row_taps, last_height, scale_height);
+	scale_replicate = last_width == last_width_scale;
+	for (uint32_t x = 0; x < scale_width; x++)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			col_weights[x * 4 + i] = col_taps[x].weight;
+		}
+		scale_replicate = scale_replicate && !col_taps[x].weight;
+	}
+	for (uint32_t x = scale_width; x < ((scale_width + 3) & ~3); x++)
+	{
+		memset(col_weights + x * 4, 0, 4 * sizeof(uint16_t));
+	}
+	for (uint32_t i = 0; i < num_copy_threads; i++)
+	{
+		copy_bands[i].first_row = scale_height * i / num_copy_threads;
+		copy_bands[i].end_row = scale_height * (i + 1) / num_copy_threads;
+		copy_bands[i].line_src[0] = copy_bands[i].line_src[1] = -1;
+	}
+}
+
+static uint32_t blend_pixel(uint32_t a, uint32_t b, uint32_t weight)
+{
+	uint32_t rb = ((a & 0xFF00FF) * weight + (b & 0xFF00FF) * (256 - weight)) >> 8;
+	uint32_t ag = ((a >> 8 & 0xFF00FF) * weight + (b >> 8 & 0xFF00FF) * (256 - weight)) >> 8;
+	return (rb & 0xFF00FF) | (ag & 0xFF00FF) << 8;
+}
+
+//weights has 4 entries per pixel so a per column or a constant weight can be used
+static void blend_line(uint32_t *dst, uint32_t const *a, uint32_t const *b, uint16_t const *weights, uint8_t constant, uint32_t width)
+{
+	uint32_t x = 0;
+#ifdef FBDEV_SIMD
+	for (; x + 4 <= width; x += 4)
+	{
+		px4_store(dst + x, px4_blend(px4_load(a + x), px4_load(b + x), weights + (constant ? 0 : x * 4)));
+	}
+#endif
+	for (; x < width; x++)
+	{
+		dst[x] = blend_pixel(a[x], b[x], weights[constant ? 0 : x * 4]);
+	}
+}
+
+static void scale_line(uint32_t *dst, uint32_t const *src)
+{
+	if (scale_replicate) {
+		uint32_t x = 0;
+		switch (scale_multiple) {
+		case 1:
+			memcpy(dst, src, last_width * sizeof(uint32_t));
+			return;
+#ifdef FBDEV_SIMD
+		case 2:
+			for (; x + 4 <= last_width; x += 4)
 			{
-				for (uint32_t i = 0; i < height_multiple; i++)
-				{
-					uint32_t *cur = cur_line;
-					uint32_t *src = src_line;
-					for (uint32_t x = 0; x < last_width	; x++)
-					{
-						uint32_t pixel = *(src++);
-						for (uint32_t j = 0; j < multiple; j++)
-						{
-							*(cur++) = pixel;
-						}
-					}
-					
-					cur_line += fb_stride / sizeof(uint32_t);
-				}
-				src_line += LINEBUF_SIZE;
+				px4 pixels = px4_load(src + x);
+				px4_store(dst + x * 2, px4_ziplo(pixels));
+				px4_store(dst + x * 2 + 4, px4_ziphi(pixels));
 			}
-		} else {
-			float scale_multiple = ((float)(last_width_scale * multiple)) / (float)last_width;
-			float remaining = 0.0f;
-			uint32_t last_pixel = 0;
-			for (uint32_t y = 0; y < last_height; y++)
+			break;
+#endif
+		}
+		for (; x < last_width; x++)
+		{
+			for (uint32_t i = 0; i < scale_multiple; i++)
 			{
-				for (uint32_t i = 0; i < height_multiple; i++)
-				{
-					uint32_t *cur = cur_line;
-					uint32_t *src = src_line;
-					for (uint32_t x = 0; x < last_width	; x++)
-					{
-						uint32_t pixel = *(src++);
-						float count = scale_multiple;
-						if (remaining > 0.0f) {
-							*(cur++) = mix_pixel(last_pixel, pixel, remaining);
-							count -= 1.0f - remaining;
-						}
-						for (; count >= 1; count -= 1.0f)
-						{
-							*(cur++) = pixel;
-						}
-						remaining = count;
-						last_pixel = pixel;
-					}
-					
-					cur_line += fb_stride / sizeof(uint32_t);
-				}
-				src_line += LINEBUF_SIZE;
+				*(dst++) = src[x];
 			}
 		}
-	} else {
-		float height_scale = ((float)(last_height_scale * multiple)) / (float)last_height;
-		float height_remaining = 0.0f;
-		uint32_t *last_line;
-		if (last_width == last_width_scale) {
-			for (uint32_t y = 0; y < last_height; y++)
+		return;
+	}
+	if (scale_filter == FILTER_NEAREST) {
+		for (uint32_t x = 0; x < scale_width; x++)
+		{
+			dst[x] = src[col_taps[x].src];
+		}
+		return;
+	}
+	uint32_t x = 0;
+#ifdef FBDEV_SIMD
+	for (; x + 4 <= scale_width; x += 4)
+	{
+		scale_tap const *taps = col_taps + x;
+		px4 prev = px4_set(src[taps[0].prev], src[taps[1].prev], src[taps[2].prev], src[taps[3].prev]);
+		px4 cur = px4_set(src[taps[0].src], src[taps[1].src], src[taps[2].src], src[taps[3].src]);
+		px4_store(dst + x, px4_blend(prev, cur, col_weights + x * 4));
+	}
+#endif
+	for (; x < scale_width; x++)
+	{
+		scale_tap tap = col_taps[x];
+		dst[x] = tap.weight ? blend_pixel(src[tap.prev], src[tap.src], tap.weight) : src[tap.src];
+	}
+}
+
+static uint32_t *scaled_line(copy_band *band, uint32_t src_line)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		if (band->line_src[i] == (int32_t)src_line) {
+			return band->lines[i];
+		}
+	}
+	uint8_t slot = band->next_line;
+	band->next_line ^= 1;
+	band->line_src[slot] = src_line;
+	scale_line(band->lines[slot], copy_buffer + src_line * LINEBUF_SIZE);
+	return band->lines[slot];
+}
+
+static void scale_band(copy_band *band)
+{
+	//source contents change every frame
+	band->line_src[0] = band->line_src[1] = -1;
+	uint32_t stride = fb_stride / sizeof(uint32_t);
+	uint32_t *dst = scale_origin + band->first_row * stride;
+	for (uint32_t y = band->first_row; y < band->end_row; y++, dst += stride)
+	{
+		scale_tap tap = row_taps[y];
+		if (tap.weight) {
+			uint16_t weights[16];
+			for (int i = 0; i < 16; i++)
 			{
-				float hcount = height_scale;
-				if (height_remaining > 0.0f) {
-					uint32_t *cur = cur_line;
-					uint32_t *src = src_line;
-					uint32_t *last = last_line;
-					for (uint32_t x = 0; x < last_width	; x++)
-					{
-						uint32_t mixed = mix_pixel(*(last++), *(src++), height_remaining);
-						for (uint32_t j = 0; j < multiple; j++)
-						{
-							*(cur++) = mixed;
-						}
-					}
-					hcount -= 1.0f - height_remaining;
-					cur_line += fb_stride / sizeof(uint32_t);
-				}
-				for(; hcount >= 1; hcount -= 1.0f)
-				{
-					uint32_t *cur = cur_line;
-					uint32_t *src = src_line;
-					for (uint32_t x = 0; x < last_width	; x++)
-					{
-						uint32_t pixel = *(src++);
-						for (uint32_t j = 0; j < multiple; j++)
-						{
-							*(cur++) = pixel;
-						}
-					}
-					
-					cur_line += fb_stride / sizeof(uint32_t);
-				}
-				height_remaining = hcount;
-				last_line = src_line;
-				src_line += LINEBUF_SIZE;
+				weights[i] = tap.weight;
 			}
+			blend_line(dst, scaled_line(band, tap.prev), scaled_line(band, tap.src), weights, 1, scale_width);
+		} else if (y + 1 < band->end_row && (row_taps[y + 1].src == tap.src || row_taps[y + 1].prev == tap.src)) {
+			//the framebuffer is often uncached so repeated lines are copied from a scaled line rather than read back
+			memcpy(dst, scaled_line(band, tap.src), scale_width * sizeof(uint32_t));
 		} else {
-			float scale_multiple = ((float)(last_width_scale * multiple)) / (float)last_width;
-			float remaining = 0.0f;
-			uint32_t last_pixel = 0;
-			for (uint32_t y = 0; y < last_height; y++)
+			scale_line(dst, copy_buffer + tap.src * LINEBUF_SIZE);
+		}
+	}
+}
+
+static void *band_thread(void *data)
+{
+	copy_band *band = data;
+	pthread_mutex_lock(&band_lock);
+	for(;;)
+	{
+		while (band_generation == band->generation)
+		{
+			pthread_cond_wait(&band_start_cond, &band_lock);
+		}
+		band->generation = band_generation;
+		if ((uint32_t)(band - copy_bands) >= num_copy_threads) {
+			//copy_threads was lowered after this thread was started
+			continue;
+		}
+		pthread_mutex_unlock(&band_lock);
+		scale_band(band);
+		pthread_mutex_lock(&band_lock);
+		if (!--bands_pending) {
+			pthread_cond_signal(&band_done_cond);
+		}
+	}
+	return 0;
+}
+
+static void do_buffer_copy(void)
+{
+	update_scale();
+	if (!scale_multiple) {
+		//screen is smaller than the source
+		return;
+	}
+	if (num_copy_threads > 1) {
+		pthread_mutex_lock(&band_lock);
+			bands_pending = num_copy_threads - 1;
+			band_generation++;
+			pthread_cond_broadcast(&band_start_cond);
+		pthread_mutex_unlock(&band_lock);
+	}
+	scale_band(copy_bands);
+	if (num_copy_threads > 1) {
+		pthread_mutex_lock(&band_lock);
+			while (bands_pending)
 			{
-				float hcount = height_scale;
-				if (height_remaining > 0.0f) {
-					uint32_t *cur = cur_line;
-					uint32_t *src = src_line;
-					uint32_t *last = last_line;
-					
-					for (uint32_t x = 0; x < last_width; x++)
-					{
-						uint32_t pixel = mix_pixel(*(last++), *(src++), height_remaining);
-						float count = scale_multiple;
-						if (remaining > 0.0f) {
-							*(cur++) = mix_pixel(last_pixel, pixel, remaining);
-							count -= 1.0f - remaining;
-						}
-						for (; count >= 1.0f; count -= 1.0f)
-						{
-							*(cur++) = pixel;
-						}
-						remaining = count;
-						last_pixel = pixel;
-					}
-					hcount -= 1.0f - height_remaining;
-					cur_line += fb_stride / sizeof(uint32_t);
-				}
-				
-				for (; hcount >= 1.0f; hcount -= 1.0f)
-				{
-					uint32_t *cur = cur_line;
-					uint32_t *src = src_line;
-					for (uint32_t x = 0; x < last_width	; x++)
-					{
-						uint32_t pixel = *(src++);
-						float count = scale_multiple;
-						if (remaining > 0.0f) {
-							*(cur++) = mix_pixel(last_pixel, pixel, remaining);
-							count -= 1.0f - remaining;
-						}
-						for (; count >= 1; count -= 1.0f)
-						{
-							*(cur++) = pixel;
-						}
-						remaining = count;
-						last_pixel = pixel;
-					}
-					
-					cur_line += fb_stride / sizeof(uint32_t);
-				}
-				height_remaining = hcount;
-				last_line = src_line;
-				src_line += LINEBUF_SIZE;
+				pthread_cond_wait(&band_done_cond, &band_lock);
 			}
-		}
+		pthread_mutex_unlock(&band_lock);
 	}
 }
 static void *buffer_copy(void *data)
@@ -1020,6 +1178,8 @@ static void *buffer_copy(void *data)
 }
 
 static pthread_t buffer_copy_handle;
+static pthread_t band_handles[MAX_COPY_THREADS];
+static uint32_t band_threads = 1; //band 0 is done by the thread doing the copy
 static uint8_t copy_use_thread;
 void window_setup(void)
 {
@@ -1091,6 +1251,36 @@ void window_setup(void)
 	if (copy_use_thread) {
 		pthread_create(&buffer_copy_handle, NULL, buffer_copy, NULL);
 	}
+	def.ptrval = "linear";
+	scale_filter = strcmp(tern_find_path_default(config, "video\0fbdev\0filter\0", def, TVAL_PTR).ptrval, "nearest") ? FILTER_LINEAR : FILTER_NEAREST;
+	//the copy is split into bands of rows, 0 means one band per CPU
+	def.ptrval = "0";
+	uint32_t copy_threads = atoi(tern_find_path_default(config, "video\0fbdev\0copy_threads\0", def, TVAL_PTR).ptrval);
+	if (!copy_threads) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		copy_threads = cpus > 0 ? cpus : 1;
+	}
+	if (copy_threads > MAX_COPY_THREADS) {
+		copy_threads = MAX_COPY_THREADS;
+	}
+	//this runs again when the config changes, the copy thread holds buffer_lock for the whole copy
+	pthread_mutex_lock(&buffer_lock);
+		num_copy_threads = copy_threads;
+		//scaled lines are never wider than the screen, rounded up for the vector paths
+		size_t line_size = sizeof(uint32_t) * ((main_width + 3) & ~3);
+		for (uint32_t i = 0; i < num_copy_threads; i++)
+		{
+			copy_bands[i].lines[0] = realloc(copy_bands[i].lines[0], line_size);
+			copy_bands[i].lines[1] = realloc(copy_bands[i].lines[1], line_size);
+		}
+		//band threads are never stopped, ones past num_copy_threads just sit idle
+		for (; band_threads < num_copy_threads; band_threads++)
+		{
+			//no copy can start while buffer_lock is held so this can't miss one
+			copy_bands[band_threads].generation = band_generation;
+			pthread_create(band_handles + band_threads, NULL, band_thread, copy_bands + band_threads);
+		}
+	pthread_mutex_unlock(&buffer_lock);
 #ifndef DISABLE_OPENGL
 	}
 #endif
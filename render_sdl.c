@@ -46,8 +46,9 @@ static uint8_t scanlines = 0;
 
 static uint32_t last_frame = 0;
 
-static SDL_mutex *audio_mutex, *frame_mutex, *free_buffer_mutex;
-static SDL_cond *audio_ready, *frame_ready;
+static SDL_mutex *audio_mutex;
+static SDL_sem *frame_ready;
+static SDL_sem *audio_ready;
 static uint8_t quitting = 0;
 
 enum {
@@ -60,9 +61,30 @@ enum {
 static uint8_t sync_src;
 static uint32_t min_buffered;
 
-uint32_t **frame_buffers;
-uint32_t num_buffers;
-uint32_t buffer_storage;
+typedef struct {
+	uint32_t *buffer;
+	uint32_t sequence;
+	int      width;
+	uint8_t  which;
+} mailbox_slot;
+
+//When the emulation thread is separate from the video thread each framebuffer is handed over through a lock-free
+//triple buffer. The emulation thread renders into back and publishes it by swapping it with the shared middle
+//slot, the video thread swaps front with the middle slot whenever that holds a frame it hasn't presented yet.
+//Neither thread ever waits on the other and the video thread always gets the newest complete frame
+typedef struct {
+	mailbox_slot slots[3];
+	uint8_t      back;   //only used by the emulation thread
+	uint8_t      front;  //only used by the video thread
+	uint8_t      middle; //slot index, swapped atomically
+	uint8_t      initialized;
+} frame_mailbox;
+#define MAILBOX_FRESH 0x80
+
+static frame_mailbox mailboxes[256];
+static uint16_t num_mailboxes;
+static uint32_t frame_sequence;
+static uint8_t frame_signal_pending;
 
 uint32_t render_min_buffered(void)
 {
@@ -79,25 +101,41 @@ uint8_t render_should_release_on_exit(void)
 	return sync_src != SYNC_AUDIO_THREAD;
 }
 
+//Wakes up a thread waiting on sem without letting the count grow when nobody is waiting
+//waiters always recheck their condition so an extra wakeup is harmless, but a missed one is not
+static void wake_audio_waiter(SDL_sem *sem)
+{
+	if (!SDL_SemValue(sem)) {
+		SDL_SemPost(sem);
+	}
+}
+
 void render_buffer_consumed(audio_source *src)
 {
-	SDL_CondSignal(src->opaque);
+	if (sync_src == SYNC_AUDIO) {
+		wake_audio_waiter(src->opaque);
+	}
 }
 
 static void audio_callback(void * userdata, uint8_t *byte_stream, int len)
 {
-	SDL_LockMutex(audio_mutex);
-		uint8_t all_ready;
-		do {
-			all_ready = all_sources_ready();
-			if (!quitting && !all_ready) {
-				SDL_CondWait(audio_ready, audio_mutex);
+	//audio_mutex only protects the list of sources, buffers are handed over through front_populated
+	//so the emulation thread never has to wait for mixing to finish
+	for (;;)
+	{
+		SDL_LockMutex(audio_mutex);
+			if (AUDIO_LOAD(quitting)) {
+				SDL_UnlockMutex(audio_mutex);
+				return;
 			}
-		} while(!quitting && !all_ready);
-		if (!quitting) {
-			mix_and_convert(byte_stream, len, NULL);
-		}
-	SDL_UnlockMutex(audio_mutex);
+			if (all_sources_ready()) {
+				mix_and_convert(byte_stream, len, NULL);
+				SDL_UnlockMutex(audio_mutex);
+				return;
+			}
+		SDL_UnlockMutex(audio_mutex);
+		SDL_SemWait(audio_ready);
+	}
 }
 
 #define NO_LAST_BUFFERED -2000000000
@@ -110,11 +148,13 @@ static int32_t cur_min_buffered;
 static uint32_t min_remaining_buffer;
 static void audio_callback_drc(void *userData, uint8_t *byte_stream, int len)
 {
-	if (cur_min_buffered < 0) {
+	if (AUDIO_LOAD(cur_min_buffered) < 0) {
 		//underflow last frame, but main thread hasn't gotten a chance to call SDL_PauseAudio yet
 		return;
 	}
-	cur_min_buffered = mix_and_convert(byte_stream, len, &min_remaining_buffer);
+	int min_remaining;
+	AUDIO_STORE(cur_min_buffered, mix_and_convert(byte_stream, len, &min_remaining));
+	AUDIO_STORE(min_remaining_buffer, min_remaining);
 }
 
 static void audio_callback_run_on_audio(void *user_data, uint8_t *byte_stream, int len)
@@ -145,10 +185,8 @@ void render_unlock_audio()
 
 static void render_close_audio()
 {
-	SDL_LockMutex(audio_mutex);
-		quitting = 1;
-		SDL_CondSignal(audio_ready);
-	SDL_UnlockMutex(audio_mutex);
+	AUDIO_STORE(quitting, 1);
+	SDL_SemPost(audio_ready);
 	SDL_CloseAudio();
 	/*
 	FIXME: move this to render_audio.c
@@ -161,12 +199,12 @@ static void render_close_audio()
 
 void *render_new_audio_opaque(void)
 {
-	return SDL_CreateCond();
+	return SDL_CreateSemaphore(0);
 }
 
 void render_free_audio_opaque(void *opaque)
 {
-	SDL_DestroyCond(opaque);
+	SDL_DestroySemaphore(opaque);
 }
 
 void render_audio_created(audio_source *source)
@@ -182,12 +220,12 @@ void render_audio_created(audio_source *source)
 void render_source_paused(audio_source *src, uint8_t remaining_sources)
 {
 	if (sync_src == SYNC_AUDIO) {
-		SDL_CondSignal(audio_ready);
+		wake_audio_waiter(audio_ready);
 	}
 	if (!remaining_sources && render_is_audio_sync()) {
 		SDL_PauseAudio(1);
 		if (sync_src == SYNC_AUDIO_THREAD) {
-			SDL_CondSignal(frame_ready);
+			SDL_SemPost(frame_ready);
 		}
 	}
 }
@@ -204,7 +242,9 @@ void render_source_resumed(audio_source *src)
 
 void render_do_audio_ready(audio_source *src)
 {
-	if (sync_src == SYNC_AUDIO_THREAD) {
+	if (headless) {
+		render_audio_discard(src);
+	} else if (sync_src == SYNC_AUDIO_THREAD) {
 		int16_t *tmp = src->front;
 		src->front = src->back;
 		src->back = tmp;
@@ -215,23 +255,20 @@ void render_do_audio_ready(audio_source *src)
 			system_request_exit(current_system, 0);
 		}
 	} else if (sync_src == SYNC_AUDIO) {
-		SDL_LockMutex(audio_mutex);
-			while (src->front_populated) {
-				SDL_CondWait(src->opaque, audio_mutex);
-			}
-			int16_t *tmp = src->front;
-			src->front = src->back;
-			src->back = tmp;
-			src->front_populated = 1;
-			src->buffer_pos = 0;
-			SDL_CondSignal(audio_ready);
-		SDL_UnlockMutex(audio_mutex);
+		//front and back form a two entry queue, only wait if the audio thread hasn't consumed the last buffer yet
+		while (AUDIO_LOAD(src->front_populated)) {
+			SDL_SemWait(src->opaque);
+		}
+		int16_t *tmp = src->front;
+		src->front = src->back;
+		src->back = tmp;
+		src->buffer_pos = 0;
+		AUDIO_STORE(src->front_populated, 1);
+		wake_audio_waiter(audio_ready);
 	} else {
-		uint32_t num_buffered;
-		SDL_LockAudio();
-			src->read_end = src->buffer_pos;
-			num_buffered = ((src->read_end - src->read_start) & src->mask) / src->num_channels;
-		SDL_UnlockAudio();
+		//the ring buffer has a single producer and a single consumer so publishing the new end is all that's needed
+		AUDIO_STORE(src->read_end, src->buffer_pos);
+		uint32_t num_buffered = ((src->buffer_pos - AUDIO_LOAD(src->read_start)) & src->mask) / src->num_channels;
 		if (num_buffered >= min_buffered && SDL_GetAudioStatus() == SDL_AUDIO_PAUSED) {
 			SDL_PauseAudio(0);
 		}
@@ -1002,14 +1039,8 @@ void window_setup(void)
 		}
 	}
 	
-	if (!num_buffers && (sync_src == SYNC_AUDIO_THREAD || sync_src == SYNC_EXTERNAL)) {
-		frame_mutex = SDL_CreateMutex();
-		free_buffer_mutex = SDL_CreateMutex();
-		frame_ready = SDL_CreateCond();
-		buffer_storage = 4;
-		frame_buffers = calloc(buffer_storage, sizeof(uint32_t*));
-		frame_buffers[0] = texture_buf;
-		num_buffers = 1;
+	if (!frame_ready && (sync_src == SYNC_AUDIO_THREAD || sync_src == SYNC_EXTERNAL)) {
+		frame_ready = SDL_CreateSemaphore(0);
 	}
 	
 	const char *vsync;
@@ -1171,7 +1202,7 @@ void render_init(int width, int height, char * title, uint8_t fullscreen)
 	window_setup();
 
 	audio_mutex = SDL_CreateMutex();
-	audio_ready = SDL_CreateCond();
+	audio_ready = SDL_CreateSemaphore(0);
 	
 	init_audio();
 	
@@ -1252,7 +1283,7 @@ void render_config_updated(void)
 
 	uint8_t was_paused = SDL_GetAudioStatus() == SDL_AUDIO_PAUSED;
 	render_close_audio();
-	quitting = 0;
+	AUDIO_STORE(quitting, 0);
 	init_audio();
 	render_set_video_standard(video_standard);
 	
@@ -1390,16 +1421,23 @@ uint32_t *render_get_framebuffer(uint8_t which, int *pitch)
 {
 	if (sync_src == SYNC_AUDIO_THREAD || sync_src == SYNC_EXTERNAL) {
 		*pitch = LINEBUF_SIZE * sizeof(uint32_t);
-		uint32_t *buffer;
-		SDL_LockMutex(free_buffer_mutex);
-			if (num_buffers) {
-				buffer = frame_buffers[--num_buffers];
-			} else {
-				buffer = calloc(tex_width*(tex_height + 1), sizeof(uint32_t));
+		frame_mailbox *box = mailboxes + which;
+		if (!box->initialized) {
+			box->back = 0;
+			box->front = 1;
+			box->middle = 2;
+			box->initialized = 1;
+			if (which >= num_mailboxes) {
+				__atomic_store_n(&num_mailboxes, which + 1, __ATOMIC_RELEASE);
 			}
-		SDL_UnlockMutex(free_buffer_mutex);
-		locked_pixels = buffer;
-		return buffer;
+		}
+		mailbox_slot *slot = box->slots + box->back;
+		if (!slot->buffer) {
+			//tex_width/tex_height only exist in GL builds and are never set when falling back to SDL_Renderer
+			slot->buffer = calloc(LINEBUF_SIZE * (294 + 1), sizeof(uint32_t)); //PAL height with full borders
+		}
+		locked_pixels = slot->buffer;
+		return slot->buffer;
 	}
 #ifndef DISABLE_OPENGL
 	if (render_gl && which <= FRAMEBUFFER_EVEN) {
@@ -1437,17 +1475,6 @@ uint32_t *render_get_framebuffer(uint8_t which, int *pitch)
 #endif
 }
 
-static void release_buffer(uint32_t *buffer)
-{
-	SDL_LockMutex(free_buffer_mutex);
-		if (num_buffers == buffer_storage) {
-			buffer_storage *= 2;
-			frame_buffers = realloc(frame_buffers, sizeof(uint32_t*)*buffer_storage);
-		}
-		frame_buffers[num_buffers++] = buffer;
-	SDL_UnlockMutex(free_buffer_mutex);
-}
-
 uint8_t events_processed;
 #ifdef __ANDROID__
 #define FPS_INTERVAL 10000
@@ -1598,16 +1625,13 @@ static void process_framebuffer(uint32_t *buffer, uint8_t which, int width)
 		}
 	}
 	if (!render_is_audio_sync()) {
-		int32_t local_cur_min, local_min_remaining;
-		SDL_LockAudio();
-			if (last_buffered > NO_LAST_BUFFERED) {
-				average_change *= 0.9f;
-				average_change += (cur_min_buffered - last_buffered) * 0.1f;
-			}
-			local_cur_min = cur_min_buffered;
-			local_min_remaining = min_remaining_buffer;
-			last_buffered = cur_min_buffered;
-		SDL_UnlockAudio();
+		int32_t local_cur_min = AUDIO_LOAD(cur_min_buffered);
+		int32_t local_min_remaining = AUDIO_LOAD(min_remaining_buffer);
+		if (last_buffered > NO_LAST_BUFFERED) {
+			average_change *= 0.9f;
+			average_change += (local_cur_min - last_buffered) * 0.1f;
+		}
+		last_buffered = local_cur_min;
 		float frames_to_problem;
 		if (average_change < 0) {
 			frames_to_problem = (float)local_cur_min / -average_change;
@@ -1619,14 +1643,14 @@ static void process_framebuffer(uint32_t *buffer, uint8_t which, int width)
 			frames_to_problem < BUFFER_FRAMES_THRESHOLD
 			|| (average_change < 0 && local_cur_min < 3*min_buffered / 4)
 			|| (average_change >0 && local_cur_min > 5 * min_buffered / 4)
-			|| cur_min_buffered < 0
+			|| local_cur_min < 0
 		) {
 			
-			if (cur_min_buffered < 0) {
+			if (local_cur_min < 0) {
 				adjust_ratio = max_adjust;
 				SDL_PauseAudio(1);
 				last_buffered = NO_LAST_BUFFERED;
-				cur_min_buffered = 0;
+				AUDIO_STORE(cur_min_buffered, 0);
 			} else {
 				adjust_ratio = -1.0 * average_change / ((float)sample_rate / (float)source_hz);
 				adjust_ratio /= 2.5 * source_hz;
@@ -1655,81 +1679,74 @@ static void process_framebuffer(uint32_t *buffer, uint8_t which, int width)
 	}
 }
 
-typedef struct {
-	uint32_t *buffer;
-	int      width;
-	uint8_t  which;
-} frame;
-frame frame_queue[4];
-int frame_queue_len, frame_queue_read, frame_queue_write;
-
 void render_framebuffer_updated(uint8_t which, int width)
 {
 	if (sync_src == SYNC_AUDIO_THREAD || sync_src == SYNC_EXTERNAL) {
-		SDL_LockMutex(frame_mutex);
-			while (frame_queue_len == 4) {
-				SDL_CondSignal(frame_ready);
-				SDL_UnlockMutex(frame_mutex);
-				SDL_Delay(1);
-				SDL_LockMutex(frame_mutex);
-			}
-			for (int cur = frame_queue_read, i = 0; i < frame_queue_len; i++) {
-				if (frame_queue[cur].which == which) {
-					int last = (frame_queue_write - 1) & 3;
-					frame_queue_len--;
-					release_buffer(frame_queue[cur].buffer);
-					if (last != cur) {
-						frame_queue[cur] = frame_queue[last];
-					}
-					frame_queue_write = last;
-					break;
-				}
-				cur = (cur + 1) & 3;
-			}
-			frame_queue[frame_queue_write++] = (frame){
-				.buffer = locked_pixels,
-				.width = width,
-				.which = which
-			};
-			frame_queue_write &= 0x3;
-			frame_queue_len++;
-			SDL_CondSignal(frame_ready);
-		SDL_UnlockMutex(frame_mutex);
+		frame_mailbox *box = mailboxes + which;
+		mailbox_slot *slot = box->slots + box->back;
+		slot->width = width;
+		slot->which = which;
+		slot->sequence = __atomic_add_fetch(&frame_sequence, 1, __ATOMIC_RELAXED);
+		//an unpresented frame in the middle slot is simply replaced by the newer one
+		//both exchanges are seq_cst so they can't be reordered against the presenter clearing
+		//frame_signal_pending and then checking middle, otherwise a wakeup could be lost
+		box->back = __atomic_exchange_n(&box->middle, box->back | MAILBOX_FRESH, __ATOMIC_SEQ_CST) & ~MAILBOX_FRESH;
+		if (!__atomic_exchange_n(&frame_signal_pending, 1, __ATOMIC_SEQ_CST)) {
+			SDL_SemPost(frame_ready);
+		}
 		return;
 	}
 	//TODO: Maybe fixme for render API
 	process_framebuffer(texture_buf, which, width);
 }
 
+//takes the newest frame for each framebuffer that has one and presents them in the order they were produced
+//so the fields of an interlaced frame stay in sequence
+static void present_new_frames(void)
+{
+	mailbox_slot *ready[256];
+	int num_ready = 0;
+	uint16_t count = __atomic_load_n(&num_mailboxes, __ATOMIC_ACQUIRE);
+	for (uint16_t which = 0; which < count; which++)
+	{
+		frame_mailbox *box = mailboxes + which;
+		//only this thread clears the fresh flag so it can't go away between the check and the exchange
+		//this pairs with the producer's exchange so its initialization of the mailbox is visible here
+		//it has to be seq_cst so it isn't ordered before the store to frame_signal_pending
+		if (!(__atomic_load_n(&box->middle, __ATOMIC_SEQ_CST) & MAILBOX_FRESH)) {
+			continue;
+		}
+		box->front = __atomic_exchange_n(&box->middle, box->front, __ATOMIC_ACQ_REL) & ~MAILBOX_FRESH;
+		mailbox_slot *slot = box->slots + box->front;
+		int i = num_ready++;
+		for (; i > 0 && (int32_t)(ready[i-1]->sequence - slot->sequence) > 0; i--)
+		{
+			ready[i] = ready[i-1];
+		}
+		ready[i] = slot;
+	}
+	for (int i = 0; i < num_ready; i++)
+	{
+		process_framebuffer(ready[i]->buffer, ready[i]->which, ready[i]->width);
+	}
+}
+
 void render_video_loop(void)
 {
 	if (sync_src != SYNC_AUDIO_THREAD && sync_src != SYNC_EXTERNAL) {
 		return;
 	}
 	SDL_PauseAudio(0);
-	SDL_LockMutex(frame_mutex);
-		for(;;)
-		{
-			while (!frame_queue_len && SDL_GetAudioStatus() == SDL_AUDIO_PLAYING)
-			{
-				SDL_CondWait(frame_ready, frame_mutex);
-			}
-			while (frame_queue_len)
-			{
-				frame f = frame_queue[frame_queue_read++];
-				frame_queue_read &= 0x3;
-				frame_queue_len--;
-				SDL_UnlockMutex(frame_mutex);
-				process_framebuffer(f.buffer, f.which, f.width);
-				release_buffer(f.buffer);
-				SDL_LockMutex(frame_mutex);
-			}
-			if (SDL_GetAudioStatus() != SDL_AUDIO_PLAYING) {
-				break;
-			}
+	for(;;)
+	{
+		//cleared before looking for frames so a frame published after this point always posts a wakeup
+		__atomic_store_n(&frame_signal_pending, 0, __ATOMIC_SEQ_CST);
+		present_new_frames();
+		if (SDL_GetAudioStatus() != SDL_AUDIO_PLAYING) {
+			break;
 		}
-	
-	SDL_UnlockMutex(frame_mutex);
+		SDL_SemWait(frame_ready);
+	}
 }
 
 static ui_render_fun render_ui;
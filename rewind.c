@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rewind.h"
+#include "util.h"
+#include "zlib/zlib.h"
+
+//Only the most recent snapshot is kept in full, older snapshots are stored as compressed deltas
+//Since most of RAM and VRAM is unchanged from one frame to the next, the XOR of two consecutive
+//snapshots is mostly zeroes and compresses extremely well.
+//
+//Each entry in the ring is laid out as follows:
+//	uint32_t compressed size
+//	compressed XOR of the newer snapshot and the older one
+//	uint32_t compressed size
+//	uint32_t uncompressed size of the older snapshot
+//The leading size allows the oldest entry to be evicted and the trailing sizes allow the newest entry to be popped
+#define ENTRY_OVERHEAD (3 * sizeof(uint32_t))
+
+struct rewind_buffer {
+	uint8_t  *storage;
+	size_t   storage_size;
+	size_t   head;
+	size_t   tail;
+	size_t   used;
+	uint8_t  *current;
+	uint8_t  *out;
+	uint8_t  *delta;
+	uint8_t  *compressed;
+	size_t   current_size;
+	size_t   state_storage;
+	size_t   compressed_storage;
+	z_stream deflate_stream;
+	z_stream inflate_stream;
+	uint32_t num_deltas;
+	uint8_t  has_current;
+};
+
+rewind_buffer *rewind_alloc(size_t storage_size)
+{
+	rewind_buffer *buf = calloc(1, sizeof(rewind_buffer));
+	buf->storage_size = storage_size;
+	buf->storage = malloc(storage_size);
+	int result = deflateInit(&buf->deflate_stream, Z_BEST_SPEED);
+	if (result != Z_OK) {
+		fatal_error("deflateInit returned %d\n", result);
+	}
+	result = inflateInit(&buf->inflate_stream);
+	if (result != Z_OK) {
+		fatal_error("inflateInit returned %d\n", result);
+	}
+	return buf;
+}
+
+void rewind_free(rewind_buffer *buf)
+{
+	deflateEnd(&buf->deflate_stream);
+	inflateEnd(&buf->inflate_stream);
+	free(buf->storage);
+	free(buf->current);
+	free(buf->out);
+	free(buf->delta);
+	free(buf->compressed);
+	free(buf);
+}
+
+static size_t ring_forward(rewind_buffer *buf, size_t offset, size_t len)
+{
+	offset += len;
+	return offset >= buf->storage_size ? offset - buf->storage_size : offset;
+}
+
+static size_t ring_write(rewind_buffer *buf, size_t offset, void *src, size_t len)
+{
+	size_t first = buf->storage_size - offset;
+	if (first > len) {
+		first = len;
+	}
+	memcpy(buf->storage + offset, src, first);
+	memcpy(buf->storage, (uint8_t *)src + first, len - first);
+	return ring_forward(buf, offset, len);
+}
+
+static void ring_read(rewind_buffer *buf, size_t offset, void *dst, size_t len)
+{
+	size_t first = buf->storage_size - offset;
+	if (first > len) {
+		first = len;
+	}
+	memcpy(dst, buf->storage + offset, first);
+	memcpy((uint8_t *)dst + first, buf->storage, len - first);
+}
+
+static size_t ring_back(rewind_buffer *buf, size_t offset, size_t len)
+{
+	return offset >= len ? offset - len : offset + buf->storage_size - len;
+}
+
+static void evict_oldest(rewind_buffer *buf)
+{
+	uint32_t compressed_size;
+	ring_read(buf, buf->tail, &compressed_size, sizeof(compressed_size));
+	size_t entry_size = compressed_size + ENTRY_OVERHEAD;
+	buf->tail = ring_forward(buf, buf->tail, entry_size);
+	buf->used -= entry_size;
+	buf->num_deltas--;
+}
+
+static void reserve_state(rewind_buffer *buf, size_t size)
+{
+	if (size <= buf->state_storage) {
+		return;
+	}
+	buf->state_storage = size;
+	buf->current = realloc(buf->current, size);
+	buf->out = realloc(buf->out, size);
+	buf->delta = realloc(buf->delta, size);
+	buf->compressed_storage = deflateBound(&buf->deflate_stream, size);
+	buf->compressed = realloc(buf->compressed, buf->compressed_storage);
+}
+
+void rewind_push(rewind_buffer *buf, uint8_t *state, size_t size)
+{
+	reserve_state(buf, size);
+	if (buf->has_current) {
+		size_t delta_size = size > buf->current_size ? size : buf->current_size;
+		for (size_t i = 0; i < delta_size; i++)
+		{
+			uint8_t new_byte = i < size ? state[i] : 0;
+			uint8_t old_byte = i < buf->current_size ? buf->current[i] : 0;
+			buf->delta[i] = new_byte ^ old_byte;
+		}
+		deflateReset(&buf->deflate_stream);
+		buf->deflate_stream.next_in = buf->delta;
+		buf->deflate_stream.avail_in = delta_size;
+		buf->deflate_stream.next_out = buf->compressed;
+		buf->deflate_stream.avail_out = buf->compressed_storage;
+		int result = deflate(&buf->deflate_stream, Z_FINISH);
+		if (result != Z_STREAM_END) {
+			fatal_error("deflate returned %d\n", result);
+		}
+		uint32_t compressed_size = buf->compressed_storage - buf->deflate_stream.avail_out;
+		size_t entry_size = compressed_size + ENTRY_OVERHEAD;
+		if (entry_size > buf->storage_size) {
+			//snapshot doesn't fit at all, history before this point is unreachable
+			buf->head = buf->tail = buf->used = 0;
+			buf->num_deltas = 0;
+		} else {
+			while (buf->used + entry_size > buf->storage_size)
+			{
+				evict_oldest(buf);
+			}
+			uint32_t old_size = buf->current_size;
+			buf->head = ring_write(buf, buf->head, &compressed_size, sizeof(compressed_size));
+			buf->head = ring_write(buf, buf->head, buf->compressed, compressed_size);
+			buf->head = ring_write(buf, buf->head, &compressed_size, sizeof(compressed_size));
+			buf->head = ring_write(buf, buf->head, &old_size, sizeof(old_size));
+			buf->used += entry_size;
+			buf->num_deltas++;
+		}
+	}
+	memcpy(buf->current, state, size);
+	buf->current_size = size;
+	buf->has_current = 1;
+}
+
+uint8_t *rewind_pop(rewind_buffer *buf, size_t *size_out)
+{
+	if (!buf->has_current) {
+		return NULL;
+	}
+	uint8_t *ret = buf->current;
+	size_t ret_size = buf->current_size;
+	buf->current = buf->out;
+	buf->out = ret;
+	if (buf->num_deltas) {
+		uint32_t compressed_size, old_size;
+		size_t offset = ring_back(buf, buf->head, 2 * sizeof(uint32_t));
+		ring_read(buf, offset, &compressed_size, sizeof(compressed_size));
+		ring_read(buf, ring_forward(buf, offset, sizeof(uint32_t)), &old_size, sizeof(old_size));
+		offset = ring_back(buf, offset, compressed_size);
+		ring_read(buf, offset, buf->compressed, compressed_size);
+		inflateReset(&buf->inflate_stream);
+		buf->inflate_stream.next_in = buf->compressed;
+		buf->inflate_stream.avail_in = compressed_size;
+		buf->inflate_stream.next_out = buf->delta;
+		buf->inflate_stream.avail_out = buf->state_storage;
+		int result = inflate(&buf->inflate_stream, Z_FINISH);
+		if (result != Z_STREAM_END) {
+			fatal_error("inflate returned %d\n", result);
+		}
+		for (size_t i = 0; i < old_size; i++)
+		{
+			buf->current[i] = (i < ret_size ? ret[i] : 0) ^ buf->delta[i];
+		}
+		buf->current_size = old_size;
+		buf->head = ring_back(buf, offset, sizeof(uint32_t));
+		buf->used -= compressed_size + ENTRY_OVERHEAD;
+		buf->num_deltas--;
+	} else {
+		buf->has_current = 0;
+	}
+	if (size_out) {
+		*size_out = ret_size;
+	}
+	return ret;
+}
+
+uint32_t rewind_count(rewind_buffer *buf)
+{
+	return buf->num_deltas + buf->has_current;
+}
@@ -0,0 +1,21 @@
+#ifndef REWIND_H_
+#define REWIND_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct rewind_buffer rewind_buffer;
+
+//Allocates a rewind buffer that will use at most storage_size bytes for compressed history
+rewind_buffer *rewind_alloc(size_t storage_size);
+void rewind_free(rewind_buffer *buf);
+//Adds a new snapshot to the history, the data is copied so the caller can reuse its buffer
+void rewind_push(rewind_buffer *buf, uint8_t *state, size_t size);
+//Removes the most recent snapshot from the history and returns it
+//returned pointer is only valid until the next call to rewind_push or rewind_pop
+//returns NULL if there are no snapshots left
+uint8_t *rewind_pop(rewind_buffer *buf, size_t *size_out);
+//Number of snapshots currently available
+uint32_t rewind_count(rewind_buffer *buf);
+
+#endif //REWIND_H_
@@ -15,11 +15,29 @@ void init_serialize(serialize_buffer *buf)
 	buf->size = 0;
 	buf->current_section_start = 0;
 	buf->data = malloc(SERIALIZE_DEFAULT_SIZE);
+	buf->fixed = 0;
+	buf->overflow = 0;
 }
 
-static void reserve(serialize_buffer *buf, size_t amount)
+//Serializes directly into a caller provided buffer, nothing is allocated
+//if the buffer is too small the overflow flag will be set and the contents should be discarded
+void init_serialize_fixed(serialize_buffer *buf, uint8_t *data, size_t size)
+{
+	buf->storage = size;
+	buf->size = 0;
+	buf->current_section_start = 0;
+	buf->data = data;
+	buf->fixed = 1;
+	buf->overflow = 0;
+}
+
+static uint8_t reserve(serialize_buffer *buf, size_t amount)
 {
 	if (amount > (buf->storage - buf->size)) {
+		if (buf->fixed) {
+			buf->overflow = 1;
+			return 0;
+		}
 		if (amount < buf->storage) {
 			buf->storage *= 2;
 		} else {
@@ -28,11 +46,14 @@ static void reserve(serialize_buffer *buf, size_t amount)
 		}
 		buf->data = realloc(buf->data, buf->storage + sizeof(*buf));
 	}
+	return 1;
 }
 
 void save_int32(serialize_buffer *buf, uint32_t val)
 {
-	reserve(buf, sizeof(val));
+	if (!reserve(buf, sizeof(val))) {
+		return;
+	}
 	buf->data[buf->size++] = val >> 24;
 	buf->data[buf->size++] = val >> 16;
 	buf->data[buf->size++] = val >> 8;
@@ -41,14 +62,18 @@ void save_int32(serialize_buffer *buf, uint32_t val)
 
 void save_int16(serialize_buffer *buf, uint16_t val)
 {
-	reserve(buf, sizeof(val));
+	if (!reserve(buf, sizeof(val))) {
+		return;
+	}
 	buf->data[buf->size++] = val >> 8;
 	buf->data[buf->size++] = val;
 }
 
 void save_int8(serialize_buffer *buf, uint8_t val)
 {
-	reserve(buf, sizeof(val));
+	if (!reserve(buf, sizeof(val))) {
+		return;
+	}
 	buf->data[buf->size++] = val;
 }
 
@@ -60,14 +85,18 @@ void save_string(serialize_buffer *buf, char *val)
 
 void save_buffer8(serialize_buffer *buf, void *val, size_t len)
 {
-	reserve(buf, len);
+	if (!reserve(buf, len)) {
+		return;
+	}
 	memcpy(&buf->data[buf->size], val, len);
 	buf->size += len;
 }
 
 void save_buffer16(serialize_buffer *buf, uint16_t *val, size_t len)
 {
-	reserve(buf, len * sizeof(*val));
+	if (!reserve(buf, len * sizeof(*val))) {
+		return;
+	}
 	for(; len != 0; len--, val++) {
 		buf->data[buf->size++] = *val >> 8;
 		buf->data[buf->size++] = *val;
@@ -76,7 +105,9 @@ void save_buffer16(serialize_buffer *buf, uint16_t *val, size_t len)
 
 void save_buffer32(serialize_buffer *buf, uint32_t *val, size_t len)
 {
-	reserve(buf, len * sizeof(*val));
+	if (!reserve(buf, len * sizeof(*val))) {
+		return;
+	}
 	for(; len != 0; len--, val++) {
 		buf->data[buf->size++] = *val >> 24;
 		buf->data[buf->size++] = *val >> 16;
@@ -89,7 +120,9 @@ void start_section(serialize_buffer *buf, uint16_t section_id)
 {
 	save_int16(buf, section_id);
 	//reserve some space for size once we end this section
-	reserve(buf, sizeof(uint32_t));
+	if (!reserve(buf, sizeof(uint32_t))) {
+		return;
+	}
 	buf->size += sizeof(uint32_t);
 	//save start point for use in end_device
 	buf->current_section_start = buf->size;
@@ -97,6 +130,9 @@ void start_section(serialize_buffer *buf, uint16_t section_id)
 
 void end_section(serialize_buffer *buf)
 {
+	if (buf->overflow) {
+		return;
+	}
 	size_t section_size = buf->size - buf->current_section_start;
 	if (section_size > 0xFFFFFFFFU) {
 		fatal_error("Sections larger than 4GB are not supported");
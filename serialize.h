@@ -9,6 +9,8 @@ typedef struct {
 	size_t  storage;
 	size_t  current_section_start;
 	uint8_t *data;
+	uint8_t fixed;    //data is owned by the caller and can't be grown
+	uint8_t overflow; //set when a fixed buffer was too small, contents are invalid
 } serialize_buffer;
 
 typedef struct deserialize_buffer deserialize_buffer;
@@ -46,6 +48,7 @@ enum {
 };
 
 void init_serialize(serialize_buffer *buf);
+void init_serialize_fixed(serialize_buffer *buf, uint8_t *data, size_t size);
 void save_int32(serialize_buffer *buf, uint32_t val);
 void save_int16(serialize_buffer *buf, uint16_t val);
 void save_int8(serialize_buffer *buf, uint8_t val);
@@ -8,6 +8,7 @@
 #include "debug.h"
 #include "saves.h"
 #include "bindings.h"
+#include "config.h"
 
 #ifdef NEW_CORE
 #define Z80_CYCLE cycles
@@ -328,6 +329,15 @@ static void deserialize(system_header *sys, uint8_t *data, size_t size)
 	sms_deserialize(&buffer, sms);
 }
 
+static size_t serialize_into(system_header *sys, uint8_t *data, size_t size)
+{
+	sms_context *sms = (sms_context *)sys;
+	serialize_buffer state;
+	init_serialize_fixed(&state, data, size);
+	sms_serialize(sms, &state);
+	return state.overflow ? 0 : state.size;
+}
+
 static void save_state(sms_context *sms, uint8_t slot)
 {
 	char *save_path = get_slot_name(&sms->header, slot, "state");
@@ -607,6 +617,9 @@ sms_context *alloc_configure_sms(system_media *media, uint32_t opts, uint8_t for
 	memcpy(sms->header.info.map, memory_map, sizeof(memmap_chunk) * sms->header.info.map_chunks);
 	z80_options *zopts = malloc(sizeof(z80_options));
 	init_z80_opts(zopts, sms->header.info.map, sms->header.info.map_chunks, io_map, 4, 15, 0xFF);
+#ifndef NEW_CORE
+	set_code_pool_limit(&zopts->gen.code, get_code_cache_size(config));
+#endif
 	sms->z80 = init_z80_context(zopts);
 	sms->z80->system = sms;
 	sms->z80->Z80_OPTS->gen.debug_cmd_handler = debug_commands;
@@ -660,6 +673,7 @@ sms_context *alloc_configure_sms(system_media *media, uint32_t opts, uint8_t for
 	sms->header.keyboard_up = keyboard_up;
 	sms->header.config_updated = config_updated;
 	sms->header.serialize = serialize;
+	sms->header.serialize_into = serialize_into;
 	sms->header.deserialize = deserialize;
 	sms->header.type = SYSTEM_SMS;
 	
@@ -32,6 +32,7 @@ typedef void (*system_mabs_fun)(system_header *, uint8_t, uint16_t, uint16_t);
 typedef void (*system_mrel_fun)(system_header *, uint8_t, int32_t, int32_t);
 typedef uint8_t *(*system_ptrszt_fun_rptr8)(system_header *, size_t *);
 typedef void (*system_ptr8_sizet_fun)(system_header *, uint8_t *, size_t);
+typedef size_t (*system_ptr8_sizet_fun_rsizet)(system_header *, uint8_t *, size_t);
 
 #include "arena.h"
 #include "romdb.h"
@@ -49,6 +50,7 @@ struct system_header {
 	system_fun              free_context;
 	system_fun_r16          get_open_bus_value;
 	system_u32_fun          set_speed_percent;
+	system_u32_fun          set_runahead;
 	system_fun              inc_debug_mode;
 	system_u8_u8_fun        gamepad_down;
 	system_u8_u8_fun        gamepad_up;
@@ -60,6 +62,7 @@ struct system_header {
 	system_u8_fun           keyboard_up;
 	system_fun              config_updated;
 	system_ptrszt_fun_rptr8 serialize;
+	system_ptr8_sizet_fun_rsizet serialize_into;
 	system_ptr8_sizet_fun   deserialize;
 	system_str_fun          start_vgm_log;
 	system_fun              stop_vgm_log;
@@ -71,6 +74,7 @@ struct system_header {
 	uint8_t                 should_exit;
 	uint8_t                 save_state;
 	uint8_t                 delayed_load_slot;
+	uint8_t                 rewinding;
 	uint8_t                 has_keyboard;
 	uint8_t                 vgm_logging;
 	uint8_t                 force_release;
@@ -5,7 +5,7 @@
 #include "vdp.h"
 
 int headless = 1;
-uint16_t read_dma_value(uint32_t address)
+uint16_t read_dma_value(system_header *system, uint32_t address)
 {
 	return 0;
 }
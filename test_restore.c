@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libblastem.h"
+
+#define ROM_SIZE 0x20000
+#define RESULT_ADDRESS 0xFF0000
+
+static void put_word(uint8_t *dst, uint16_t value)
+{
+	dst[0] = value >> 8;
+	dst[1] = value;
+}
+
+static void put_long(uint8_t *dst, uint32_t value)
+{
+	put_word(dst, value >> 16);
+	put_word(dst + 2, value);
+}
+
+//copies two subroutines and a branch into the last 10 bytes of work RAM and then repeatedly calls
+//the branch in the very last word, storing the value the subroutine leaves in d0 at RESULT_ADDRESS
+static uint8_t *make_rom(void)
+{
+	static const uint16_t ram_code[] = {
+		0x7001, //0xFFFFF6: moveq #1, d0
+		0x4E75, //0xFFFFF8: rts
+		0x7002, //0xFFFFFA: moveq #2, d0
+		0x4E75, //0xFFFFFC: rts
+		0x60F6  //0xFFFFFE: bra.s 0xFFFFF6
+	};
+	uint8_t *rom = calloc(1, ROM_SIZE);
+	put_long(rom, 0xFFFF00);
+	put_long(rom + 4, 0x200);
+	memcpy(rom + 0x100, "SEGA MEGA DRIVE ", 16);
+	put_long(rom + 0x1A0, 0);
+	put_long(rom + 0x1A4, ROM_SIZE - 1);
+	put_long(rom + 0x1A8, 0xFF0000);
+	put_long(rom + 0x1AC, 0xFFFFFF);
+	uint8_t *cur = rom + 0x200;
+	for (int i = 0; i < 5; i++)
+	{
+		//move.w #imm, addr.l
+		put_word(cur, 0x33FC);
+		put_word(cur + 2, ram_code[i]);
+		put_long(cur + 4, 0xFFFFF6 + i * 2);
+		cur += 8;
+	}
+	put_word(cur, 0x4EB9); //jsr 0xFFFFFE.l
+	put_long(cur + 2, 0xFFFFFE);
+	put_word(cur + 6, 0x13C0); //move.b d0, RESULT_ADDRESS.l
+	put_long(cur + 8, RESULT_ADDRESS);
+	put_word(cur + 12, 0x60F2); //bra.s back to the jsr
+	return rom;
+}
+
+static uint8_t run_and_read(blastem_instance *inst)
+{
+	blastem_output out;
+	uint8_t result;
+	blastem_step(inst, NULL, 3, &out);
+	blastem_peek(inst, RESULT_ADDRESS, &result, 1);
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t *rom = make_rom();
+	blastem_instance *inst = blastem_create(rom, ROM_SIZE, NULL);
+	if (!inst) {
+		fputs("Failed to create instance\n", stderr);
+		return 1;
+	}
+	int ret = 0;
+	uint8_t result = run_and_read(inst);
+	if (result != 1) {
+		printf("Expected 1 before restoring state, got %d\n", result);
+		ret = 1;
+	}
+	size_t size = blastem_state_size(inst);
+	uint8_t *state = malloc(size);
+	size = blastem_save(inst, state, size);
+
+	//retarget the branch in the last word of RAM so it calls the second subroutine, code translated
+	//for the old contents of that word needs to be thrown away when the state is loaded
+	static const uint8_t ram_tail[] = {0x70, 0x01, 0x4E, 0x75, 0x70, 0x02, 0x4E, 0x75, 0x60, 0xF6};
+	uint8_t *tail = NULL;
+	for (size_t i = 0; i + sizeof(ram_tail) <= size; i++)
+	{
+		if (!memcmp(state + i, ram_tail, sizeof(ram_tail))) {
+			tail = state + i;
+			break;
+		}
+	}
+	if (!tail) {
+		puts("Failed to find end of work RAM in save state");
+		return 1;
+	}
+	tail[sizeof(ram_tail) - 1] = 0xFA;
+	blastem_restore(inst, state, size);
+	result = run_and_read(inst);
+	if (result != 2) {
+		printf("Expected 2 after restoring state with a modified last RAM word, got %d\n", result);
+		ret = 1;
+	}
+	if (!ret) {
+		puts("PASS");
+	}
+	blastem_free(inst);
+	free(state);
+	free(rom);
+	return ret;
+}
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "ym2612.h"
+#include "event_log.h"
+
+//Renders the same register write sequence with block synthesis and with one slot at a time
+//and checks that both produce exactly the same samples
+
+#define MCLKS_NTSC 53693175
+#define MCLKS_PER_YM 7
+#define NUM_STEPS 20000
+
+int headless = 1;
+
+void render_errorbox(char *title, char *message)
+{
+}
+
+void render_infobox(char *title, char *message)
+{
+}
+
+typedef struct {
+	int16_t  *samples;
+	uint32_t num_samples;
+	uint32_t storage;
+} sample_capture;
+
+audio_source *render_audio_source(uint64_t master_clock, uint64_t sample_divider, uint8_t channels)
+{
+	audio_source *src = calloc(1, sizeof(audio_source));
+	src->opaque = calloc(1, sizeof(sample_capture));
+	src->num_channels = channels;
+	return src;
+}
+
+void render_audio_adjust_clock(audio_source *src, uint64_t master_clock, uint64_t sample_divider)
+{
+}
+
+void render_put_stereo_sample(audio_source *src, int16_t left, int16_t right)
+{
+	sample_capture *cap = src->opaque;
+	if (cap->num_samples + 2 > cap->storage) {
+		cap->storage = cap->storage ? cap->storage * 2 : 4096;
+		cap->samples = realloc(cap->samples, cap->storage * sizeof(int16_t));
+	}
+	cap->samples[cap->num_samples++] = left;
+	cap->samples[cap->num_samples++] = right;
+}
+
+void render_free_source(audio_source *src)
+{
+	sample_capture *cap = src->opaque;
+	free(cap->samples);
+	free(cap);
+	free(src);
+}
+
+void event_log(uint8_t type, uint32_t cycle, uint8_t size, uint8_t *payload)
+{
+}
+
+static ym2612_context *ym[2];
+
+static void write_reg(uint8_t part, uint8_t reg, uint8_t value)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		if (part) {
+			ym_address_write_part2(ym[i], reg);
+		} else {
+			ym_address_write_part1(ym[i], reg);
+		}
+		ym_data_write(ym[i], value);
+	}
+}
+
+static uint32_t rand_state = 1;
+static uint32_t next_rand(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return rand_state >> 16;
+}
+
+//writes a register that belongs to channel 0-5
+static void write_channel_reg(uint32_t channel, uint8_t reg, uint8_t value)
+{
+	write_reg(channel >= 3, reg + channel % 3, value);
+}
+
+static void key_on(uint32_t channel, uint8_t ops)
+{
+	write_reg(0, 0x28, ops << 4 | (channel >= 3 ? channel + 1 : channel));
+}
+
+static void setup_channel(uint32_t channel)
+{
+	//each channel gets a different algorithm and feedback so all the modulation paths are covered
+	write_channel_reg(channel, 0xB0, (channel & 7) << 3 | channel);
+	write_channel_reg(channel, 0xB4, 0xC0 | (channel & 3) << 4 | channel);
+	write_channel_reg(channel, 0xA4, 0x22);
+	write_channel_reg(channel, 0xA0, 0x69 + channel * 17);
+	for (uint8_t op = 0; op < 16; op += 4)
+	{
+		write_channel_reg(channel, 0x30 + op, 0x71 - op);
+		write_channel_reg(channel, 0x40 + op, op * 2 + channel);
+		write_channel_reg(channel, 0x50 + op, 0x1F - op);
+		write_channel_reg(channel, 0x60 + op, 0x85 + op);
+		write_channel_reg(channel, 0x70 + op, 0x05 + op);
+		write_channel_reg(channel, 0x80 + op, op << 4 | 0xF);
+	}
+}
+
+static void random_write(void)
+{
+	uint32_t channel = next_rand() % 6;
+	switch (next_rand() % 13)
+	{
+	case 0:
+	case 1:
+	case 2:
+		key_on(channel, next_rand() & 0xF);
+		break;
+	case 3:
+		key_on(channel, 0);
+		break;
+	case 4:
+		write_channel_reg(channel, 0xA4, next_rand() & 0x3F);
+		write_channel_reg(channel, 0xA0, next_rand());
+		break;
+	case 5:
+		write_channel_reg(channel, 0x40 + (next_rand() & 0xC), next_rand() & 0x7F);
+		break;
+	case 6:
+		//SSG-EG, any non-zero value keeps the channel from going idle so turn it back off half the time
+		write_channel_reg(channel, 0x90 + (next_rand() & 0xC), (next_rand() & 1) ? 0 : next_rand() & 0xF);
+		break;
+	case 7:
+		//keep release fairly fast so released channels reach max attenuation
+		write_channel_reg(channel, 0x80 + (next_rand() & 0xC), next_rand() | 0xC);
+		break;
+	case 8:
+		//LFO
+		write_reg(0, 0x22, next_rand() & 0xF);
+		write_channel_reg(channel, 0xB4, 0xC0 | (next_rand() & 0x37));
+		break;
+	case 9:
+		//DAC enable and data, a DAC value of 0x80 outputs 0 so channel 6 can go idle while the DAC is on
+		write_reg(0, 0x2B, next_rand() & 0x80);
+		write_reg(0, 0x2A, (next_rand() & 1) ? 0x80 : next_rand());
+		break;
+	case 10:
+		//channel 3 special mode and timers
+		write_reg(0, 0x24, next_rand());
+		write_reg(0, 0x26, next_rand());
+		write_reg(0, 0x27, (next_rand() & 0x40) | 0x3F);
+		write_reg(0, 0xA8 + next_rand() % 3, next_rand());
+		break;
+	case 11:
+		write_channel_reg(channel, 0xB0, next_rand() & 0x3F);
+		break;
+	case 12:
+		//release everything so channels go idle during the next long run
+		for (channel = 0; channel < 6; channel++)
+		{
+			key_on(channel, 0);
+		}
+		break;
+	}
+}
+
+//phase and envelope state that hasn't reached the output yet can still differ, e.g. in an idle channel
+static uint8_t compare_operators(uint32_t step)
+{
+	for (int i = 0; i < NUM_OPERATORS; i++)
+	{
+		ym_operator *block = ym[0]->operators + i, *slot = ym[1]->operators + i;
+		if (block->phase_counter != slot->phase_counter || block->envelope != slot->envelope || block->env_phase != slot->env_phase) {
+			printf("Operator %d mismatch at step %u, block: %X/%X/%d, per slot: %X/%X/%d\n", i, step,
+				block->phase_counter, block->envelope, block->env_phase, slot->phase_counter, slot->envelope, slot->env_phase);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		ym[i] = calloc(1, sizeof(ym2612_context));
+		ym_init(ym[i], MCLKS_NTSC, MCLKS_PER_YM, 0);
+	}
+	ym_enable_block_synthesis(ym[0], 1);
+	ym_enable_block_synthesis(ym[1], 0);
+	for (uint32_t channel = 0; channel < 6; channel++)
+	{
+		setup_channel(channel);
+	}
+	uint32_t cycle = 0;
+	for (uint32_t step = 0; step < NUM_STEPS; step++)
+	{
+		//mix short runs that end partway through a sample with long ones that let channels go idle
+		if (next_rand() & 1) {
+			cycle += next_rand() % (MCLKS_PER_YM * 6 * 24) + 1;
+		} else {
+			cycle += next_rand() % (MCLKS_PER_YM * 6 * 24 * 256) + 1;
+		}
+		ym_run(ym[0], cycle);
+		ym_run(ym[1], cycle);
+		if (ym[0]->current_cycle != ym[1]->current_cycle) {
+			printf("Cycle mismatch at step %u, block: %u, per slot: %u\n", step, ym[0]->current_cycle, ym[1]->current_cycle);
+			return 1;
+		}
+		if (!compare_operators(step)) {
+			return 1;
+		}
+		random_write();
+	}
+	sample_capture *block = ym[0]->audio->opaque, *slot = ym[1]->audio->opaque;
+	int ret = 0;
+	if (block->num_samples != slot->num_samples) {
+		printf("Sample count mismatch, block: %u, per slot: %u\n", block->num_samples / 2, slot->num_samples / 2);
+		ret = 1;
+	}
+	uint32_t num_samples = block->num_samples < slot->num_samples ? block->num_samples : slot->num_samples;
+	uint32_t varied = 0;
+	for (uint32_t i = 0; i < num_samples; i++)
+	{
+		if (block->samples[i] != slot->samples[i]) {
+			printf("Sample %u %s mismatch, block: %d, per slot: %d\n", i / 2, (i & 1) ? "right" : "left", block->samples[i], slot->samples[i]);
+			ret = 1;
+			break;
+		}
+		if (!(i & 1) && block->samples[i] != block->samples[0]) {
+			varied++;
+		}
+	}
+	if (!varied) {
+		//identical silence doesn't prove anything
+		puts("Output never changed");
+		ret = 1;
+	}
+	printf("Compared %u samples, %u changed from the first one\n", num_samples / 2, varied);
+	ym_free(ym[0]);
+	ym_free(ym[1]);
+	return ret;
+}
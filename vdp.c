@@ -10,6 +10,9 @@
 #include "render.h"
 #include "util.h"
 #include "event_log.h"
+#ifdef VDP_THREAD
+#include <pthread.h>
+#endif
 
 #define NTSC_INACTIVE_START 224
 #define PAL_INACTIVE_START 240
@@ -22,6 +25,62 @@
 #define SCROLL_BUFFER_MASK (SCROLL_BUFFER_SIZE-1)
 #define SCROLL_BUFFER_DRAW (SCROLL_BUFFER_SIZE/2)
 
+//Compositing works on 16 pixels at a time, which maps nicely onto a single 128-bit vector
+//The vector paths are written against the small set of helpers below so SSE2 and NEON share the same logic
+#ifndef DISABLE_SIMD
+#if defined(__SSE2__) || defined(X86_64)
+#include <emmintrin.h>
+#define VDP_SIMD
+typedef __m128i pix16;
+#define pix_load(ptr) _mm_loadu_si128((__m128i *)(ptr))
+#define pix_store(ptr, v) _mm_storeu_si128((__m128i *)(ptr), v)
+#define pix_set1(val) _mm_set1_epi8(val)
+#define pix_and(a, b) _mm_and_si128(a, b)
+#define pix_or(a, b) _mm_or_si128(a, b)
+#define pix_andnot(mask, v) _mm_andnot_si128(mask, v)
+#define pix_add(a, b) _mm_add_epi8(a, b)
+#define pix_eq(a, b) _mm_cmpeq_epi8(a, b)
+#define pix_select(mask, a, b) _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b))
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define VDP_SIMD
+typedef uint8x16_t pix16;
+#define pix_load(ptr) vld1q_u8(ptr)
+#define pix_store(ptr, v) vst1q_u8(ptr, v)
+#define pix_set1(val) vdupq_n_u8(val)
+#define pix_and(a, b) vandq_u8(a, b)
+#define pix_or(a, b) vorrq_u8(a, b)
+#define pix_andnot(mask, v) vbicq_u8(v, mask)
+#define pix_add(a, b) vaddq_u8(a, b)
+#define pix_eq(a, b) vceqq_u8(a, b)
+#define pix_select(mask, a, b) vbslq_u8(mask, a, b)
+#endif
+#endif //DISABLE_SIMD
+
+#ifdef VDP_SIMD
+//mask of lanes where (v & bits) is zero
+#define pix_clear(v, bits) pix_eq(pix_and(v, pix_set1(bits)), pix_set1(0))
+
+static pix16 load_scroll_buffer(uint8_t *buf, int offset)
+{
+	offset &= SCROLL_BUFFER_MASK;
+	if (offset <= SCROLL_BUFFER_SIZE - 16) {
+		return pix_load(buf + offset);
+	}
+	uint8_t tmp[16];
+	memcpy(tmp, buf + offset, SCROLL_BUFFER_SIZE - offset);
+	memcpy(tmp + SCROLL_BUFFER_SIZE - offset, buf, 16 - (SCROLL_BUFFER_SIZE - offset));
+	return pix_load(tmp);
+}
+
+//lanes where layer is opaque and wins the priority comparison against the pixels composited so far
+static pix16 layer_wins(pix16 layer, pix16 pixel)
+{
+	pix16 has_priority = pix_or(pix_andnot(pix_clear(layer, BUF_BIT_PRIORITY), pix_set1(-1)), pix_clear(pixel, BUF_BIT_PRIORITY));
+	return pix_andnot(pix_clear(layer, 0xF), has_priority);
+}
+#endif
+
 #define MCLKS_SLOT_H40  16
 #define MCLKS_SLOT_H32  20
 #define VINT_SLOT_H40  0 //21 slots before HSYNC, 16 during, 10 after
@@ -251,8 +310,191 @@ vdp_context *init_vdp_context(uint8_t region_pal, uint8_t has_max_vsram)
 	return context;
 }
 
+//pattern addresses that the sprite half of an H40 line leaves on the VRAM bus for the border garbage
+//fetches of the pixel half, recorded so the two halves can be run separately
+typedef struct {
+	uint32_t *prev_output;
+	uint32_t *output;
+	uint16_t garbage[7];
+} h40_line_state;
+
+enum {
+	VDP_WRITE_VRAM,
+	VDP_WRITE_CRAM,
+	VDP_WRITE_VSRAM
+};
+
+#ifdef VDP_THREAD
+#define WORKER_JOBS 32
+#define WRITE_LOG_SIZE (1 << 14)
+
+typedef struct {
+	uint16_t address;
+	uint16_t value;
+	uint8_t  type;
+} vdp_write;
+
+//everything the pixel half of a line needs from the emulation thread
+typedef struct {
+	h40_line_state line;
+	uint32_t       log_end;
+	uint16_t       vcounter;
+	uint16_t       test_port;
+	uint8_t        regs[VDP_REGS];
+	uint8_t        flags2;
+	uint8_t        double_res;
+	uint8_t        linebuf[LINEBUF_SIZE];
+} worker_job;
+
+struct vdp_worker {
+	pthread_t       thread;
+	pthread_mutex_t lock;
+	pthread_cond_t  work_ready;
+	pthread_cond_t  work_done;
+	//has its own copy of VRAM, CRAM and VSRAM that is kept up to date by replaying the write log
+	vdp_context     *shadow;
+	worker_job      jobs[WORKER_JOBS];
+	//job_read and job_write are protected by lock
+	uint32_t        job_read;
+	uint32_t        job_write;
+	vdp_write       log[WRITE_LOG_SIZE];
+	//log_write belongs to the emulation thread, log_applied to whichever thread is updating the shadow context
+	uint32_t        log_write;
+	uint32_t        log_applied;
+	//value of log_applied the last time the emulation thread waited for the worker
+	uint32_t        log_synced;
+	//set while the scroll buffers, compositebuf and related state live in the shadow context
+	uint8_t         active;
+	uint8_t         quit;
+};
+
+static void apply_writes(vdp_worker *worker, uint32_t end)
+{
+	vdp_context *shadow = worker->shadow;
+	for (; worker->log_applied != end; worker->log_applied++)
+	{
+		vdp_write *write = worker->log + (worker->log_applied & (WRITE_LOG_SIZE-1));
+		switch (write->type)
+		{
+		case VDP_WRITE_VRAM:
+			shadow->vdpmem[write->address] = write->value;
+			break;
+		case VDP_WRITE_CRAM:
+			write_cram_internal(shadow, write->address, write->value);
+			break;
+		case VDP_WRITE_VSRAM:
+			shadow->vsram[write->address] = write->value;
+			break;
+		}
+	}
+}
+
+//state that is only used for pixel generation and moves with it between threads
+static void copy_render_state(vdp_context *dst, vdp_context *src)
+{
+	memcpy(dst->tmp_buf_a, src->tmp_buf_a, SCROLL_BUFFER_SIZE);
+	memcpy(dst->tmp_buf_b, src->tmp_buf_b, SCROLL_BUFFER_SIZE);
+	memcpy(dst->compositebuf, src->compositebuf, LINEBUF_SIZE);
+	memcpy(dst->layer_debug_buf, src->layer_debug_buf, LINEBUF_SIZE);
+	dst->done_composite = src->done_composite ? dst->compositebuf + (src->done_composite - src->compositebuf) : NULL;
+	dst->vscroll_latch[0] = src->vscroll_latch[0];
+	dst->vscroll_latch[1] = src->vscroll_latch[1];
+	dst->hscroll_a = src->hscroll_a;
+	dst->hscroll_a_fine = src->hscroll_a_fine;
+	dst->hscroll_b = src->hscroll_b;
+	dst->hscroll_b_fine = src->hscroll_b_fine;
+	dst->col_1 = src->col_1;
+	dst->col_2 = src->col_2;
+	dst->v_offset = src->v_offset;
+	dst->buf_a_off = src->buf_a_off;
+	dst->buf_b_off = src->buf_b_off;
+	dst->flags = (dst->flags & ~FLAG_WINDOW) | (src->flags & FLAG_WINDOW);
+}
+#endif
+
+//waits for the worker to finish all queued lines and takes back the pixel generation state
+static void vdp_worker_sync(vdp_context *context)
+{
+#ifdef VDP_THREAD
+	vdp_worker *worker = context->worker;
+	if (!worker || !worker->active) {
+		return;
+	}
+	pthread_mutex_lock(&worker->lock);
+	while (worker->job_read != worker->job_write)
+	{
+		pthread_cond_wait(&worker->work_done, &worker->lock);
+	}
+	pthread_mutex_unlock(&worker->lock);
+	copy_render_state(context, worker->shadow);
+	worker->log_synced = worker->log_applied;
+	worker->active = 0;
+#endif
+}
+
+static void log_vdp_write(vdp_context *context, uint8_t type, uint16_t address, uint16_t value)
+{
+#ifdef VDP_THREAD
+	vdp_worker *worker = context->worker;
+	if (!worker) {
+		return;
+	}
+	if (worker->log_write - worker->log_synced == WRITE_LOG_SIZE) {
+		//the worker might still need some of these, wait for it and then bring the shadow up to date here
+		vdp_worker_sync(context);
+		apply_writes(worker, worker->log_write);
+		worker->log_synced = worker->log_write;
+	}
+	vdp_write *write = worker->log + (worker->log_write++ & (WRITE_LOG_SIZE-1));
+	write->type = type;
+	write->address = address;
+	write->value = value;
+#endif
+}
+
+void vdp_worker_resync(vdp_context *context)
+{
+#ifdef VDP_THREAD
+	vdp_worker *worker = context->worker;
+	if (!worker) {
+		return;
+	}
+	vdp_worker_sync(context);
+	vdp_context *shadow = worker->shadow;
+	memcpy(shadow->vdpmem, context->vdpmem, VRAM_SIZE);
+	memcpy(shadow->vsram, context->vsram, sizeof(context->vsram));
+	memcpy(shadow->cram, context->cram, sizeof(context->cram));
+	memcpy(shadow->colors, context->colors, sizeof(context->colors));
+	//anything still in the log is older than what was just copied
+	worker->log_applied = worker->log_synced = worker->log_write;
+#endif
+}
+
+static void stop_worker(vdp_context *context)
+{
+#ifdef VDP_THREAD
+	vdp_worker *worker = context->worker;
+	if (!worker) {
+		return;
+	}
+	vdp_worker_sync(context);
+	pthread_mutex_lock(&worker->lock);
+	worker->quit = 1;
+	pthread_cond_signal(&worker->work_ready);
+	pthread_mutex_unlock(&worker->lock);
+	pthread_join(worker->thread, NULL);
+	pthread_mutex_destroy(&worker->lock);
+	pthread_cond_destroy(&worker->work_ready);
+	pthread_cond_destroy(&worker->work_done);
+	free(worker->shadow);
+	free(worker);
+	context->worker = NULL;
+#endif
+}
+
 void vdp_free(vdp_context *context)
 {
+	stop_worker(context);
 	free(context);
 }
 
@@ -802,6 +1044,7 @@ void write_cram_internal(vdp_context * context, uint16_t addr, uint16_t value)
 {
 	context->cram[addr] = value;
 	update_color_map(context, addr, value);
+	log_vdp_write(context, VDP_WRITE_CRAM, addr, value);
 }
 
 static void write_cram(vdp_context * context, uint16_t address, uint16_t value)
@@ -878,6 +1121,7 @@ static void write_vram_word(vdp_context *context, uint32_t address, uint16_t val
 	address ^= 1;
 	//TODO: Support an option to actually have 128KB of VRAM
 	context->vdpmem[address] = value;
+	log_vdp_write(context, VDP_WRITE_VRAM, address, value & 0xFF);
 }
 
 static void write_vram_byte(vdp_context *context, uint32_t address, uint8_t value)
@@ -888,6 +1132,7 @@ static void write_vram_byte(vdp_context *context, uint32_t address, uint8_t valu
 		address = mode4_address_map[address & 0x3FFF];
 	}
 	context->vdpmem[address] = value;
+	log_vdp_write(context, VDP_WRITE_VRAM, address, value);
 }
 
 #define DMA_FILL 0x80
@@ -960,6 +1205,7 @@ static void external_slot(vdp_context * context)
 				}
 				uint8_t buffer[3] = {((start->address/2) & 63) + 128, context->vsram[(start->address/2) & 63] >> 8, context->vsram[(start->address/2) & 63]};
 				event_log(EVENT_VDP_INTRAM, context->cycles, sizeof(buffer), buffer);
+				log_vdp_write(context, VDP_WRITE_VSRAM, (start->address/2) & 63, context->vsram[(start->address/2) & 63]);
 			}
 
 			break;
@@ -1050,7 +1296,7 @@ static void run_dma_src(vdp_context * context, int32_t slot)
 			cur = context->fifo + context->fifo_write;
 			cur->cycle = context->cycles + ((context->regs[REG_MODE_4] & BIT_H40) ? 16 : 20)*FIFO_LATENCY;
 			cur->address = context->address;
-			cur->value = read_dma_value((context->regs[REG_DMASRC_H] << 16) | (context->regs[REG_DMASRC_M] << 8) | context->regs[REG_DMASRC_L]);
+			cur->value = read_dma_value(context->system, (context->regs[REG_DMASRC_H] << 16) | (context->regs[REG_DMASRC_M] << 8) | context->regs[REG_DMASRC_L]);
 			cur->cd = context->cd;
 			cur->partial = 0;
 			if (context->fifo_read < 0) {
@@ -1341,6 +1587,25 @@ static sh_pixel composite_highlight(vdp_context *context, uint8_t *debug_dst, ui
 static void render_normal(vdp_context *context, int32_t col, uint8_t *dst, uint8_t *debug_dst, int plane_a_off, int plane_b_off)
 {
 	uint8_t *sprite_buf = context->linebuf + col * 8;
+#ifdef VDP_SIMD
+	if (col || !(context->regs[REG_MODE_1] & BIT_COL0_MASK)) {
+		pix16 plane_a = load_scroll_buffer(context->tmp_buf_a, plane_a_off);
+		pix16 plane_b = load_scroll_buffer(context->tmp_buf_b, plane_b_off);
+		pix16 sprite = pix_load(sprite_buf);
+		pix16 mask = pix_andnot(pix_clear(plane_b, 0xF), pix_set1(-1));
+		pix16 pixel = pix_select(mask, plane_b, pix_set1(context->regs[REG_BG_COLOR]));
+		pix16 src = pix_and(mask, pix_set1(DBG_SRC_B));
+		mask = layer_wins(plane_a, pixel);
+		pixel = pix_select(mask, plane_a, pixel);
+		src = pix_select(mask, pix_set1(DBG_SRC_A), src);
+		mask = layer_wins(sprite, pixel);
+		pixel = pix_select(mask, sprite, pixel);
+		src = pix_select(mask, pix_set1(DBG_SRC_S), src);
+		pix_store(dst, pix_and(pixel, pix_set1(0x3F)));
+		pix_store(debug_dst, src);
+		return;
+	}
+#endif
 	if (!col && (context->regs[REG_MODE_1] & BIT_COL0_MASK)) {
 		memset(dst, 0, 8);
 		memset(debug_dst, DBG_SRC_BG, 8);
@@ -1380,6 +1645,43 @@ static void render_highlight(vdp_context *context, int32_t col, uint8_t *dst, ui
 		start = 8;
 	}
 	uint8_t *sprite_buf = context->linebuf + col * 8 + start;
+#ifdef VDP_SIMD
+	if (!start) {
+		pix16 plane_a = load_scroll_buffer(context->tmp_buf_a, plane_a_off);
+		pix16 plane_b = load_scroll_buffer(context->tmp_buf_b, plane_b_off);
+		pix16 sprite = pix_load(sprite_buf);
+		pix16 priority = pix_set1(BUF_BIT_PRIORITY);
+		pix16 mask = pix_andnot(pix_clear(plane_b, 0xF), pix_set1(-1));
+		pix16 pixel = pix_select(mask, plane_b, pix_set1(context->regs[REG_BG_COLOR]));
+		pix16 src = pix_and(mask, pix_set1(DBG_SRC_B));
+		pix16 intensity = pix_and(pix_or(plane_a, plane_b), priority);
+		mask = layer_wins(plane_a, pixel);
+		pixel = pix_select(mask, plane_a, pixel);
+		src = pix_select(mask, pix_set1(DBG_SRC_A), src);
+		
+		mask = layer_wins(sprite, pixel);
+		pix16 sprite_index = pix_and(sprite, pix_set1(0x3F));
+		pix16 highlight_op = pix_and(mask, pix_eq(sprite_index, pix_set1(0x3E)));
+		pix16 shadow_op = pix_and(mask, pix_eq(sprite_index, pix_set1(0x3F)));
+		mask = pix_andnot(pix_or(highlight_op, shadow_op), mask);
+		intensity = pix_select(highlight_op, pix_add(intensity, priority), intensity);
+		intensity = pix_andnot(shadow_op, intensity);
+		pix16 sprite_intensity = pix_select(
+			pix_eq(pix_and(sprite, pix_set1(0xF)), pix_set1(0xE)),
+			priority, pix_or(intensity, pix_and(sprite, priority))
+		);
+		intensity = pix_select(mask, sprite_intensity, intensity);
+		pixel = pix_select(mask, sprite, pixel);
+		src = pix_select(mask, pix_set1(DBG_SRC_S), src);
+		
+		pixel = pix_and(pixel, pix_set1(0x3F));
+		pixel = pix_add(pixel, pix_and(pix_eq(intensity, pix_set1(0)), pix_set1(SHADOW_OFFSET)));
+		pixel = pix_add(pixel, pix_and(pix_eq(intensity, pix_set1(BUF_BIT_PRIORITY << 1)), pix_set1(HIGHLIGHT_OFFSET)));
+		pix_store(dst, pixel);
+		pix_store(debug_dst, src);
+		return;
+	}
+#endif
 	for (int i = start; i < 16; ++plane_a_off, ++plane_b_off, ++sprite_buf, ++i)
 	{
 		uint8_t sprite, plane_a, plane_b;
@@ -1613,6 +1915,13 @@ static void render_map_output(uint32_t line, int32_t col, vdp_context * context)
 		context->done_composite = dst + 16;
 		return;
 	}
+	if (context->skip_output) {
+		//nobody is going to see this line, just keep the scroll buffers in sync
+		context->done_composite = NULL;
+		context->buf_a_off = (context->buf_a_off + SCROLL_BUFFER_DRAW) & SCROLL_BUFFER_MASK;
+		context->buf_b_off = (context->buf_b_off + SCROLL_BUFFER_DRAW) & SCROLL_BUFFER_MASK;
+		return;
+	}
 	line &= 0xFF;
 	render_map(context->col_2, context->tmp_buf_b, context->buf_b_off+8, context);
 	uint8_t *sprite_buf;
@@ -1743,6 +2052,10 @@ static void render_map_mode4(uint32_t line, int32_t col, vdp_context * context)
 		*dst = (pixels >> i & 0xF) | pal_priority;
 	}
 	context->buf_a_off = (context->buf_a_off + 8) & 15;
+	if (context->skip_output) {
+		context->done_composite = NULL;
+		return;
+	}
 	
 	uint8_t *dst = context->compositebuf + col * 8 + BORDER_LEFT;
 	uint8_t *debug_dst = context->layer_debug_buf + col * 8 + BORDER_LEFT;
@@ -2080,6 +2393,7 @@ static void vdp_update_per_frame_debug(vdp_context *context)
 
 void vdp_force_update_framebuffer(vdp_context *context)
 {
+	vdp_worker_sync(context);
 	if (!context->fb) {
 		return;
 	}
@@ -2096,20 +2410,34 @@ void vdp_force_update_framebuffer(vdp_context *context)
 	vdp_update_per_frame_debug(context);
 }
 
+static uint32_t dummy_buffer[LINEBUF_SIZE];
+//returns true if the next call to advance_output_line will finish the current frame
+static uint8_t output_frame_done(vdp_context *context)
+{
+	uint16_t lines_max = context->inactive_start + context->border_bot + context->border_top;
+	uint32_t output_line = context->vcounter;
+	if (!(context->regs[REG_MODE_2] & BIT_MODE_5)) {
+		//vcounter increment occurs much later in Mode 4
+		output_line++;
+	}
+	return context->output_lines >= lines_max || (!context->pushed_frame && output_line == context->inactive_start + context->border_top);
+}
+
 static void advance_output_line(vdp_context *context)
 {
 	//This function is kind of gross because of the need to deal with vertical border busting via mode changes
-	uint16_t lines_max = context->inactive_start + context->border_bot + context->border_top;
 	uint32_t output_line = context->vcounter;
 	if (!(context->regs[REG_MODE_2] & BIT_MODE_5)) {
 		//vcounter increment occurs much later in Mode 4
 		output_line++;
 	} 
 	
-	if (context->output_lines >= lines_max || (!context->pushed_frame && output_line == context->inactive_start + context->border_top)) {
+	if (output_frame_done(context)) {
 		//we've either filled up a full frame or we're at the bottom of screen in the current defined mode + border crop
 		if (!headless) {
-			render_framebuffer_updated(context->cur_buffer, context->h40_lines > (context->inactive_start + context->border_top) / 2 ? LINEBUF_SIZE : (256+HORIZ_BORDER));
+			if (!context->skip_output || context->fb) {
+				render_framebuffer_updated(context->cur_buffer, context->h40_lines > (context->inactive_start + context->border_top) / 2 ? LINEBUF_SIZE : (256+HORIZ_BORDER));
+			}
 			uint8_t is_even = context->flags2 & FLAG2_EVEN_FIELD;
 			if (context->vcounter <= context->inactive_start && (context->regs[REG_MODE_4] & BIT_INTERLACE)) {
 				is_even = !is_even;
@@ -2147,6 +2475,10 @@ static void advance_output_line(vdp_context *context)
 		context->output = NULL;
 		return;
 	}
+	if (context->skip_output && !context->fb) {
+		context->output = dummy_buffer;
+		return;
+	}
 	if (!context->fb) {
 		context->fb = render_get_framebuffer(context->cur_buffer, &context->output_pitch);
 	}
@@ -2165,6 +2497,7 @@ static void advance_output_line(vdp_context *context)
 
 void vdp_release_framebuffer(vdp_context *context)
 {
+	vdp_worker_sync(context);
 	if (context->fb) {
 		render_framebuffer_updated(context->cur_buffer, context->h40_lines > (context->inactive_start + context->border_top) / 2 ? LINEBUF_SIZE : (256+HORIZ_BORDER));
 		context->output = context->fb = NULL;
@@ -2173,6 +2506,7 @@ void vdp_release_framebuffer(vdp_context *context)
 
 void vdp_reacquire_framebuffer(vdp_context *context)
 {
+	vdp_worker_sync(context);
 	uint16_t lines_max = context->inactive_start + context->border_bot + context->border_top;
 	if (context->output_lines <= lines_max && context->output_lines > 0) {
 		context->fb = render_get_framebuffer(context->cur_buffer, &context->output_pitch);
@@ -2547,65 +2881,20 @@ static void draw_right_border(vdp_context *context)
 		render_sprite_cells_mode4(context);\
 		MODE4_CHECK_SLOT_LINE(CALC_SLOT(slot, 5))
 
-static uint32_t dummy_buffer[LINEBUF_SIZE];
-static void vdp_h40_line(vdp_context * context)
+//sprite evaluation and rendering for slots 165 through 0
+static void h40_line_sprites_start(vdp_context *context, h40_line_state *line)
 {
-	uint16_t address;
-	uint32_t mask;
-	uint32_t const slot_cycles = MCLKS_SLOT_H40;
-	uint8_t bgindex = context->regs[REG_BG_COLOR] & 0x3F;
-	uint8_t test_layer = context->test_port >> 7 & 3;
-	
-	//165
-	if (!(context->regs[REG_MODE_3] & BIT_VSCROLL)) {
-		//TODO: Develop some tests on hardware to see when vscroll latch actually happens for full plane mode
-		//See note in vdp_h32 for why this was originally moved out of read_map_scroll
-		//Skitchin' has a similar problem, but uses H40 mode. It seems to be able to hit the extern slot at 232
-		//pretty consistently
-		context->vscroll_latch[0] = context->vsram[0];
-		context->vscroll_latch[1] = context->vsram[1];
-	}
 	render_sprite_cells(context);
 	//166
 	render_sprite_cells(context);
 	//167
 	context->sprite_index = 0x80;
 	context->slot_counter = 0;
-	render_border_garbage(
-		context,
-		context->sprite_draw_list[context->cur_slot].address,
-		context->tmp_buf_b, context->buf_b_off,
-		context->col_1
-	);
+	line->garbage[0] = context->sprite_draw_list[context->cur_slot].address;
 	render_sprite_cells(context);
 	scan_sprite_table(context->vcounter, context);
 	//168
-	render_border_garbage(
-		context,
-		context->sprite_draw_list[context->cur_slot].address,
-		context->tmp_buf_b,
-		context->buf_b_off + 8,
-		context->col_2
-	);
-	//Do palette lookup for end of previous line
-	uint8_t *src = context->compositebuf + (LINE_CHANGE_H40 - BG_START_SLOT) *2;
-	uint32_t *dst = context->output + (LINE_CHANGE_H40 - BG_START_SLOT) *2;
-	if (test_layer) {
-		for (int i = 0; i < LINEBUF_SIZE - (LINE_CHANGE_H40 - BG_START_SLOT) * 2; i++)
-		{
-			*(dst++) = context->colors[*(src++)];
-		}
-	} else {
-		for (int i = 0; i < LINEBUF_SIZE - (LINE_CHANGE_H40 - BG_START_SLOT) * 2; i++)
-		{
-			if (*src & 0x3F) {
-				*(dst++) = context->colors[*(src++)];
-			} else {
-				*(dst++) = context->colors[(*(src++) & 0xC0) | bgindex];
-			}
-		}
-	}
-	advance_output_line(context);
+	line->garbage[1] = context->sprite_draw_list[context->cur_slot].address;
 	//168-242 (inclusive)
 	for (int i = 0; i < 28; i++)
 	{
@@ -2613,29 +2902,7 @@ static void vdp_h40_line(vdp_context * context)
 		scan_sprite_table(context->vcounter, context);
 	}
 	//243
-	render_border_garbage(
-		context,
-		context->sprite_draw_list[context->cur_slot].address,
-		context->tmp_buf_a,
-		context->buf_a_off,
-		context->col_1
-	);
-	//244
-	address = (context->regs[REG_HSCROLL] & 0x3F) << 10;
-	mask = 0;
-	if (context->regs[REG_MODE_3] & 0x2) {
-		mask |= 0xF8;
-	}
-	if (context->regs[REG_MODE_3] & 0x1) {
-		mask |= 0x7;
-	}
-	render_border_garbage(context, address, context->tmp_buf_a, context->buf_a_off+8, context->col_2);
-	address += (context->vcounter & mask) * 4;
-	context->hscroll_a = context->vdpmem[address] << 8 | context->vdpmem[address+1];
-	context->hscroll_a_fine = context->hscroll_a & 0xF;
-	context->hscroll_b = context->vdpmem[address+2] << 8 | context->vdpmem[address+3];
-	context->hscroll_b_fine = context->hscroll_b & 0xF;
-	//printf("%d: HScroll A: %d, HScroll B: %d\n", context->vcounter, context->hscroll_a, context->hscroll_b);
+	line->garbage[2] = context->sprite_draw_list[context->cur_slot].address;
 	//243-246 inclusive
 	for (int i = 0; i < 3; i++)
 	{
@@ -2643,27 +2910,13 @@ static void vdp_h40_line(vdp_context * context)
 		scan_sprite_table(context->vcounter, context);
 	}
 	//247
-	render_border_garbage(
-		context,
-		context->sprite_draw_list[context->cur_slot].address,
-		context->tmp_buf_b,
-		context->buf_b_off,
-		context->col_1
-	);
+	line->garbage[3] = context->sprite_draw_list[context->cur_slot].address;
 	render_sprite_cells(context);
 	scan_sprite_table(context->vcounter, context);
 	//248
-	render_border_garbage(
-		context,
-		context->sprite_draw_list[context->cur_slot].address,
-		context->tmp_buf_b,
-		context->buf_b_off + 8,
-		context->col_2
-	);
+	line->garbage[4] = context->sprite_draw_list[context->cur_slot].address;
 	render_sprite_cells(context);
 	scan_sprite_table(context->vcounter, context);
-	context->buf_a_off = (context->buf_a_off + SCROLL_BUFFER_DRAW) & SCROLL_BUFFER_MASK;
-	context->buf_b_off = (context->buf_b_off + SCROLL_BUFFER_DRAW) & SCROLL_BUFFER_MASK;
 	//250
 	render_sprite_cells(context);
 	scan_sprite_table(context->vcounter, context);
@@ -2688,17 +2941,11 @@ static void vdp_h40_line(vdp_context * context)
 	context->cur_slot = context->slot_counter;
 	context->sprite_x_offset = 0;
 	context->sprite_draws = MAX_SPRITES_LINE;
-	//background planes and layer compositing
-	for (int col = 0; col < 42; col+=2)
-	{
-		read_map_scroll_a(col, context->vcounter, context);
-		render_map_1(context);
-		render_map_2(context);
-		read_map_scroll_b(col, context->vcounter, context);
-		render_map_3(context);
-		render_map_output(context->vcounter, col, context);
-	}
-	//sprite rendering phase 2
+}
+
+//sprite rendering phase 2, runs after the background planes have consumed linebuf
+static void h40_line_sprites_end(vdp_context *context, h40_line_state *line)
+{
 	for (int i = 0; i < MAX_SPRITES_LINE; i++)
 	{
 		read_sprite_x(context->vcounter, context);
@@ -2706,33 +2953,126 @@ static void vdp_h40_line(vdp_context * context)
 	//163
 	context->cur_slot = MAX_SPRITES_LINE-1;
 	memset(context->linebuf, 0, LINEBUF_SIZE);
-	render_border_garbage(
-		context,
-		context->sprite_draw_list[context->cur_slot].address,
-		context->tmp_buf_a, context->buf_a_off,
-		context->col_1
-	);
+	line->garbage[5] = context->sprite_draw_list[context->cur_slot].address;
 	context->flags &= ~FLAG_MASKED;
 	render_sprite_cells(context);
 	//164
-	render_border_garbage(
-		context,
-		context->sprite_draw_list[context->cur_slot].address,
-		context->tmp_buf_a, context->buf_a_off + 8,
-		context->col_2
-	);
+	line->garbage[6] = context->sprite_draw_list[context->cur_slot].address;
 	render_sprite_cells(context);
-	context->cycles += MCLKS_LINE;
-	vdp_advance_line(context);
-	src = context->compositebuf;
-	dst = context->output;
-	if (test_layer) {
-		for (int i = 0; i < (LINE_CHANGE_H40 - BG_START_SLOT) * 2; i++)
+}
+
+//palette lookup for the end of the previous line
+static void h40_line_tail(vdp_context *context, uint32_t *dst)
+{
+	uint8_t bgindex = context->regs[REG_BG_COLOR] & 0x3F;
+	uint8_t *src = context->compositebuf + (LINE_CHANGE_H40 - BG_START_SLOT) *2;
+	dst += (LINE_CHANGE_H40 - BG_START_SLOT) *2;
+	if (context->test_port >> 7 & 3) {
+		for (int i = 0; i < LINEBUF_SIZE - (LINE_CHANGE_H40 - BG_START_SLOT) * 2; i++)
 		{
 			*(dst++) = context->colors[*(src++)];
 		}
 	} else {
+		for (int i = 0; i < LINEBUF_SIZE - (LINE_CHANGE_H40 - BG_START_SLOT) * 2; i++)
+		{
+			if (*src & 0x3F) {
+				*(dst++) = context->colors[*(src++)];
+			} else {
+				*(dst++) = context->colors[(*(src++) & 0xC0) | bgindex];
+			}
+		}
+	}
+}
+
+//background planes and layer compositing
+static void h40_line_background(vdp_context *context, h40_line_state *line)
+{
+	uint16_t address;
+	uint32_t mask;
+	//165
+	if (!(context->regs[REG_MODE_3] & BIT_VSCROLL)) {
+		//TODO: Develop some tests on hardware to see when vscroll latch actually happens for full plane mode
+		//See note in vdp_h32 for why this was originally moved out of read_map_scroll
+		//Skitchin' has a similar problem, but uses H40 mode. It seems to be able to hit the extern slot at 232
+		//pretty consistently
+		context->vscroll_latch[0] = context->vsram[0];
+		context->vscroll_latch[1] = context->vsram[1];
+	}
+	//167
+	render_border_garbage(context, line->garbage[0], context->tmp_buf_b, context->buf_b_off, context->col_1);
+	//168
+	render_border_garbage(context, line->garbage[1], context->tmp_buf_b, context->buf_b_off + 8, context->col_2);
+	//243
+	render_border_garbage(context, line->garbage[2], context->tmp_buf_a, context->buf_a_off, context->col_1);
+	//244
+	address = (context->regs[REG_HSCROLL] & 0x3F) << 10;
+	mask = 0;
+	if (context->regs[REG_MODE_3] & 0x2) {
+		mask |= 0xF8;
+	}
+	if (context->regs[REG_MODE_3] & 0x1) {
+		mask |= 0x7;
+	}
+	render_border_garbage(context, address, context->tmp_buf_a, context->buf_a_off+8, context->col_2);
+	address += (context->vcounter & mask) * 4;
+	context->hscroll_a = context->vdpmem[address] << 8 | context->vdpmem[address+1];
+	context->hscroll_a_fine = context->hscroll_a & 0xF;
+	context->hscroll_b = context->vdpmem[address+2] << 8 | context->vdpmem[address+3];
+	context->hscroll_b_fine = context->hscroll_b & 0xF;
+	//printf("%d: HScroll A: %d, HScroll B: %d\n", context->vcounter, context->hscroll_a, context->hscroll_b);
+	//247
+	render_border_garbage(context, line->garbage[3], context->tmp_buf_b, context->buf_b_off, context->col_1);
+	//248
+	render_border_garbage(context, line->garbage[4], context->tmp_buf_b, context->buf_b_off + 8, context->col_2);
+	context->buf_a_off = (context->buf_a_off + SCROLL_BUFFER_DRAW) & SCROLL_BUFFER_MASK;
+	context->buf_b_off = (context->buf_b_off + SCROLL_BUFFER_DRAW) & SCROLL_BUFFER_MASK;
+	for (int col = 0; col < 42; col+=2)
+	{
+		read_map_scroll_a(col, context->vcounter, context);
+		render_map_1(context);
+		render_map_2(context);
+		read_map_scroll_b(col, context->vcounter, context);
+		render_map_3(context);
+		render_map_output(context->vcounter, col, context);
+	}
+}
+
+//border garbage for the next line and palette lookup for the part of this line before the line change
+static void h40_line_finish(vdp_context *context, h40_line_state *line)
+{
+	//163
+	render_border_garbage(context, line->garbage[5], context->tmp_buf_a, context->buf_a_off, context->col_1);
+	//164
+	render_border_garbage(context, line->garbage[6], context->tmp_buf_a, context->buf_a_off + 8, context->col_2);
+	if (context->skip_output) {
+		return;
+	}
+	uint8_t bgindex = context->regs[REG_BG_COLOR] & 0x3F;
+	uint8_t *src = context->compositebuf;
+	uint32_t *dst = line->output;
+	if (context->test_port >> 7 & 3) {
 		for (int i = 0; i < (LINE_CHANGE_H40 - BG_START_SLOT) * 2; i++)
+		{
+			*(dst++) = context->colors[*(src++)];
+		}
+	} else {
+		int i = 0;
+#ifdef VDP_SIMD
+		//pick the palette entries for a group of pixels at once, only the table lookups themselves are scalar
+		pix16 bg = pix_set1(bgindex);
+		for (; i + 16 <= (LINE_CHANGE_H40 - BG_START_SLOT) * 2; i += 16)
+		{
+			uint8_t indices[16];
+			pix16 pixels = pix_load(src);
+			pix_store(indices, pix_select(pix_clear(pixels, 0x3F), pix_or(pix_and(pixels, pix_set1(0xC0)), bg), pixels));
+			for (int j = 0; j < 16; j++)
+			{
+				*(dst++) = context->colors[indices[j]];
+			}
+			src += 16;
+		}
+#endif
+		for (; i < (LINE_CHANGE_H40 - BG_START_SLOT) * 2; i++)
 		{
 			if (*src & 0x3F) {
 				*(dst++) = context->colors[*(src++)];
@@ -2742,6 +3082,126 @@ static void vdp_h40_line(vdp_context * context)
 		}
 	}
 }
+
+static void vdp_h40_line(vdp_context * context)
+{
+	h40_line_state line;
+	h40_line_sprites_start(context, &line);
+	h40_line_tail(context, context->output);
+	advance_output_line(context);
+	line.output = context->output;
+	h40_line_background(context, &line);
+	h40_line_sprites_end(context, &line);
+	h40_line_finish(context, &line);
+	context->cycles += MCLKS_LINE;
+	vdp_advance_line(context);
+}
+
+#ifdef VDP_THREAD
+static void *worker_main(void *data)
+{
+	vdp_worker *worker = data;
+	vdp_context *shadow = worker->shadow;
+	pthread_mutex_lock(&worker->lock);
+	for (;;)
+	{
+		while (worker->job_read == worker->job_write && !worker->quit)
+		{
+			pthread_cond_wait(&worker->work_ready, &worker->lock);
+		}
+		if (worker->job_read == worker->job_write) {
+			break;
+		}
+		worker_job *job = worker->jobs + worker->job_read % WORKER_JOBS;
+		pthread_mutex_unlock(&worker->lock);
+		
+		apply_writes(worker, job->log_end);
+		memcpy(shadow->regs, job->regs, VDP_REGS);
+		memcpy(shadow->linebuf, job->linebuf, LINEBUF_SIZE);
+		shadow->vcounter = job->vcounter;
+		shadow->test_port = job->test_port;
+		shadow->flags2 = job->flags2;
+		shadow->double_res = job->double_res;
+		h40_line_tail(shadow, job->line.prev_output);
+		h40_line_background(shadow, &job->line);
+		h40_line_finish(shadow, &job->line);
+		
+		pthread_mutex_lock(&worker->lock);
+		worker->job_read++;
+		pthread_cond_signal(&worker->work_done);
+	}
+	pthread_mutex_unlock(&worker->lock);
+	return NULL;
+}
+
+//emulation thread half of vdp_h40_line, the rest is queued for the worker
+static void vdp_h40_line_threaded(vdp_context *context)
+{
+	vdp_worker *worker = context->worker;
+	pthread_mutex_lock(&worker->lock);
+	while (worker->job_write - worker->job_read == WORKER_JOBS)
+	{
+		pthread_cond_wait(&worker->work_done, &worker->lock);
+	}
+	pthread_mutex_unlock(&worker->lock);
+	worker_job *job = worker->jobs + worker->job_write % WORKER_JOBS;
+	
+	job->line.prev_output = context->output;
+	h40_line_sprites_start(context, &job->line);
+	advance_output_line(context);
+	job->line.output = context->output;
+	memcpy(job->linebuf, context->linebuf, LINEBUF_SIZE);
+	h40_line_sprites_end(context, &job->line);
+	memcpy(job->regs, context->regs, VDP_REGS);
+	job->vcounter = context->vcounter;
+	job->test_port = context->test_port;
+	job->flags2 = context->flags2;
+	job->double_res = context->double_res;
+	job->log_end = worker->log_write;
+	if (!worker->active) {
+		//worker is idle so the shadow context can be updated directly
+		copy_render_state(worker->shadow, context);
+		worker->active = 1;
+	}
+	
+	pthread_mutex_lock(&worker->lock);
+	worker->job_write++;
+	pthread_cond_signal(&worker->work_ready);
+	pthread_mutex_unlock(&worker->lock);
+	
+	context->cycles += MCLKS_LINE;
+	vdp_advance_line(context);
+}
+#endif
+
+void vdp_start_worker(vdp_context *context)
+{
+#ifdef VDP_THREAD
+	if (context->worker) {
+		return;
+	}
+	vdp_worker *worker = calloc(1, sizeof(vdp_worker));
+	worker->shadow = malloc(sizeof(vdp_context) + VRAM_SIZE);
+	memcpy(worker->shadow, context, sizeof(vdp_context) + VRAM_SIZE);
+	//the shadow context only ever runs the pixel half of active lines
+	worker->shadow->worker = NULL;
+	worker->shadow->state = ACTIVE;
+	worker->shadow->skip_output = 0;
+	pthread_mutex_init(&worker->lock, NULL);
+	pthread_cond_init(&worker->work_ready, NULL);
+	pthread_cond_init(&worker->work_done, NULL);
+	if (pthread_create(&worker->thread, NULL, worker_main, worker)) {
+		warning("Failed to start VDP worker thread, pixels will be generated on the emulation thread\n");
+		pthread_mutex_destroy(&worker->lock);
+		pthread_cond_destroy(&worker->work_ready);
+		pthread_cond_destroy(&worker->work_done);
+		free(worker->shadow);
+		free(worker);
+		return;
+	}
+	context->worker = worker;
+#endif
+}
 static void vdp_h40(vdp_context * context, uint32_t target_cycles)
 {
 	uint16_t address;
@@ -2762,10 +3222,19 @@ static void vdp_h40(vdp_context * context, uint32_t target_cycles)
 		//only consider doing a line at a time if the FIFO is empty, there are no pending reads and there is no DMA running
 		if (context->fifo_read == -1 && !(context->flags & FLAG_DMA_RUN) && ((context->cd & 1) || (context->flags & FLAG_READ_FETCHED))) {
 			while (target_cycles - context->cycles >= MCLKS_LINE && context->state != PREPARING && context->vcounter != context->inactive_start) {
+#ifdef VDP_THREAD
+				//lines that push a frame or feed the debug views need the pixels right away
+				if (context->worker && !context->skip_output && !context->enabled_debuggers && !output_frame_done(context)) {
+					vdp_h40_line_threaded(context);
+					continue;
+				}
+				vdp_worker_sync(context);
+#endif
 				vdp_h40_line(context);
 			}
 			CHECK_ONLY
 		}
+		vdp_worker_sync(context);
 		OUTPUT_PIXEL(165)
 		if (!(context->regs[REG_MODE_3] & BIT_VSCROLL)) {
 			//TODO: Develop some tests on hardware to see when vscroll latch actually happens for full plane mode
@@ -3597,6 +4066,10 @@ void vdp_run_context_full(vdp_context * context, uint32_t target_cycles)
 	{
 		check_switch_inactive(context, is_h40);
 		
+		if (!(mode_5 && is_h40 && context->hslot == 165 && is_active(context))) {
+			//only the start of an H40 line can hand pixel generation to the worker thread
+			vdp_worker_sync(context);
+		}
 		if (is_active(context)) {
 			if (mode_5) {
 				if (is_h40) {
@@ -4266,6 +4739,7 @@ void vdp_int_ack(vdp_context * context)
 #define VDP_STATE_VERSION 3
 void vdp_serialize(vdp_context *context, serialize_buffer *buf)
 {
+	vdp_worker_sync(context);
 	save_int8(buf, VDP_STATE_VERSION);
 	save_int8(buf, VRAM_SIZE / 1024);//VRAM size in KB, needed for future proofing
 	save_buffer8(buf, context->vdpmem, VRAM_SIZE);
@@ -4350,6 +4824,7 @@ void vdp_serialize(vdp_context *context, serialize_buffer *buf)
 void vdp_deserialize(deserialize_buffer *buf, void *vcontext)
 {
 	vdp_context *context = vcontext;
+	vdp_worker_sync(context);
 	uint8_t version = load_int8(buf);
 	uint8_t vramk;
 	if (version == 64) {
@@ -4487,6 +4962,7 @@ void vdp_deserialize(deserialize_buffer *buf, void *vcontext)
 		context->cd_latch = context->cd;
 	}
 	update_video_params(context);
+	vdp_worker_resync(context);
 }
 
 static vdp_context *current_vdp;
@@ -4504,6 +4980,7 @@ static void vdp_debug_window_close(uint8_t which)
 
 void vdp_toggle_debug_view(vdp_context *context, uint8_t debug_type)
 {
+	vdp_worker_sync(context);
 	if (context->enabled_debuggers & 1 << debug_type) {
 		render_destroy_window(context->debug_fb_indices[debug_type]);
 		context->enabled_debuggers &= ~(1 << debug_type);
@@ -4637,9 +5114,12 @@ void vdp_replay_event(vdp_context *context, uint8_t event, event_reader *reader)
 	}
 	case EVENT_VDP_INTRAM:
 		if (address < 128) {
+			//write_cram can touch the line the worker is generating
+			vdp_worker_sync(context);
 			write_cram(context, address, load_int16(buffer));
 		} else {
 			context->vsram[address&63] = load_int16(buffer);
+			log_vdp_write(context, VDP_WRITE_VSRAM, address&63, context->vsram[address&63]);
 		}
 		break;
 	}
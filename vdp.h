@@ -160,6 +160,8 @@ enum {
 	VDP_NUM_DEBUG_TYPES
 };
 
+typedef struct vdp_worker vdp_worker;
+
 typedef struct {
 	system_header  *system;
 	//pointer to current line in framebuffer
@@ -238,6 +240,8 @@ typedef struct {
 	uint8_t        debug_fb_indices[VDP_NUM_DEBUG_TYPES];
 	uint8_t        debug_modes[VDP_NUM_DEBUG_TYPES];
 	uint8_t        pushed_frame;
+	uint8_t        skip_output; //when set, compositing and framebuffer output are skipped
+	vdp_worker     *worker;
 	uint8_t        vdpmem[];
 } vdp_context;
 
@@ -283,8 +287,12 @@ void vdp_deserialize(deserialize_buffer *buf, void *vcontext);
 void vdp_force_update_framebuffer(vdp_context *context);
 void vdp_toggle_debug_view(vdp_context *context, uint8_t debug_type);
 void vdp_inc_debug_mode(vdp_context *context);
+//moves pixel generation for H40 lines to a separate thread, does nothing in builds without VDP_THREAD
+void vdp_start_worker(vdp_context *context);
+//needs to be called after VRAM, CRAM or VSRAM are modified without going through the VDP
+void vdp_worker_resync(vdp_context *context);
 //to be implemented by the host system
-uint16_t read_dma_value(uint32_t address);
+uint16_t read_dma_value(system_header *system, uint32_t address);
 void vdp_replay_event(vdp_context *context, uint8_t event, event_reader *reader);
 
 #endif //VDP_H_
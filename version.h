@@ -0,0 +1,6 @@
+#ifndef VERSION_H_
+#define VERSION_H_
+
+#define BLASTEM_VERSION "0.6.3-pre"
+
+#endif //VERSION_H_
@@ -281,6 +281,7 @@ void ym_init(ym2612_context * context, uint32_t master_clock, uint32_t clock_div
 	}
 	ym_reset(context);
 	ym_enable_zero_offset(context, 1);
+	ym_enable_block_synthesis(context, 1);
 }
 
 void ym_free(ym2612_context *context)
@@ -292,6 +293,11 @@ void ym_free(ym2612_context *context)
 	free(context);
 }
 
+void ym_enable_block_synthesis(ym2612_context *context, uint8_t enabled)
+{
+	context->block_synthesis = enabled;
+}
+
 void ym_enable_zero_offset(ym2612_context *context, uint8_t enabled)
 {
 	if (enabled) {
@@ -303,6 +309,14 @@ void ym_enable_zero_offset(ym2612_context *context, uint8_t enabled)
 		context->volume_mult = 2;
 		context->volume_div = 3;
 	}
+	//channel outputs are always a multiple of 16 so the scaled value for each can be precomputed
+	//to keep divisions out of the per-sample mixing
+	for (int32_t i = 0; i < YM_VOLUME_TABLE_SIZE; i++)
+	{
+		int32_t value = (i - YM_VOLUME_TABLE_SIZE/2) * 16;
+		context->volume_table[i] = (value * context->volume_mult) / context->volume_div;
+	}
+	context->zero_offset_volume = (context->zero_offset * context->volume_mult) / context->volume_div;
 }
 #define YM_MOD_SHIFT 1
 
@@ -481,64 +495,104 @@ void ym_run_envelope(ym2612_context *context, ym_channel *channel, ym_operator *
 	}
 }
 
-void ym_run_phase(ym2612_context *context, uint32_t channel, uint32_t op)
+//Applies SSG-EG, total level and AM to the envelope of an operator to get its final attenuation
+//SSG-EG can restart the phase, in which case *phase is updated as well
+static inline uint16_t ym_op_attenuation(ym2612_context *context, ym_operator *operator, ym_channel *chan, uint16_t *phase)
 {
-	if (channel != 5 || !context->dac_enable) {
-		//printf("updating operator %d of channel %d\n", op, channel);
-		ym_operator * operator = context->operators + op;
-		ym_channel * chan = context->channels + channel;
-		uint16_t phase = operator->phase_counter >> 10 & 0x3FF;
-		operator->phase_counter += operator->phase_inc;//ym_calc_phase_inc(context, operator, op);
-		int16_t mod = 0;
-		if (op & 3) {
-			if (operator->mod_src[0]) {
-				mod = *operator->mod_src[0];
-				if (operator->mod_src[1]) {
-					mod += *operator->mod_src[1];
+	uint16_t env = operator->envelope;
+	if (operator->ssg) {
+		if (env >= SSG_CENTER) {
+			if (operator->ssg & SSG_ALTERNATE) {
+				if (operator->env_phase != PHASE_RELEASE && (
+					!(operator->ssg & SSG_HOLD) || ((operator->ssg ^ operator->inverted) & SSG_INVERT) == 0
+				)) {
+					operator->inverted ^= SSG_INVERT;
 				}
-				mod >>= YM_MOD_SHIFT;
+			} else if (!(operator->ssg & SSG_HOLD)) {
+				*phase = operator->phase_counter = 0;
 			}
-		} else {
-			if (chan->feedback) {
-				mod = (chan->op1_old + operator->output) >> (10-chan->feedback);
+			if (
+				(operator->env_phase == PHASE_DECAY || operator->env_phase == PHASE_SUSTAIN) 
+				&& !(operator->ssg & SSG_HOLD)
+			) {
+				start_envelope(operator, chan);
+				env = operator->envelope;
 			}
 		}
-		uint16_t env = operator->envelope;
-		if (operator->ssg) {
-			if (env >= SSG_CENTER) {
-				if (operator->ssg & SSG_ALTERNATE) {
-					if (operator->env_phase != PHASE_RELEASE && (
-						!(operator->ssg & SSG_HOLD) || ((operator->ssg ^ operator->inverted) & SSG_INVERT) == 0
-					)) {
-						operator->inverted ^= SSG_INVERT;
-					}
-				} else if (!(operator->ssg & SSG_HOLD)) {
-					phase = operator->phase_counter = 0;
-				}
-				if (
-					(operator->env_phase == PHASE_DECAY || operator->env_phase == PHASE_SUSTAIN) 
-					&& !(operator->ssg & SSG_HOLD)
-				) {
-					start_envelope(operator, chan);
-					env = operator->envelope;
-				}
-			}
-			if (operator->inverted) {
-				env = (SSG_CENTER - env) & MAX_ENVELOPE;
-			}
+		if (operator->inverted) {
+			env = (SSG_CENTER - env) & MAX_ENVELOPE;
 		}
-		env += operator->total_level;
-		if (operator->am) {
-			uint16_t base_am = (context->lfo_am_step & 0x80 ? context->lfo_am_step : ~context->lfo_am_step) & 0x7E;
-			if (ams_shift[chan->ams] >= 0) {
-				env += (base_am >> ams_shift[chan->ams]) & MAX_ENVELOPE;
-			} else {
-				env += base_am << (-ams_shift[chan->ams]);
+	}
+	env += operator->total_level;
+	if (operator->am) {
+		uint16_t base_am = (context->lfo_am_step & 0x80 ? context->lfo_am_step : ~context->lfo_am_step) & 0x7E;
+		if (ams_shift[chan->ams] >= 0) {
+			env += (base_am >> ams_shift[chan->ams]) & MAX_ENVELOPE;
+		} else {
+			env += base_am << (-ams_shift[chan->ams]);
+		}
+	}
+	if (env > MAX_ENVELOPE) {
+		env = MAX_ENVELOPE;
+	}
+	return env;
+}
+
+static inline int16_t ym_op_modulation(ym_operator *operator, ym_channel *chan, uint32_t op)
+{
+	int16_t mod = 0;
+	if (op & 3) {
+		if (operator->mod_src[0]) {
+			mod = *operator->mod_src[0];
+			if (operator->mod_src[1]) {
+				mod += *operator->mod_src[1];
 			}
+			mod >>= YM_MOD_SHIFT;
 		}
-		if (env > MAX_ENVELOPE) {
-			env = MAX_ENVELOPE;
+	} else {
+		if (chan->feedback) {
+			mod = (chan->op1_old + operator->output) >> (10-chan->feedback);
 		}
+	}
+	return mod;
+}
+
+static inline void ym_op_output(ym2612_context *context, uint32_t channel, uint32_t op, int16_t output)
+{
+	ym_operator * operator = context->operators + op;
+	ym_channel * chan = context->channels + channel;
+	if (op % 4 == 0) {
+		chan->op1_old = operator->output;
+	} else if (op % 4 == 2) {
+		chan->op2_old = operator->output;
+	}
+	operator->output = output;
+	//Update the channel output if we've updated all operators
+	if (op % 4 == 3) {
+		if (chan->algorithm < 4) {
+			chan->output = operator->output;
+		} else if(chan->algorithm == 4) {
+			chan->output = operator->output + context->operators[channel * 4 + 2].output;
+		} else {
+			output = 0;
+			for (uint32_t op = ((chan->algorithm == 7) ? 0 : 1) + channel*4; op < (channel+1)*4; op++) {
+				output += context->operators[op].output;
+			}
+			chan->output = output;
+		}
+	}
+}
+
+void ym_run_phase(ym2612_context *context, uint32_t channel, uint32_t op)
+{
+	if (channel != 5 || !context->dac_enable) {
+		//printf("updating operator %d of channel %d\n", op, channel);
+		ym_operator * operator = context->operators + op;
+		ym_channel * chan = context->channels + channel;
+		uint16_t phase = operator->phase_counter >> 10 & 0x3FF;
+		operator->phase_counter += operator->phase_inc;//ym_calc_phase_inc(context, operator, op);
+		int16_t mod = ym_op_modulation(operator, chan, op);
+		uint16_t env = ym_op_attenuation(context, operator, chan, &phase);
 		if (first_key_on) {
 			dfprintf(debug_file, "op %d, base phase: %d, mod: %d, sine: %d, out: %d\n", op, phase, mod, sine_table[(phase+mod) & 0x1FF], pow_table[sine_table[phase & 0x1FF] + env]);
 		}
@@ -550,32 +604,7 @@ void ym_run_phase(ym2612_context *context, uint32_t channel, uint32_t op)
 		if (phase & 0x200) {
 			output = -output;
 		}
-		if (op % 4 == 0) {
-			chan->op1_old = operator->output;
-		} else if (op % 4 == 2) {
-			chan->op2_old = operator->output;
-		}
-		operator->output = output;
-		//Update the channel output if we've updated all operators
-		if (op % 4 == 3) {
-			if (chan->algorithm < 4) {
-				chan->output = operator->output;
-			} else if(chan->algorithm == 4) {
-				chan->output = operator->output + context->operators[channel * 4 + 2].output;
-			} else {
-				output = 0;
-				for (uint32_t op = ((chan->algorithm == 7) ? 0 : 1) + channel*4; op < (channel+1)*4; op++) {
-					output += context->operators[op].output;
-				}
-				chan->output = output;
-			}
-			if (first_key_on) {
-				int16_t value = context->channels[channel].output & 0x3FE0;
-				if (value & 0x2000) {
-					value |= 0xC000;
-				}
-			}
-		}
+		ym_op_output(context, channel, op, output);
 		//puts("operator update done");
 	}
 }
@@ -603,28 +632,158 @@ void ym_output_sample(ym2612_context *context)
 		if (context->channels[i].logfile) {
 			fwrite(&value, sizeof(value), 1, context->channels[i].logfile);
 		}
+		int16_t scaled = context->volume_table[value / 16 + YM_VOLUME_TABLE_SIZE/2];
 		if (context->channels[i].lr & 0x80) {
-			left += (value * context->volume_mult) / context->volume_div;
-		} else if (context->zero_offset) {
-			if (value >= 0) {
-				left += (context->zero_offset * context->volume_mult) / context->volume_div;
-			} else {
-				left -= (context->zero_offset * context->volume_mult) / context->volume_div;
-			}
+			left += scaled;
+		} else if (value >= 0) {
+			left += context->zero_offset_volume;
+		} else {
+			left -= context->zero_offset_volume;
 		}
 		if (context->channels[i].lr & 0x40) {
-			right += (value * context->volume_mult) / context->volume_div;
-		} else if (context->zero_offset) {
-			if (value >= 0) {
-				right += (context->zero_offset * context->volume_mult) / context->volume_div;
-			} else {
-				right -= (context->zero_offset * context->volume_mult) / context->volume_div;
-			}
+			right += scaled;
+		} else if (value >= 0) {
+			right += context->zero_offset_volume;
+		} else {
+			right -= context->zero_offset_volume;
 		}
 	}
 	render_put_stereo_sample(context->audio, left, right);
 }
 
+//pow_table is zero for every index at or above this value, so there's no need to look
+//at the phase or modulation input of an operator that is attenuated this much
+#define SILENT_ENVELOPE 0xE00
+
+//a released operator that has reached maximum attenuation stays there until the next key on
+#define ENVELOPE_IDLE(operator) ((operator)->env_phase == PHASE_RELEASE && (operator)->envelope == MAX_ENVELOPE)
+
+//A channel is idle when all of its operators are fully released and their outputs have settled to 0
+static uint8_t ym_channel_idle(ym2612_context *context, uint32_t channel)
+{
+	ym_channel *chan = context->channels + channel;
+	if (chan->output || chan->op1_old || chan->op2_old) {
+		return 0;
+	}
+	for (ym_operator *operator = context->operators + channel * 4, *end = operator + 4; operator < end; operator++)
+	{
+		if (!ENVELOPE_IDLE(operator) || operator->ssg || operator->output) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+//Runs operator slots first through last-1 of the current sample in one go. This is equivalent to running
+//the same slots one at a time with ym_run_slot, but the per-slot bookkeeping is hoisted out of the loop
+//and operators that can't produce any output skip the table lookups
+static void ym_run_slots(ym2612_context *context, uint32_t first, uint32_t last)
+{
+	if (!first) {
+		ym_run_timers(context);
+	}
+	//The envelope generator updates one operator every 3 slots, so each sample covers a block of 8 operators.
+	//Operators are independent of each other's envelopes so the only thing that matters is whether an
+	//operator's envelope update comes before or after its own phase generator update
+	uint32_t env_first = (first + 2) / 3, env_last = (last + 2) / 3;
+	uint32_t env_start = (context->current_env_op + NUM_OPERATORS - env_first) % NUM_OPERATORS;
+	//nothing observable happens in an idle channel except for the phase counters advancing
+	//envelope updates can be skipped too since they're a no-op for idle operators
+	uint8_t idle_channels = 0;
+	for (uint32_t channel = first / 4; channel <= (last - 1) / 4; channel++)
+	{
+		if (ym_channel_idle(context, channel)) {
+			idle_channels |= 1 << channel;
+		}
+	}
+	for (uint32_t op = first; op < last; op++)
+	{
+		if (idle_channels & (1 << (op / 4))) {
+			if (op / 4 != 5 || !context->dac_enable) {
+				context->operators[op].phase_counter += context->operators[op].phase_inc;
+			}
+			continue;
+		}
+		uint32_t env_index = op - env_start;
+		uint8_t env_update = env_index >= env_first && env_index < env_last;
+		//update slot for this operator's envelope is env_index * 3
+		uint8_t env_early = env_update && env_index * 2 <= env_start;
+		ym_operator *operator = context->operators + op;
+		uint32_t channel = op / 4;
+		ym_channel *chan = context->channels + channel;
+		if (env_early && !ENVELOPE_IDLE(operator)) {
+			ym_run_envelope(context, chan, operator);
+		}
+		if (channel != 5 || !context->dac_enable) {
+			uint16_t phase = operator->phase_counter >> 10 & 0x3FF;
+			operator->phase_counter += operator->phase_inc;
+			uint16_t env = ym_op_attenuation(context, operator, chan, &phase);
+			int16_t output = 0;
+			if (env < SILENT_ENVELOPE) {
+				phase += ym_op_modulation(operator, chan, op);
+				output = pow_table[sine_table[phase & 0x1FF] + env];
+				if (phase & 0x200) {
+					output = -output;
+				}
+			}
+			ym_op_output(context, channel, op, output);
+		}
+		if (env_update && !env_early && !ENVELOPE_IDLE(operator)) {
+			ym_run_envelope(context, chan, operator);
+		}
+	}
+	if (env_last > env_first) {
+		//envelope updates for operators whose phase update is outside of this range
+		for (uint32_t env_index = env_first; env_index < env_last; env_index++)
+		{
+			uint32_t op = env_start + env_index;
+			if (op < first || op >= last) {
+				ym_run_envelope(context, context->channels + op / 4, context->operators + op);
+			}
+		}
+		context->current_env_op += env_last - env_first;
+		if (context->current_env_op == NUM_OPERATORS) {
+			context->current_env_op = 0;
+			context->env_counter++;
+		}
+	}
+	context->current_cycle += context->clock_inc * (last - first);
+	if (last == NUM_OPERATORS) {
+		context->current_op = 0;
+		ym_output_sample(context);
+	} else {
+		context->current_op = last;
+	}
+}
+
+static void ym_run_slot(ym2612_context *context)
+{
+	//Update timers at beginning of 144 cycle period
+	if (!context->current_op) {
+		ym_run_timers(context);
+	}
+	//Update Envelope Generator
+	if (!(context->current_op % 3)) {
+		uint32_t op = context->current_env_op;
+		ym_operator * operator = context->operators + op;
+		ym_channel * channel = context->channels + op/4;
+		ym_run_envelope(context, channel, operator);
+		context->current_env_op++;
+		if (context->current_env_op == NUM_OPERATORS) {
+			context->current_env_op = 0;
+			context->env_counter++;
+		}
+	}
+
+	//Update Phase Generator
+	ym_run_phase(context, context->current_op / 4, context->current_op);
+	context->current_op++;
+	if (context->current_op == NUM_OPERATORS) {
+		context->current_op = 0;
+		ym_output_sample(context);
+	}
+}
+
 void ym_run(ym2612_context * context, uint32_t to_cycle)
 {
 	if (context->current_cycle >= to_cycle) {
@@ -632,32 +791,16 @@ void ym_run(ym2612_context * context, uint32_t to_cycle)
 	}
 	//printf("Running YM2612 from cycle %d to cycle %d\n", context->current_cycle, to_cycle);
 	//TODO: Fix channel update order OR remap channels in register write
-	for (; context->current_cycle < to_cycle; context->current_cycle += context->clock_inc) {
-		//Update timers at beginning of 144 cycle period
-		if (!context->current_op) {
-			ym_run_timers(context);
-		}
-		//Update Envelope Generator
-		if (!(context->current_op % 3)) {
-			uint32_t op = context->current_env_op;
-			ym_operator * operator = context->operators + op;
-			ym_channel * channel = context->channels + op/4;
-			ym_run_envelope(context, channel, operator);
-			context->current_env_op++;
-			if (context->current_env_op == NUM_OPERATORS) {
-				context->current_env_op = 0;
-				context->env_counter++;
-			}
-		}
-
-		//Update Phase Generator
-		ym_run_phase(context, context->current_op / 4, context->current_op);
-		context->current_op++;
-		if (context->current_op == NUM_OPERATORS) {
-			context->current_op = 0;
-			ym_output_sample(context);
+	if (context->block_synthesis) {
+		while (context->current_cycle < to_cycle)
+		{
+			uint32_t last = context->current_op + (to_cycle - context->current_cycle + context->clock_inc - 1) / context->clock_inc;
+			ym_run_slots(context, context->current_op, last < NUM_OPERATORS ? last : NUM_OPERATORS);
 		}
-		
+		return;
+	}
+	for (; context->current_cycle < to_cycle; context->current_cycle += context->clock_inc) {
+		ym_run_slot(context);
 	}
 	//printf("Done running YM2612 at cycle %d\n", context->current_cycle, to_cycle);
 }
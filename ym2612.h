@@ -16,6 +16,9 @@
 #define NUM_CHANNELS 6
 #define NUM_OPERATORS (4*NUM_CHANNELS)
 
+//covers every possible channel output after clamping and zero offset in steps of 16
+#define YM_VOLUME_TABLE_SIZE 1040
+
 #define YM_OPT_WAVE_LOG 1
 #define YM_OPT_3834 2
 
@@ -83,6 +86,8 @@ typedef struct {
 	ym_operator operators[NUM_OPERATORS];
 	ym_channel  channels[NUM_CHANNELS];
 	int16_t     zero_offset;
+	int16_t     zero_offset_volume;
+	int16_t     volume_table[YM_VOLUME_TABLE_SIZE];
 	uint16_t    timer_a;
 	uint16_t    timer_a_load;
 	uint16_t    env_counter;
@@ -93,6 +98,7 @@ typedef struct {
 	uint8_t     ch3_mode;
 	uint8_t     current_op;
 	uint8_t     current_env_op;
+	uint8_t     block_synthesis;
 
 	uint8_t     timer_control;
 	uint8_t     dac_enable;
@@ -140,6 +146,7 @@ void ym_init(ym2612_context * context, uint32_t master_clock, uint32_t clock_div
 void ym_reset(ym2612_context *context);
 void ym_free(ym2612_context *context);
 void ym_enable_zero_offset(ym2612_context *context, uint8_t enabled);
+void ym_enable_block_synthesis(ym2612_context *context, uint8_t enabled);
 void ym_adjust_master_clock(ym2612_context * context, uint32_t master_clock);
 void ym_adjust_cycles(ym2612_context *context, uint32_t deduction);
 void ym_run(ym2612_context * context, uint32_t to_cycle);
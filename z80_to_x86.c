@@ -28,6 +28,7 @@
 
 uint32_t zbreakpoint_patch(z80_context * context, uint16_t address, code_ptr dst);
 void z80_handle_deferred(z80_context * context);
+void zcreate_stub(z80_context * context);
 
 uint8_t z80_size(z80inst * inst)
 {
@@ -323,6 +324,188 @@ void z80_print_regs_exit(z80_context * context)
 	exit(0);
 }
 
+//longest loop body, in bytes, that is checked for idle loop behavior
+#define Z80_IDLE_MAX_BYTES 16
+#define Z80_IDLE_FLAG(flag) (1 << (16 + (flag)))
+#define Z80_IDLE_ALL_FLAGS (((1 << ZF_NUM) - 1) << 16)
+
+static uint8_t z80_idle_reg(uint8_t reg)
+{
+	return reg <= Z80_A && reg != Z80_I && reg != Z80_R;
+}
+
+static uint8_t z80_idle_readable(z80_options *opts, uint16_t address)
+{
+	//reads from plain memory have no side effects and nothing else can write to it while the Z80 runs
+	memmap_chunk const *chunk = find_map_chunk(address, &opts->gen, 0, NULL);
+	return chunk && (chunk->flags & MMAP_READ)
+		&& !(chunk->flags & (MMAP_PTR_IDX|MMAP_ONLY_ODD|MMAP_ONLY_EVEN|MMAP_FUNC_NULL));
+}
+
+//Checks whether the branch at address that jumps back to target closes an idle loop. The body
+//may only read registers and plain RAM and anything it writes has to be written before it is read,
+//so once the branch has been taken after a full iteration every later iteration will do exactly the
+//same thing until an interrupt or sync lets something else run. On success the length of the body
+//in T-states and its R register increment are returned in body_cycles and r_inc, not counting the branch
+static uint8_t z80_is_idle_loop(z80_context *context, uint16_t address, uint16_t target, uint32_t *body_cycles, uint8_t *r_inc)
+{
+	z80_options *opts = context->options;
+	if (target > address || address - target > Z80_IDLE_MAX_BYTES) {
+		return 0;
+	}
+	uint32_t written = 0, read_first = 0;
+	*body_cycles = 0;
+	*r_inc = 0;
+	uint16_t cur = target;
+	while (cur < address)
+	{
+		if (context->breakpoint_flags[cur / 8] & (1 << (cur % 8))) {
+			return 0;
+		}
+		uint8_t *encoded = get_native_pointer(cur, (void **)context->mem_pointers, &opts->gen);
+		if (!encoded) {
+			return 0;
+		}
+		z80inst inst;
+		uint8_t *next = z80_decode(encoded, &inst);
+		uint32_t reads = 0, writes = 0, inst_cycles = 4 * inst.opcode_bytes;
+		switch (inst.op)
+		{
+		case Z80_NOP:
+			break;
+		case Z80_LD:
+			if ((inst.addr_mode & Z80_DIR) || !z80_idle_reg(inst.reg)) {
+				return 0;
+			}
+			if (inst.addr_mode == Z80_REG && z80_idle_reg(inst.ea_reg)) {
+				reads = 1 << inst.ea_reg;
+			} else if (inst.addr_mode == Z80_IMMED) {
+				inst_cycles += 3;
+			} else if (inst.addr_mode == Z80_IMMED_INDIRECT && z80_idle_readable(opts, inst.immed)) {
+				inst_cycles += 6 + opts->gen.bus_cycles;
+			} else {
+				return 0;
+			}
+			writes = 1 << inst.reg;
+			break;
+		case Z80_AND:
+		case Z80_OR:
+		case Z80_XOR:
+		case Z80_CP:
+			if (inst.reg != Z80_A) {
+				return 0;
+			}
+			if (inst.addr_mode == Z80_REG && z80_idle_reg(inst.ea_reg)) {
+				reads = 1 << inst.ea_reg;
+			} else if (inst.addr_mode == Z80_IMMED) {
+				inst_cycles += 3;
+			} else {
+				return 0;
+			}
+			reads |= 1 << Z80_A;
+			writes = Z80_IDLE_ALL_FLAGS | (inst.op == Z80_CP ? 0 : 1 << Z80_A);
+			break;
+		case Z80_BIT:
+			if (inst.addr_mode != Z80_REG || !z80_idle_reg(inst.ea_reg)) {
+				return 0;
+			}
+			reads = 1 << inst.ea_reg;
+			writes = Z80_IDLE_ALL_FLAGS & ~Z80_IDLE_FLAG(ZF_C);
+			break;
+		default:
+			return 0;
+		}
+		read_first |= reads & ~written;
+		written |= writes;
+		*body_cycles += inst_cycles;
+		*r_inc += inst.opcode_bytes > 1 ? 2 : 1;
+		cur += next - encoded;
+	}
+	if (cur != address || (read_first & written)) {
+		return 0;
+	}
+	//remember the branch so that a write to the loop body retranslates it, see z80_invalidate_idle_branches
+	context->idle_branch_flags[address / 8] |= 1 << (address % 8);
+	return 1;
+}
+
+//Divides the cycles remaining, minus one, by period leaving the quotient in EAX and the remainder
+//in EDX. Skipping that many iterations leaves at least one cycle so the instruction that ends up
+//crossing the limit is still the one that gets interrupted. RAX and RDX are saved on the stack
+static void z80_idle_divide(z80_options *opts, uint32_t period)
+{
+	code_info *code = &opts->gen.code;
+	push_r(code, RAX);
+	push_r(code, RDX);
+	mov_rr(code, opts->gen.cycles, RAX, SZ_D);
+	sub_ir(code, 1, RAX, SZ_D);
+	xor_rr(code, RDX, RDX, SZ_D);
+	mov_ir(code, period, opts->gen.scratch1, SZ_D);
+	div_r(code, opts->gen.scratch1, SZ_D);
+}
+
+//Emitted on the taken path of the branch closing an idle loop. The first time the branch is taken
+//only arms the skip, the next time a full iteration has run from the top without any chance for its
+//inputs to change, so all the iterations that fit before the next interrupt or sync are skipped at once
+static void z80_idle_loop_skip(z80_options *opts, uint32_t period, uint8_t r_inc)
+{
+	code_info *code = &opts->gen.code;
+	period *= opts->gen.clock_divider;
+	cmp_irdisp(code, 0, opts->gen.context_reg, offsetof(z80_context, idle_loop), SZ_B);
+	code_ptr armed = code->cur + 1;
+	jcc(code, CC_NZ, armed);
+	mov_irdisp(code, 1, opts->gen.context_reg, offsetof(z80_context, idle_loop), SZ_B);
+	code_ptr arm_done = code->cur + 1;
+	jmp(code, arm_done);
+	*armed = code->cur - (armed + 1);
+	cmp_ir(code, period, opts->gen.cycles, SZ_D);
+	code_ptr too_close = code->cur + 1;
+	jcc(code, CC_LE, too_close);
+	z80_idle_divide(opts, period);
+	mov_rr(code, RDX, opts->gen.cycles, SZ_D);
+	add_ir(code, 1, opts->gen.cycles, SZ_D);
+	imul_irr(code, r_inc, RAX, RAX, SZ_D);
+	mov_rr(code, RAX, opts->gen.scratch1, SZ_D);
+	pop_r(code, RDX);
+	pop_r(code, RAX);
+	add_rr(code, opts->gen.scratch1, opts->regs[Z80_R], SZ_B);
+	*arm_done = code->cur - (arm_done + 1);
+	*too_close = code->cur - (too_close + 1);
+}
+
+//Fused form of djnz $, runs as many iterations of the delay loop as fit before the next interrupt or
+//sync in one go. Emitted on the taken path after B has been decremented
+static void z80_djnz_self_skip(z80_options *opts)
+{
+	code_info *code = &opts->gen.code;
+	uint32_t period = 13 * opts->gen.clock_divider;
+	cmp_ir(code, period, opts->gen.cycles, SZ_D);
+	code_ptr too_close = code->cur + 1;
+	jcc(code, CC_LE, too_close);
+	z80_idle_divide(opts, period);
+	//the iteration that takes B to zero falls through so it can't be skipped
+	zreg_to_native(opts, Z80_B, RDX);
+	movzx_rr(code, RDX, RDX, SZ_B, SZ_D);
+	sub_ir(code, 1, RDX, SZ_D);
+	cmp_rr(code, RDX, RAX, SZ_D);
+	code_ptr in_range = code->cur + 1;
+	jcc(code, CC_BE, in_range);
+	mov_rr(code, RDX, RAX, SZ_D);
+	*in_range = code->cur - (in_range + 1);
+	if (opts->regs[Z80_B] >= 0) {
+		sub_rr(code, RAX, opts->regs[Z80_B], SZ_B);
+	} else {
+		sub_rrdisp(code, RAX, opts->gen.context_reg, zr_off(Z80_B), SZ_B);
+	}
+	mov_rr(code, RAX, opts->gen.scratch1, SZ_D);
+	imul_irr(code, period, RAX, RAX, SZ_D);
+	sub_rr(code, RAX, opts->gen.cycles, SZ_D);
+	pop_r(code, RDX);
+	pop_r(code, RAX);
+	add_rr(code, opts->gen.scratch1, opts->regs[Z80_R], SZ_B);
+	*too_close = code->cur - (too_close + 1);
+}
+
 void translate_z80inst(z80inst * inst, z80_context * context, uint16_t address, uint8_t interp)
 {
 	uint32_t num_cycles;
@@ -336,6 +519,7 @@ void translate_z80inst(z80inst * inst, z80_context * context, uint16_t address,
 		if (context->breakpoint_flags[address / 8] & (1 << (address % 8))) {
 			zbreakpoint_patch(context, address, start);
 		}
+		profile_inst(&opts->gen, address);
 		num_cycles = 4 * inst->opcode_bytes;
 		add_ir(code, inst->opcode_bytes > 1 ? 2 : 1, opts->regs[Z80_R], SZ_B);
 #ifdef Z80_LOG_ADDRESS
@@ -1447,6 +1631,10 @@ void translate_z80inst(z80inst * inst, z80_context * context, uint16_t address,
 		mov_irdisp(code, 1, opts->gen.context_reg, offsetof(z80_context, iff2), SZ_B);
 		//interrupt enable has a one-instruction latency, minimum instruction duration is 4 cycles
 		add_irdisp(code, 4*opts->gen.clock_divider, opts->gen.context_reg, offsetof(z80_context, int_enable_cycle), SZ_D);
+		if (!interp) {
+			//do_sync resumes at the next instruction, record its address so the core knows where it stopped
+			mov_irdisp(code, address + 1, opts->gen.context_reg, offsetof(z80_context, pc), SZ_W);
+		}
 		call(code, opts->do_sync);
 		break;
 	case Z80_IM:
@@ -2062,6 +2250,11 @@ void translate_z80inst(z80inst * inst, z80_context * context, uint16_t address,
 		}
 		cycles(&opts->gen, num_cycles);
 		if (inst->addr_mode != Z80_REG_INDIRECT) {
+			uint32_t body_cycles;
+			uint8_t r_inc;
+			if (!interp && z80_is_idle_loop(context, address, inst->immed, &body_cycles, &r_inc)) {
+				z80_idle_loop_skip(opts, body_cycles + num_cycles, r_inc + 1);
+			}
 			code_ptr call_dst = z80_get_native_address(context, inst->immed);
 			if (!call_dst) {
 				opts->gen.deferred = defer_address(opts->gen.deferred, inst->immed, code->cur + 1);
@@ -2109,6 +2302,12 @@ void translate_z80inst(z80inst * inst, z80_context * context, uint16_t address,
 		uint8_t *no_jump_off = code->cur+1;
 		jcc(code, cond, code->cur+2);
 		uint16_t dest_addr = inst->immed;
+		uint32_t body_cycles;
+		uint8_t r_inc;
+		uint8_t idle = !interp && z80_is_idle_loop(context, address, dest_addr, &body_cycles, &r_inc);
+		if (idle) {
+			z80_idle_loop_skip(opts, body_cycles + num_cycles + 6, r_inc + 1);
+		}
 		code_ptr call_dst = z80_get_native_address(context, dest_addr);
 			if (!call_dst) {
 			opts->gen.deferred = defer_address(opts->gen.deferred, dest_addr, code->cur + 1);
@@ -2117,11 +2316,20 @@ void translate_z80inst(z80inst * inst, z80_context * context, uint16_t address,
 			}
 		jmp(code, call_dst);
 		*no_jump_off = code->cur - (no_jump_off+1);
+		if (idle) {
+			//falling out of the loop disarms the skip
+			mov_irdisp(code, 0, opts->gen.context_reg, offsetof(z80_context, idle_loop), SZ_B);
+		}
 		break;
 	}
 	case Z80_JR: {
 		cycles(&opts->gen, num_cycles + 8);//T States: 4,3,5
 		uint16_t dest_addr = address + inst->immed + 2;
+		uint32_t body_cycles;
+		uint8_t r_inc;
+		if (!interp && z80_is_idle_loop(context, address, dest_addr, &body_cycles, &r_inc)) {
+			z80_idle_loop_skip(opts, body_cycles + num_cycles + 8, r_inc + 1);
+		}
 		code_ptr call_dst = z80_get_native_address(context, dest_addr);
 			if (!call_dst) {
 			opts->gen.deferred = defer_address(opts->gen.deferred, dest_addr, code->cur + 1);
@@ -2151,6 +2359,12 @@ void translate_z80inst(z80inst * inst, z80_context * context, uint16_t address,
 		jcc(code, cond, code->cur+2);
 		cycles(&opts->gen, 5);//T States: 5
 		uint16_t dest_addr = address + inst->immed + 2;
+		uint32_t body_cycles;
+		uint8_t r_inc;
+		uint8_t idle = !interp && z80_is_idle_loop(context, address, dest_addr, &body_cycles, &r_inc);
+		if (idle) {
+			z80_idle_loop_skip(opts, body_cycles + num_cycles + 8, r_inc + 1);
+		}
 		code_ptr call_dst = z80_get_native_address(context, dest_addr);
 			if (!call_dst) {
 			opts->gen.deferred = defer_address(opts->gen.deferred, dest_addr, code->cur + 1);
@@ -2159,6 +2373,10 @@ void translate_z80inst(z80inst * inst, z80_context * context, uint16_t address,
 			}
 		jmp(code, call_dst);
 		*no_jump_off = code->cur - (no_jump_off+1);
+		if (idle) {
+			//falling out of the loop disarms the skip
+			mov_irdisp(code, 0, opts->gen.context_reg, offsetof(z80_context, idle_loop), SZ_B);
+		}
 		break;
 	}
 	case Z80_DJNZ: {
@@ -2172,6 +2390,9 @@ void translate_z80inst(z80inst * inst, z80_context * context, uint16_t address,
 		jcc(code, CC_Z, code->cur+2);
 		cycles(&opts->gen, 5);//T States: 5
 		uint16_t dest_addr = address + inst->immed + 2;
+		if (!interp && dest_addr == address) {
+			z80_djnz_self_skip(opts);
+		}
 		code_ptr call_dst = z80_get_native_address(context, dest_addr);
 			if (!call_dst) {
 			opts->gen.deferred = defer_address(opts->gen.deferred, dest_addr, code->cur + 1);
@@ -3000,8 +3221,28 @@ uint32_t z80_get_instruction_start(z80_context *context, uint32_t address)
 //Technically unbounded due to redundant prefixes, but this is the max useful size
 #define Z80_MAX_INST_SIZE 4
 
+//The skip emitted for an idle loop is only valid for the body it was translated with,
+//so any branch closing a loop that overlaps the modified range needs to be retranslated too
+static void z80_invalidate_idle_branches(z80_context *context, uint32_t start, uint32_t end)
+{
+	z80_options *opts = context->options;
+	for (uint32_t address = start; address < end + Z80_IDLE_MAX_BYTES && address < 0x10000; address++)
+	{
+		if (context->idle_branch_flags[address / 8] & (1 << (address % 8))) {
+			context->idle_branch_flags[address / 8] &= ~(1 << (address % 8));
+			code_ptr dst = z80_get_native_address(context, address);
+			if (dst) {
+				code_info code = {dst, dst+32, 0};
+				mov_ir(&code, address, opts->gen.scratch1, SZ_D);
+				call(&code, opts->retrans_stub);
+			}
+		}
+	}
+}
+
 z80_context * z80_handle_code_write(uint32_t address, z80_context * context)
 {
+	z80_invalidate_idle_branches(context, address, address + 1);
 	uint32_t inst_start = z80_get_instruction_start(context, address);
 	while (inst_start != INVALID_INSTRUCTION_START && (address - inst_start) < Z80_MAX_INST_SIZE) {
 		code_ptr dst = z80_get_native_address(context, inst_start);
@@ -3029,6 +3270,7 @@ void z80_invalidate_code_range(z80_context *context, uint32_t start, uint32_t en
 		//calculate the lowest alias for this address
 		end = mem_chunk->start + ((end - mem_chunk->start) & mem_chunk->mask);
 	}
+	z80_invalidate_idle_branches(context, start, end);
 	uint32_t start_chunk = start / NATIVE_CHUNK_SIZE, end_chunk = end / NATIVE_CHUNK_SIZE;
 	for (uint32_t chunk = start_chunk; chunk <= end_chunk; chunk++)
 	{
@@ -3042,6 +3284,7 @@ void z80_invalidate_code_range(z80_context *context, uint32_t start, uint32_t en
 					code.cur = native_code_map[chunk].base + native_code_map[chunk].offsets[offset];
 					code.last = code.cur + 32;
 					code.stack_off = 0;
+					code.pool = NULL;
 					mov_ir(&code, chunk * NATIVE_CHUNK_SIZE + offset, opts->gen.scratch1, SZ_D);
 					call(&code, opts->retrans_stub);
 				}
@@ -3082,6 +3325,9 @@ void * z80_retranslate_inst(uint32_t address, z80_context * context, uint8_t * o
 	uint8_t *after, *inst = get_native_pointer(address, (void **)context->mem_pointers, &opts->gen);
 	z80inst instbuf;
 	dprintf("Retranslating code at Z80 address %X, native address %p\n", address, orig_start);
+	if (opts->gen.profile) {
+		jit_profile_retranslated(opts->gen.profile, address);
+	}
 	after = z80_decode(inst, &instbuf);
 	#ifdef DO_DEBUG_PRINT
 	z80_disasm(&instbuf, disbuf, address);
@@ -3193,6 +3439,9 @@ void translate_z80_stream(z80_context * context, uint32_t address)
 void init_z80_opts(z80_options * options, memmap_chunk const * chunks, uint32_t num_chunks, memmap_chunk const * io_chunks, uint32_t num_io_chunks, uint32_t clock_divider, uint32_t io_address_mask)
 {
 	memset(options, 0, sizeof(*options));
+#ifdef JIT_PROFILE
+	options->gen.profile = jit_profile_new("z80", &options->gen.code);
+#endif
 
 	options->gen.memmap = chunks;
 	options->gen.memmap_chunks = num_chunks;
@@ -3343,11 +3592,14 @@ void init_z80_opts(z80_options * options, memmap_chunk const * chunks, uint32_t
 	uint32_t call_adjust_size = code->cur - options->gen.handle_cycle_limit;
 	code->cur = options->gen.handle_cycle_limit;
 	
+	//anything can happen once we return to C so an idle loop needs to run a full iteration again
+	mov_irdisp(code, 0, options->gen.context_reg, offsetof(z80_context, idle_loop), SZ_B);
 	neg_r(code, options->gen.cycles, SZ_D);
 	add_rdispr(code, options->gen.context_reg, offsetof(z80_context, target_cycle), options->gen.cycles, SZ_D);
 	cmp_rdispr(code, options->gen.context_reg, offsetof(z80_context, sync_cycle), options->gen.cycles, SZ_D);
 	code_ptr no_sync = code->cur+1;
 	jcc(code, CC_B, no_sync);
+	profile_event(&options->gen, JIT_PROF_CYCLE_LIMIT, 0, 0);
 	neg_r(code, options->gen.cycles, SZ_D);
 	add_rdispr(code, options->gen.context_reg, offsetof(z80_context, target_cycle), options->gen.cycles, SZ_D);
 	mov_irdisp(code, 0, options->gen.context_reg, offsetof(z80_context, pc), SZ_W);
@@ -3409,6 +3661,8 @@ void init_z80_opts(z80_options * options, memmap_chunk const * chunks, uint32_t
 	code->stack_off = tmp_stack_off;
 
 	options->gen.handle_cycle_limit_int = code->cur;
+	profile_event(&options->gen, JIT_PROF_CYCLE_LIMIT_INT, 0, 0);
+	mov_irdisp(code, 0, options->gen.context_reg, offsetof(z80_context, idle_loop), SZ_B);
 	neg_r(code, options->gen.cycles, SZ_D);
 	add_rdispr(code, options->gen.context_reg, offsetof(z80_context, target_cycle), options->gen.cycles, SZ_D);
 	cmp_rdispr(code, options->gen.context_reg, offsetof(z80_context, int_cycle), options->gen.cycles, SZ_D);
@@ -3618,6 +3872,8 @@ void init_z80_opts(z80_options * options, memmap_chunk const * chunks, uint32_t
 	*no_extra = code->cur - (no_extra + 1);
 	jmp_rind(code, options->gen.context_reg);
 	code->stack_off = tmp_stack_off;
+	//everything after this point is translated Z80 code that can be thrown away when the cache fills up
+	init_code_pool(code, 0);
 }
 
 z80_context *init_z80_context(z80_options * options)
@@ -3650,6 +3906,10 @@ void z80_run(z80_context * context, uint32_t target_cycle)
 			//busreq is sampled at the end of an m-cycle
 			//we can approximate that by running for a single m-cycle after a bus request
 			context->sync_cycle = context->busreq ? context->current_cycle + 3*context->options->gen.clock_divider : target_cycle;
+			if (z80_code_flush_pending(context) && !context->extra_pc) {
+				//not in the middle of an instruction so it's safe to throw away translated code
+				z80_flush_code_cache(context);
+			}
 			if (!context->native_pc) {
 				context->native_pc = z80_get_native_address_trans(context, context->pc);
 			}
@@ -3679,6 +3939,44 @@ void z80_run(z80_context * context, uint32_t target_cycle)
 	}
 }
 
+uint8_t z80_code_flush_pending(z80_context *context)
+{
+	code_pool *pool = context->options->gen.code.pool;
+	return pool && pool->flush_pending;
+}
+
+void z80_flush_code_cache(z80_context *context)
+{
+	z80_options *opts = context->options;
+	for (uint32_t address = 0; address < opts->gen.address_mask; address += NATIVE_CHUNK_SIZE)
+	{
+		uint32_t chunk = address / NATIVE_CHUNK_SIZE;
+		if (opts->gen.native_code_map[chunk].base) {
+			free(opts->gen.native_code_map[chunk].offsets);
+			opts->gen.native_code_map[chunk].base = NULL;
+			opts->gen.native_code_map[chunk].offsets = NULL;
+		}
+	}
+	uint32_t ram_inst_slots = ram_size(&opts->gen) / 1024;
+	for (uint32_t i = 0; i < ram_inst_slots; i++)
+	{
+		free(opts->gen.ram_inst_sizes[i]);
+		opts->gen.ram_inst_sizes[i] = NULL;
+	}
+	memset(context->ram_code_flags, 0, ram_size(&opts->gen) / (1 << opts->gen.ram_flags_shift) / 8);
+	memset(context->idle_branch_flags, 0, sizeof(context->idle_branch_flags));
+	remove_deferred_until(&opts->gen.deferred, NULL);
+	memset(context->interp_code, 0, sizeof(context->interp_code));
+	flush_code_pool(&opts->gen.code);
+	//context->pc is valid at an instruction boundary so just retranslate from there
+	context->native_pc = NULL;
+	if (context->bp_stub) {
+		//breakpoints get patched back in by translate_z80_stream as code is retranslated
+		context->bp_stub = NULL;
+		zcreate_stub(context);
+	}
+}
+
 void z80_options_free(z80_options *opts)
 {
 	for (uint32_t address = 0; address < opts->gen.address_mask; address += NATIVE_CHUNK_SIZE)
@@ -3695,6 +3993,10 @@ void z80_options_free(z80_options *opts)
 		free(opts->gen.ram_inst_sizes[i]);
 	}
 	free(opts->gen.ram_inst_sizes);
+	if (opts->gen.profile) {
+		jit_profile_free(opts->gen.profile);
+	}
+	free_code_pool(&opts->gen.code);
 	free(opts);
 }
 
@@ -3827,6 +4129,8 @@ void zcreate_stub(z80_context * context)
 	push_r(code, opts->gen.scratch1);
 	call_args_abi(code, context->bp_handler, 2, opts->gen.context_reg, opts->gen.scratch1);
 	mov_rr(code, RAX, opts->gen.context_reg, SZ_PTR);
+	//the debugger may have changed memory or registers
+	mov_irdisp(code, 0, opts->gen.context_reg, offsetof(z80_context, idle_loop), SZ_B);
 		//Restore context
 	call(code, opts->gen.load_context);
 	pop_r(code, opts->gen.scratch1);
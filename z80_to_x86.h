@@ -10,7 +10,7 @@
 #include "serialize.h"
 
 #define ZNUM_MEM_AREAS 4
-#ifdef Z80_LOG_ADDRESS
+#if defined(Z80_LOG_ADDRESS) || defined(JIT_PROFILE)
 #define ZMAX_NATIVE_SIZE 255
 #else
 #define ZMAX_NATIVE_SIZE 160
@@ -79,6 +79,8 @@ struct z80_context {
 	uint32_t          int_pulse_end;
 	uint32_t          nmi_start;
 	uint8_t           breakpoint_flags[(16 * 1024)/sizeof(uint8_t)];
+	//branches that were translated with an idle loop skip, see z80_is_idle_loop
+	uint8_t           idle_branch_flags[0x10000/8];
 	uint8_t *         bp_handler;
 	uint8_t *         bp_stub;
 	uint8_t *         interp_code[256];
@@ -88,12 +90,17 @@ struct z80_context {
 	uint8_t           busack;
 	uint8_t           int_is_nmi;
 	uint8_t           im2_vector;
+	//set by the branch closing an idle loop, cleared whenever the translated code yields
+	uint8_t           idle_loop;
 	uint8_t           ram_code_flags[];
 };
 
 void translate_z80_stream(z80_context * context, uint32_t address);
 void init_z80_opts(z80_options * options, memmap_chunk const * chunks, uint32_t num_chunks, memmap_chunk const * io_chunks, uint32_t num_io_chunks, uint32_t clock_divider, uint32_t io_address_mask);
 void z80_options_free(z80_options *opts);
+uint8_t z80_code_flush_pending(z80_context *context);
+//discards all translated code, only safe to call while the Z80 is stopped at an instruction boundary
+void z80_flush_code_cache(z80_context *context);
 z80_context * init_z80_context(z80_options * options);
 code_ptr z80_get_native_address(z80_context * context, uint32_t address);
 code_ptr z80_get_native_address_trans(z80_context * context, uint32_t address);
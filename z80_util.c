@@ -11,6 +11,21 @@ void z80_read_8(z80_context *context)
 	}
 }
 
+//used by the x86 target to guess which instructions follow the one being translated
+//only memory that can be read without side effects is looked at, page and offset say where
+//translated code can find the opcode again to check it hasn't changed
+uint8_t z80_jit_peek(z80_context *context, uint32_t address, uint32_t *opcode, uint8_t ***page, uint32_t *offset)
+{
+	uint8_t *fast = context->fastread[address >> 10];
+	if (!fast) {
+		return 0;
+	}
+	*page = context->fastread + (address >> 10);
+	*offset = address & 0x3FF;
+	*opcode = fast[*offset];
+	return 1;
+}
+
 void z80_write_8(z80_context *context)
 {
 	context->cycles += 3 * context->opts->gen.clock_divider;
@@ -12,18 +12,20 @@
 #endif
 #include "mem.h"
 #include "vdp.h"
+#include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
-#include <stdarg.h>
+#include <time.h>
 
-void fatal_error(char *format, ...)
+int headless = 1;
+
+void render_errorbox(char *title, char *message)
+{
+}
+
+void render_infobox(char *title, char *message)
 {
-	va_list args;
-	va_start(args, format);
-	vfprintf(stderr, format, args);
-	va_end(args);
-	exit(1);
 }
 
 uint8_t z80_ram[0x2000];
@@ -54,6 +56,27 @@ void z80_next_int_pulse(z80_context * context)
 }
 #endif
 
+#define BENCH_SLICE 1000000
+//runs the program for a fixed number of cycles and reports how long it took
+//the registers printed afterwards can be compared between cores
+void run_bench(z80_context *context, uint32_t cycles)
+{
+	clock_t start = clock();
+	for (uint32_t remaining = cycles; remaining;)
+	{
+		uint32_t slice = remaining < BENCH_SLICE ? remaining : BENCH_SLICE;
+#ifdef NEW_CORE
+		z80_execute(context, context->cycles + slice);
+#else
+		z80_run(context, context->current_cycle + slice);
+#endif
+		z80_adjust_cycles(context, slice);
+		remaining -= slice;
+	}
+	double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	printf("Ran %u cycles in %.3f seconds, %.2f MHz\n\n", cycles, seconds, cycles / seconds / 1000000.0);
+}
+
 int main(int argc, char ** argv)
 {
 	long filesize;
@@ -62,6 +85,7 @@ int main(int argc, char ** argv)
 	z80_context *context;
 	char *fname = NULL;
 	uint8_t retranslate = 0;
+	uint32_t bench_cycles = 0;
 	for (int i = 1; i < argc; i++)
 	{
 		if (argv[i][0] == '-') {
@@ -70,6 +94,14 @@ int main(int argc, char ** argv)
 			case 'r':
 				retranslate = 1;
 				break;
+			case 'b':
+				i++;
+				if (i >= argc) {
+					fputs("-b must be followed by a number of cycles\n", stderr);
+					exit(1);
+				}
+				bench_cycles = strtoul(argv[i], NULL, 0);
+				break;
 			default:
 				fprintf(stderr, "Unrecognized switch -%c\n", argv[i][1]);
 				exit(1);
@@ -79,7 +111,7 @@ int main(int argc, char ** argv)
 		}
 	}
 	if (!fname) {
-		fputs("usage: ztestrun zrom [cartrom]\n", stderr);
+		fputs("usage: ztestrun [-r] [-b cycles] zrom\n", stderr);
 		exit(1);
 	}
 	FILE * f = fopen(fname, "rb");
@@ -99,7 +131,11 @@ int main(int argc, char ** argv)
 	init_z80_opts(&opts, z80_map, 2, port_map, 1, 1, 0xFF);
 	context = init_z80_context(&opts);
 #ifdef NEW_CORE
-	z80_execute(context, 1000);
+	if (bench_cycles) {
+		run_bench(context, bench_cycles);
+	} else {
+		z80_execute(context, 1000);
+	}
 	printf("A: %X\nB: %X\nC: %X\nD: %X\nE: %X\nHL: %X\nIX: %X\nIY: %X\nSP: %X\n\nIM: %d, IFF1: %d, IFF2: %d\n",
 		context->main[7], context->main[0], context->main[1],
 		context->main[2], context->main[3],
@@ -131,7 +167,11 @@ int main(int argc, char ** argv)
 		z80_clear_reset(context, context->current_cycle + 3);
 		z80_adjust_cycles(context, context->current_cycle);
 	}
-	z80_run(context, 1000);
+	if (bench_cycles) {
+		run_bench(context, bench_cycles);
+	} else {
+		z80_run(context, 1000);
+	}
 	printf("A: %X\nB: %X\nC: %X\nD: %X\nE: %X\nHL: %X\nIX: %X\nIY: %X\nSP: %X\n\nIM: %d, IFF1: %d, IFF2: %d\n",
 		context->regs[Z80_A], context->regs[Z80_B], context->regs[Z80_C],
 		context->regs[Z80_D], context->regs[Z80_E],